@@ -48,6 +48,13 @@ typedef NS_ENUM(int, FMDBCheckpointMode) {
     FMDBCheckpointModeTruncate = 3  // SQLITE_CHECKPOINT_TRUNCATE
 };
 
+/** 数据库被其它连接锁定（SQLITE_BUSY）时的等待策略
+ */
+typedef NS_ENUM(NSInteger, FMDBBusyStrategy) {
+    FMDBBusyStrategyRandomSleep = 0,//每次随机挂起 50~100ms（旧的策略）
+    FMDBBusyStrategyExponentialBackoff,//指数退避：从微秒级开始，每次等待时长翻倍，直到上限
+};
+
 /** 对 SQLite 的封装
  *
  * FMDatabase：代表一个单独的SQLite操作实例，数据库通过它增删改查操作；
@@ -445,6 +452,95 @@ typedef NS_ENUM(int, FMDBCheckpointMode) {
  */
 @property (nonatomic) NSTimeInterval maxBusyRetryTimeInterval;
 
+/** 数据库被锁定时的等待策略，默认 FMDBBusyStrategyExponentialBackoff
+ */
+@property (nonatomic) FMDBBusyStrategy busyStrategy;
+
+/** 指数退避第一次等待的时长，默认 0.00005 秒（50 微秒）
+ */
+@property (nonatomic) NSTimeInterval busyRetryInitialInterval;
+
+/** 指数退避单次等待的最大时长，默认 0.02 秒
+ */
+@property (nonatomic) NSTimeInterval busyRetryMaxInterval;
+
+/** 等待期间，同一进程中其它连接提交或回滚事务时是否立即唤醒重试，默认 YES
+ * 唤醒只在指数退避策略下生效
+ */
+@property (nonatomic) BOOL busyWakesOnCommit;
+
+/** 竞争统计：遇到数据库被锁定的次数
+ */
+@property (nonatomic, readonly) NSUInteger busyCount;
+
+/** 竞争统计：因数据库被锁定而等待的总时长（秒）
+ */
+@property (nonatomic, readonly) NSTimeInterval busyWaitTime;
+
+/** 竞争统计：等待超过 maxBusyRetryTimeInterval 而返回 SQLITE_BUSY 的次数
+ */
+@property (nonatomic, readonly) NSUInteger busyTimeoutCount;
+
+/** 重置竞争统计
+ */
+- (void)resetBusyStatistics;
+
+/** 设置进度回调：执行 SQL 语句期间，每执行 instructions 条虚拟机指令调用一次 block
+ * block 返回 YES 时中断当前语句，该语句返回 SQLITE_INTERRUPT；
+ * 数据库关闭后重新打开时，会自动重新设置该回调
+ * @param block 为 nil 时移除进度回调
+ * @see [sqlite3_progress_handler()](http://sqlite.org/c3ref/progress_handler.html)
+ */
+- (void)setProgressHandler:(BOOL (^ _Nullable)(void))block instructions:(int)instructions;
+
+/** 设置提交回调：每次提交事务（包括自动提交模式下单条语句的隐式提交）之前调用 block
+ * block 返回 YES 时，本次提交转为回滚，该语句返回 SQLITE_CONSTRAINT_COMMITHOOK；
+ * 数据库关闭后重新打开时，会自动重新设置该回调
+ * @param block 为 nil 时移除提交回调
+ * @see [sqlite3_commit_hook()](http://sqlite.org/c3ref/commit_hook.html)
+ */
+- (void)setCommitHook:(BOOL (^ _Nullable)(void))block;
+
+/** 设置 WAL 回调：WAL 模式下每次提交事务之后调用 block
+ * @param block 参数 databaseName 为提交的数据库名称，pageCount 为提交后 WAL 文件中的总帧数；为 nil 时移除回调
+ * @note 设置该回调会覆盖 SQLite 的自动检查点（wal_autocheckpoint），检查点需要由开发者自行执行；
+ *       数据库关闭后重新打开时，会自动重新设置该回调
+ * @see [sqlite3_wal_hook()](http://sqlite.org/c3ref/wal_hook.html)
+ */
+- (void)setWalHook:(void (^ _Nullable)(NSString *databaseName, int pageCount))block;
+
+/** 设置行变更回调：INSERT、UPDATE、DELETE 每修改一行调用一次（包括触发器修改的行），此时事务还未提交
+ * 参数 operation 为 SQLITE_INSERT、SQLITE_UPDATE 或 SQLITE_DELETE，rowid 为被修改的行；
+ * WITHOUT ROWID 的表、REPLACE 因约束冲突删除旧行、DELETE 不带条件清空整张表（truncate 优化）时不调用；
+ * block 中不能使用该连接；数据库关闭后重新打开时，会自动重新设置该回调
+ * @param block 为 nil 时移除回调
+ * @see [sqlite3_update_hook()](http://sqlite.org/c3ref/update_hook.html)
+ */
+- (void)setUpdateHook:(void (^ _Nullable)(int operation, NSString *databaseName, NSString *tableName, int64_t rowid))block;
+
+/** 设置回滚回调：事务回滚时调用，包括提交回调将提交转为回滚的情况；自动回滚（例如关闭连接）时不调用
+ * 数据库关闭后重新打开时，会自动重新设置该回调
+ * @param block 为 nil 时移除回调
+ * @see [sqlite3_rollback_hook()](http://sqlite.org/c3ref/commit_hook.html)
+ */
+- (void)setRollbackHook:(void (^ _Nullable)(void))block;
+
+/** 设置授权回调：编译语句时，每访问一个表、列（SQLITE_READ、SQLITE_UPDATE 等），执行一种操作调用一次
+ * 参数依次为操作类型与两个参数（SQLITE_READ 时为表名、列名）、数据库名称（未限定数据库名称的表可能为 nil）、触发器或视图的名称；
+ * 返回 SQLITE_OK 允许，SQLITE_IGNORE 忽略（读取时以 NULL 代替），SQLITE_DENY 使编译失败；
+ * 设置、移除授权回调会使该连接已编译的语句失效，下次执行时重新编译；数据库关闭后重新打开时，会自动重新设置该回调
+ * @param block 为 nil 时移除回调
+ * @see [sqlite3_set_authorizer()](http://sqlite.org/c3ref/set_authorizer.html)
+ */
+- (void)setAuthorizer:(int (^ _Nullable)(int actionCode, NSString * _Nullable arg1, NSString * _Nullable arg2, NSString * _Nullable databaseName, NSString * _Nullable triggerOrView))block;
+
+/** 设置语句观察者：所有 FMDatabase 实例每次通过 executeQuery、executeUpdate 执行 SQL 时，以未绑定参数的 SQL 文本调用 block
+ * 在执行 SQL 的线程中同步调用，block 应尽快返回；没有设置时只有一次原子读取的开销
+ * 用于收集应用实际执行的语句，例如索引建议（DatabaseIndexAdvisor）
+ * @param block 为 nil 时移除观察者
+ */
++ (void)setStatementObserver:(void (^ _Nullable)(NSString *sql))block;
+
 
 ///------------------
 /// @name 事务中的 SavePoint
@@ -1,6 +1,7 @@
 #import "FMDatabase.h"
 #import <unistd.h>
 #import <objc/runtime.h>
+#import <stdatomic.h>
 
 #if FMDB_SQLITE_STANDALONE
 #import <sqlite3/sqlite3.h>
@@ -14,11 +15,22 @@
     void*               _db;//打开的SQLite数据库
     BOOL                _isExecutingStatement;//是否正在执行 Sql 语句
     NSTimeInterval      _startBusyRetryTime;
+    NSUInteger          _busyCount;//遇到数据库被锁定的次数
+    NSTimeInterval      _busyWaitTime;//等待的总时长
+    NSUInteger          _busyTimeoutCount;//等待超时的次数
     
     NSMutableSet        *_openResultSets;
     NSMutableSet        *_openFunctions;
     
     NSDateFormatter     *_dateFormat;
+    
+    BOOL                (^_progressBlock)(void);//进度回调
+    int                 _progressInstructions;//每执行多少条虚拟机指令调用一次进度回调
+    BOOL                (^_commitHookBlock)(void);//提交回调
+    void                (^_walHookBlock)(NSString *databaseName, int pageCount);//WAL 回调
+    void                (^_updateHookBlock)(int operation, NSString *databaseName, NSString *tableName, int64_t rowid);//行变更回调
+    void                (^_rollbackHookBlock)(void);//回滚回调
+    int                 (^_authorizerBlock)(int actionCode, NSString *arg1, NSString *arg2, NSString *databaseName, NSString *triggerOrView);//授权回调
 }
 
 NS_ASSUME_NONNULL_BEGIN
@@ -67,6 +79,10 @@ NS_ASSUME_NONNULL_END
         _logsErrors                 = YES;
         _crashOnErrors              = NO;
         _maxBusyRetryTimeInterval   = 2;//默认为 2S
+        _busyStrategy               = FMDBBusyStrategyExponentialBackoff;
+        _busyRetryInitialInterval   = 0.00005;//50 微秒
+        _busyRetryMaxInterval       = 0.02;
+        _busyWakesOnCommit          = YES;
         _isOpen                     = NO;//默认数据库关闭
     }
     return self;
@@ -86,6 +102,12 @@ NS_ASSUME_NONNULL_END
     FMDBRelease(_dateFormat);
     FMDBRelease(_databasePath);
     FMDBRelease(_openFunctions);
+    FMDBRelease(_progressBlock);
+    FMDBRelease(_commitHookBlock);
+    FMDBRelease(_walHookBlock);
+    FMDBRelease(_updateHookBlock);
+    FMDBRelease(_rollbackHookBlock);
+    FMDBRelease(_authorizerBlock);
     
 #if ! __has_feature(objc_arc)
     [super dealloc];
@@ -142,6 +164,13 @@ NS_ASSUME_NONNULL_END
     return [_databasePath fileSystemRepresentation];
 }
 
+static int FMDBDatabaseProgressHandler(void *f);
+static int FMDBDatabaseCommitHook(void *f);
+static int FMDBDatabaseWalHook(void *f, sqlite3 *db, const char *databaseName, int pageCount);
+static void FMDBDatabaseUpdateHook(void *f, int operation, const char *databaseName, const char *tableName, sqlite3_int64 rowid);
+static void FMDBDatabaseRollbackHook(void *f);
+static int FMDBDatabaseAuthorizer(void *f, int actionCode, const char *arg1, const char *arg2, const char *databaseName, const char *triggerOrView);
+
 #pragma mark 打开、关闭 数据库
 
 /** 根据指定路径打开一个 SQLite 数据库，返回一个用于其他 SQLite 程序的数据库连接对象
@@ -172,6 +201,26 @@ int sqlite3_open(const char *filename,sqlite3 **ppDb);
     if (_maxBusyRetryTimeInterval > 0.0) {
         [self setMaxBusyRetryTimeInterval:_maxBusyRetryTimeInterval];
     }
+    if (_progressBlock) {
+        sqlite3_progress_handler(_db, _progressInstructions, &FMDBDatabaseProgressHandler, (__bridge void *)(self));
+    }
+    if (_commitHookBlock) {
+        sqlite3_commit_hook(_db, &FMDBDatabaseCommitHook, (__bridge void *)(self));
+    }
+#if SQLITE_VERSION_NUMBER >= 3007000
+    if (_walHookBlock) {
+        sqlite3_wal_hook(_db, &FMDBDatabaseWalHook, (__bridge void *)(self));
+    }
+#endif
+    if (_updateHookBlock) {
+        sqlite3_update_hook(_db, &FMDBDatabaseUpdateHook, (__bridge void *)(self));
+    }
+    if (_rollbackHookBlock) {
+        sqlite3_rollback_hook(_db, &FMDBDatabaseRollbackHook, (__bridge void *)(self));
+    }
+    if (_authorizerBlock) {
+        sqlite3_set_authorizer(_db, &FMDBDatabaseAuthorizer, (__bridge void *)(self));
+    }
     _isOpen = YES;
     return YES;
 }
@@ -197,6 +246,26 @@ int sqlite3_open(const char *filename,sqlite3 **ppDb);
     if (_maxBusyRetryTimeInterval > 0.0) {
         [self setMaxBusyRetryTimeInterval:_maxBusyRetryTimeInterval];
     }
+    if (_progressBlock) {
+        sqlite3_progress_handler(_db, _progressInstructions, &FMDBDatabaseProgressHandler, (__bridge void *)(self));
+    }
+    if (_commitHookBlock) {
+        sqlite3_commit_hook(_db, &FMDBDatabaseCommitHook, (__bridge void *)(self));
+    }
+#if SQLITE_VERSION_NUMBER >= 3007000
+    if (_walHookBlock) {
+        sqlite3_wal_hook(_db, &FMDBDatabaseWalHook, (__bridge void *)(self));
+    }
+#endif
+    if (_updateHookBlock) {
+        sqlite3_update_hook(_db, &FMDBDatabaseUpdateHook, (__bridge void *)(self));
+    }
+    if (_rollbackHookBlock) {
+        sqlite3_rollback_hook(_db, &FMDBDatabaseRollbackHook, (__bridge void *)(self));
+    }
+    if (_authorizerBlock) {
+        sqlite3_set_authorizer(_db, &FMDBDatabaseAuthorizer, (__bridge void *)(self));
+    }
     _isOpen = YES;
     return YES;
 #else
@@ -251,25 +320,54 @@ int sqlite3_open(const char *filename,sqlite3 **ppDb);
 //       C function causes problems; the rest don't. Anyway, ignoring the .m
 //       files with appledoc will prevent this problem from occurring.
 
-/** 该函数就是简单调用 sqlite3_sleep() 来挂起线程
+/** 进程内所有连接共用的条件变量：有连接提交或回滚事务时广播，唤醒正在等待锁的连接
+ */
+static NSCondition *FMDBBusyCondition(void) {
+    static NSCondition *condition = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        condition = [[NSCondition alloc] init];
+    });
+    return condition;
+}
+
+/** 正在条件变量上等待的连接数量；为 0 时提交事务无需广播
+ */
+static atomic_int FMDBBusyWaiterCount = 0;
+
+/** 事务结束（锁可能已释放）时调用，唤醒正在等待锁的连接
+ */
+static void FMDBBusyConditionBroadcast(void) {
+    if (atomic_load(&FMDBBusyWaiterCount) > 0) {
+        NSCondition *condition = FMDBBusyCondition();
+        [condition lock];
+        [condition broadcast];
+        [condition unlock];
+    }
+}
+
+/** 该函数在数据库被其它连接锁定时调用，挂起当前线程一段时间后重试
  * @param count 表示这次锁事件，该回调函数被调用的次数。
  * @return 如果返回０时，将不再尝试再次访问数据库而返回SQLITE_BUSY或者SQLITE_IOERR_BLOCKED。
  *         如果回调函数返回非０,　将会不断尝试操作数据库。
  */
 static int FMDBDatabaseBusyHandler(void *f, int count) {
     FMDatabase *self = (__bridge FMDatabase*)f;
-    if (count == 0) {// count为0，表示第一次执行回调函数
+    if (count == 0) {// count为0，表示第一次执行回调函数，立即重试
         self->_startBusyRetryTime = [NSDate timeIntervalSinceReferenceDate];//以2001/01/01 GMT为基准时间，返回实例保存的时间与2001/01/01 GMT的时间间隔
+        self->_busyCount++;
         return 1;
     }
     
-    // 使用delta变量控制执行回调函数的次数，每次挂起50~100ms
-    // 所以maxBusyRetryTimeInterval的作用就在这体现出来了
-    // 当挂起的时长大于maxBusyRetryTimeInterval，就返回0，并停止执行该回调函数了
-    NSTimeInterval delta = [NSDate timeIntervalSinceReferenceDate] - (self->_startBusyRetryTime);
+    // 当等待的时长大于maxBusyRetryTimeInterval，就返回0，并停止执行该回调函数了
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    NSTimeInterval delta = now - (self->_startBusyRetryTime);
+    if (delta >= [self maxBusyRetryTimeInterval]) {
+        self->_busyTimeoutCount++;
+        return 0;
+    }
     
-    if (delta < [self maxBusyRetryTimeInterval]) {
-        
+    if (self->_busyStrategy == FMDBBusyStrategyRandomSleep) {
         // 使用sqlite3_sleep每次当前线程挂起50~100ms
         int requestedSleepInMillseconds = (int) arc4random_uniform(50) + 50;
         int actualSleepInMilliseconds = sqlite3_sleep(requestedSleepInMillseconds);
@@ -278,25 +376,28 @@ static int FMDBDatabaseBusyHandler(void *f, int count) {
         if (actualSleepInMilliseconds != requestedSleepInMillseconds) {
             NSLog(@"WARNING: Requested sleep of %i milliseconds, but SQLite returned %i. Maybe SQLite wasn't built with HAVE_USLEEP=1?", requestedSleepInMillseconds, actualSleepInMilliseconds);
         }
-        return 1;
+    }else {
+        // 指数退避：第 count 次等待 initial * 2^(count-1)，不超过单次上限，也不超过剩余的等待时长
+        NSTimeInterval interval = self->_busyRetryInitialInterval * (double)(1ULL << MIN(count - 1, 30));
+        interval = MIN(interval, self->_busyRetryMaxInterval);
+        interval = MIN(interval, [self maxBusyRetryTimeInterval] - delta);
+        
+        if (self->_busyWakesOnCommit) {
+            // 等待期间其它连接提交或回滚事务时被提前唤醒
+            NSCondition *condition = FMDBBusyCondition();
+            [condition lock];
+            atomic_fetch_add(&FMDBBusyWaiterCount, 1);
+            [condition waitUntilDate:[NSDate dateWithTimeIntervalSinceReferenceDate:now + interval]];
+            atomic_fetch_sub(&FMDBBusyWaiterCount, 1);
+            [condition unlock];
+        }else {
+            usleep((useconds_t)(interval * USEC_PER_SEC));
+        }
     }
-    
-    return 0;
+    self->_busyWaitTime += [NSDate timeIntervalSinceReferenceDate] - now;
+    return 1;
 }
 
-/** 最大繁忙重试时间间隔
- *
- * 程序运行过程中，如果有其它线程在读写数据库，那么sqlite3_busy_handler() 会不断调用回调函数，直到其他进程或者线程释放锁。
- * 获得锁之后，不会再调用回调函数，从而向下执行，进行数据库操作。
- * 该函数是在获取不到锁的时候，以执行回调函数的次数来进行延迟，等待其他进程或者线程操作数据库结束，从而获得锁操作数据库。
- *
- *
- * SQLITE_API int sqlite3_busy_handler(sqlite3*,int(*)(void*,int),void*);
- * param1 告知哪个数据库需要设置 busy_handler
- * param2 回调函数，该函数的参数是sqlite3_busy_handler()第三个参数
- * param3 int参数代表锁事件，该函数被调用次数，如果返回为0，不会再次访问数据库，返回非0，将不断尝试访问数据库。
- * 当获取不到锁时，会执行回调函数的次数以此来延时，等待其他线程等操作完数据库，这样获得操作数据库。
- */
 - (void)setMaxBusyRetryTimeInterval:(NSTimeInterval)timeout {
     _maxBusyRetryTimeInterval = timeout;
     if (!_db) {
@@ -315,6 +416,12 @@ static int FMDBDatabaseBusyHandler(void *f, int count) {
     return _maxBusyRetryTimeInterval;
 }
 
+- (void)resetBusyStatistics {
+    _busyCount = 0;
+    _busyWaitTime = 0;
+    _busyTimeoutCount = 0;
+}
+
 
 // we no longer make busyRetryTimeout public
 // but for folks who don't bother noticing that the interface to FMDatabase changed,
@@ -331,6 +438,181 @@ static int FMDBDatabaseBusyHandler(void *f, int count) {
     NSLog(@"FMDB: setBusyRetryTimeout does nothing, please use setMaxBusyRetryTimeInterval:");
 }
 
+#pragma mark 语句观察者
+
+static atomic_bool FMDBHasStatementObserver = false;
+static void (^FMDBStatementObserverBlock)(NSString *sql) = nil;//只在 @synchronized ([FMDatabase class]) 中访问
+
++ (void)setStatementObserver:(void (^)(NSString *sql))block {
+    @synchronized ([FMDatabase class]) {
+        FMDBAutorelease(FMDBStatementObserverBlock);
+        FMDBStatementObserverBlock = [block copy];
+        atomic_store(&FMDBHasStatementObserver, block != nil);
+    }
+}
+
+static void FMDBNotifyStatementObserver(NSString *sql) {
+    if (!sql || !atomic_load(&FMDBHasStatementObserver)) {
+        return;
+    }
+    void (^block)(NSString *sql) = nil;
+    @synchronized ([FMDatabase class]) {
+        block = FMDBStatementObserverBlock;
+    }
+    if (block) {
+        block(sql);
+    }
+}
+
+#pragma mark 进度回调、提交回调、WAL 回调、行变更回调、回滚回调、授权回调
+
+/** 进度回调：返回非 0 时，SQLite 中断正在执行的语句
+ */
+static int FMDBDatabaseProgressHandler(void *f) {
+    FMDatabase *self = (__bridge FMDatabase*)f;
+    BOOL (^block)(void) = self->_progressBlock;
+    return (block && block()) ? 1 : 0;
+}
+
+- (void)setProgressHandler:(BOOL (^)(void))block instructions:(int)instructions {
+    FMDBAutorelease(_progressBlock);
+    _progressBlock = [block copy];
+    _progressInstructions = MAX(instructions, 1);
+    if (!_db) {
+        return;
+    }
+    if (_progressBlock) {
+        sqlite3_progress_handler(_db, _progressInstructions, &FMDBDatabaseProgressHandler, (__bridge void *)(self));
+    }else {
+        sqlite3_progress_handler(_db, 0, nil, nil);
+    }
+}
+
+/** 提交回调：返回非 0 时，SQLite 将本次提交转为回滚
+ */
+static int FMDBDatabaseCommitHook(void *f) {
+    FMDatabase *self = (__bridge FMDatabase*)f;
+    BOOL (^block)(void) = self->_commitHookBlock;
+    return (block && block()) ? 1 : 0;
+}
+
+- (void)setCommitHook:(BOOL (^)(void))block {
+    FMDBAutorelease(_commitHookBlock);
+    _commitHookBlock = [block copy];
+    if (!_db) {
+        return;
+    }
+    if (_commitHookBlock) {
+        sqlite3_commit_hook(_db, &FMDBDatabaseCommitHook, (__bridge void *)(self));
+    }else {
+        sqlite3_commit_hook(_db, nil, nil);
+    }
+}
+
+/** WAL 回调：提交事务之后调用，返回 SQLITE_OK
+ */
+static int FMDBDatabaseWalHook(void *f, sqlite3 *db, const char *databaseName, int pageCount) {
+#pragma unused(db)
+    FMDatabase *self = (__bridge FMDatabase*)f;
+    void (^block)(NSString *, int) = self->_walHookBlock;
+    if (block) {
+        block(databaseName ? [NSString stringWithUTF8String:databaseName] : @"main", pageCount);
+    }
+    return SQLITE_OK;
+}
+
+- (void)setWalHook:(void (^)(NSString *databaseName, int pageCount))block {
+#if SQLITE_VERSION_NUMBER >= 3007000
+    FMDBAutorelease(_walHookBlock);
+    _walHookBlock = [block copy];
+    if (!_db) {
+        return;
+    }
+    if (_walHookBlock) {
+        sqlite3_wal_hook(_db, &FMDBDatabaseWalHook, (__bridge void *)(self));
+    }else {
+        //移除回调后恢复 SQLite 默认的自动检查点
+        sqlite3_wal_autocheckpoint(_db, 1000);
+    }
+#else
+    NSLog(@"sqlite3_wal_hook unavailable before sqlite 3.7.0");
+#endif
+}
+
+/** 行变更回调：INSERT、UPDATE、DELETE 每修改一行调用一次，此时事务还未提交
+ */
+static void FMDBDatabaseUpdateHook(void *f, int operation, const char *databaseName, const char *tableName, sqlite3_int64 rowid) {
+    FMDatabase *self = (__bridge FMDatabase*)f;
+    void (^block)(int, NSString *, NSString *, int64_t) = self->_updateHookBlock;
+    if (block) {
+        block(operation, databaseName ? [NSString stringWithUTF8String:databaseName] : @"main", tableName ? [NSString stringWithUTF8String:tableName] : @"", rowid);
+    }
+}
+
+- (void)setUpdateHook:(void (^)(int operation, NSString *databaseName, NSString *tableName, int64_t rowid))block {
+    FMDBAutorelease(_updateHookBlock);
+    _updateHookBlock = [block copy];
+    if (!_db) {
+        return;
+    }
+    if (_updateHookBlock) {
+        sqlite3_update_hook(_db, &FMDBDatabaseUpdateHook, (__bridge void *)(self));
+    }else {
+        sqlite3_update_hook(_db, nil, nil);
+    }
+}
+
+/** 回滚回调：事务回滚时调用（包括提交回调将提交转为回滚）
+ */
+static void FMDBDatabaseRollbackHook(void *f) {
+    FMDatabase *self = (__bridge FMDatabase*)f;
+    void (^block)(void) = self->_rollbackHookBlock;
+    if (block) {
+        block();
+    }
+}
+
+- (void)setRollbackHook:(void (^)(void))block {
+    FMDBAutorelease(_rollbackHookBlock);
+    _rollbackHookBlock = [block copy];
+    if (!_db) {
+        return;
+    }
+    if (_rollbackHookBlock) {
+        sqlite3_rollback_hook(_db, &FMDBDatabaseRollbackHook, (__bridge void *)(self));
+    }else {
+        sqlite3_rollback_hook(_db, nil, nil);
+    }
+}
+
+/** 授权回调：编译语句时，每访问一个表、列，执行一种操作调用一次
+ */
+static int FMDBDatabaseAuthorizer(void *f, int actionCode, const char *arg1, const char *arg2, const char *databaseName, const char *triggerOrView) {
+    FMDatabase *self = (__bridge FMDatabase*)f;
+    int (^block)(int, NSString *, NSString *, NSString *, NSString *) = self->_authorizerBlock;
+    if (!block) {
+        return SQLITE_OK;
+    }
+    return block(actionCode,
+                 arg1 ? [NSString stringWithUTF8String:arg1] : nil,
+                 arg2 ? [NSString stringWithUTF8String:arg2] : nil,
+                 databaseName ? [NSString stringWithUTF8String:databaseName] : nil,
+                 triggerOrView ? [NSString stringWithUTF8String:triggerOrView] : nil);
+}
+
+- (void)setAuthorizer:(int (^)(int actionCode, NSString *arg1, NSString *arg2, NSString *databaseName, NSString *triggerOrView))block {
+    FMDBAutorelease(_authorizerBlock);
+    _authorizerBlock = [block copy];
+    if (!_db) {
+        return;
+    }
+    if (_authorizerBlock) {
+        sqlite3_set_authorizer(_db, &FMDBDatabaseAuthorizer, (__bridge void *)(self));
+    }else {
+        sqlite3_set_authorizer(_db, nil, nil);
+    }
+}
+
 #pragma mark 结果集
 
 /** 是否有打开的结果集 ***/
@@ -809,6 +1091,7 @@ static int FMDBDatabaseBusyHandler(void *f, int count) {
     if (_traceExecution && sql) {//打印sql语句
         NSLog(@"%@ executeQuery: %@", self, sql);
     }
+    FMDBNotifyStatementObserver(sql);
     /********** 获取缓存数据 ********/
     if (_shouldCacheStatements) {
         statement = [self cachedStatementForQuery:sql];
@@ -971,6 +1254,7 @@ static int FMDBDatabaseBusyHandler(void *f, int count) {
     if (_traceExecution && sql) {
         NSLog(@"%@ executeUpdate: %@", self, sql);
     }
+    FMDBNotifyStatementObserver(sql);
     
     /********** 获取缓存数据 ********/
     if (_shouldCacheStatements) {
@@ -1139,6 +1423,11 @@ static int FMDBDatabaseBusyHandler(void *f, int count) {
     }
     
     _isExecutingStatement = NO;
+    
+    //处于自动提交模式，说明事务已结束（提交或回滚），唤醒等待锁的其它连接
+    if (sqlite3_get_autocommit(_db)) {
+        FMDBBusyConditionBroadcast();
+    }
     return (rc == SQLITE_DONE || rc == SQLITE_OK);
 }
 
@@ -90,6 +90,15 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)close;
 
+/** 关闭数据库，执行 block 之后以原来的路径、标志重新打开
+ * 在串行队列中执行，期间其它操作排队等待；关闭与重新打开使用同一个 FMDatabase 对象，
+ * 其上设置的忙碌处理、进度回调、提交回调、WAL 回调、语句缓存等在重新打开后依然有效
+ *
+ * @param block 数据库关闭期间执行，一般用于替换数据库文件；不能再访问本队列
+ * @return 重新打开是否成功
+ */
+- (BOOL)closeAndReopenAfter:(__attribute__((noescape)) void (^)(void))block;
+
 /** 中断数据库操作
  */
 - (void)interrupt;
@@ -124,6 +133,12 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)inImmediateTransaction:(__attribute__((noescape)) void (^)(FMDatabase *db, BOOL *rollback))block;
 
+/** 在队列上开启延迟事务执行只读操作，block 内的多次查询读取同一个数据库版本
+ * @note 延迟事务只获取读锁，在 WAL 模式下不会阻塞写操作；
+ *       block 结束后提交事务，不支持写操作
+ */
+- (void)inReadTransaction:(__attribute__((noescape)) void (^)(FMDatabase *db))block;
+
 ///-----------------------------------------------
 /// @name 将数据库操作分派到队列
 ///-----------------------------------------------
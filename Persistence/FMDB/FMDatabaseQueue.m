@@ -135,6 +135,18 @@ static const void * const kDispatchQueueSpecificKey = &kDispatchQueueSpecificKey
     FMDBRelease(self);
 }
 
+- (BOOL)closeAndReopenAfter:(__attribute__((noescape)) void (^)(void))block {
+    __block BOOL result;
+    FMDBRetain(self);
+    dispatch_sync(_queue, ^() {
+        [self->_db close];
+        block();
+        result = [self database] != nil;//-database 以原来的标志重新打开
+    });
+    FMDBRelease(self);
+    return result;
+}
+
 - (void)interrupt {
     [[self database] interrupt];
 }
@@ -229,6 +241,17 @@ static const void * const kDispatchQueueSpecificKey = &kDispatchQueueSpecificKey
     [self beginTransaction:FMDBTransactionImmediate withBlock:block];
 }
 
+- (void)inReadTransaction:(__attribute__((noescape)) void (^)(FMDatabase *db))block {
+    FMDBRetain(self);
+    dispatch_sync(_queue, ^() {
+        FMDatabase *db = [self database];
+        [db beginDeferredTransaction];//延迟事务：第一次读取时才获取读锁
+        block(db);
+        [db commit];
+    });
+    FMDBRelease(self);
+}
+
 - (NSError*)inSavePoint:(__attribute__((noescape)) void (^)(FMDatabase *db, BOOL *rollback))block {
 #if SQLITE_VERSION_NUMBER >= 3007000
     static unsigned long savePointIdx = 0;
@@ -8,6 +8,10 @@
 
 #import <Foundation/Foundation.h>
 
+@class DatabaseCancellationToken;
+@class DatabaseTableSchema;
+@class DatabaseLiveQuery;
+
 NS_ASSUME_NONNULL_BEGIN
 
 @interface Car : NSObject
@@ -20,17 +24,25 @@ NS_ASSUME_NONNULL_BEGIN
 
 @interface Car (DAO)
 
+/** 表结构
+ */
++ (DatabaseTableSchema *)tableSchema;
+
 /** 根据唯一键查询唯一值
  */
-+ (void)getDateWithName:(NSString *)name completionBlock:(void(^)(NSDate *date))block;
++ (DatabaseCancellationToken *)getDateWithName:(NSString *)name completionBlock:(void(^)(NSDate *date))block;
 
 /** 根据某个表头获取表中数据
  */
-+ (void)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(NSArray<Car *> *models))block;
++ (DatabaseCancellationToken *)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(NSArray<Car *> *models))block;
 
 /** 根据所有数据
  */
-+ (void)getAllDatas:(void(^)(NSArray<Car *> *models))block;
++ (DatabaseCancellationToken *)getAllDatas:(void(^)(NSArray<Car *> *models))block;
+
+/** 所有数据的实时查询：Cars 表有修改提交之后重新查询，回调与上次结果的差异
+ */
++ (DatabaseLiveQuery *)liveQueryForAllDatas;
 
 /** 插入
  */
@@ -8,6 +8,8 @@
 
 #import "Car.h"
 #import "DatabaseManagement.h"
+#import "DatabaseDAO.h"
+#import "DatabaseLiveQuery.h"
 
 
 @implementation Car
@@ -16,139 +18,70 @@
 
 @implementation Car (DAO)
 
-+ (void)creatTableWithDatabase:(FMDatabase *)database{
-    if (![database tableExists:@"Cars"]){
-        [database executeUpdate:@"CREATE TABLE Cars (id INTEGER PRIMARY KEY,owners TEXT NOT NULL,brand TEXT,price DOUBLE DEFAULT 0.0,time DATETIME DEFAULT (datetime('now','localtime')),FOREIGN KEY (owners) REFERENCES Persons(name))"];
-    }
+/** 映射：表名为 Cars，按车主更新、删除
+ */
++ (NSString *)databaseTableName{
+    return @"Cars";
+}
+
++ (NSString *)databaseUniqueKey{
+    return @"owners";
 }
 
-+ (void)getDateWithName:(NSString *)owners completionBlock:(void(^)(NSDate *date))block{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase * _Nonnull database, BOOL * _Nonnull rollback) {
++ (DatabaseTableSchema *)tableSchema{
+    return [DatabaseTableSchema schemaWithTableName:@"Cars" version:1 createSQL:@"CREATE TABLE Cars (id INTEGER PRIMARY KEY,owners TEXT NOT NULL,brand TEXT,price DOUBLE DEFAULT 0.0,time DATETIME DEFAULT (datetime('now','localtime')),FOREIGN KEY (owners) REFERENCES Persons(name))" migrations:nil];
+}
+
++ (DatabaseCancellationToken *)getDateWithName:(NSString *)owners completionBlock:(void(^)(NSDate *date))block{
+    return [DatabaseManagement databaseChildThreadInRead:^(FMDatabase *database) {
         NSDate *date = [database dateForQuery:@"SELECT time FROM Cars WHERE owners = ?",owners];
-        dispatch_async(dispatch_get_main_queue(), ^{
+        [DatabaseManagement databaseMainThreadCompletion:^{
              block(date);
-         });
+         }];
         
         NSString *string = [database stringForQuery:@"SELECT time FROM Cars WHERE owners = ?",owners];
          NSLog(@"string ---- %@",string);
     }];
 }
 
-+ (void)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(NSArray<Car *> *models))block{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        
-        NSMutableArray *array = [NSMutableArray array];
-        
-        FMResultSet *resultSet = [database executeQuery:@"SELECT * FROM Cars WHERE ? = ?",key,value];
-        while ([resultSet next]){
-            Car *model = [[Car alloc] init];
-            model.owners = [resultSet stringForColumn:@"owners"];
-            model.brand = [resultSet stringForColumn:@"brand"];
-            model.price = [resultSet doubleForColumn:@"price"];
-            [array addObject:model];
-        }
-        [resultSet close];
-        
-       dispatch_async(dispatch_get_main_queue(), ^{
-            block(array);
-        });
-    }];
++ (DatabaseCancellationToken *)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(NSArray<Car *> *models))block{
+    return [DatabaseDAO getModelsOfClass:self key:key value:value extraClause:nil completionBlock:block];
 }
 
 /** 根据所有数据
  */
-+ (void)getAllDatas:(void(^)(NSArray<Car *> *models))block{
-    
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        NSMutableArray *array = [NSMutableArray array];
-        
-        FMResultSet *resultSet = [database executeQuery:@"SELECT * FROM Cars"];
-        while ([resultSet next]){
-            Car *model = [[Car alloc] init];
-            model.owners = [resultSet stringForColumn:@"owners"];
-            model.brand = [resultSet stringForColumn:@"brand"];
-            model.price = [resultSet doubleForColumn:@"price"];
-            [array addObject:model];
-        }
-        [resultSet close];
-        
-       dispatch_async(dispatch_get_main_queue(), ^{
-            block(array);
-        });
-    }];
++ (DatabaseCancellationToken *)getAllDatas:(void(^)(NSArray<Car *> *models))block{
+    return [DatabaseDAO getModelsOfClass:self where:nil arguments:nil completionBlock:block];
+}
+
++ (DatabaseLiveQuery *)liveQueryForAllDatas{
+    return [[DatabaseLiveQuery alloc] initWithModelClass:self where:nil arguments:nil];
 }
 
 + (void)insertModel:(Car *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [self creatTableWithDatabase:database];
-        
-        BOOL result = [database executeUpdate:@"INSERT INTO Cars (owners,brand,price) VALUES (? , ? , ?)" ,model.owners,model.brand,@(model.price)];
-        if (!result) {
-            NSLog(@"error ===== %@",database.lastError);
-            NSLog(@"model ===== %@",model);
-        }
-    }];
+    [DatabaseDAO insertModel:model];
 }
 
 + (void)insertModels:(NSArray<Car *> *)modelArray{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [self creatTableWithDatabase:database];
-        [modelArray enumerateObjectsUsingBlock:^(Car * _Nonnull model, NSUInteger idx, BOOL * _Nonnull stop) {
-            BOOL result = [database executeUpdate:@"INSERT INTO Cars (owners,brand,price) VALUES (? , ? , ?)" ,model.owners,model.brand,@(model.price)];
-            if (!result) {
-                NSLog(@"error ===== %@",database.lastError);
-                NSLog(@"model ===== %@",model);
-            }
-        }];
-    }];
+    [DatabaseDAO insertModels:modelArray];
 }
 
 + (void)replaceModel:(Car *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [self creatTableWithDatabase:database];
-        
-        [database executeUpdate:@"REPLACE INTO Cars (owners,brand,price) VALUES (? , ? , ?)" ,model.owners,model.brand,@(model.price)];
-
-    }];
+    [DatabaseDAO replaceModel:model];
 }
 
 + (void)replaceModels:(NSArray<Car *> *)modelArray{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [self creatTableWithDatabase:database];
-        
-        NSMutableString *string = [[NSMutableString alloc] init];
-        [modelArray enumerateObjectsUsingBlock:^(Car * _Nonnull model, NSUInteger idx, BOOL * _Nonnull stop) {
-            if (idx) {
-                [string appendFormat:@",('%@' , '%@' , '%@')",model.owners,model.brand,@(model.price)];
-            }else{
-                [string appendFormat:@"('%@' , '%@' , '%@')",model.owners,model.brand,@(model.price)];
-            }
-        }];
-        NSString *sql = [NSString stringWithFormat:@"REPLACE INTO Cars (owners,brand,price) VALUES %@",string];
-        BOOL result = [database executeUpdate:sql];
-        if (!result) {
-            NSLog(@"error ===== %@",database.lastError);
-        }
-    }];
+    [DatabaseDAO replaceModels:modelArray];
 }
 
 /** 更新
 */
 + (void)updateModel:(Car *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-
-        BOOL result = [database executeUpdate:@"UPDATE Cars SET brand = ?,price = ? WHERE owners = ?" ,model.brand,@(model.price),model.owners];
-        if (!result) {
-            NSLog(@"error ===== %@",database.lastError);
-            NSLog(@"model ===== %@",model);
-        }
-    }];
+    [DatabaseDAO updateModel:model];
 }
 
 + (void)deleteModel:(Car *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [database executeUpdate:@"DELETE FROM Cars WHERE owners = ?",model.owners];
-    }];
+    [DatabaseDAO deleteModel:model];
 }
 
 @end
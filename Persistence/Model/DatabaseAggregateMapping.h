@@ -0,0 +1,99 @@
+//
+//  DatabaseAggregateMapping.h
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/6/8.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "DatabaseModelMapping.h"
+
+@class FMDatabase;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** 一个一对一关系：子表中 childColumn 等于聚合标识的行解析为子模型，赋值给根模型的 property
+ */
+@interface DatabaseAggregateRelationship : NSObject
+
++ (instancetype)relationshipWithProperty:(NSString *)property childClass:(Class)childClass childColumn:(NSString *)childColumn;
+
+@property (nonatomic, copy, readonly) NSString *property;
+@property (nonatomic, unsafe_unretained, readonly) Class childClass;
+@property (nonatomic, copy, readonly) NSString *childColumn;
+
+@end
+
+
+/** 跨多张表的模型（聚合）实现的映射规则
+ */
+@protocol DatabaseAggregate <DatabaseModel>
+
+/** 根表中标识聚合的列，需要有唯一约束
+ */
++ (NSString *)databaseAggregateKeyColumn;
+
+/** 根模型及子模型之间的关系，子表与根表在同一个数据库文件中
+ */
++ (NSArray<DatabaseAggregateRelationship *> *)databaseRelationships;
+
+@optional
+
+/** 从根模型读取聚合标识的 keyPath，默认与 databaseAggregateKeyColumn 相同；标识只保存在子模型中时为 子模型属性.属性
+ */
++ (NSString *)databaseAggregateKeyPath;
+
+@end
+
+
+/** 聚合的映射：关系只声明一次，生成并缓存一条 LEFT JOIN 语句，一次查询读取根模型与所有子模型
+ *
+ * 根表的列（DatabaseModelMapping 映射的列）在前，之后依次为每个子表的列与 rowid（rowid 为 NULL 表示没有子模型），最后为聚合标识；
+ * 按一组标识查询时，整组标识编码为 JSON 数组通过 json_each 绑定，SQL 与个数无关；
+ * 写入、删除在调用方所在的数据库任务中执行，调用方以 databaseBatchWrite 包装为一个事务
+ *
+ * 查询不经过行缓存；写入经过写连接的 update_hook，行缓存与观察者照常收到修改
+ */
+@interface DatabaseAggregateMapping : NSObject
+
+/** 获取一个聚合类的映射，第一次获取时生成，之后线程安全地复用
+ */
++ (instancetype)mappingForClass:(Class<DatabaseAggregate>)aggregateClass;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (nonatomic, strong, readonly) DatabaseModelMapping *rootMapping;
+@property (nonatomic, copy, readonly) NSString *keyColumn;
+@property (nonatomic, copy, readonly) NSString *keyPath;
+@property (nonatomic, copy, readonly) NSArray<DatabaseAggregateRelationship *> *relationships;
+
+/** SELECT ... FROM 根表 LEFT JOIN 子表 ...；查询条件拼接在后面，根表的别名为 p
+ */
+@property (nonatomic, copy, readonly) NSString *selectSQL;
+
+/** 聚合标识
+ */
+- (nullable id)keyForAggregate:(id)aggregate;
+
+/** 按标识查询一个聚合；根表中没有该标识时返回 nil
+ */
+- (nullable id)aggregateInDatabase:(FMDatabase *)database key:(nullable id)key;
+
+/** 按一组标识查询：标识 -> 聚合；不存在的标识不包含在内
+ */
+- (NSMutableDictionary *)aggregatesInDatabase:(FMDatabase *)database keys:(NSArray *)keys;
+
+/** 写入根表与所有子表：按聚合标识与子表的唯一键 upsert，内容相同的行不写入
+ * 子模型的关联列设置为聚合标识；子模型为 nil 时删除子表中的行
+ * 返回是否成功；失败时打印错误
+ */
+- (BOOL)writeAggregate:(id)aggregate inDatabase:(FMDatabase *)database;
+
+/** 删除根表与所有子表中该标识的行
+ */
+- (BOOL)deleteAggregateWithKey:(id)key inDatabase:(FMDatabase *)database;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,277 @@
+//
+//  DatabaseAggregateMapping.m
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/6/8.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import "DatabaseAggregateMapping.h"
+#import "FMDatabase.h"
+#import "FMResultSet.h"
+
+@implementation DatabaseAggregateRelationship
+
++ (instancetype)relationshipWithProperty:(NSString *)property childClass:(Class)childClass childColumn:(NSString *)childColumn{
+    DatabaseAggregateRelationship *relationship = [[DatabaseAggregateRelationship alloc] init];
+    relationship->_property = [property copy];
+    relationship->_childClass = childClass;
+    relationship->_childColumn = [childColumn copy];
+    return relationship;
+}
+
+@end
+
+
+@interface DatabaseAggregateMapping ()
+{
+    NSArray<DatabaseModelMapping *> *_childMappings;//与 relationships 的顺序一致
+    NSArray<NSNumber *> *_childOffsets;//每个子表的第一列在结果集中的下标
+    NSArray *_childKeyProperties;//子模型中关联列对应的属性，没有映射时为 NSNull
+    int _keyIndex;//聚合标识在结果集中的下标
+    DatabaseModelMapping *_keyMapping;//按映射的属性类型整理 json_each 绑定的标识
+    NSString *_keyMappingColumn;
+    NSString *_selectByKeySQL;
+    NSString *_selectByKeysSQL;
+    NSString *_writeRootSQL;
+    NSString *_deleteRootSQL;
+    NSArray<NSString *> *_deleteChildSQLs;
+}
+@end
+
+@implementation DatabaseAggregateMapping
+
++ (instancetype)mappingForClass:(Class<DatabaseAggregate>)aggregateClass{
+    static NSMutableDictionary<NSString *, DatabaseAggregateMapping *> *mappings;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        mappings = [NSMutableDictionary dictionary];
+    });
+
+    NSString *key = NSStringFromClass(aggregateClass);
+    @synchronized (mappings) {
+        DatabaseAggregateMapping *mapping = mappings[key];
+        if (mapping == nil) {
+            mapping = [[DatabaseAggregateMapping alloc] initWithClass:aggregateClass];
+            mappings[key] = mapping;
+        }
+        return mapping;
+    }
+}
+
+- (instancetype)initWithClass:(Class<DatabaseAggregate>)aggregateClass{
+    self = [super init];
+    if (self) {
+        _rootMapping = [DatabaseModelMapping mappingForClass:aggregateClass];
+        _keyColumn = [[aggregateClass databaseAggregateKeyColumn] copy];
+        _keyPath = [(id)aggregateClass respondsToSelector:@selector(databaseAggregateKeyPath)] ? [[aggregateClass databaseAggregateKeyPath] copy] : _keyColumn;
+        _relationships = [[aggregateClass databaseRelationships] copy];
+        if ([_rootMapping columnForKey:_keyColumn]) {
+            _keyMapping = _rootMapping;
+            _keyMappingColumn = _keyColumn;
+        }
+
+        //根表的列在前，之后依次为每个子表的列与 rowid，最后为聚合标识
+        NSString *rootTable = _rootMapping.tableName;
+        NSMutableArray<NSString *> *resultColumns = [NSMutableArray array];
+        for (NSString *column in _rootMapping.columns) {
+            [resultColumns addObject:[@"p." stringByAppendingString:column]];
+        }
+        NSMutableString *joins = [NSMutableString string];
+        NSMutableArray<DatabaseModelMapping *> *childMappings = [NSMutableArray arrayWithCapacity:_relationships.count];
+        NSMutableArray<NSNumber *> *childOffsets = [NSMutableArray arrayWithCapacity:_relationships.count];
+        NSMutableArray *childKeyProperties = [NSMutableArray arrayWithCapacity:_relationships.count];
+        NSMutableArray<NSString *> *deleteChildSQLs = [NSMutableArray arrayWithCapacity:_relationships.count];
+        [_relationships enumerateObjectsUsingBlock:^(DatabaseAggregateRelationship *relationship, NSUInteger idx, BOOL *stop) {
+            DatabaseModelMapping *childMapping = [DatabaseModelMapping mappingForClass:relationship.childClass];
+            NSString *alias = [NSString stringWithFormat:@"c%lu",(unsigned long)idx];
+            [childMappings addObject:childMapping];
+            [childOffsets addObject:@(resultColumns.count)];
+            for (NSString *column in childMapping.columns) {
+                [resultColumns addObject:[NSString stringWithFormat:@"%@.%@",alias,column]];
+            }
+            [resultColumns addObject:[alias stringByAppendingString:@".rowid"]];
+            [joins appendFormat:@" LEFT JOIN %@ %@ ON %@.%@ = p.%@",childMapping.tableName,alias,alias,relationship.childColumn,self->_keyColumn];
+
+            NSUInteger columnIndex = [childMapping.columns indexOfObject:[childMapping columnForKey:relationship.childColumn] ?: @""];
+            if (columnIndex == NSNotFound) {
+                NSLog(@"%@ 的关联列 %@ 不是映射的列，写入时不会设置",childMapping.tableName,relationship.childColumn);
+                [childKeyProperties addObject:NSNull.null];
+            }else{
+                [childKeyProperties addObject:childMapping.properties[columnIndex]];
+                if (self->_keyMapping == nil) {
+                    self->_keyMapping = childMapping;
+                    self->_keyMappingColumn = relationship.childColumn;
+                }
+            }
+            [deleteChildSQLs addObject:[NSString stringWithFormat:@"DELETE FROM %@ WHERE %@ = ?",childMapping.tableName,relationship.childColumn]];
+        }];
+        _keyIndex = (int)resultColumns.count;
+        [resultColumns addObject:[@"p." stringByAppendingString:_keyColumn]];
+
+        _childMappings = [childMappings copy];
+        _childOffsets = [childOffsets copy];
+        _childKeyProperties = [childKeyProperties copy];
+        _deleteChildSQLs = [deleteChildSQLs copy];
+
+        //所有 SQL 只生成一次
+        _selectSQL = [NSString stringWithFormat:@"SELECT %@ FROM %@ p%@",[resultColumns componentsJoinedByString:@","],rootTable,joins];
+        _selectByKeySQL = [NSString stringWithFormat:@"%@ WHERE p.%@ = ?",_selectSQL,_keyColumn];
+        _selectByKeysSQL = [NSString stringWithFormat:@"%@ WHERE p.%@ IN (SELECT value FROM json_each(?))",_selectSQL,_keyColumn];
+
+        NSMutableArray<NSString *> *rootColumns = [NSMutableArray arrayWithObject:_keyColumn];
+        for (NSString *column in _rootMapping.columns) {
+            if (![column isEqualToString:_keyColumn]) {
+                [rootColumns addObject:column];
+            }
+        }
+        NSMutableArray<NSString *> *placeholders = [NSMutableArray arrayWithCapacity:rootColumns.count];
+        for (NSUInteger i = 0; i < rootColumns.count; i++) {
+            [placeholders addObject:@"?"];
+        }
+        //按聚合标识 upsert：已存在的行原地更新，内容相同时不写入；根表只有聚合标识时不需要更新
+        NSMutableArray<NSString *> *assignments = [NSMutableArray arrayWithCapacity:rootColumns.count];
+        NSMutableArray<NSString *> *differences = [NSMutableArray arrayWithCapacity:rootColumns.count];
+        for (NSUInteger i = 1; i < rootColumns.count; i++) {
+            [assignments addObject:[NSString stringWithFormat:@"%@ = excluded.%@",rootColumns[i],rootColumns[i]]];
+            [differences addObject:[NSString stringWithFormat:@"%@ IS NOT excluded.%@",rootColumns[i],rootColumns[i]]];
+        }
+        NSString *action = assignments.count ? [NSString stringWithFormat:@"DO UPDATE SET %@ WHERE %@",[assignments componentsJoinedByString:@","],[differences componentsJoinedByString:@" OR "]] : @"DO NOTHING";
+        _writeRootSQL = [NSString stringWithFormat:@"INSERT INTO %@ (%@) VALUES (%@) ON CONFLICT(%@) %@",rootTable,[rootColumns componentsJoinedByString:@","],[placeholders componentsJoinedByString:@" , "],_keyColumn,action];
+        _deleteRootSQL = [NSString stringWithFormat:@"DELETE FROM %@ WHERE %@ = ?",rootTable,_keyColumn];
+    }
+    return self;
+}
+
+- (NSString *)description{
+    return [NSString stringWithFormat:@"<DatabaseAggregateMapping %@ -> %@>",NSStringFromClass(self.rootMapping.modelClass),self.selectSQL];
+}
+
+#pragma mark - 读取
+
+- (id)keyForAggregate:(id)aggregate{
+    id key = [aggregate valueForKeyPath:self.keyPath];
+    return key == NSNull.null ? nil : key;
+}
+
+/** 将结果集的当前行解析为聚合，不移动、不关闭结果集
+ */
+- (id)aggregateFromResultSet:(FMResultSet *)resultSet{
+    id aggregate = [self.rootMapping modelFromResultSet:resultSet];
+    [_relationships enumerateObjectsUsingBlock:^(DatabaseAggregateRelationship *relationship, NSUInteger idx, BOOL *stop) {
+        DatabaseModelMapping *childMapping = self->_childMappings[idx];
+        int offset = self->_childOffsets[idx].intValue;
+        //LEFT JOIN 没有匹配的行时子表的 rowid 为 NULL
+        id child = [resultSet columnIndexIsNull:offset + (int)childMapping.columns.count] ? nil : [childMapping modelFromResultSet:resultSet columnOffset:offset];
+        [aggregate setValue:child forKey:relationship.property];
+    }];
+    return aggregate;
+}
+
+- (id)aggregateInDatabase:(FMDatabase *)database key:(id)key{
+    if (key == nil) {
+        return nil;
+    }
+    FMResultSet *resultSet = [database executeQuery:_selectByKeySQL withArgumentsInArray:@[key]];
+    if (resultSet == nil) {
+        NSLog(@"error ===== %@",database.lastError);
+        return nil;
+    }
+    id aggregate = nil;
+    if ([resultSet next]) {
+        aggregate = [self aggregateFromResultSet:resultSet];
+    }
+    [resultSet close];
+    return aggregate;
+}
+
+- (NSMutableDictionary *)aggregatesInDatabase:(FMDatabase *)database keys:(NSArray *)keys{
+    NSMutableDictionary *aggregates = [NSMutableDictionary dictionaryWithCapacity:keys.count];
+    if (keys.count == 0) {
+        return aggregates;
+    }
+    NSArray *values = _keyMapping ? [_keyMapping JSONValues:keys forColumn:_keyMappingColumn] : keys;
+    NSError *error = nil;
+    NSData *data = [NSJSONSerialization isValidJSONObject:values] ? [NSJSONSerialization dataWithJSONObject:values options:0 error:&error] : nil;
+    if (data == nil) {
+        NSLog(@"%@ 聚合标识只能是字符串或数字 ===== %@",self.rootMapping.tableName,error ?: values);
+        return aggregates;
+    }
+    NSString *json = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+    FMResultSet *resultSet = [database executeQuery:_selectByKeysSQL withArgumentsInArray:@[json]];
+    if (resultSet == nil) {
+        NSLog(@"error ===== %@",database.lastError);
+        return aggregates;
+    }
+    while ([resultSet next]) {
+        id key = [resultSet objectForColumnIndex:_keyIndex];
+        if (key && key != NSNull.null) {
+            aggregates[key] = [self aggregateFromResultSet:resultSet];
+        }
+    }
+    [resultSet close];
+    return aggregates;
+}
+
+#pragma mark - 写操作
+
+- (BOOL)writeAggregate:(id)aggregate inDatabase:(FMDatabase *)database{
+    id key = [self keyForAggregate:aggregate];
+    if (key == nil) {
+        NSLog(@"%@ 聚合标识 %@ 为空，不能写入",self.rootMapping.tableName,self.keyPath);
+        return NO;
+    }
+
+    NSMutableArray *arguments = [NSMutableArray arrayWithObject:key];
+    NSArray *rootValues = [self.rootMapping argumentsForModel:aggregate];
+    [self.rootMapping.columns enumerateObjectsUsingBlock:^(NSString *column, NSUInteger idx, BOOL *stop) {
+        if (![column isEqualToString:self.keyColumn]) {
+            [arguments addObject:rootValues[idx]];
+        }
+    }];
+    if (![database executeUpdate:_writeRootSQL withArgumentsInArray:arguments]) {
+        NSLog(@"error ===== %@",database.lastError);
+        NSLog(@"model ===== %@",aggregate);
+        return NO;
+    }
+
+    for (NSUInteger i = 0; i < _relationships.count; i++) {
+        DatabaseAggregateRelationship *relationship = _relationships[i];
+        id child = [aggregate valueForKey:relationship.property];
+        BOOL result = YES;
+        if (child == nil) {
+            result = [database executeUpdate:_deleteChildSQLs[i] withArgumentsInArray:@[key]];
+        }else{
+            //写入的行以聚合标识为准，与根表中的记录保持一致
+            id property = _childKeyProperties[i];
+            if (property != NSNull.null && ![[child valueForKey:property] isEqual:key]) {
+                [child setValue:key forKey:property];
+            }
+            result = [_childMappings[i] upsertModel:child schema:nil inDatabase:database] != DatabaseUpsertResultFailed;
+        }
+        if (!result) {
+            NSLog(@"error ===== %@",database.lastError);
+            return NO;
+        }
+    }
+    return YES;
+}
+
+- (BOOL)deleteAggregateWithKey:(id)key inDatabase:(FMDatabase *)database{
+    if (key == nil) {
+        return NO;
+    }
+    for (NSString *sql in _deleteChildSQLs) {
+        if (![database executeUpdate:sql withArgumentsInArray:@[key]]) {
+            NSLog(@"error ===== %@",database.lastError);
+            return NO;
+        }
+    }
+    if (![database executeUpdate:_deleteRootSQL withArgumentsInArray:@[key]]) {
+        NSLog(@"error ===== %@",database.lastError);
+        return NO;
+    }
+    return YES;
+}
+
+@end
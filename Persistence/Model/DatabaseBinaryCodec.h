@@ -0,0 +1,53 @@
+//
+//  DatabaseBinaryCodec.h
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/6/10.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** 模型类可选实现的编码规则
+ */
+@protocol DatabaseBinaryCoding <NSObject>
+@optional
+
+/** 嵌套的模型属性：属性名 -> 模型类；属性为 NSArray 时为元素的类
+ */
++ (NSDictionary<NSString *, Class> *)binaryCodingNestedClasses;
+
+@end
+
+
+/** 模型的二进制编码：代替 NSKeyedArchiver 保存模型树（快照文件、BLOB 列）
+ *
+ * 编码的字段为 DatabaseModelMapping 映射的属性与 binaryCodingNestedClasses 声明的嵌套模型；
+ * 格式：文件头 PMB1，共享的字符串表（所有字符串、类名、字段名各保存一次，UTF-8，长度前缀），类表（类名与字段名的下标），之后为根对象或根数组；
+ * 每个字段为 varint 标签（类表中字段的下标 << 3 | 类型）与值：整数为 zigzag varint，浮点数、日期为 8 字节，字符串为字符串表的下标，
+ * 对象与数组带有长度前缀，nil 的字段不写入；
+ * 按字段名对应，增加、删除属性之后旧数据仍可读取，不存在的字段被忽略
+ *
+ * 读取时先检查整个缓冲区的边界与下标，之后按需解码：数组（根数组、childArray 等）在访问元素时才解码，字符串在第一次使用时才创建；
+ * 解码得到的数组持有数据，文件以内存映射读取
+ */
+@interface DatabaseBinaryCodec : NSObject
+
+/** 编码一个模型或一组模型；对象不是模型或嵌套属性的类型与声明不一致时返回 nil
+ */
++ (nullable NSData *)dataWithRootObject:(id)rootObject;
+
+/** 解码：根为数组时返回的数组按需解码；数据不完整或格式不正确时返回 nil
+ */
++ (nullable id)rootObjectWithData:(NSData *)data;
+
+/** 写入文件（原子写入）、从文件读取（内存映射）
+ */
++ (BOOL)writeRootObject:(id)rootObject toFile:(NSString *)path;
++ (nullable id)rootObjectWithContentsOfFile:(NSString *)path;
+
+@end
+
+NS_ASSUME_NONNULL_END
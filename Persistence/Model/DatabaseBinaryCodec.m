@@ -0,0 +1,744 @@
+//
+//  DatabaseBinaryCodec.m
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/6/10.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import "DatabaseBinaryCodec.h"
+#import "DatabaseModelMapping.h"
+#import <objc/runtime.h>
+#import <os/lock.h>
+
+static uint8_t const DatabaseBinaryMagic[4] = {'P', 'M', 'B', '1'};
+static NSUInteger const DatabaseBinaryMaxDepth = 64;
+
+/** 字段值的类型：标签的低 3 位
+ */
+typedef NS_ENUM(uint8_t, DatabaseBinaryWireType) {
+    DatabaseBinaryWireVarint = 0,//有符号整数，zigzag
+    DatabaseBinaryWireDouble = 1,
+    DatabaseBinaryWireString = 2,//字符串表的下标
+    DatabaseBinaryWireBytes = 3,//长度前缀
+    DatabaseBinaryWireObject = 4,//长度前缀：类的下标与字段
+    DatabaseBinaryWireArray = 5,//长度前缀：个数与对象
+    DatabaseBinaryWireDate = 6,//timeIntervalSince1970
+    DatabaseBinaryWireUnsigned = 7,//超过 INT64_MAX 的无符号整数
+};
+
+#pragma mark - varint
+
+static void DatabaseBinaryWriteVarint(NSMutableData *data, uint64_t value){
+    uint8_t buffer[10];
+    NSUInteger length = 0;
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        buffer[length++] = value ? (byte | 0x80) : byte;
+    } while (value);
+    [data appendBytes:buffer length:length];
+}
+
+static void DatabaseBinaryWriteDouble(NSMutableData *data, double value){
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bits = CFSwapInt64HostToLittle(bits);
+    [data appendBytes:&bits length:sizeof(bits)];
+}
+
+/** 读取位置：[p, end)
+ */
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+} DatabaseBinaryCursor;
+
+static inline BOOL DatabaseBinaryReadVarint(DatabaseBinaryCursor *cursor, uint64_t *value){
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && cursor->p < cursor->end; shift += 7) {
+        uint8_t byte = *cursor->p++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return YES;
+        }
+    }
+    return NO;
+}
+
+static inline BOOL DatabaseBinaryReadDouble(DatabaseBinaryCursor *cursor, double *value){
+    if (cursor->end - cursor->p < 8) {
+        return NO;
+    }
+    uint64_t bits;
+    memcpy(&bits, cursor->p, sizeof(bits));
+    bits = CFSwapInt64LittleToHost(bits);
+    memcpy(value, &bits, sizeof(bits));
+    cursor->p += 8;
+    return YES;
+}
+
+/** 读取长度前缀，返回长度范围内的子区间，cursor 移到区间之后
+ */
+static inline BOOL DatabaseBinaryReadLength(DatabaseBinaryCursor *cursor, DatabaseBinaryCursor *range){
+    uint64_t length;
+    if (!DatabaseBinaryReadVarint(cursor, &length) || length > (uint64_t)(cursor->end - cursor->p)) {
+        return NO;
+    }
+    range->p = cursor->p;
+    range->end = cursor->p + length;
+    cursor->p += length;
+    return YES;
+}
+
+
+#pragma mark - 类的编码结构
+
+/** 一个类的字段：映射的属性在前，之后为嵌套的模型属性
+ */
+@interface DatabaseBinaryClassSchema : NSObject
+{
+    @public
+    Class _modelClass;
+    DatabaseModelMapping *_mapping;
+    NSUInteger _scalarCount;
+    NSArray<NSString *> *_fieldNames;
+    NSArray<Class> *_nestedClasses;
+    NSArray<NSNumber *> *_nestedIsArray;
+}
+@end
+
+@implementation DatabaseBinaryClassSchema
+
++ (instancetype)schemaForClass:(Class)modelClass{
+    static NSMutableDictionary<NSString *, DatabaseBinaryClassSchema *> *schemas;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        schemas = [NSMutableDictionary dictionary];
+    });
+
+    NSString *key = NSStringFromClass(modelClass);
+    @synchronized (schemas) {
+        DatabaseBinaryClassSchema *schema = schemas[key];
+        if (schema == nil) {
+            schema = [[DatabaseBinaryClassSchema alloc] initWithClass:modelClass];
+            schemas[key] = schema;
+        }
+        return schema;
+    }
+}
+
+- (instancetype)initWithClass:(Class)modelClass{
+    self = [super init];
+    if (self) {
+        _modelClass = modelClass;
+        _mapping = [DatabaseModelMapping mappingForClass:modelClass];
+        _scalarCount = _mapping.properties.count;
+
+        NSMutableArray<NSString *> *fieldNames = [_mapping.properties mutableCopy];
+        NSMutableArray<Class> *nestedClasses = [NSMutableArray array];
+        NSMutableArray<NSNumber *> *nestedIsArray = [NSMutableArray array];
+        NSDictionary<NSString *, Class> *nested = [modelClass respondsToSelector:@selector(binaryCodingNestedClasses)] ? [modelClass binaryCodingNestedClasses] : nil;
+        //按属性名排序，字段的顺序与字典的遍历顺序无关
+        for (NSString *name in [nested.allKeys sortedArrayUsingSelector:@selector(compare:)]) {
+            objc_property_t property = class_getProperty(modelClass, name.UTF8String);
+            char *encoding = property ? property_copyAttributeValue(property, "T") : NULL;
+            if (encoding == NULL) {
+                NSLog(@"%@ 没有属性 %@，不编码",NSStringFromClass(modelClass),name);
+                continue;
+            }
+            //T@"NSArray"
+            NSString *typeName = @"";
+            size_t length = strlen(encoding);
+            if (encoding[0] == '@' && length > 3) {
+                typeName = [[NSString alloc] initWithBytes:encoding + 2 length:length - 3 encoding:NSUTF8StringEncoding];
+            }
+            free(encoding);
+            [fieldNames addObject:name];
+            [nestedClasses addObject:nested[name]];
+            [nestedIsArray addObject:@([NSClassFromString(typeName) isSubclassOfClass:NSArray.class])];
+        }
+        _fieldNames = [fieldNames copy];
+        _nestedClasses = [nestedClasses copy];
+        _nestedIsArray = [nestedIsArray copy];
+    }
+    return self;
+}
+
+@end
+
+
+#pragma mark - 编码
+
+@interface DatabaseBinaryEncoder : NSObject
+{
+    NSMutableArray<NSString *> *_strings;
+    NSMutableDictionary<NSString *, NSNumber *> *_stringIndexes;
+    NSMutableArray<DatabaseBinaryClassSchema *> *_classes;
+    NSMutableDictionary<NSString *, NSNumber *> *_classIndexes;
+    NSUInteger _depth;
+}
+@end
+
+@implementation DatabaseBinaryEncoder
+
+- (instancetype)init{
+    self = [super init];
+    if (self) {
+        _strings = [NSMutableArray array];
+        _stringIndexes = [NSMutableDictionary dictionary];
+        _classes = [NSMutableArray array];
+        _classIndexes = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (uint64_t)indexForString:(NSString *)string{
+    NSNumber *index = _stringIndexes[string];
+    if (index == nil) {
+        index = @(_strings.count);
+        string = [string copy];
+        [_strings addObject:string];
+        _stringIndexes[string] = index;
+    }
+    return index.unsignedLongLongValue;
+}
+
+- (uint64_t)indexForSchema:(DatabaseBinaryClassSchema *)schema{
+    NSString *name = NSStringFromClass(schema->_modelClass);
+    NSNumber *index = _classIndexes[name];
+    if (index == nil) {
+        index = @(_classes.count);
+        [_classes addObject:schema];
+        _classIndexes[name] = index;
+    }
+    return index.unsignedLongLongValue;
+}
+
+static inline void DatabaseBinaryWriteTag(NSMutableData *data, NSUInteger field, DatabaseBinaryWireType type){
+    DatabaseBinaryWriteVarint(data, ((uint64_t)field << 3) | type);
+}
+
+- (BOOL)writeScalar:(id)value field:(NSUInteger)field into:(NSMutableData *)data{
+    if ([value isKindOfClass:NSString.class]) {
+        DatabaseBinaryWriteTag(data, field, DatabaseBinaryWireString);
+        DatabaseBinaryWriteVarint(data, [self indexForString:value]);
+    }else if ([value isKindOfClass:NSNumber.class]) {
+        NSNumber *number = value;
+        if (CFNumberIsFloatType((__bridge CFNumberRef)number)) {
+            DatabaseBinaryWriteTag(data, field, DatabaseBinaryWireDouble);
+            DatabaseBinaryWriteDouble(data, number.doubleValue);
+        }else if (strcmp(number.objCType, @encode(unsigned long long)) == 0 && number.unsignedLongLongValue > INT64_MAX) {
+            DatabaseBinaryWriteTag(data, field, DatabaseBinaryWireUnsigned);
+            DatabaseBinaryWriteVarint(data, number.unsignedLongLongValue);
+        }else{
+            int64_t integer = number.longLongValue;
+            DatabaseBinaryWriteTag(data, field, DatabaseBinaryWireVarint);
+            DatabaseBinaryWriteVarint(data, ((uint64_t)integer << 1) ^ (uint64_t)(integer >> 63));
+        }
+    }else if ([value isKindOfClass:NSDate.class]) {
+        DatabaseBinaryWriteTag(data, field, DatabaseBinaryWireDate);
+        DatabaseBinaryWriteDouble(data, [value timeIntervalSince1970]);
+    }else if ([value isKindOfClass:NSData.class]) {
+        DatabaseBinaryWriteTag(data, field, DatabaseBinaryWireBytes);
+        DatabaseBinaryWriteVarint(data, [value length]);
+        [data appendData:value];
+    }else{
+        return NO;
+    }
+    return YES;
+}
+
+/** 写入一个对象：长度前缀，类的下标，字段
+ */
+- (BOOL)writeObject:(id)object into:(NSMutableData *)data{
+    if (++_depth > DatabaseBinaryMaxDepth) {
+        NSLog(@"DatabaseBinaryCodec 嵌套超过 %lu 层 ===== %@",(unsigned long)DatabaseBinaryMaxDepth,NSStringFromClass([object class]));
+        return NO;
+    }
+    DatabaseBinaryClassSchema *schema = [DatabaseBinaryClassSchema schemaForClass:[object class]];
+    NSMutableData *body = [NSMutableData data];
+    DatabaseBinaryWriteVarint(body, [self indexForSchema:schema]);
+
+    NSArray *values = [schema->_mapping argumentsForModel:object];
+    for (NSUInteger i = 0; i < schema->_scalarCount; i++) {
+        id value = values[i];
+        if (value != NSNull.null && ![self writeScalar:value field:i into:body]) {
+            return NO;
+        }
+    }
+    for (NSUInteger i = 0; i < schema->_nestedClasses.count; i++) {
+        NSUInteger field = schema->_scalarCount + i;
+        id value = [object valueForKey:schema->_fieldNames[field]];
+        if (value == nil) {
+            continue;
+        }
+        Class nestedClass = schema->_nestedClasses[i];
+        BOOL result = NO;
+        if (schema->_nestedIsArray[i].boolValue) {
+            if ([value isKindOfClass:NSArray.class]) {
+                DatabaseBinaryWriteTag(body, field, DatabaseBinaryWireArray);
+                result = [self writeArray:value elementClass:nestedClass into:body];
+            }
+        }else if ([value isKindOfClass:nestedClass]) {
+            DatabaseBinaryWriteTag(body, field, DatabaseBinaryWireObject);
+            result = [self writeObject:value into:body];
+        }
+        if (!result) {
+            NSLog(@"DatabaseBinaryCodec %@.%@ 的类型与声明不一致 ===== %@",NSStringFromClass(schema->_modelClass),schema->_fieldNames[field],value);
+            return NO;
+        }
+    }
+    _depth--;
+
+    DatabaseBinaryWriteVarint(data, body.length);
+    [data appendData:body];
+    return YES;
+}
+
+/** 写入一组对象：长度前缀，个数，每个对象
+ */
+- (BOOL)writeArray:(NSArray *)array elementClass:(Class)elementClass into:(NSMutableData *)data{
+    NSMutableData *body = [NSMutableData data];
+    DatabaseBinaryWriteVarint(body, array.count);
+    for (id object in array) {
+        if ((elementClass && ![object isKindOfClass:elementClass]) || ![self writeObject:object into:body]) {
+            return NO;
+        }
+    }
+    DatabaseBinaryWriteVarint(data, body.length);
+    [data appendData:body];
+    return YES;
+}
+
+/** 文件头、字符串表、类表在根对象之后才能确定，最后拼接
+ */
+- (NSData *)dataWithRootObject:(id)rootObject{
+    NSMutableData *root = [NSMutableData data];
+    BOOL isArray = [rootObject isKindOfClass:NSArray.class];
+    uint8_t type = isArray ? DatabaseBinaryWireArray : DatabaseBinaryWireObject;
+    [root appendBytes:&type length:1];
+    if (isArray) {
+        for (id object in rootObject) {
+            if ([object isKindOfClass:NSString.class] || [object isKindOfClass:NSNumber.class] || [object isKindOfClass:NSArray.class] || [object isKindOfClass:NSDictionary.class]) {
+                NSLog(@"DatabaseBinaryCodec 根数组的元素必须是模型 ===== %@",object);
+                return nil;
+            }
+        }
+        if (![self writeArray:rootObject elementClass:Nil into:root]) {
+            return nil;
+        }
+    }else if (![self writeObject:rootObject into:root]) {
+        return nil;
+    }
+
+    //类名与字段名同样保存在字符串表中
+    NSMutableData *classTable = [NSMutableData data];
+    DatabaseBinaryWriteVarint(classTable, _classes.count);
+    for (DatabaseBinaryClassSchema *schema in _classes) {
+        DatabaseBinaryWriteVarint(classTable, [self indexForString:NSStringFromClass(schema->_modelClass)]);
+        DatabaseBinaryWriteVarint(classTable, schema->_fieldNames.count);
+        for (NSString *name in schema->_fieldNames) {
+            DatabaseBinaryWriteVarint(classTable, [self indexForString:name]);
+        }
+    }
+
+    NSMutableData *data = [NSMutableData dataWithCapacity:root.length + classTable.length + _strings.count * 8 + 16];
+    [data appendBytes:DatabaseBinaryMagic length:sizeof(DatabaseBinaryMagic)];
+    DatabaseBinaryWriteVarint(data, _strings.count);
+    for (NSString *string in _strings) {
+        NSUInteger length = [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+        DatabaseBinaryWriteVarint(data, length);
+        [data appendBytes:string.UTF8String length:length];
+    }
+    [data appendData:classTable];
+    [data appendData:root];
+    return data;
+}
+
+@end
+
+
+#pragma mark - 解码
+
+@class DatabaseBinaryLazyArray;
+
+/** 一份数据的解码状态：字符串表、类表与按需创建的字符串；所有解码在 _lock 中进行
+ */
+@interface DatabaseBinaryReader : NSObject
+{
+    @public
+    os_unfair_lock _lock;
+    NSData *_data;
+    const uint8_t *_bytes;
+    NSUInteger _stringCount;
+    uint32_t *_stringOffsets;
+    uint32_t *_stringLengths;
+    __strong NSString **_strings;//按需创建
+    NSArray *_classes;//文件中的类 -> DatabaseBinaryClassSchema，本地不存在的类为 NSNull
+    NSArray<NSData *> *_fieldMaps;//文件中的类 -> 文件中的字段下标对应的本地字段下标（int32_t，-1 为本地不存在的字段）
+    NSArray<NSNumber *> *_fieldCounts;
+    DatabaseBinaryCursor _root;
+}
+@end
+
+/** 按需解码的数组：第一次访问时记录每个元素的位置，元素在第一次访问时解码并缓存
+ */
+@interface DatabaseBinaryLazyArray : NSArray
+{
+    DatabaseBinaryReader *_reader;
+    DatabaseBinaryCursor _range;//个数之后的所有元素
+    NSUInteger _count;
+    const uint8_t **_offsets;
+    __strong id *_objects;
+}
+- (instancetype)initWithReader:(DatabaseBinaryReader *)reader range:(DatabaseBinaryCursor)range count:(NSUInteger)count;
+@end
+
+@implementation DatabaseBinaryReader
+
+- (instancetype)initWithData:(NSData *)data{
+    self = [super init];
+    if (self) {
+        _lock = OS_UNFAIR_LOCK_INIT;
+        _data = [data copy];
+        _bytes = _data.bytes;
+        if (![self parseHeader]) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc{
+    for (NSUInteger i = 0; i < _stringCount && _strings; i++) {
+        _strings[i] = nil;
+    }
+    free(_strings);
+    free(_stringOffsets);
+    free(_stringLengths);
+}
+
+- (BOOL)parseHeader{
+    DatabaseBinaryCursor cursor = {_bytes, _bytes + _data.length};
+    if (_data.length < sizeof(DatabaseBinaryMagic) || memcmp(_bytes, DatabaseBinaryMagic, sizeof(DatabaseBinaryMagic)) != 0) {
+        return NO;
+    }
+    cursor.p += sizeof(DatabaseBinaryMagic);
+
+    //字符串表：只记录位置
+    uint64_t count;
+    if (!DatabaseBinaryReadVarint(&cursor, &count) || count > (uint64_t)(cursor.end - cursor.p)) {
+        return NO;
+    }
+    _stringCount = (NSUInteger)count;
+    _stringOffsets = calloc(MAX(_stringCount, 1), sizeof(uint32_t));
+    _stringLengths = calloc(MAX(_stringCount, 1), sizeof(uint32_t));
+    _strings = (__strong NSString **)calloc(MAX(_stringCount, 1), sizeof(id));
+    for (NSUInteger i = 0; i < _stringCount; i++) {
+        DatabaseBinaryCursor range;
+        if (!DatabaseBinaryReadLength(&cursor, &range) || range.end - _bytes > UINT32_MAX) {
+            return NO;
+        }
+        _stringOffsets[i] = (uint32_t)(range.p - _bytes);
+        _stringLengths[i] = (uint32_t)(range.end - range.p);
+    }
+
+    //类表：按类名、字段名与本地的类对应
+    if (!DatabaseBinaryReadVarint(&cursor, &count) || count > (uint64_t)(cursor.end - cursor.p)) {
+        return NO;
+    }
+    NSMutableArray *classes = [NSMutableArray arrayWithCapacity:(NSUInteger)count];
+    NSMutableArray<NSData *> *fieldMaps = [NSMutableArray arrayWithCapacity:(NSUInteger)count];
+    NSMutableArray<NSNumber *> *fieldCounts = [NSMutableArray arrayWithCapacity:(NSUInteger)count];
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t nameIndex, fieldCount;
+        if (!DatabaseBinaryReadVarint(&cursor, &nameIndex) || nameIndex >= _stringCount ||
+            !DatabaseBinaryReadVarint(&cursor, &fieldCount) || fieldCount > (uint64_t)(cursor.end - cursor.p)) {
+            return NO;
+        }
+        Class modelClass = NSClassFromString([self stringAtIndex:(NSUInteger)nameIndex]);
+        DatabaseBinaryClassSchema *schema = modelClass ? [DatabaseBinaryClassSchema schemaForClass:modelClass] : nil;
+        NSMutableData *fieldMap = [NSMutableData dataWithLength:(NSUInteger)fieldCount * sizeof(int32_t)];
+        int32_t *fields = fieldMap.mutableBytes;
+        for (uint64_t j = 0; j < fieldCount; j++) {
+            uint64_t fieldNameIndex;
+            if (!DatabaseBinaryReadVarint(&cursor, &fieldNameIndex) || fieldNameIndex >= _stringCount) {
+                return NO;
+            }
+            NSUInteger local = schema ? [schema->_fieldNames indexOfObject:[self stringAtIndex:(NSUInteger)fieldNameIndex]] : NSNotFound;
+            fields[j] = local == NSNotFound ? -1 : (int32_t)local;
+        }
+        [classes addObject:schema ?: NSNull.null];
+        [fieldMaps addObject:fieldMap];
+        [fieldCounts addObject:@(fieldCount)];
+    }
+    _classes = [classes copy];
+    _fieldMaps = [fieldMaps copy];
+    _fieldCounts = [fieldCounts copy];
+
+    //根：类型与值；先检查整个区间，之后的按需解码不再检查边界
+    if (cursor.p >= cursor.end) {
+        return NO;
+    }
+    uint8_t type = *cursor.p++;
+    _root = cursor;
+    if (type == DatabaseBinaryWireObject) {
+        return [self validateObject:&cursor depth:0] && cursor.p == cursor.end;
+    }
+    if (type == DatabaseBinaryWireArray) {
+        return [self validateArray:&cursor depth:0] && cursor.p == cursor.end;
+    }
+    return NO;
+}
+
+- (NSString *)stringAtIndex:(NSUInteger)index{
+    NSString *string = _strings[index];
+    if (string == nil) {
+        string = [[NSString alloc] initWithBytes:_bytes + _stringOffsets[index] length:_stringLengths[index] encoding:NSUTF8StringEncoding] ?: @"";
+        _strings[index] = string;
+    }
+    return string;
+}
+
+#pragma mark 检查
+
+- (BOOL)validateObject:(DatabaseBinaryCursor *)cursor depth:(NSUInteger)depth{
+    DatabaseBinaryCursor body;
+    uint64_t classIndex;
+    if (depth > DatabaseBinaryMaxDepth || !DatabaseBinaryReadLength(cursor, &body) ||
+        !DatabaseBinaryReadVarint(&body, &classIndex) || classIndex >= _classes.count) {
+        return NO;
+    }
+    uint64_t fieldCount = _fieldCounts[(NSUInteger)classIndex].unsignedLongLongValue;
+    while (body.p < body.end) {
+        uint64_t tag, value;
+        double number;
+        DatabaseBinaryCursor range;
+        if (!DatabaseBinaryReadVarint(&body, &tag) || (tag >> 3) >= fieldCount) {
+            return NO;
+        }
+        BOOL valid = NO;
+        switch ((DatabaseBinaryWireType)(tag & 7)) {
+            case DatabaseBinaryWireVarint:
+            case DatabaseBinaryWireUnsigned: valid = DatabaseBinaryReadVarint(&body, &value); break;
+            case DatabaseBinaryWireDouble:
+            case DatabaseBinaryWireDate: valid = DatabaseBinaryReadDouble(&body, &number); break;
+            case DatabaseBinaryWireString: valid = DatabaseBinaryReadVarint(&body, &value) && value < _stringCount; break;
+            case DatabaseBinaryWireBytes: valid = DatabaseBinaryReadLength(&body, &range); break;
+            case DatabaseBinaryWireObject: valid = [self validateObject:&body depth:depth + 1]; break;
+            case DatabaseBinaryWireArray: valid = [self validateArray:&body depth:depth + 1]; break;
+        }
+        if (!valid) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+- (BOOL)validateArray:(DatabaseBinaryCursor *)cursor depth:(NSUInteger)depth{
+    DatabaseBinaryCursor body;
+    uint64_t count;
+    if (depth > DatabaseBinaryMaxDepth || !DatabaseBinaryReadLength(cursor, &body) || !DatabaseBinaryReadVarint(&body, &count)) {
+        return NO;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        if (![self validateObject:&body depth:depth + 1]) {
+            return NO;
+        }
+    }
+    return body.p == body.end;
+}
+
+#pragma mark 解码，在 _lock 中调用，数据已检查
+
+- (id)decodeArray:(DatabaseBinaryCursor *)cursor{
+    DatabaseBinaryCursor body;
+    uint64_t count;
+    DatabaseBinaryReadLength(cursor, &body);
+    DatabaseBinaryReadVarint(&body, &count);
+    return [[DatabaseBinaryLazyArray alloc] initWithReader:self range:body count:(NSUInteger)count];
+}
+
+/** 解码一个对象；本地不存在的类返回 nil
+ */
+- (id)decodeObject:(DatabaseBinaryCursor *)cursor{
+    DatabaseBinaryCursor body;
+    uint64_t classIndex;
+    DatabaseBinaryReadLength(cursor, &body);
+    DatabaseBinaryReadVarint(&body, &classIndex);
+    DatabaseBinaryClassSchema *schema = _classes[(NSUInteger)classIndex];
+    if ((id)schema == NSNull.null) {
+        return nil;
+    }
+    const int32_t *fields = _fieldMaps[(NSUInteger)classIndex].bytes;
+    id object = [[schema->_modelClass alloc] init];
+    while (body.p < body.end) {
+        uint64_t tag, integer;
+        double number;
+        DatabaseBinaryCursor range;
+        id value = nil;
+        DatabaseBinaryReadVarint(&body, &tag);
+        DatabaseBinaryWireType type = tag & 7;
+        switch (type) {
+            case DatabaseBinaryWireVarint:{
+                DatabaseBinaryReadVarint(&body, &integer);
+                value = @((int64_t)(integer >> 1) ^ -(int64_t)(integer & 1));
+            }break;
+            case DatabaseBinaryWireUnsigned:{
+                DatabaseBinaryReadVarint(&body, &integer);
+                value = @(integer);
+            }break;
+            case DatabaseBinaryWireDouble:{
+                DatabaseBinaryReadDouble(&body, &number);
+                value = @(number);
+            }break;
+            case DatabaseBinaryWireDate:{
+                DatabaseBinaryReadDouble(&body, &number);
+                value = [NSDate dateWithTimeIntervalSince1970:number];
+            }break;
+            case DatabaseBinaryWireString:{
+                DatabaseBinaryReadVarint(&body, &integer);
+                value = [self stringAtIndex:(NSUInteger)integer];
+            }break;
+            case DatabaseBinaryWireBytes:{
+                DatabaseBinaryReadLength(&body, &range);
+                value = [NSData dataWithBytes:range.p length:range.end - range.p];
+            }break;
+            case DatabaseBinaryWireObject:{
+                value = [self decodeObject:&body];
+            }break;
+            case DatabaseBinaryWireArray:{
+                value = [self decodeArray:&body];
+            }break;
+        }
+
+        int32_t field = fields[tag >> 3];
+        if (field < 0 || value == nil) {
+            continue;
+        }
+        if ((NSUInteger)field < schema->_scalarCount) {
+            [schema->_mapping setValue:value atIndex:(NSUInteger)field forModel:object];
+        }else{
+            //嵌套属性按声明的类型检查：数组与单个对象不一致时忽略
+            NSUInteger nested = (NSUInteger)field - schema->_scalarCount;
+            BOOL isArray = schema->_nestedIsArray[nested].boolValue;
+            if (isArray ? type == DatabaseBinaryWireArray : [value isKindOfClass:schema->_nestedClasses[nested]]) {
+                [object setValue:value forKey:schema->_fieldNames[field]];
+            }
+        }
+    }
+    return object;
+}
+
+- (id)rootObject{
+    os_unfair_lock_lock(&_lock);
+    DatabaseBinaryCursor cursor = _root;
+    id object = _root.p[-1] == DatabaseBinaryWireArray ? [self decodeArray:&cursor] : [self decodeObject:&cursor];
+    os_unfair_lock_unlock(&_lock);
+    return object;
+}
+
+@end
+
+
+@implementation DatabaseBinaryLazyArray
+
+- (instancetype)initWithReader:(DatabaseBinaryReader *)reader range:(DatabaseBinaryCursor)range count:(NSUInteger)count{
+    self = [super init];
+    if (self) {
+        _reader = reader;
+        _range = range;
+        _count = count;
+    }
+    return self;
+}
+
+- (void)dealloc{
+    for (NSUInteger i = 0; i < _count && _objects; i++) {
+        _objects[i] = nil;
+    }
+    free(_objects);
+    free(_offsets);
+}
+
+- (NSUInteger)count{
+    return _count;
+}
+
+- (id)objectAtIndex:(NSUInteger)index{
+    if (index >= _count) {
+        [NSException raise:NSRangeException format:@"*** -[%@ objectAtIndex:]: index %lu beyond bounds [0 .. %ld]",NSStringFromClass(self.class),(unsigned long)index,(long)_count - 1];
+    }
+    DatabaseBinaryReader *reader = _reader;
+    os_unfair_lock_lock(&reader->_lock);
+    if (_offsets == NULL) {
+        //每个元素带有长度前缀：只跳过，不解码
+        _offsets = calloc(_count, sizeof(const uint8_t *));
+        _objects = (__strong id *)calloc(_count, sizeof(id));
+        DatabaseBinaryCursor cursor = _range;
+        for (NSUInteger i = 0; i < _count; i++) {
+            DatabaseBinaryCursor body;
+            _offsets[i] = cursor.p;
+            DatabaseBinaryReadLength(&cursor, &body);
+        }
+    }
+    id object = _objects[index];
+    if (object == nil) {
+        DatabaseBinaryCursor cursor = {_offsets[index], _range.end};
+        object = [reader decodeObject:&cursor] ?: NSNull.null;
+        _objects[index] = object;
+    }
+    os_unfair_lock_unlock(&reader->_lock);
+    return object;
+}
+
+/** 不可变：复制时返回自身，不解码所有元素
+ */
+- (id)copyWithZone:(NSZone *)zone{
+    return self;
+}
+
+@end
+
+
+@implementation DatabaseBinaryCodec
+
++ (NSData *)dataWithRootObject:(id)rootObject{
+    if (rootObject == nil) {
+        return nil;
+    }
+    return [[[DatabaseBinaryEncoder alloc] init] dataWithRootObject:rootObject];
+}
+
++ (id)rootObjectWithData:(NSData *)data{
+    DatabaseBinaryReader *reader = data.length ? [[DatabaseBinaryReader alloc] initWithData:data] : nil;
+    if (reader == nil) {
+        NSLog(@"DatabaseBinaryCodec 数据不完整或格式不正确 ===== %lu bytes",(unsigned long)data.length);
+        return nil;
+    }
+    return [reader rootObject];
+}
+
++ (BOOL)writeRootObject:(id)rootObject toFile:(NSString *)path{
+    NSData *data = [self dataWithRootObject:rootObject];
+    NSError *error = nil;
+    if (data == nil || ![data writeToFile:path options:NSDataWritingAtomic error:&error]) {
+        NSLog(@"DatabaseBinaryCodec 写入失败 ===== %@",error ?: path);
+        return NO;
+    }
+    return YES;
+}
+
++ (id)rootObjectWithContentsOfFile:(NSString *)path{
+    NSError *error = nil;
+    NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:&error];
+    if (data == nil) {
+        NSLog(@"DatabaseBinaryCodec 读取失败 ===== %@",error);
+        return nil;
+    }
+    return [self rootObjectWithData:data];
+}
+
+@end
@@ -0,0 +1,105 @@
+//
+//  DatabaseChangeTracker.h
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/6/4.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** 一个事务提交的所有修改：同一行的多次修改已合并
+ *  插入后更新 -> 插入；插入后删除 -> 不出现；更新后删除 -> 删除；删除后以同一 rowid 插入 -> 更新
+ *
+ * REPLACE 因唯一键冲突删除的旧行不经过 update_hook，不会出现在 deleted 中：按唯一键维护数据的观察者应以 inserted 中的行替换同一唯一键的旧行
+ */
+@interface DatabaseChangeSet : NSObject
+
+/** 数据库文件的名称
+ */
+@property (nonatomic, copy, readonly) NSString *storeName;
+
+/** 有修改的表，包括整表变化的表
+ */
+@property (nonatomic, copy, readonly) NSSet<NSString *> *tableNames;
+
+/** 所有表都可能变化（清空数据库）：无法给出修改的行，观察者应重新读取
+ */
+@property (nonatomic, assign, readonly) BOOL resetsAllTables;
+
+/** 表中所有的行都可能变化（不带条件的 DELETE、清空表）：无法给出修改的行，观察者应重新读取该表
+ */
+- (BOOL)isResetTable:(NSString *)tableName;
+
+/** 该表是否有修改
+ */
+- (BOOL)containsTable:(NSString *)tableName;
+
+/** 该表中插入、更新、删除的行的 rowid；没有时为空集合
+ */
+- (NSSet<NSNumber *> *)insertedRowidsInTable:(NSString *)tableName;
+- (NSSet<NSNumber *> *)updatedRowidsInTable:(NSString *)tableName;
+- (NSSet<NSNumber *> *)deletedRowidsInTable:(NSString *)tableName;
+
+@end
+
+
+/** 一个观察者：需要主动调用 -invalidate 移除，释放这个对象不会移除观察者
+ */
+@interface DatabaseChangeObservation : NSObject
+
+/** 组合多个观察者：-invalidate 时依次移除
+ */
+- (instancetype)initWithChildren:(NSArray<DatabaseChangeObservation *> *)children NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+/** 移除观察者：之后不再回调；已经提交到队列中的回调仍会执行
+ */
+- (void)invalidate;
+
+@end
+
+
+/** 记录写连接每个事务修改的行，提交之后将合并的修改发布给观察者，回滚时丢弃
+ *
+ * 写连接的 update_hook 记录每一行的修改（没有观察者时不记录）；
+ * rollback_hook 丢弃当前事务的记录；保存点回滚（ROLLBACK TO）不会调用 rollback_hook，由调用方通过 -savepointMark 与 -rollbackToSavepointMark: 丢弃；
+ * 提交之后（WAL 回调，新数据已对只读连接可见）合并同一行的多次修改，每个事务只发布一次
+ *
+ * 以 rowDidChange、savepoint、transactionDid 开头的方法只在写连接的线程中调用，由 DatabaseStore 设置
+ */
+@interface DatabaseChangeTracker : NSObject
+
+- (instancetype)initWithStoreName:(NSString *)storeName NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (nonatomic, copy, readonly) NSString *storeName;
+
+/** 添加观察者
+ * @param tableNames 只在这些表有修改时回调；nil 为所有的表。清空数据库时总是回调
+ * @param queue 回调所在的队列，nil 为主队列
+ */
+- (DatabaseChangeObservation *)addObserverForTables:(nullable NSSet<NSString *> *)tableNames queue:(nullable dispatch_queue_t)queue block:(void (^)(DatabaseChangeSet *changes))block;
+
+/** 写连接的回调
+ * @param operation SQLITE_INSERT、SQLITE_UPDATE 或 SQLITE_DELETE
+ */
+- (void)rowDidChangeInTable:(NSString *)tableName rowid:(int64_t)rowid operation:(int)operation;
+- (void)transactionDidCommit;
+- (void)transactionDidRollback;
+
+/** 保存点：开始保存点之前获取标记，回滚到保存点之后丢弃标记之后的记录
+ */
+- (NSUInteger)savepointMark;
+- (void)rollbackToSavepointMark:(NSUInteger)mark;
+
+/** 发布不经过 update_hook 的整表变化，立即发布
+ * @param tableNames nil 表示所有的表
+ */
+- (void)publishResetTables:(nullable NSSet<NSString *> *)tableNames;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,314 @@
+//
+//  DatabaseChangeTracker.m
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/6/4.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import "DatabaseChangeTracker.h"
+#import <sqlite3.h>
+#import <stdatomic.h>
+
+/** 一张表合并后的修改
+ */
+@interface DatabaseTableChanges : NSObject
+{
+    @public
+    NSMutableSet<NSNumber *> *_inserted;
+    NSMutableSet<NSNumber *> *_updated;
+    NSMutableSet<NSNumber *> *_deleted;
+    BOOL _reset;
+}
+@end
+
+@implementation DatabaseTableChanges
+
+- (instancetype)init{
+    self = [super init];
+    if (self) {
+        _inserted = [NSMutableSet set];
+        _updated = [NSMutableSet set];
+        _deleted = [NSMutableSet set];
+    }
+    return self;
+}
+
+@end
+
+
+@interface DatabaseChangeSet ()
+{
+    NSDictionary<NSString *, DatabaseTableChanges *> *_tables;
+}
+@end
+
+@implementation DatabaseChangeSet
+
+- (instancetype)initWithStoreName:(NSString *)storeName tables:(NSDictionary<NSString *, DatabaseTableChanges *> *)tables resetsAllTables:(BOOL)resetsAllTables{
+    self = [super init];
+    if (self) {
+        _storeName = [storeName copy];
+        _tables = [tables copy];
+        _tableNames = [NSSet setWithArray:tables.allKeys];
+        _resetsAllTables = resetsAllTables;
+    }
+    return self;
+}
+
+- (NSString *)description{
+    NSMutableString *string = [NSMutableString stringWithFormat:@"<%@: %p> %@",NSStringFromClass(self.class),self,self.storeName];
+    if (self.resetsAllTables) {
+        [string appendString:@" reset all tables"];
+    }
+    [_tables enumerateKeysAndObjectsUsingBlock:^(NSString *name, DatabaseTableChanges *changes, BOOL *stop) {
+        if (changes->_reset) {
+            [string appendFormat:@"\n  %@ reset",name];
+        }else{
+            [string appendFormat:@"\n  %@ inserted:%lu updated:%lu deleted:%lu",name,(unsigned long)changes->_inserted.count,(unsigned long)changes->_updated.count,(unsigned long)changes->_deleted.count];
+        }
+    }];
+    return string;
+}
+
+- (BOOL)isResetTable:(NSString *)tableName{
+    DatabaseTableChanges *changes = _tables[tableName];
+    return self.resetsAllTables || (changes && changes->_reset);
+}
+
+- (BOOL)containsTable:(NSString *)tableName{
+    return self.resetsAllTables || _tables[tableName] != nil;
+}
+
+- (NSSet<NSNumber *> *)insertedRowidsInTable:(NSString *)tableName{
+    DatabaseTableChanges *changes = _tables[tableName];
+    return changes ? [changes->_inserted copy] : [NSSet set];
+}
+
+- (NSSet<NSNumber *> *)updatedRowidsInTable:(NSString *)tableName{
+    DatabaseTableChanges *changes = _tables[tableName];
+    return changes ? [changes->_updated copy] : [NSSet set];
+}
+
+- (NSSet<NSNumber *> *)deletedRowidsInTable:(NSString *)tableName{
+    DatabaseTableChanges *changes = _tables[tableName];
+    return changes ? [changes->_deleted copy] : [NSSet set];
+}
+
+@end
+
+
+@interface DatabaseChangeObservation ()
+{
+    @public
+    __weak DatabaseChangeTracker *_tracker;
+    NSSet<NSString *> *_tableNames;
+    dispatch_queue_t _queue;
+    void (^_block)(DatabaseChangeSet *changes);
+    NSArray<DatabaseChangeObservation *> *_children;//DatabaseManagement 按数据库文件分组注册时，每个文件一个
+}
+@end
+
+@interface DatabaseChangeTracker ()
+- (void)removeObserver:(DatabaseChangeObservation *)observer;
+@end
+
+@implementation DatabaseChangeObservation
+
+- (instancetype)initWithChildren:(NSArray<DatabaseChangeObservation *> *)children{
+    self = [super init];
+    if (self) {
+        _children = [children copy];
+    }
+    return self;
+}
+
+- (void)invalidate{
+    for (DatabaseChangeObservation *child in _children) {
+        [child invalidate];
+    }
+    [_tracker removeObserver:self];
+}
+
+@end
+
+
+/** 一条修改记录
+ */
+typedef struct {
+    uint32_t tableIndex;//_logTableNames 中的下标
+    int32_t operation;
+    int64_t rowid;
+} DatabaseChangeRecord;
+
+@interface DatabaseChangeTracker ()
+{
+    NSArray<DatabaseChangeObservation *> *_observers;//写时复制；只在 @synchronized (self) 中修改
+    atomic_bool _hasObservers;//记录修改之前检查，只需一次原子读取
+
+    //以下只在写连接的线程中访问
+    NSMutableData *_log;//当前事务的 DatabaseChangeRecord
+    NSMutableArray<NSString *> *_logTableNames;
+    NSMutableDictionary<NSString *, NSNumber *> *_logTableIndexes;
+}
+@end
+
+@implementation DatabaseChangeTracker
+
+- (instancetype)initWithStoreName:(NSString *)storeName{
+    self = [super init];
+    if (self) {
+        _storeName = [storeName copy];
+        _observers = @[];
+        atomic_init(&_hasObservers, false);
+        _log = [NSMutableData data];
+        _logTableNames = [NSMutableArray array];
+        _logTableIndexes = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+#pragma mark - 观察者
+
+- (DatabaseChangeObservation *)addObserverForTables:(NSSet<NSString *> *)tableNames queue:(dispatch_queue_t)queue block:(void (^)(DatabaseChangeSet *changes))block{
+    DatabaseChangeObservation *observer = [[DatabaseChangeObservation alloc] initWithChildren:@[]];
+    observer->_tracker = self;
+    observer->_tableNames = [tableNames copy];
+    observer->_queue = queue ?: dispatch_get_main_queue();
+    observer->_block = [block copy];
+    @synchronized (self) {
+        _observers = [_observers arrayByAddingObject:observer];
+        atomic_store(&_hasObservers, true);
+    }
+    return observer;
+}
+
+- (void)removeObserver:(DatabaseChangeObservation *)observer{
+    @synchronized (self) {
+        NSMutableArray *observers = [_observers mutableCopy];
+        [observers removeObjectIdenticalTo:observer];
+        _observers = [observers copy];
+        atomic_store(&_hasObservers, _observers.count > 0);
+    }
+}
+
+- (void)publishChangeSet:(DatabaseChangeSet *)changeSet{
+    NSArray<DatabaseChangeObservation *> *observers;
+    @synchronized (self) {
+        observers = _observers;
+    }
+    for (DatabaseChangeObservation *observer in observers) {
+        if (observer->_tableNames && !changeSet.resetsAllTables && ![observer->_tableNames intersectsSet:changeSet.tableNames]) {
+            continue;
+        }
+        void (^block)(DatabaseChangeSet *) = observer->_block;
+        dispatch_async(observer->_queue, ^{
+            block(changeSet);
+        });
+    }
+}
+
+- (void)publishResetTables:(NSSet<NSString *> *)tableNames{
+    if (!atomic_load(&_hasObservers)) {
+        return;
+    }
+    NSMutableDictionary<NSString *, DatabaseTableChanges *> *tables = [NSMutableDictionary dictionary];
+    for (NSString *name in tableNames) {
+        DatabaseTableChanges *changes = [[DatabaseTableChanges alloc] init];
+        changes->_reset = YES;
+        tables[name] = changes;
+    }
+    [self publishChangeSet:[[DatabaseChangeSet alloc] initWithStoreName:self.storeName tables:tables resetsAllTables:tableNames == nil]];
+}
+
+#pragma mark - 写连接的回调
+
+- (void)rowDidChangeInTable:(NSString *)tableName rowid:(int64_t)rowid operation:(int)operation{
+    if (!atomic_load(&_hasObservers)) {
+        return;
+    }
+    NSNumber *index = _logTableIndexes[tableName];
+    if (index == nil) {
+        index = @(_logTableNames.count);
+        _logTableIndexes[tableName] = index;
+        [_logTableNames addObject:tableName];
+    }
+    DatabaseChangeRecord record = {index.unsignedIntValue, operation, rowid};
+    [_log appendBytes:&record length:sizeof(record)];
+}
+
+- (NSUInteger)savepointMark{
+    return _log.length;
+}
+
+- (void)rollbackToSavepointMark:(NSUInteger)mark{
+    if (mark < _log.length) {
+        _log.length = mark;
+    }
+}
+
+- (void)clearLog{
+    _log.length = 0;
+    [_logTableNames removeAllObjects];
+    [_logTableIndexes removeAllObjects];
+}
+
+- (void)transactionDidRollback{
+    [self clearLog];
+}
+
+- (void)transactionDidCommit{
+    NSUInteger count = _log.length / sizeof(DatabaseChangeRecord);
+    if (count == 0) {
+        [self clearLog];
+        return;
+    }
+
+    //按顺序合并同一行的多次修改
+    const DatabaseChangeRecord *records = _log.bytes;
+    NSMutableArray<DatabaseTableChanges *> *tableChanges = [NSMutableArray arrayWithCapacity:_logTableNames.count];
+    for (NSUInteger i = 0; i < _logTableNames.count; i++) {
+        [tableChanges addObject:[[DatabaseTableChanges alloc] init]];
+    }
+    for (NSUInteger i = 0; i < count; i++) {
+        DatabaseTableChanges *changes = tableChanges[records[i].tableIndex];
+        NSNumber *rowid = @(records[i].rowid);
+        switch (records[i].operation) {
+            case SQLITE_INSERT:{
+                if ([changes->_deleted containsObject:rowid]) {
+                    [changes->_deleted removeObject:rowid];
+                    [changes->_updated addObject:rowid];
+                }else{
+                    [changes->_inserted addObject:rowid];
+                }
+            }break;
+            case SQLITE_UPDATE:{
+                if (![changes->_inserted containsObject:rowid]) {
+                    [changes->_updated addObject:rowid];
+                }
+            }break;
+            case SQLITE_DELETE:{
+                if ([changes->_inserted containsObject:rowid]) {
+                    [changes->_inserted removeObject:rowid];
+                }else{
+                    [changes->_updated removeObject:rowid];
+                    [changes->_deleted addObject:rowid];
+                }
+            }break;
+        }
+    }
+
+    NSMutableDictionary<NSString *, DatabaseTableChanges *> *tables = [NSMutableDictionary dictionaryWithCapacity:_logTableNames.count];
+    [_logTableNames enumerateObjectsUsingBlock:^(NSString *name, NSUInteger idx, BOOL *stop) {
+        DatabaseTableChanges *changes = tableChanges[idx];
+        if (changes->_inserted.count || changes->_updated.count || changes->_deleted.count) {
+            tables[name] = changes;
+        }
+    }];
+    [self clearLog];
+    if (tables.count) {
+        [self publishChangeSet:[[DatabaseChangeSet alloc] initWithStoreName:self.storeName tables:tables resetsAllTables:NO]];
+    }
+}
+
+@end
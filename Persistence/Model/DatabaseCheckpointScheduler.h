@@ -0,0 +1,81 @@
+//
+//  DatabaseCheckpointScheduler.h
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/22.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "DatabaseScheduler.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** 一次检查点的执行结果
+ */
+@interface DatabaseCheckpointReport : NSObject
+@property (nonatomic, assign) FMDBCheckpointMode mode;//检查点类型
+@property (nonatomic, assign) BOOL success;//是否执行成功
+@property (nonatomic, assign) NSTimeInterval duration;//耗时（秒）
+@property (nonatomic, assign) int walPageCount;//执行前 WAL 回调记录的总帧数
+@property (nonatomic, assign) int logFrameCount;//执行时 WAL 文件中的总帧数
+@property (nonatomic, assign) int checkpointCount;//已写回数据库文件的帧数
+@end
+
+/** WAL 检查点调度器
+ *
+ * 在写连接上设置 WAL 回调（同时关闭 SQLite 的自动检查点，提交事务时不再被检查点拖慢），记录 WAL 文件的帧数；
+ * 检查点在维护通道中、使用单独的连接执行，不占用写连接：
+ *  帧数达到 passivePageCount 且写连接空闲 idleInterval 之后，执行 PASSIVE 检查点，不等待读写操作；
+ *  帧数达到 restartPageCount，或者连续多次 PASSIVE 检查点因读操作未能写回所有帧，执行 RESTART 检查点，之后的写操作从 WAL 文件头部开始；
+ *  帧数达到 truncatePageCount，执行 TRUNCATE 检查点，并将 WAL 文件截断为 0 字节；
+ *  达到 restartPageCount 之后不再等待空闲，避免持续写入时 WAL 文件无限增长
+ */
+@interface DatabaseCheckpointScheduler : NSObject
+
+/** @param writeQueue 写连接，在其上设置 WAL 回调
+ *  @param checkpointQueue 执行检查点的连接，需要可读写
+ *  @param scheduler 在其维护通道中执行检查点
+ */
+- (instancetype)initWithWriteQueue:(FMDatabaseQueue *)writeQueue
+                   checkpointQueue:(FMDatabaseQueue *)checkpointQueue
+                         scheduler:(DatabaseScheduler *)scheduler NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+/** 写连接空闲多久之后执行 PASSIVE 检查点，默认 0.5 秒
+ */
+@property (atomic, assign) NSTimeInterval idleInterval;
+
+/** 执行 PASSIVE 检查点的帧数，默认 1000（与 SQLite 默认的自动检查点一致）
+ */
+@property (atomic, assign) int passivePageCount;
+
+/** 执行 RESTART 检查点的帧数，默认 4000
+ */
+@property (atomic, assign) int restartPageCount;
+
+/** 执行 TRUNCATE 检查点的帧数，默认 10000
+ */
+@property (atomic, assign) int truncatePageCount;
+
+/** 每次检查点执行完毕后回调，在分线程中调用
+ */
+@property (atomic, copy, nullable) void (^reportHandler)(DatabaseCheckpointReport *report);
+
+/** 写连接的事务提交之后回调：在 WAL 回调中同步调用，此时新数据已对其它连接可见
+ * 在写连接的线程中调用，不能执行耗时操作，也不能访问写连接
+ */
+@property (atomic, copy, nullable) void (^commitHandler)(void);
+
+/** 最近一次检查点的执行结果
+ */
+@property (atomic, strong, readonly, nullable) DatabaseCheckpointReport *lastReport;
+
+/** 立即在维护通道中执行一次检查点；已有检查点在执行时忽略本次调用
+ * @note 检查点不受 DatabaseScheduler 的 -cancelAllOperations 影响
+ */
+- (void)checkpointWithMode:(FMDBCheckpointMode)mode;
+
+@end
+
+NS_ASSUME_NONNULL_END
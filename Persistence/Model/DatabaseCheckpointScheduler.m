@@ -0,0 +1,168 @@
+//
+//  DatabaseCheckpointScheduler.m
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/22.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import "DatabaseCheckpointScheduler.h"
+
+/** 连续多少次 PASSIVE 检查点未能写回所有帧之后，升级为 RESTART 检查点
+ */
+static NSUInteger const DatabaseCheckpointMaxIncompletePassive = 3;
+
+@implementation DatabaseCheckpointReport
+
+- (NSString *)description{
+    NSArray<NSString *> *modeNames = @[@"PASSIVE",@"FULL",@"RESTART",@"TRUNCATE"];
+    return [NSString stringWithFormat:@"checkpoint %@ success:%d duration:%.4fs walPageCount:%d logFrameCount:%d checkpointCount:%d",modeNames[self.mode],self.success,self.duration,self.walPageCount,self.logFrameCount,self.checkpointCount];
+}
+
+@end
+
+@interface DatabaseCheckpointScheduler ()
+{
+    dispatch_queue_t _stateQueue;//串行队列，保护下面的状态
+    int _walPageCount;//最近一次提交后 WAL 文件中的帧数
+    CFAbsoluteTime _lastCommitTime;//最近一次提交的时间
+    BOOL _isIdleCheckScheduled;//是否已安排空闲检查
+    BOOL _isCheckpointing;//是否有检查点正在执行
+    NSUInteger _incompletePassiveCount;//连续未能写回所有帧的 PASSIVE 检查点次数
+}
+@property (nonatomic, strong) FMDatabaseQueue *checkpointQueue;
+@property (nonatomic, weak) DatabaseScheduler *scheduler;
+@property (atomic, strong, readwrite) DatabaseCheckpointReport *lastReport;
+@end
+
+@implementation DatabaseCheckpointScheduler
+
+- (instancetype)initWithWriteQueue:(FMDatabaseQueue *)writeQueue checkpointQueue:(FMDatabaseQueue *)checkpointQueue scheduler:(DatabaseScheduler *)scheduler{
+    self = [super init];
+    if (self) {
+        _checkpointQueue = checkpointQueue;
+        _scheduler = scheduler;
+        _idleInterval = 0.5;
+        _passivePageCount = 1000;
+        _restartPageCount = 4000;
+        _truncatePageCount = 10000;
+        _stateQueue = dispatch_queue_create("com.persistence.checkpoint", DISPATCH_QUEUE_SERIAL);
+
+        //WAL 回调在写连接提交事务后调用，只记录帧数，不做耗时操作
+        __weak typeof(self) weakSelf = self;
+        [writeQueue inDatabase:^(FMDatabase *db) {
+            [db setWalHook:^(NSString *databaseName, int pageCount) {
+                [weakSelf walDidCommitWithPageCount:pageCount];
+            }];
+        }];
+    }
+    return self;
+}
+
+- (void)walDidCommitWithPageCount:(int)pageCount{
+    void (^commitHandler)(void) = self.commitHandler;
+    if (commitHandler) {
+        commitHandler();
+    }
+    CFAbsoluteTime commitTime = CFAbsoluteTimeGetCurrent();
+    dispatch_async(_stateQueue, ^{
+        self->_walPageCount = pageCount;
+        self->_lastCommitTime = commitTime;
+        [self evaluateCheckpoint];
+    });
+}
+
+/** 根据 WAL 帧数选择检查点类型
+ * @return 不需要执行检查点时返回 NO
+ * @note 只在 _stateQueue 中调用
+ */
+- (BOOL)checkpointMode:(FMDBCheckpointMode *)mode{
+    if (_walPageCount >= self.truncatePageCount) {
+        *mode = FMDBCheckpointModeTruncate;
+    }else if (_walPageCount >= self.restartPageCount ||
+              (_walPageCount >= self.passivePageCount && _incompletePassiveCount >= DatabaseCheckpointMaxIncompletePassive)) {
+        *mode = FMDBCheckpointModeRestart;
+    }else if (_walPageCount >= self.passivePageCount) {
+        *mode = FMDBCheckpointModePassive;
+    }else{
+        return NO;
+    }
+    return YES;
+}
+
+/** PASSIVE 检查点等待写连接空闲；帧数更多时立即执行
+ * @note 只在 _stateQueue 中调用
+ */
+- (void)evaluateCheckpoint{
+    FMDBCheckpointMode mode;
+    if (_isCheckpointing || ![self checkpointMode:&mode]) {
+        return;
+    }
+    if (mode == FMDBCheckpointModePassive) {
+        NSTimeInterval idleTime = CFAbsoluteTimeGetCurrent() - _lastCommitTime;
+        if (idleTime < self.idleInterval) {
+            if (!_isIdleCheckScheduled) {
+                _isIdleCheckScheduled = YES;
+                dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)((self.idleInterval - idleTime) * NSEC_PER_SEC)), _stateQueue, ^{
+                    self->_isIdleCheckScheduled = NO;
+                    [self evaluateCheckpoint];
+                });
+            }
+            return;
+        }
+    }
+    [self runCheckpointWithMode:mode];
+}
+
+- (void)checkpointWithMode:(FMDBCheckpointMode)mode{
+    dispatch_async(_stateQueue, ^{
+        if (!self->_isCheckpointing) {
+            [self runCheckpointWithMode:mode];
+        }
+    });
+}
+
+/** 在维护通道中执行检查点
+ * @note 只在 _stateQueue 中调用；直接使用维护通道的任务队列，不登记取消令牌，保证 _isCheckpointing 一定会被复位
+ */
+- (void)runCheckpointWithMode:(FMDBCheckpointMode)mode{
+    _isCheckpointing = YES;
+    int walPageCount = _walPageCount;
+    [[self.scheduler operationQueueForLane:DatabaseLaneMaintenance] addOperationWithBlock:^{
+        DatabaseCheckpointReport *report = [[DatabaseCheckpointReport alloc] init];
+        report.mode = mode;
+        report.walPageCount = walPageCount;
+
+        int logFrameCount = -1;
+        int checkpointCount = -1;
+        NSError *error = nil;
+        CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+        report.success = [self.checkpointQueue checkpoint:mode name:nil logFrameCount:&logFrameCount checkpointCount:&checkpointCount error:&error];
+        report.duration = CFAbsoluteTimeGetCurrent() - startTime;
+        report.logFrameCount = logFrameCount;
+        report.checkpointCount = checkpointCount;
+        if (!report.success) {
+            NSLog(@"checkpoint error ===== %@",error);
+        }
+
+        dispatch_async(self->_stateQueue, ^{
+            self->_isCheckpointing = NO;
+            BOOL complete = report.success && checkpointCount >= logFrameCount;
+            if (mode == FMDBCheckpointModePassive) {
+                self->_incompletePassiveCount = complete ? 0 : self->_incompletePassiveCount + 1;
+            }else if (complete) {
+                //RESTART、TRUNCATE 之后，下一次写操作从 WAL 文件头部开始
+                self->_incompletePassiveCount = 0;
+                self->_walPageCount = 0;
+            }
+        });
+
+        self.lastReport = report;
+        void (^reportHandler)(DatabaseCheckpointReport *report) = self.reportHandler;
+        if (reportHandler) {
+            reportHandler(report);
+        }
+    }];
+}
+
+@end
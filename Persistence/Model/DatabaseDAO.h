@@ -0,0 +1,114 @@
+//
+//  DatabaseDAO.h
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/27.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "DatabaseModelMapping.h"
+
+@class DatabaseStore;
+@class DatabaseCancellationToken;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** 一组按唯一键插入或更新的统计
+ */
+@interface DatabaseUpsertCounts : NSObject
+@property (nonatomic, assign, readonly) NSUInteger insertedCount;
+@property (nonatomic, assign, readonly) NSUInteger updatedCount;
+@property (nonatomic, assign, readonly) NSUInteger unchangedCount;
+@property (nonatomic, assign, readonly) NSUInteger failedCount;
+@end
+
+
+/** 通用的数据访问：SQL 与绑定、读取计划来自模型类的 DatabaseModelMapping，表所在的数据库文件由 DatabaseManagement 分配
+ *
+ * 查询在交互通道中执行，结果在主线程回调；
+ * 单个写操作通过合并写入提交；一组写操作在后台通道中分批执行，每批一个事务，重复使用同一条缓存的预编译语句；
+ * 一组模型必须属于同一个类
+ */
+@interface DatabaseDAO : NSObject
+
+/** 模型类的表所在的数据库文件
+ */
++ (DatabaseStore *)storeForClass:(Class)modelClass;
+
+/** 查询：clause 为 nil 时查询所有行，否则为 WHERE 之后的条件
+ */
++ (DatabaseCancellationToken *)getModelsOfClass:(Class)modelClass where:(nullable NSString *)clause arguments:(nullable NSArray *)arguments completionBlock:(void(^)(NSArray *models))block;
+
+/** 根据某一列的值查询：key 可以是属性名或列名，不是映射的列时回调空数组；extraClause 以 AND 追加在条件之后
+ */
++ (DatabaseCancellationToken *)getModelsOfClass:(Class)modelClass key:(NSString *)key value:(nullable id)value extraClause:(nullable NSString *)extraClause completionBlock:(void(^)(NSArray *models))block;
+
+/** 按唯一键读取一行：先查找数据库文件的行缓存（DatabaseStore 的 rowCache），未命中时查询并写入缓存
+ * 在调用方所在的数据库任务中同步执行；返回的模型可能被多个调用方共享，不能修改；
+ * 开启修改记录（databaseTracksChanges）的类返回缓存中模型的副本，可以修改之后调用 +updateModel:
+ */
++ (nullable id)modelOfClass:(Class)modelClass uniqueValue:(nullable id)value inDatabase:(FMDatabase *)database;
+
+/** 同上，extraClause 以 AND 追加在未命中时的查询条件之后；已缓存的模型不再检查这个条件（例如有效期：过期的行由清理任务删除时才失效）
+ */
++ (nullable id)modelOfClass:(Class)modelClass uniqueValue:(nullable id)value extraClause:(nullable NSString *)extraClause inDatabase:(FMDatabase *)database;
+
+/** 同上，在交互通道中执行，结果在主线程回调
+ * 命中缓存或 value 为 nil 时不提交数据库任务：在主线程调用时立即回调，并返回 nil
+ */
++ (nullable DatabaseCancellationToken *)getModelOfClass:(Class)modelClass uniqueValue:(nullable id)value completionBlock:(void(^)(id _Nullable model))block;
+
+/** 按一组唯一键读取：已缓存的直接返回，其余在一条语句中查询（唯一键以 JSON 数组绑定，见 DatabaseModelMapping），并写入行缓存
+ * 在调用方所在的数据库任务中同步执行；代替逐个调用 +modelOfClass:uniqueValue:inDatabase:
+ * @return 唯一键的值 -> 模型；不存在的唯一键不包含在内
+ */
++ (NSDictionary *)modelsOfClass:(Class)modelClass uniqueValues:(NSArray *)values inDatabase:(FMDatabase *)database;
+
+/** 同上，在交互通道中执行，结果在主线程回调
+ */
++ (DatabaseCancellationToken *)getModelsOfClass:(Class)modelClass uniqueValues:(NSArray *)values completionBlock:(void(^)(NSDictionary *models))block;
+
+/** 插入
+ */
++ (DatabaseCancellationToken *)insertModel:(id)model;
++ (nullable DatabaseCancellationToken *)insertModels:(NSArray *)modelArray;
+
+/** 替代：REPLACE INTO，唯一约束冲突时删除旧行再插入新行（新的 rowid，触发 DELETE 触发器）
+ * 唯一键有 UNIQUE 约束时使用 upsert
+ */
++ (DatabaseCancellationToken *)replaceModel:(id)model;
++ (nullable DatabaseCancellationToken *)replaceModels:(NSArray *)modelArray;
+
+/** 按唯一键插入或更新（DatabaseModelMapping 的 upsertSQL）：已有的行原地更新，内容相同的行不写入
+ * 带有效期的表（已注册的表结构声明了 expiryColumn）同时刷新写入时间，见 DatabaseTableSchema 的 refreshClause
+ */
++ (DatabaseCancellationToken *)upsertModel:(id)model;
++ (nullable DatabaseCancellationToken *)upsertModels:(NSArray *)modelArray;
+
+/** 同上，提交之后在主线程回调；一组写操作的 counts 只统计已提交的批次，被抢占后重新执行的批次只计一次
+ */
++ (DatabaseCancellationToken *)upsertModel:(id)model completion:(void (^ _Nullable)(BOOL success, DatabaseUpsertResult result))completion;
++ (nullable DatabaseCancellationToken *)upsertModels:(NSArray *)modelArray completion:(void (^ _Nullable)(BOOL success, DatabaseUpsertCounts *counts))completion;
+
+/** 根据唯一键更新、删除
+ */
++ (DatabaseCancellationToken *)updateModel:(id)model;
++ (DatabaseCancellationToken *)deleteModel:(id)model;
+
+/** 同上，写操作提交之后在主线程回调：单个写操作的 success 表示该操作是否成功
+ */
++ (DatabaseCancellationToken *)insertModel:(id)model completion:(void (^ _Nullable)(BOOL success))completion;
++ (DatabaseCancellationToken *)replaceModel:(id)model completion:(void (^ _Nullable)(BOOL success))completion;
++ (DatabaseCancellationToken *)updateModel:(id)model completion:(void (^ _Nullable)(BOOL success))completion;
++ (DatabaseCancellationToken *)deleteModel:(id)model completion:(void (^ _Nullable)(BOOL success))completion;
+
+/** 一组写操作：违反约束（例如 INSERT 的唯一键冲突、NOT NULL）的行不写入，同批次的其它行照常提交
+ * success 表示所有批次都已提交且没有失败的行；failedCount 只统计已提交的批次中失败的行
+ */
++ (nullable DatabaseCancellationToken *)insertModels:(NSArray *)modelArray completion:(void (^ _Nullable)(BOOL success, NSUInteger failedCount))completion;
++ (nullable DatabaseCancellationToken *)replaceModels:(NSArray *)modelArray completion:(void (^ _Nullable)(BOOL success, NSUInteger failedCount))completion;
+
+@end
+
+NS_ASSUME_NONNULL_END
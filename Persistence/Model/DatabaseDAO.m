@@ -0,0 +1,380 @@
+//
+//  DatabaseDAO.m
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/27.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import "DatabaseDAO.h"
+#import "DatabaseManagement.h"
+#import "DatabaseRowCache.h"
+
+/** 一组写操作每批写入的行数
+ */
+static NSUInteger const DatabaseDAOBatchCount = 200;
+
+@interface DatabaseUpsertCounts ()
+{
+    @public
+    NSUInteger _counts[4];//按 DatabaseUpsertResult 计数
+}
+@end
+
+@implementation DatabaseUpsertCounts
+
+- (NSUInteger)insertedCount{
+    return _counts[DatabaseUpsertResultInserted];
+}
+
+- (NSUInteger)updatedCount{
+    return _counts[DatabaseUpsertResultUpdated];
+}
+
+- (NSUInteger)unchangedCount{
+    return _counts[DatabaseUpsertResultUnchanged];
+}
+
+- (NSUInteger)failedCount{
+    return _counts[DatabaseUpsertResultFailed];
+}
+
+- (NSString *)description{
+    return [NSString stringWithFormat:@"<%@: %p> inserted:%lu updated:%lu unchanged:%lu failed:%lu",NSStringFromClass(self.class),self,(unsigned long)self.insertedCount,(unsigned long)self.updatedCount,(unsigned long)self.unchangedCount,(unsigned long)self.failedCount];
+}
+
+@end
+
+
+@implementation DatabaseDAO
+
++ (DatabaseStore *)storeForClass:(Class)modelClass{
+    return [DatabaseManagement storeForTable:[DatabaseModelMapping mappingForClass:modelClass].tableName];
+}
+
+#pragma mark - 查询
+
++ (DatabaseCancellationToken *)getModelsOfClass:(Class)modelClass where:(NSString *)clause arguments:(NSArray *)arguments completionBlock:(void(^)(NSArray *models))block{
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:modelClass];
+    return [[self storeForClass:modelClass] databaseChildThreadInRead:^(FMDatabase *database) {
+        NSArray *array = [mapping modelsInDatabase:database where:clause arguments:arguments];
+        [DatabaseManagement databaseMainThreadCompletion:^{
+            block(array);
+        }];
+    }];
+}
+
++ (DatabaseCancellationToken *)getModelsOfClass:(Class)modelClass key:(NSString *)key value:(id)value extraClause:(NSString *)extraClause completionBlock:(void(^)(NSArray *models))block{
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:modelClass];
+    return [[self storeForClass:modelClass] databaseChildThreadInRead:^(FMDatabase *database) {
+        NSArray *array = [mapping modelsInDatabase:database key:key value:value extraClause:extraClause];
+        [DatabaseManagement databaseMainThreadCompletion:^{
+            block(array);
+        }];
+    }];
+}
+
++ (id)modelOfClass:(Class)modelClass uniqueValue:(id)value inDatabase:(FMDatabase *)database{
+    return [self modelOfClass:modelClass uniqueValue:value extraClause:nil inDatabase:database];
+}
+
++ (id)modelOfClass:(Class)modelClass uniqueValue:(id)value extraClause:(NSString *)extraClause inDatabase:(FMDatabase *)database{
+    if (value == nil) {
+        return nil;
+    }
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:modelClass];
+    DatabaseRowCache *rowCache = [self storeForClass:modelClass].rowCache;
+    id model = [rowCache objectForTable:mapping.tableName key:value] ?: [self loadModelWithMapping:mapping rowCache:rowCache uniqueValue:value extraClause:extraClause inDatabase:database];
+    return [self modelForCaller:model mapping:mapping];
+}
+
+/** 行缓存中的模型被多个调用方共享；开启修改记录的类会被修改后更新，交给调用方一份副本：
+ * 修改副本不影响缓存与其它调用方，各自的修改记录互不干扰
+ */
++ (id)modelForCaller:(id)model mapping:(DatabaseModelMapping *)mapping{
+    return mapping.tracksChanges ? [mapping copyOfModel:model] : model;
+}
+
+/** 缓存未命中：查询一行并写入缓存
+ */
++ (id)loadModelWithMapping:(DatabaseModelMapping *)mapping rowCache:(DatabaseRowCache *)rowCache uniqueValue:(id)value extraClause:(NSString *)extraClause inDatabase:(FMDatabase *)database{
+    //时间戳在查询之前获取：查询期间该表被修改时不写入缓存
+    uint64_t readStamp = [rowCache readStamp];
+    int64_t rowid = 0;
+    id model = [mapping modelInDatabase:database uniqueValue:value extraClause:extraClause rowid:&rowid];
+    if (model) {
+        [rowCache setObject:model forTable:mapping.tableName key:value rowid:rowid readStamp:readStamp];
+    }
+    return model;
+}
+
++ (DatabaseCancellationToken *)getModelOfClass:(Class)modelClass uniqueValue:(id)value completionBlock:(void(^)(id model))block{
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:modelClass];
+    DatabaseStore *store = [self storeForClass:modelClass];
+    DatabaseRowCache *rowCache = store.rowCache;
+    id model = [self modelForCaller:[rowCache objectForTable:mapping.tableName key:value] mapping:mapping];
+    if (model || value == nil) {
+        if ([NSThread isMainThread]) {
+            block(model);
+        }else{
+            dispatch_async(dispatch_get_main_queue(), ^{
+                block(model);
+            });
+        }
+        return nil;
+    }
+    return [store databaseChildThreadInRead:^(FMDatabase *database) {
+        id model = [self modelForCaller:[self loadModelWithMapping:mapping rowCache:rowCache uniqueValue:value extraClause:nil inDatabase:database] mapping:mapping];
+        [DatabaseManagement databaseMainThreadCompletion:^{
+            block(model);
+        }];
+    }];
+}
+
++ (NSDictionary *)modelsOfClass:(Class)modelClass uniqueValues:(NSArray *)values inDatabase:(FMDatabase *)database{
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:modelClass];
+    DatabaseRowCache *rowCache = [self storeForClass:modelClass].rowCache;
+    NSMutableDictionary *models = [NSMutableDictionary dictionaryWithCapacity:values.count];
+    NSMutableArray *missingValues = [NSMutableArray array];
+    for (id value in [NSOrderedSet orderedSetWithArray:values]) {
+        id model = [rowCache objectForTable:mapping.tableName key:value];
+        if (model) {
+            models[value] = [self modelForCaller:model mapping:mapping];
+        }else{
+            [missingValues addObject:value];
+        }
+    }
+    if (missingValues.count) {
+        uint64_t readStamp = [rowCache readStamp];
+        NSMutableDictionary<id, NSNumber *> *rowids = [NSMutableDictionary dictionaryWithCapacity:missingValues.count];
+        NSDictionary *loadedModels = [mapping modelsInDatabase:database uniqueValues:missingValues extraClause:nil rowids:rowids];
+        [loadedModels enumerateKeysAndObjectsUsingBlock:^(id value, id model, BOOL *stop) {
+            [rowCache setObject:model forTable:mapping.tableName key:value rowid:rowids[value].longLongValue readStamp:readStamp];
+            models[value] = [self modelForCaller:model mapping:mapping];
+        }];
+    }
+    return models;
+}
+
++ (DatabaseCancellationToken *)getModelsOfClass:(Class)modelClass uniqueValues:(NSArray *)values completionBlock:(void(^)(NSDictionary *models))block{
+    NSArray *keys = [values copy];
+    return [[self storeForClass:modelClass] databaseChildThreadInRead:^(FMDatabase *database) {
+        NSDictionary *models = [self modelsOfClass:modelClass uniqueValues:keys inDatabase:database];
+        [DatabaseManagement databaseMainThreadCompletion:^{
+            block(models);
+        }];
+    }];
+}
+
+#pragma mark - 写操作
+
++ (DatabaseCancellationToken *)insertModel:(id)model{
+    return [self insertModel:model completion:nil];
+}
+
++ (DatabaseCancellationToken *)insertModels:(NSArray *)modelArray{
+    return [self writeModels:modelArray replace:NO completion:nil];
+}
+
++ (DatabaseCancellationToken *)replaceModel:(id)model{
+    return [self replaceModel:model completion:nil];
+}
+
++ (DatabaseCancellationToken *)replaceModels:(NSArray *)modelArray{
+    return [self writeModels:modelArray replace:YES completion:nil];
+}
+
++ (DatabaseCancellationToken *)upsertModel:(id)model{
+    return [self upsertModel:model completion:nil];
+}
+
++ (DatabaseCancellationToken *)upsertModels:(NSArray *)modelArray{
+    return [self upsertModels:modelArray completion:nil];
+}
+
++ (DatabaseCancellationToken *)updateModel:(id)model{
+    return [self updateModel:model completion:nil];
+}
+
++ (DatabaseCancellationToken *)deleteModel:(id)model{
+    return [self deleteModel:model completion:nil];
+}
+
++ (DatabaseCancellationToken *)insertModel:(id)model completion:(void (^)(BOOL))completion{
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:[model class]];
+    return [self writeModel:model mapping:mapping block:^BOOL(FMDatabase *database) {
+        return [mapping insertModel:model replace:NO inDatabase:database];
+    } completion:completion];
+}
+
++ (DatabaseCancellationToken *)insertModels:(NSArray *)modelArray completion:(void (^)(BOOL, NSUInteger))completion{
+    return [self writeModels:modelArray replace:NO completion:completion];
+}
+
++ (DatabaseCancellationToken *)replaceModel:(id)model completion:(void (^)(BOOL))completion{
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:[model class]];
+    return [self writeModel:model mapping:mapping block:^BOOL(FMDatabase *database) {
+        return [mapping insertModel:model replace:YES inDatabase:database];
+    } completion:completion];
+}
+
++ (DatabaseCancellationToken *)replaceModels:(NSArray *)modelArray completion:(void (^)(BOOL, NSUInteger))completion{
+    return [self writeModels:modelArray replace:YES completion:completion];
+}
+
++ (DatabaseCancellationToken *)upsertModel:(id)model completion:(void (^)(BOOL, DatabaseUpsertResult))completion{
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:[model class]];
+    DatabaseTableSchema *schema = [DatabaseManagement tableSchemaForTable:mapping.tableName];
+    __block DatabaseUpsertResult result = DatabaseUpsertResultFailed;
+    return [self writeModel:model mapping:mapping block:^BOOL(FMDatabase *database) {
+        result = [mapping upsertModel:model schema:schema inDatabase:database];
+        return result != DatabaseUpsertResultFailed;
+    } completion:completion ? ^(BOOL success) {
+        completion(success, success ? result : DatabaseUpsertResultFailed);
+    } : nil];
+}
+
+/** 与 -writeModels:replace:completion: 相同的分批方式，逐行统计；每批提交之后计入总数
+ */
++ (DatabaseCancellationToken *)upsertModels:(NSArray *)modelArray completion:(void (^)(BOOL, DatabaseUpsertCounts *))completion{
+    DatabaseUpsertCounts *counts = [[DatabaseUpsertCounts alloc] init];
+    if (modelArray.count == 0) {
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(YES, counts);
+            });
+        }
+        return nil;
+    }
+    NSArray *models = [modelArray copy];
+    Class modelClass = [models.firstObject class];
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:modelClass];
+    DatabaseTableSchema *schema = [DatabaseManagement tableSchemaForTable:mapping.tableName];
+    //每一批的统计单独保存：被抢占的批次重新执行时覆盖，提交之后才计入总数，回滚的批次不计入
+    NSUInteger resultCount = sizeof(counts->_counts) / sizeof(counts->_counts[0]);
+    NSMutableData *batchCounts = [NSMutableData dataWithLength:(models.count + DatabaseDAOBatchCount - 1) / DatabaseDAOBatchCount * resultCount * sizeof(NSUInteger)];
+    NSMutableData *changes = mapping.tracksChanges ? [NSMutableData dataWithLength:models.count * sizeof(uint64_t)] : nil;
+    NSMutableData *written = [NSMutableData dataWithLength:models.count];//每一行是否写入成功
+    return [[self storeForClass:modelClass] databaseInLane:DatabaseLaneBackground batches:^BOOL(FMDatabase *database, NSUInteger batchIndex, BOOL *rollback) {
+        NSUInteger *batchCount = (NSUInteger *)batchCounts.mutableBytes + batchIndex * resultCount;
+        memset(batchCount, 0, resultCount * sizeof(NSUInteger));
+        NSUInteger location = batchIndex * DatabaseDAOBatchCount;
+        NSUInteger length = MIN(DatabaseDAOBatchCount, models.count - location);
+        [self takeChanges:changes ofModels:models range:NSMakeRange(location, length) mapping:mapping];
+        BOOL *succeeded = (BOOL *)written.mutableBytes;
+        for (NSUInteger i = location; i < location + length; i++) {
+            DatabaseUpsertResult result = [mapping upsertModel:models[i] schema:schema inDatabase:database];
+            succeeded[i] = result != DatabaseUpsertResultFailed;
+            batchCount[result]++;
+        }
+        return location + length < models.count;
+    } batchCommitted:^(NSUInteger batchIndex) {
+        const NSUInteger *batchCount = (const NSUInteger *)batchCounts.bytes + batchIndex * resultCount;
+        for (NSUInteger i = 0; i < resultCount; i++) {
+            counts->_counts[i] += batchCount[i];
+        }
+        [self commitChanges:changes ofModels:models written:written batchIndex:batchIndex mapping:mapping];
+    } completion:completion ? ^(BOOL success) {
+        completion(success, counts);
+    } : nil];
+}
+
++ (DatabaseCancellationToken *)updateModel:(id)model completion:(void (^)(BOOL))completion{
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:[model class]];
+    return [self writeModel:model mapping:mapping block:^BOOL(FMDatabase *database) {
+        return [mapping updateModel:model inDatabase:database];
+    } completion:completion];
+}
+
++ (DatabaseCancellationToken *)deleteModel:(id)model completion:(void (^)(BOOL))completion{
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:[model class]];
+    return [[self storeForClass:[model class]] databaseBatchWrite:^BOOL(FMDatabase *database) {
+        return [mapping deleteModel:model inDatabase:database];
+    } completion:completion];
+}
+
+/** 在后台通道中分批写入：每批一个事务，批次之间让出写连接；同一条 SQL 的预编译语句在所有行之间复用
+ * 违反约束的行只回滚该行的语句，同批次的其它行照常提交；失败的行数在批次提交之后计入，被抢占后重新执行的批次只计一次
+ */
++ (DatabaseCancellationToken *)writeModels:(NSArray *)modelArray replace:(BOOL)replace completion:(void (^)(BOOL success, NSUInteger failedCount))completion{
+    if (modelArray.count == 0) {
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(YES, 0);
+            });
+        }
+        return nil;
+    }
+    NSArray *models = [modelArray copy];
+    Class modelClass = [models.firstObject class];
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:modelClass];
+    NSMutableData *changes = mapping.tracksChanges ? [NSMutableData dataWithLength:models.count * sizeof(uint64_t)] : nil;
+    NSMutableData *written = [NSMutableData dataWithLength:models.count];//每一行是否写入成功
+    __block NSUInteger failedCount = 0;
+    return [[self storeForClass:modelClass] databaseInLane:DatabaseLaneBackground batches:^BOOL(FMDatabase *database, NSUInteger batchIndex, BOOL *rollback) {
+        NSUInteger location = batchIndex * DatabaseDAOBatchCount;
+        NSUInteger length = MIN(DatabaseDAOBatchCount, models.count - location);
+        BOOL *succeeded = (BOOL *)written.mutableBytes;
+        [self takeChanges:changes ofModels:models range:NSMakeRange(location, length) mapping:mapping];
+        for (NSUInteger i = location; i < location + length; i++) {
+            succeeded[i] = [mapping insertModel:models[i] replace:replace inDatabase:database];
+        }
+        return location + length < models.count;
+    } batchCommitted:^(NSUInteger batchIndex) {
+        const BOOL *succeeded = (const BOOL *)written.bytes;
+        NSUInteger location = batchIndex * DatabaseDAOBatchCount;
+        for (NSUInteger i = location; i < MIN(location + DatabaseDAOBatchCount, models.count); i++) {
+            failedCount += succeeded[i] ? 0 : 1;
+        }
+        [self commitChanges:changes ofModels:models written:written batchIndex:batchIndex mapping:mapping];
+    } completion:completion ? ^(BOOL finished) {
+        completion(finished && failedCount == 0, failedCount);
+    } : nil];
+}
+
+#pragma mark - 修改记录
+
+/** 单个写操作：执行之前获取修改记录的快照，合并写入的事务提交之后才清除；失败、回滚时修改保留，下一次更新重新写入
+ */
++ (DatabaseCancellationToken *)writeModel:(id)model mapping:(DatabaseModelMapping *)mapping block:(BOOL (^)(FMDatabase *database))block completion:(void (^)(BOOL success))completion{
+    if (!mapping.tracksChanges) {
+        return [[self storeForClass:[model class]] databaseBatchWrite:block completion:completion];
+    }
+    __block uint64_t changes = 0;
+    return [[self storeForClass:[model class]] databaseBatchWrite:^BOOL(FMDatabase *database) {
+        changes = [mapping changesOfModel:model];
+        return block(database);
+    } completion:^(BOOL success) {
+        if (success) {
+            [mapping commitChanges:changes ofModel:model];
+        }
+        if (completion) {
+            completion(success);
+        }
+    }];
+}
+
+/** 一组写操作：每批写入之前保存该批模型的快照，被抢占后重新执行时覆盖
+ */
++ (void)takeChanges:(NSMutableData *)changes ofModels:(NSArray *)models range:(NSRange)range mapping:(DatabaseModelMapping *)mapping{
+    uint64_t *snapshots = changes.mutableBytes;
+    for (NSUInteger i = range.location; snapshots && i < NSMaxRange(range); i++) {
+        snapshots[i] = [mapping changesOfModel:models[i]];
+    }
+}
+
+/** 该批提交之后清除快照中的修改；写入失败的行保留修改，下一次更新重新写入
+ */
++ (void)commitChanges:(NSMutableData *)changes ofModels:(NSArray *)models written:(NSData *)written batchIndex:(NSUInteger)batchIndex mapping:(DatabaseModelMapping *)mapping{
+    const uint64_t *snapshots = changes.bytes;
+    const BOOL *succeeded = written.bytes;
+    NSUInteger location = batchIndex * DatabaseDAOBatchCount;
+    NSUInteger length = MIN(DatabaseDAOBatchCount, models.count - location);
+    for (NSUInteger i = location; snapshots && i < location + length; i++) {
+        if (succeeded[i]) {
+            [mapping commitChanges:snapshots[i] ofModel:models[i]];
+        }
+    }
+}
+
+@end
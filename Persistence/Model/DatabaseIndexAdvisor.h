@@ -0,0 +1,82 @@
+//
+//  DatabaseIndexAdvisor.h
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/31.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class DatabaseStore;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** 一条语句的索引建议
+ */
+@interface DatabaseIndexAdvice : NSObject
+
+@property (nonatomic, copy, readonly) NSString *sql;
+
+/** 语句所在的数据库文件
+ */
+@property (nonatomic, copy, readonly) NSString *storeName;
+
+/** 记录期间的执行次数
+ */
+@property (nonatomic, assign, readonly) NSUInteger executionCount;
+
+/** 建议创建的索引：CREATE INDEX ...；现有索引已经足够时为空
+ */
+@property (nonatomic, copy, readonly) NSArray<NSString *> *indexes;
+
+/** 查询计划：planBefore 使用现有的索引，planAfter 假设已创建建议的索引；每行一个步骤
+ */
+@property (nonatomic, copy, readonly) NSString *planBefore;
+@property (nonatomic, copy, readonly) NSString *planAfter;
+
+/** 查询计划的代价：全表扫描（SCAN）与临时 B 树（排序、去重）的步骤数
+ */
+@property (nonatomic, assign, readonly) NSUInteger costBefore;
+@property (nonatomic, assign, readonly) NSUInteger costAfter;
+
+@end
+
+
+/** 索引建议：根据应用实际执行的语句，而不是猜测，决定需要哪些索引
+ *
+ * 记录期间通过 FMDatabase 的语句观察者收集所有连接执行的 SELECT、UPDATE、DELETE 语句（去重并计数）；
+ * 分析时将这些语句交给 sqlite3expert：它复制数据库的表结构与统计信息，尝试候选索引，给出能改进查询计划的 CREATE INDEX；
+ * 引用其它数据库文件、虚拟表的语句在该数据库中无法编译，被跳过
+ *
+ * 只用于开发、测试期间的诊断，不修改数据库
+ */
+@interface DatabaseIndexAdvisor : NSObject
+
+/** 开始、停止记录；停止后保留已记录的语句
+ */
++ (void)startRecording;
++ (void)stopRecording;
++ (BOOL)isRecording;
+
+/** 已记录的语句与执行次数
+ */
++ (NSDictionary<NSString *, NSNumber *> *)recordedStatements;
++ (void)removeAllRecordedStatements;
+
+/** 分析已记录的语句：在维护通道中使用单独的只读连接执行
+ * @param completion 在主线程回调，advices 为该数据库中能编译的语句，按执行次数降序排列
+ */
++ (void)analyzeStore:(DatabaseStore *)store completion:(void (^)(NSArray<DatabaseIndexAdvice *> *advices))completion;
+
+/** 依次分析所有数据库文件，并打印报告
+ */
++ (void)analyzeAllStoresWithCompletion:(void (^ _Nullable)(NSArray<DatabaseIndexAdvice *> *advices))completion;
+
+/** 报告：每个建议的索引、受益语句的执行次数，以及创建前后的查询计划
+ */
++ (NSString *)reportWithAdvices:(NSArray<DatabaseIndexAdvice *> *)advices;
+
+@end
+
+NS_ASSUME_NONNULL_END
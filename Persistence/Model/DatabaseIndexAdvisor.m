@@ -0,0 +1,287 @@
+//
+//  DatabaseIndexAdvisor.m
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/31.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import "DatabaseIndexAdvisor.h"
+#import "DatabaseManagement.h"
+#import "DatabasePinyinTokenizer.h"
+#import "sqlite3expert.h"
+
+/** 最多记录的不同语句数：拼接了参数值的语句每次都不同，避免无限增长
+ */
+static NSUInteger const DatabaseIndexAdvisorMaxStatements = 1000;
+
+@interface DatabaseIndexAdvice ()
+@property (nonatomic, copy, readwrite) NSString *sql;
+@property (nonatomic, copy, readwrite) NSString *storeName;
+@property (nonatomic, assign, readwrite) NSUInteger executionCount;
+@property (nonatomic, copy, readwrite) NSArray<NSString *> *indexes;
+@property (nonatomic, copy, readwrite) NSString *planBefore;
+@property (nonatomic, copy, readwrite) NSString *planAfter;
+@property (nonatomic, assign, readwrite) NSUInteger costBefore;
+@property (nonatomic, assign, readwrite) NSUInteger costAfter;
+@end
+
+@implementation DatabaseIndexAdvice
+
+- (NSString *)description{
+    return [NSString stringWithFormat:@"<DatabaseIndexAdvice %@ x%lu cost:%lu->%lu %@>",self.storeName,(unsigned long)self.executionCount,(unsigned long)self.costBefore,(unsigned long)self.costAfter,self.sql];
+}
+
+@end
+
+
+@implementation DatabaseIndexAdvisor
+
+static BOOL _isRecording = NO;
+static NSMutableDictionary<NSString *, NSNumber *> *_statements = nil;
+
+#pragma mark - 记录
+
++ (void)startRecording{
+    @synchronized (self) {
+        if (_statements == nil) {
+            _statements = [NSMutableDictionary dictionary];
+        }
+        _isRecording = YES;
+    }
+    NSCharacterSet *whitespace = NSCharacterSet.whitespaceAndNewlineCharacterSet;
+    [FMDatabase setStatementObserver:^(NSString *sql) {
+        NSString *statement = [sql stringByTrimmingCharactersInSet:whitespace];
+        if (![self isAnalyzableStatement:statement]) {
+            return;
+        }
+        @synchronized (self) {
+            NSNumber *count = _statements[statement];
+            if (count || _statements.count < DatabaseIndexAdvisorMaxStatements) {
+                _statements[statement] = @(count.unsignedIntegerValue + 1);
+            }
+        }
+    }];
+}
+
++ (void)stopRecording{
+    [FMDatabase setStatementObserver:nil];
+    @synchronized (self) {
+        _isRecording = NO;
+    }
+}
+
++ (BOOL)isRecording{
+    @synchronized (self) {
+        return _isRecording;
+    }
+}
+
++ (NSDictionary<NSString *, NSNumber *> *)recordedStatements{
+    @synchronized (self) {
+        return [_statements copy] ?: @{};
+    }
+}
+
++ (void)removeAllRecordedStatements{
+    @synchronized (self) {
+        [_statements removeAllObjects];
+    }
+}
+
+/** 只有查询与按条件修改的语句能从索引中受益；表结构、PRAGMA、事务语句与插入被忽略
+ */
++ (BOOL)isAnalyzableStatement:(NSString *)sql{
+    for (NSString *prefix in @[@"SELECT",@"WITH",@"UPDATE",@"DELETE"]) {
+        if ([sql rangeOfString:prefix options:NSCaseInsensitiveSearch | NSAnchoredSearch].location != NSNotFound) {
+            return [sql rangeOfString:@"sqlite_" options:NSCaseInsensitiveSearch].location == NSNotFound;
+        }
+    }
+    return NO;
+}
+
+#pragma mark - 分析
+
++ (void)analyzeStore:(DatabaseStore *)store completion:(void (^)(NSArray<DatabaseIndexAdvice *> *))completion{
+    NSDictionary<NSString *, NSNumber *> *statements = self.recordedStatements;
+    [store databaseInLane:DatabaseLaneMaintenance read:^(FMDatabase *database) {
+        NSArray<DatabaseIndexAdvice *> *advices = [self advicesForStatements:statements inStore:store];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(advices);
+        });
+    }];
+}
+
++ (void)analyzeAllStoresWithCompletion:(void (^)(NSArray<DatabaseIndexAdvice *> *))completion{
+    NSMutableArray<DatabaseStore *> *stores = [NSMutableArray arrayWithObjects:DatabaseManagement.mainStore,DatabaseManagement.referenceStore,nil];
+    if (DatabaseManagement.bundleStore) {
+        [stores addObject:DatabaseManagement.bundleStore];
+    }
+    [self analyzeStores:stores advices:[NSMutableArray array] completion:completion];
+}
+
++ (void)analyzeStores:(NSMutableArray<DatabaseStore *> *)stores advices:(NSMutableArray<DatabaseIndexAdvice *> *)allAdvices completion:(void (^)(NSArray<DatabaseIndexAdvice *> *))completion{
+    if (stores.count == 0) {
+        NSLog(@"%@",[self reportWithAdvices:allAdvices]);
+        if (completion) {
+            completion(allAdvices);
+        }
+        return;
+    }
+    DatabaseStore *store = stores.firstObject;
+    [stores removeObjectAtIndex:0];
+    [self analyzeStore:store completion:^(NSArray<DatabaseIndexAdvice *> *advices) {
+        [allAdvices addObjectsFromArray:advices];
+        [self analyzeStores:stores advices:allAdvices completion:completion];
+    }];
+}
+
+/** sqlite3expert 会在传入的连接上注册函数、创建临时表，因此使用单独的只读连接，分析结束后关闭
+ * 虚拟表及其影子表（例如 PhoneCodeSearch、PhoneCodeSearch_data）不能创建索引，sqlite3expert 不复制它们的表结构
+ */
++ (NSArray<DatabaseIndexAdvice *> *)advicesForStatements:(NSDictionary<NSString *, NSNumber *> *)statements inStore:(DatabaseStore *)store{
+    if (statements.count == 0) {
+        return @[];
+    }
+    NSString *query = store.profile == DatabaseStoreProfileImmutable ? @"immutable=1" : @"mode=ro";
+    NSString *uri = [NSString stringWithFormat:@"%@?%@",[NSURL fileURLWithPath:store.path].absoluteString,query];
+    FMDatabase *db = [FMDatabase databaseWithPath:uri];
+    if (![db openWithFlags:SQLITE_OPEN_READONLY | SQLITE_OPEN_URI]) {
+        NSLog(@"%@ open advisor database error",store);
+        return @[];
+    }
+    //与其它连接一致注册分词器：全文索引的虚拟表、引用它的触发器在这个连接上才能编译
+    DatabaseRegisterPinyinTokenizer(db);
+
+    NSMutableArray<DatabaseIndexAdvice *> *advices = [NSMutableArray array];
+    char *error = NULL;
+    sqlite3expert *expert = sqlite3_expert_new(db.sqliteHandle, &error);
+    if (expert == NULL) {
+        NSLog(@"%@ expert error ===== %s",store,error);
+        sqlite3_free(error);
+        [db close];
+        return @[];
+    }
+
+    //在该数据库中无法编译的语句（其它数据库文件的表、虚拟表）不计入报告
+    NSMutableArray<NSString *> *acceptedStatements = [NSMutableArray array];
+    for (NSString *sql in statements) {
+        int count = sqlite3_expert_count(expert);
+        if (sqlite3_expert_sql(expert, sql.UTF8String, &error) == SQLITE_OK && sqlite3_expert_count(expert) == count + 1) {
+            [acceptedStatements addObject:sql];
+        }
+        sqlite3_free(error);
+        error = NULL;
+    }
+
+    if (acceptedStatements.count && sqlite3_expert_analyze(expert, &error) == SQLITE_OK) {
+        [acceptedStatements enumerateObjectsUsingBlock:^(NSString * _Nonnull sql, NSUInteger idx, BOOL * _Nonnull stop) {
+            DatabaseIndexAdvice *advice = [[DatabaseIndexAdvice alloc] init];
+            advice.sql = sql;
+            advice.storeName = store.name;
+            advice.executionCount = statements[sql].unsignedIntegerValue;
+            advice.indexes = [self indexesFromReport:sqlite3_expert_report(expert, (int)idx, EXPERT_REPORT_INDEXES)];
+            advice.planBefore = [self queryPlanWithSQL:sql inDatabase:db];
+            advice.planAfter = [self stringFromReport:sqlite3_expert_report(expert, (int)idx, EXPERT_REPORT_PLAN)];
+            advice.costBefore = [self costOfQueryPlan:advice.planBefore];
+            advice.costAfter = [self costOfQueryPlan:advice.planAfter];
+            [advices addObject:advice];
+        }];
+    }else if (error) {
+        NSLog(@"%@ expert analyze error ===== %s",store,error);
+    }
+    sqlite3_free(error);
+    sqlite3_expert_destroy(expert);
+    [db close];
+
+    [advices sortUsingComparator:^NSComparisonResult(DatabaseIndexAdvice * _Nonnull obj1, DatabaseIndexAdvice * _Nonnull obj2) {
+        return [@(obj2.executionCount) compare:@(obj1.executionCount)];
+    }];
+    return advices;
+}
+
++ (NSString *)stringFromReport:(const char *)report{
+    return report ? [[NSString stringWithUTF8String:report] stringByTrimmingCharactersInSet:NSCharacterSet.whitespaceAndNewlineCharacterSet] : @"";
+}
+
+/** 报告中每个索引占一行，以 ; 结尾
+ */
++ (NSArray<NSString *> *)indexesFromReport:(const char *)report{
+    NSMutableArray<NSString *> *indexes = [NSMutableArray array];
+    for (NSString *line in [[self stringFromReport:report] componentsSeparatedByString:@"\n"]) {
+        NSString *index = [line stringByTrimmingCharactersInSet:[NSCharacterSet characterSetWithCharactersInString:@"; \t"]];
+        if ([index hasPrefix:@"CREATE"]) {
+            [indexes addObject:index];
+        }
+    }
+    return indexes;
+}
+
+/** 现有索引下的查询计划：EXPLAIN QUERY PLAN 不执行语句，参数无需绑定
+ */
++ (NSString *)queryPlanWithSQL:(NSString *)sql inDatabase:(FMDatabase *)db{
+    sqlite3_stmt *statement = NULL;
+    NSString *explain = [@"EXPLAIN QUERY PLAN " stringByAppendingString:sql];
+    if (sqlite3_prepare_v2(db.sqliteHandle, explain.UTF8String, -1, &statement, NULL) != SQLITE_OK) {
+        sqlite3_finalize(statement);
+        return @"";
+    }
+    NSMutableArray<NSString *> *lines = [NSMutableArray array];
+    NSMutableDictionary<NSNumber *, NSNumber *> *depths = [NSMutableDictionary dictionary];
+    while (sqlite3_step(statement) == SQLITE_ROW) {
+        int identifier = sqlite3_column_int(statement, 0);
+        int parent = sqlite3_column_int(statement, 1);
+        const char *detail = (const char *)sqlite3_column_text(statement, 3);
+        NSUInteger depth = depths[@(parent)] ? depths[@(parent)].unsignedIntegerValue + 1 : 0;
+        depths[@(identifier)] = @(depth);
+        NSString *indent = [@"" stringByPaddingToLength:depth * 2 withString:@" " startingAtIndex:0];
+        [lines addObject:[indent stringByAppendingString:detail ? [NSString stringWithUTF8String:detail] : @""]];
+    }
+    sqlite3_finalize(statement);
+    return [lines componentsJoinedByString:@"\n"];
+}
+
++ (NSUInteger)costOfQueryPlan:(NSString *)plan{
+    NSUInteger cost = 0;
+    for (NSString *line in [plan componentsSeparatedByString:@"\n"]) {
+        NSString *step = [line stringByTrimmingCharactersInSet:NSCharacterSet.whitespaceCharacterSet];
+        if ([step hasPrefix:@"SCAN "] || [step rangeOfString:@"TEMP B-TREE"].location != NSNotFound) {
+            cost++;
+        }
+    }
+    return cost;
+}
+
+#pragma mark - 报告
+
++ (NSString *)reportWithAdvices:(NSArray<DatabaseIndexAdvice *> *)advices{
+    //同一个索引可能被多条语句建议：按受益语句的总执行次数排序
+    NSMutableDictionary<NSString *, NSNumber *> *executions = [NSMutableDictionary dictionary];
+    NSMutableDictionary<NSString *, NSMutableArray<DatabaseIndexAdvice *> *> *beneficiaries = [NSMutableDictionary dictionary];
+    for (DatabaseIndexAdvice *advice in advices) {
+        for (NSString *index in advice.indexes) {
+            NSString *key = [NSString stringWithFormat:@"%@: %@",advice.storeName,index];
+            executions[key] = @(executions[key].unsignedIntegerValue + advice.executionCount);
+            if (beneficiaries[key] == nil) {
+                beneficiaries[key] = [NSMutableArray array];
+            }
+            [beneficiaries[key] addObject:advice];
+        }
+    }
+    NSArray<NSString *> *keys = [executions keysSortedByValueUsingComparator:^NSComparisonResult(NSNumber * _Nonnull obj1, NSNumber * _Nonnull obj2) {
+        return [obj2 compare:obj1];
+    }];
+
+    NSMutableString *report = [NSMutableString stringWithFormat:@"DatabaseIndexAdvisor: %lu statements, %lu suggested indexes\n",(unsigned long)advices.count,(unsigned long)keys.count];
+    for (NSString *key in keys) {
+        [report appendFormat:@"\n%@;  -- %@ executions\n",key,executions[key]];
+        for (DatabaseIndexAdvice *advice in beneficiaries[key]) {
+            [report appendFormat:@"  x%lu cost %lu -> %lu  %@\n",(unsigned long)advice.executionCount,(unsigned long)advice.costBefore,(unsigned long)advice.costAfter,advice.sql];
+            [report appendFormat:@"    before:\n      %@\n",[advice.planBefore stringByReplacingOccurrencesOfString:@"\n" withString:@"\n      "]];
+            [report appendFormat:@"    after:\n      %@\n",[advice.planAfter stringByReplacingOccurrencesOfString:@"\n" withString:@"\n      "]];
+        }
+    }
+    return report;
+}
+
+@end
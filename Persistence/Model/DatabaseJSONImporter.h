@@ -0,0 +1,52 @@
+//
+//  DatabaseJSONImporter.h
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/28.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class DatabaseStore;
+@class DatabaseCancellationToken;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** 将 JSON 文件导入到一张表：解析与写入并行
+ *
+ * 解析线程通过 DatabaseJSONRowReader 流式读取文件，把每个对象展开为一行，按 batchSize 行一组放入有界队列；队列已满时解析线程等待，内存占用有上限；
+ * 写入在后台通道中分批提交：每一批最多 batchesPerCommit 组，使用同一条预编译的 upsert 语句逐行写入，单独提交；
+ * 等待解析线程时不开启事务、不占用写连接；批次之间更高优先级的写操作可以插入执行，被抢占时只重新写入当前一批
+ *
+ * 按唯一列 upsert：冲突时原地更新，内容相同的行不写入，中断后重新导入同一个文件是幂等的
+ */
+@interface DatabaseJSONImporter : NSObject
+
+/** @param uniqueColumn 有 UNIQUE 约束的列，按该列判断插入或更新
+ * @param columnsForKeys JSON 成员名称 -> 列名；对象中不包含任何一个成员时不导入该对象
+ */
+- (instancetype)initWithPath:(NSString *)path tableName:(NSString *)tableName uniqueColumn:(NSString *)uniqueColumn columnsForKeys:(NSDictionary<NSString *, NSString *> *)columnsForKeys;
+- (instancetype)init NS_UNAVAILABLE;
+
+/** 每组的行数，默认 256
+ */
+@property (nonatomic, assign) NSUInteger batchSize;
+
+/** 每次提交最多写入的组数，默认 4
+ */
+@property (nonatomic, assign) NSUInteger batchesPerCommit;
+
+/** 队列中最多等待写入的组数，默认 8；不少于 batchesPerCommit
+ */
+@property (nonatomic, assign) NSUInteger queueCapacity;
+
+/** 导入到指定的数据库文件（必须可写）
+ * @param completion 在主线程回调，success 表示是否所有批次都已提交，rowCount 为已提交的行数（包括内容相同、没有写入的行）；
+ *                   失败或取消时，已提交的批次保留，重新导入时跳过内容相同的行
+ */
+- (DatabaseCancellationToken *)importIntoStore:(DatabaseStore *)store completion:(void (^ _Nullable)(BOOL success, NSUInteger rowCount))completion;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,257 @@
+//
+//  DatabaseJSONImporter.m
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/28.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import "DatabaseJSONImporter.h"
+#import "DatabaseJSONRowReader.h"
+#import "DatabaseManagement.h"
+
+/** 解析线程与写连接之间的有界队列：队列已满时生产者等待，队列为空时消费者等待
+ */
+@interface DatabaseImportQueue : NSObject
+{
+    NSCondition *_condition;
+    NSMutableArray<NSArray *> *_batches;
+    NSUInteger _capacity;
+    BOOL _finished;
+    BOOL _cancelled;
+    NSError *_error;
+}
+@end
+
+@implementation DatabaseImportQueue
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity{
+    self = [super init];
+    if (self) {
+        _condition = [[NSCondition alloc] init];
+        _batches = [NSMutableArray array];
+        _capacity = MAX(capacity, 1);
+    }
+    return self;
+}
+
+/** 放入一组行；已取消时返回 NO
+ */
+- (BOOL)push:(NSArray *)batch{
+    [_condition lock];
+    while (_batches.count >= _capacity && !_cancelled) {
+        [_condition wait];
+    }
+    BOOL accepted = !_cancelled;
+    if (accepted) {
+        [_batches addObject:batch];
+        [_condition broadcast];
+    }
+    [_condition unlock];
+    return accepted;
+}
+
+/** 取出最多 count 组行；生产者已结束且队列为空，或已取消时返回 nil
+ * @param wait 队列为空时是否等待生产者；不等待时返回空数组
+ */
+- (NSArray<NSArray *> *)popUpTo:(NSUInteger)count wait:(BOOL)wait{
+    [_condition lock];
+    while (wait && _batches.count == 0 && !_finished && !_cancelled) {
+        [_condition wait];
+    }
+    NSArray<NSArray *> *batches = nil;
+    if (!_cancelled && _batches.count) {
+        NSRange range = NSMakeRange(0, MIN(MAX(count, 1), _batches.count));
+        batches = [_batches subarrayWithRange:range];
+        [_batches removeObjectsInRange:range];
+        [_condition broadcast];
+    }else if (!_cancelled && !_finished) {
+        batches = @[];
+    }
+    [_condition unlock];
+    return batches;
+}
+
+/** 生产者结束；error 为解析失败的原因
+ */
+- (void)finishWithError:(NSError *)error{
+    [_condition lock];
+    _finished = YES;
+    _error = error;
+    [_condition broadcast];
+    [_condition unlock];
+}
+
+- (NSError *)error{
+    [_condition lock];
+    NSError *error = _error;
+    [_condition unlock];
+    return error;
+}
+
+- (void)cancel{
+    [_condition lock];
+    _cancelled = YES;
+    [_batches removeAllObjects];
+    [_condition broadcast];
+    [_condition unlock];
+}
+
+@end
+
+
+@interface DatabaseJSONImporter ()
+
+@property (nonatomic, copy) NSString *path;
+@property (nonatomic, copy) NSString *tableName;
+@property (nonatomic, copy) NSArray<NSString *> *keys;
+@property (nonatomic, copy) NSString *upsertSQL;
+
+@end
+
+@implementation DatabaseJSONImporter
+
+- (instancetype)initWithPath:(NSString *)path tableName:(NSString *)tableName uniqueColumn:(NSString *)uniqueColumn columnsForKeys:(NSDictionary<NSString *,NSString *> *)columnsForKeys{
+    self = [super init];
+    if (self) {
+        _path = [path copy];
+        _tableName = [tableName copy];
+        _batchSize = 256;
+        _batchesPerCommit = 4;
+        _queueCapacity = 8;
+
+        //每一行按 keys 的顺序绑定
+        _keys = [columnsForKeys.allKeys sortedArrayUsingSelector:@selector(compare:)];
+        NSMutableArray<NSString *> *columns = [NSMutableArray arrayWithCapacity:_keys.count];
+        NSMutableArray<NSString *> *placeholders = [NSMutableArray arrayWithCapacity:_keys.count];
+        NSMutableArray<NSString *> *assignments = [NSMutableArray array];
+        NSMutableArray<NSString *> *differences = [NSMutableArray array];
+        for (NSString *key in _keys) {
+            NSString *column = columnsForKeys[key];
+            [columns addObject:column];
+            [placeholders addObject:@"?"];
+            if (![column isEqualToString:uniqueColumn]) {
+                [assignments addObject:[NSString stringWithFormat:@"%@ = excluded.%@",column,column]];
+                [differences addObject:[NSString stringWithFormat:@"%@.%@ IS NOT excluded.%@",tableName,column,column]];
+            }
+        }
+        //冲突时原地更新，内容相同的行不写入：重复导入同一个文件（或被中断后重新导入）不产生任何修改
+        NSString *action = assignments.count ? [NSString stringWithFormat:@"DO UPDATE SET %@ WHERE %@",[assignments componentsJoinedByString:@", "],[differences componentsJoinedByString:@" OR "]] : @"DO NOTHING";
+        _upsertSQL = [NSString stringWithFormat:@"INSERT INTO %@ (%@) VALUES (%@) ON CONFLICT (%@) %@",tableName,[columns componentsJoinedByString:@","],[placeholders componentsJoinedByString:@" , "],uniqueColumn,action];
+    }
+    return self;
+}
+
+- (DatabaseCancellationToken *)importIntoStore:(DatabaseStore *)store completion:(void (^)(BOOL, NSUInteger))completion{
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    DatabaseCancellationToken *token = [[DatabaseCancellationToken alloc] init];
+    //队列至少能容纳一次提交的组数
+    DatabaseImportQueue *queue = [[DatabaseImportQueue alloc] initWithCapacity:MAX(self.queueCapacity, self.batchesPerCommit)];
+
+    //解析线程：展开为行，按组放入队列
+    DatabaseJSONRowReader *reader = [[DatabaseJSONRowReader alloc] initWithPath:self.path];
+    NSArray<NSString *> *keys = self.keys;
+    NSUInteger batchSize = MAX(self.batchSize, 1);
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        __block NSMutableArray<NSArray *> *batch = [NSMutableArray arrayWithCapacity:batchSize];
+        BOOL parsed = [reader readObjects:^(NSDictionary<NSString *,NSString *> *object, BOOL *stop) {
+            NSMutableArray *row = [NSMutableArray arrayWithCapacity:keys.count];
+            BOOL matched = NO;
+            for (NSString *key in keys) {
+                NSString *value = object[key];
+                matched = matched || value != nil;
+                [row addObject:value ?: NSNull.null];
+            }
+            if (!matched) {
+                return;
+            }
+            [batch addObject:row];
+            if (batch.count >= batchSize) {
+                *stop = ![queue push:batch];
+                batch = [NSMutableArray arrayWithCapacity:batchSize];
+            }
+        }];
+        if (parsed && batch.count) {
+            [queue push:batch];
+        }
+        [queue finishWithError:parsed ? nil : (reader.error ?: [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:nil])];
+    });
+
+    [self importFromQueue:queue intoStore:store token:token rowCount:0 completion:^(BOOL success, NSUInteger rowCount) {
+        if (success) {
+            NSLog(@"%@ 导入 %lu 行，耗时 %.3f 秒",self.tableName,(unsigned long)rowCount,CFAbsoluteTimeGetCurrent() - startTime);
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (completion) {
+                completion(success,rowCount);
+            }
+        });
+    }];
+    return token;
+}
+
+/** 在分线程中等待解析线程放入下一组行（不持有写连接），再提交一组批次：
+ * 每一批写入最多 batchesPerCommit 组并单独提交；之后的批次只取出队列中已有的行，队列为空时结束这一组批次，回到这里等待
+ * 被抢占的批次回滚之后以同一个 batchIndex 重新执行，重新写入同一批数据
+ */
+- (void)importFromQueue:(DatabaseImportQueue *)queue intoStore:(DatabaseStore *)store token:(DatabaseCancellationToken *)token rowCount:(NSUInteger)rowCount completion:(void (^)(BOOL success, NSUInteger rowCount))completion{
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        NSUInteger batchesPerCommit = MAX(self.batchesPerCommit, 1);
+        NSArray<NSArray *> *first = token.isCancelled ? nil : [queue popUpTo:batchesPerCommit wait:YES];
+        if (first == nil) {
+            NSError *error = queue.error;
+            if (error) {
+                NSLog(@"%@ import error ===== %@",self.tableName,error);
+            }
+            [queue cancel];
+            completion(!token.isCancelled && error == nil, rowCount);
+            return;
+        }
+
+        __block NSArray<NSArray *> *groups = first;
+        __block NSUInteger groupsIndex = 0;
+        __block NSUInteger committedCount = rowCount;
+        __block BOOL failed = NO;
+        [store databaseInLane:DatabaseLaneBackground token:token batches:^BOOL(FMDatabase *database, NSUInteger batchIndex, BOOL *rollback) {
+            if (batchIndex != groupsIndex) {
+                //上一批已提交
+                committedCount += [self rowCountOfGroups:groups];
+                groups = [queue popUpTo:batchesPerCommit wait:NO];
+                groupsIndex = batchIndex;
+            }
+            if (groups.count == 0) {
+                return NO;
+            }
+            for (NSArray<NSArray *> *batch in groups) {
+                @autoreleasepool {
+                    for (NSArray *row in batch) {
+                        if (![database executeUpdate:self.upsertSQL withArgumentsInArray:row]) {
+                            NSLog(@"%@ import error ===== %@",self.tableName,database.lastError);
+                            failed = YES;
+                            *rollback = YES;
+                            return NO;
+                        }
+                    }
+                }
+            }
+            return YES;
+        } completion:^(BOOL finished) {
+            if (!finished || failed) {
+                [queue cancel];
+                completion(NO, committedCount);
+                return;
+            }
+            [self importFromQueue:queue intoStore:store token:token rowCount:committedCount completion:completion];
+        }];
+    });
+}
+
+- (NSUInteger)rowCountOfGroups:(NSArray<NSArray *> *)groups{
+    NSUInteger count = 0;
+    for (NSArray *batch in groups) {
+        count += batch.count;
+    }
+    return count;
+}
+
+@end
@@ -0,0 +1,41 @@
+//
+//  DatabaseJSONRowReader.h
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/28.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** 流式读取 JSON 文件，将其中的每个对象展开为一行
+ *
+ * 按固定大小的缓冲区从文件中读取，不把整个文件或整棵树加载到内存中：
+ * 每个对象读取完毕时，以它的标量成员（字符串、数字、布尔值）回调一次，嵌套的对象、数组依次展开，子对象先于父对象回调；
+ * 数字保留原文，布尔值为 @"1"、@"0"，null 被忽略；
+ * 内存占用只与嵌套深度、单个对象的大小有关，与文件大小无关
+ */
+@interface DatabaseJSONRowReader : NSObject
+
+- (instancetype)initWithPath:(NSString *)path;
+- (instancetype)init NS_UNAVAILABLE;
+
+/** 读取缓冲区的大小，默认 16 KB
+ */
+@property (nonatomic, assign) NSUInteger bufferSize;
+
+/** 读取失败时的错误
+ */
+@property (nonatomic, strong, readonly, nullable) NSError *error;
+
+/** 在当前线程读取整个文件
+ * @param block 每个对象的标量成员；设置 stop 为 YES 时停止读取
+ * @return 读取到文件末尾且格式正确时返回 YES
+ */
+- (BOOL)readObjects:(void (^)(NSDictionary<NSString *, NSString *> *object, BOOL *stop))block;
+
+@end
+
+NS_ASSUME_NONNULL_END
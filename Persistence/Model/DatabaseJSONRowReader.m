@@ -0,0 +1,367 @@
+//
+//  DatabaseJSONRowReader.m
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/28.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import "DatabaseJSONRowReader.h"
+
+static int const DatabaseJSONEnd = -1;
+static NSUInteger const DatabaseJSONMaxDepth = 64;
+
+@interface DatabaseJSONRowReader ()
+{
+    NSString *_path;
+    NSInputStream *_stream;
+    uint8_t *_buffer;
+    NSInteger _length;//缓冲区中有效的字节数
+    NSInteger _position;//缓冲区中下一个读取的位置
+    unsigned long long _offset;//缓冲区之前已读取的字节数，用于错误信息
+    NSMutableData *_token;//解析字符串、数字时复用的缓冲区
+    void (^_block)(NSDictionary<NSString *, NSString *> *object, BOOL *stop);
+    BOOL _stopped;
+}
+@end
+
+@implementation DatabaseJSONRowReader
+
+/** 当前字节，不前进；缓冲区读完时从文件中读取下一段
+ */
+static inline int DatabaseJSONPeek(DatabaseJSONRowReader *reader){
+    if (reader->_position >= reader->_length) {
+        reader->_offset += reader->_length;
+        reader->_position = 0;
+        reader->_length = [reader->_stream read:reader->_buffer maxLength:reader->_bufferSize];
+        if (reader->_length <= 0) {
+            reader->_length = 0;
+            return DatabaseJSONEnd;
+        }
+    }
+    return reader->_buffer[reader->_position];
+}
+
+static inline int DatabaseJSONNext(DatabaseJSONRowReader *reader){
+    int c = DatabaseJSONPeek(reader);
+    if (c != DatabaseJSONEnd) {
+        reader->_position++;
+    }
+    return c;
+}
+
+static inline int DatabaseJSONSkipSpace(DatabaseJSONRowReader *reader){
+    int c = DatabaseJSONPeek(reader);
+    while (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+        reader->_position++;
+        c = DatabaseJSONPeek(reader);
+    }
+    return c;
+}
+
+- (instancetype)initWithPath:(NSString *)path{
+    self = [super init];
+    if (self) {
+        _path = [path copy];
+        _bufferSize = 16 * 1024;
+    }
+    return self;
+}
+
+- (BOOL)readObjects:(void (^)(NSDictionary<NSString *, NSString *> *object, BOOL *stop))block{
+    _stream = [NSInputStream inputStreamWithFileAtPath:_path];
+    [_stream open];
+    if (_stream.streamStatus != NSStreamStatusOpen) {
+        _error = _stream.streamError ?: [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadNoSuchFileError userInfo:@{NSFilePathErrorKey : _path ?: @""}];
+        _stream = nil;
+        return NO;
+    }
+
+    _bufferSize = MAX(_bufferSize, 64);
+    _buffer = malloc(_bufferSize);
+    _length = 0;
+    _position = 0;
+    _offset = 0;
+    _token = [NSMutableData dataWithCapacity:256];
+    _block = block;
+    _stopped = NO;
+    _error = nil;
+
+    NSString *scalar = nil;
+    BOOL result = [self parseValueAtDepth:0 scalar:&scalar];
+    if (result && !_stopped && DatabaseJSONSkipSpace(self) != DatabaseJSONEnd) {
+        result = [self failWithReason:@"文件末尾有多余的内容"];
+    }
+    if (result && _stream.streamStatus == NSStreamStatusError) {
+        _error = _stream.streamError;
+        result = NO;
+    }
+
+    [_stream close];
+    _stream = nil;
+    free(_buffer);
+    _buffer = NULL;
+    _token = nil;
+    _block = nil;
+    return result && !_stopped;
+}
+
+- (BOOL)failWithReason:(NSString *)reason{
+    if (_error == nil) {
+        NSString *description = [NSString stringWithFormat:@"%@（第 %llu 字节）",reason,_offset + (unsigned long long)_position];
+        _error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSPropertyListReadCorruptError userInfo:@{NSLocalizedDescriptionKey : description, NSFilePathErrorKey : _path ?: @""}];
+    }
+    return NO;
+}
+
+#pragma mark - 解析
+
+/** 解析一个值：对象、数组在内部展开；字符串、数字、布尔值通过 scalar 返回，null 返回 nil
+ */
+- (BOOL)parseValueAtDepth:(NSUInteger)depth scalar:(NSString **)scalar{
+    int c = DatabaseJSONSkipSpace(self);
+    switch (c) {
+        case '{':
+            _position++;
+            return [self parseObjectAtDepth:depth + 1];
+        case '[':
+            _position++;
+            return [self parseArrayAtDepth:depth + 1];
+        case '"':{
+            _position++;
+            NSString *string = [self parseString];
+            *scalar = string;
+            return string != nil;
+        }
+        case DatabaseJSONEnd:
+            return [self failWithReason:@"意外的文件结尾"];
+        default:
+            return [self parseLiteral:scalar];
+    }
+}
+
+- (BOOL)parseObjectAtDepth:(NSUInteger)depth{
+    if (depth > DatabaseJSONMaxDepth) {
+        return [self failWithReason:@"嵌套层级过深"];
+    }
+    NSMutableDictionary<NSString *, NSString *> *object = [NSMutableDictionary dictionary];
+    int c = DatabaseJSONSkipSpace(self);
+    if (c == '}') {
+        _position++;
+        return YES;
+    }
+    while (YES) {
+        if (DatabaseJSONSkipSpace(self) != '"') {
+            return [self failWithReason:@"缺少成员名称"];
+        }
+        _position++;
+        NSString *key = [self parseString];
+        if (key == nil) {
+            return NO;
+        }
+        if (DatabaseJSONSkipSpace(self) != ':') {
+            return [self failWithReason:@"缺少冒号"];
+        }
+        _position++;
+
+        NSString *scalar = nil;
+        if (![self parseValueAtDepth:depth scalar:&scalar]) {
+            return NO;
+        }
+        if (_stopped) {
+            return YES;
+        }
+        if (scalar) {
+            object[key] = scalar;
+        }
+
+        c = DatabaseJSONSkipSpace(self);
+        if (c == ',') {
+            _position++;
+        }else if (c == '}') {
+            _position++;
+            break;
+        }else{
+            return [self failWithReason:@"对象中缺少逗号或右括号"];
+        }
+    }
+
+    //子对象已在解析成员时回调，父对象在最后回调
+    if (object.count) {
+        BOOL stop = NO;
+        _block(object, &stop);
+        _stopped = stop;
+    }
+    return YES;
+}
+
+- (BOOL)parseArrayAtDepth:(NSUInteger)depth{
+    if (depth > DatabaseJSONMaxDepth) {
+        return [self failWithReason:@"嵌套层级过深"];
+    }
+    int c = DatabaseJSONSkipSpace(self);
+    if (c == ']') {
+        _position++;
+        return YES;
+    }
+    while (YES) {
+        //数组中的标量不属于任何一行，忽略
+        NSString *scalar = nil;
+        if (![self parseValueAtDepth:depth scalar:&scalar]) {
+            return NO;
+        }
+        if (_stopped) {
+            return YES;
+        }
+        c = DatabaseJSONSkipSpace(self);
+        if (c == ',') {
+            _position++;
+        }else if (c == ']') {
+            _position++;
+            return YES;
+        }else{
+            return [self failWithReason:@"数组中缺少逗号或右括号"];
+        }
+    }
+}
+
+/** 数字、true、false、null
+ */
+- (BOOL)parseLiteral:(NSString **)scalar{
+    [_token setLength:0];
+    int c = DatabaseJSONPeek(self);
+    while (c != DatabaseJSONEnd && c != ',' && c != '}' && c != ']' && c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+        uint8_t byte = (uint8_t)c;
+        [_token appendBytes:&byte length:1];
+        _position++;
+        c = DatabaseJSONPeek(self);
+    }
+
+    const char *bytes = _token.bytes;
+    NSUInteger length = _token.length;
+    if (length == 4 && memcmp(bytes, "true", 4) == 0) {
+        *scalar = @"1";
+    }else if (length == 5 && memcmp(bytes, "false", 5) == 0) {
+        *scalar = @"0";
+    }else if (length == 4 && memcmp(bytes, "null", 4) == 0) {
+        *scalar = nil;
+    }else if (length && (bytes[0] == '-' || (bytes[0] >= '0' && bytes[0] <= '9'))) {
+        *scalar = [[NSString alloc] initWithBytes:bytes length:length encoding:NSASCIIStringEncoding];
+    }else{
+        return [self failWithReason:@"无法识别的值"];
+    }
+    return YES;
+}
+
+static inline int DatabaseJSONHexValue(int c){
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/** \u 之后的 4 位十六进制数；失败返回 -1
+ */
+- (int)parseHex4{
+    int value = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = DatabaseJSONHexValue(DatabaseJSONNext(self));
+        if (digit < 0) {
+            return -1;
+        }
+        value = (value << 4) | digit;
+    }
+    return value;
+}
+
+- (void)appendCodePoint:(uint32_t)codePoint{
+    uint8_t bytes[4];
+    NSUInteger length = 0;
+    if (codePoint < 0x80) {
+        bytes[length++] = (uint8_t)codePoint;
+    }else if (codePoint < 0x800) {
+        bytes[length++] = (uint8_t)(0xC0 | (codePoint >> 6));
+        bytes[length++] = (uint8_t)(0x80 | (codePoint & 0x3F));
+    }else if (codePoint < 0x10000) {
+        bytes[length++] = (uint8_t)(0xE0 | (codePoint >> 12));
+        bytes[length++] = (uint8_t)(0x80 | ((codePoint >> 6) & 0x3F));
+        bytes[length++] = (uint8_t)(0x80 | (codePoint & 0x3F));
+    }else{
+        bytes[length++] = (uint8_t)(0xF0 | (codePoint >> 18));
+        bytes[length++] = (uint8_t)(0x80 | ((codePoint >> 12) & 0x3F));
+        bytes[length++] = (uint8_t)(0x80 | ((codePoint >> 6) & 0x3F));
+        bytes[length++] = (uint8_t)(0x80 | (codePoint & 0x3F));
+    }
+    [_token appendBytes:bytes length:length];
+}
+
+/** 左引号之后的字符串：不含转义的片段整段复制，片段可以跨越多个缓冲区
+ */
+- (NSString *)parseString{
+    [_token setLength:0];
+    while (YES) {
+        if (DatabaseJSONPeek(self) == DatabaseJSONEnd) {
+            [self failWithReason:@"字符串没有结束"];
+            return nil;
+        }
+        NSInteger start = _position;
+        while (_position < _length && _buffer[_position] != '"' && _buffer[_position] != '\\') {
+            _position++;
+        }
+        [_token appendBytes:_buffer + start length:(NSUInteger)(_position - start)];
+        if (_position >= _length) {
+            continue;//当前缓冲区读完，读取下一段
+        }
+
+        uint8_t c = _buffer[_position++];
+        if (c == '"') {
+            break;
+        }
+
+        int escape = DatabaseJSONNext(self);
+        uint8_t byte = 0;
+        switch (escape) {
+            case '"': case '\\': case '/': byte = (uint8_t)escape; break;
+            case 'b': byte = '\b'; break;
+            case 'f': byte = '\f'; break;
+            case 'n': byte = '\n'; break;
+            case 'r': byte = '\r'; break;
+            case 't': byte = '\t'; break;
+            case 'u':{
+                int unit = [self parseHex4];
+                if (unit < 0) {
+                    [self failWithReason:@"错误的 \\u 转义"];
+                    return nil;
+                }
+                uint32_t codePoint = (uint32_t)unit;
+                if (unit >= 0xD800 && unit <= 0xDBFF) {
+                    //UTF-16 代理对
+                    if (DatabaseJSONNext(self) != '\\' || DatabaseJSONNext(self) != 'u') {
+                        [self failWithReason:@"不完整的代理对"];
+                        return nil;
+                    }
+                    int low = [self parseHex4];
+                    if (low < 0xDC00 || low > 0xDFFF) {
+                        [self failWithReason:@"不完整的代理对"];
+                        return nil;
+                    }
+                    codePoint = 0x10000 + (((uint32_t)unit - 0xD800) << 10) + ((uint32_t)low - 0xDC00);
+                }
+                [self appendCodePoint:codePoint];
+                continue;
+            }
+            default:
+                [self failWithReason:@"错误的转义字符"];
+                return nil;
+        }
+        [_token appendBytes:&byte length:1];
+    }
+
+    NSString *string = [[NSString alloc] initWithBytes:_token.bytes length:_token.length encoding:NSUTF8StringEncoding];
+    if (string == nil) {
+        [self failWithReason:@"字符串不是有效的 UTF-8"];
+    }
+    return string;
+}
+
+@end
@@ -0,0 +1,96 @@
+//
+//  DatabaseLiveQuery.h
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/6/6.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class DatabaseStore;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** 一次移动：旧结果中的下标 -> 新结果中的下标
+ */
+@interface DatabaseLiveQueryMove : NSObject
+@property (nonatomic, assign, readonly) NSUInteger fromIndex;
+@property (nonatomic, assign, readonly) NSUInteger toIndex;
+@end
+
+/** 两次查询结果之间的变化，与 UITableView、UICollectionView 批量更新的约定一致
+ * 行以标识区分：模型查询为唯一键的值（没有声明唯一键时为所有列的值），任意查询为 identityColumn 的值（没有指定时为整行）
+ */
+@interface DatabaseLiveQueryDiff : NSObject
+
+/** 被移除的行：旧结果中的下标
+ */
+@property (nonatomic, copy, readonly) NSIndexSet *removedIndexes;
+
+/** 新增的行：新结果中的下标
+ */
+@property (nonatomic, copy, readonly) NSIndexSet *insertedIndexes;
+
+/** 位置变化的行：只包含最少的一组移动，其余行的相对顺序不变；移动且内容变化的行表现为移除与新增
+ */
+@property (nonatomic, copy, readonly) NSArray<DatabaseLiveQueryMove *> *moves;
+
+/** 标识不变、位置不变、内容变化的行：旧结果中的下标；与 moves 没有重叠
+ */
+@property (nonatomic, copy, readonly) NSIndexSet *updatedIndexes;
+
+@property (nonatomic, assign, readonly) BOOL hasChanges;
+
+@end
+
+
+/** 实时查询：结果所依赖的表有修改提交之后，自动在只读连接上重新查询，并给出与上次结果的差异
+ *
+ * 开始时先编译一次查询语句，通过授权回调（SQLITE_READ）记录读取的表，包括视图、ATTACH 的数据库中的表；
+ * 之后观察这些表所在的数据库文件（DatabaseChangeTracker），只有依赖的表被修改时才重新查询，其余表的写入不触发；
+ * 全文索引的虚拟表按影子表（表名_data 等）的修改触发；
+ * 重新查询在交互通道中执行，执行期间再次发生的修改合并为之后的一次查询
+ *
+ * 依赖的表只在开始时记录一次：之后创建、删除的视图、表不会改变依赖
+ */
+@interface DatabaseLiveQuery : NSObject
+
+/** 模型查询：clause 为 nil 时查询所有行，否则为 WHERE 之后的条件；表所在的数据库文件由 DatabaseManagement 分配
+ * 结果为模型，没有声明唯一键的模型以所有列的值为标识
+ */
+- (instancetype)initWithModelClass:(Class)modelClass where:(nullable NSString *)clause arguments:(nullable NSArray *)arguments;
+
+/** 任意查询：结果为 NSDictionary（列名 -> 值）
+ * @param identityColumn 标识一行的列，例如主键；nil 时以整行为标识，内容的变化表现为移除与新增
+ */
+- (instancetype)initWithStore:(DatabaseStore *)store sql:(NSString *)sql arguments:(nullable NSArray *)arguments identityColumn:(nullable NSString *)identityColumn NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (nonatomic, strong, readonly) DatabaseStore *store;
+@property (nonatomic, copy, readonly) NSString *sql;
+
+/** 依赖的表：数据库文件的名称 -> 表名；开始之后记录
+ */
+@property (atomic, copy, readonly, nullable) NSDictionary<NSString *, NSSet<NSString *> *> *dependencies;
+
+/** 最近一次的结果
+ */
+@property (atomic, copy, readonly) NSArray *results;
+
+/** 开始：立即查询一次，之后每次结果变化时回调；结果没有变化时不回调
+ * @param queue 回调所在的队列，nil 为主队列
+ * @param handler 第一次回调的 diff 相对于空结果
+ */
+- (void)startWithQueue:(nullable dispatch_queue_t)queue handler:(void (^)(NSArray *results, DatabaseLiveQueryDiff *diff))handler;
+
+/** 停止：之后不再回调；可以再次开始
+ */
+- (void)stop;
+
+@property (atomic, assign, readonly, getter=isRunning) BOOL running;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,478 @@
+//
+//  DatabaseLiveQuery.m
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/6/6.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import "DatabaseLiveQuery.h"
+#import "DatabaseManagement.h"
+#import "DatabaseDAO.h"
+#import "FMDatabase.h"
+#import <sqlite3.h>
+
+@interface DatabaseLiveQueryMove ()
+@property (nonatomic, assign, readwrite) NSUInteger fromIndex;
+@property (nonatomic, assign, readwrite) NSUInteger toIndex;
+@end
+
+@implementation DatabaseLiveQueryMove
+
+- (NSString *)description{
+    return [NSString stringWithFormat:@"%lu -> %lu",(unsigned long)self.fromIndex,(unsigned long)self.toIndex];
+}
+
+@end
+
+/** 结果中的一行
+ */
+@interface DatabaseLiveQueryRow : NSObject
+{
+    @public
+    id _identity;//标识
+    id _content;//比较内容是否变化
+    id _object;//返回给调用方的模型或字典
+}
+@end
+
+@implementation DatabaseLiveQueryRow
+@end
+
+
+@interface DatabaseLiveQueryDiff ()
+@property (nonatomic, copy, readwrite) NSIndexSet *removedIndexes;
+@property (nonatomic, copy, readwrite) NSIndexSet *insertedIndexes;
+@property (nonatomic, copy, readwrite) NSArray<DatabaseLiveQueryMove *> *moves;
+@property (nonatomic, copy, readwrite) NSIndexSet *updatedIndexes;
+@end
+
+@implementation DatabaseLiveQueryDiff
+
+- (NSString *)description{
+    return [NSString stringWithFormat:@"<%@: %p> removed:%@ inserted:%@ moves:%@ updated:%@",NSStringFromClass(self.class),self,self.removedIndexes,self.insertedIndexes,self.moves,self.updatedIndexes];
+}
+
+- (BOOL)hasChanges{
+    return self.removedIndexes.count || self.insertedIndexes.count || self.moves.count || self.updatedIndexes.count;
+}
+
+/** 按标识匹配新旧两行，一次遍历完成（Heckel 算法）：
+ * 旧结果中没有匹配的行被移除，新结果中没有匹配的行为新增；
+ * 匹配的行按新结果的顺序排列旧下标，其中最长递增子序列中的行相对顺序不变，其余的行为移动，移动的行数最少；
+ * 顺序不变、内容不同的行为更新；移动且内容不同的行记为移除与新增，同一行不会既移动又更新
+ * 标识重复时按出现的顺序依次匹配
+ */
++ (instancetype)diffWithOldRows:(NSArray<DatabaseLiveQueryRow *> *)oldRows newRows:(NSArray<DatabaseLiveQueryRow *> *)newRows{
+    NSMutableDictionary<id, NSMutableArray<NSNumber *> *> *oldIndexes = [NSMutableDictionary dictionaryWithCapacity:oldRows.count];
+    [oldRows enumerateObjectsUsingBlock:^(DatabaseLiveQueryRow *row, NSUInteger idx, BOOL *stop) {
+        NSMutableArray<NSNumber *> *indexes = oldIndexes[row->_identity];
+        if (indexes == nil) {
+            indexes = [NSMutableArray arrayWithCapacity:1];
+            oldIndexes[row->_identity] = indexes;
+        }
+        [indexes addObject:@(idx)];
+    }];
+
+    NSUInteger oldCount = oldRows.count, newCount = newRows.count;
+    NSInteger *oldForNew = malloc(sizeof(NSInteger) * MAX(newCount, 1));//新结果的每一行匹配的旧下标，-1 为新增
+    BOOL *oldMatched = calloc(MAX(oldCount, 1), sizeof(BOOL));
+    NSUInteger matchedCount = 0;
+    for (NSUInteger i = 0; i < newCount; i++) {
+        NSMutableArray<NSNumber *> *indexes = oldIndexes[newRows[i]->_identity];
+        if (indexes.count) {
+            NSUInteger j = indexes.firstObject.unsignedIntegerValue;
+            [indexes removeObjectAtIndex:0];
+            oldForNew[i] = (NSInteger)j;
+            oldMatched[j] = YES;
+            matchedCount++;
+        }else{
+            oldForNew[i] = -1;
+        }
+    }
+
+    //最长递增子序列（耐心排序，O(n log n)）：tails[k] 为长度 k+1 的递增子序列末尾的新下标，previous 记录前一个新下标
+    NSUInteger *tails = malloc(sizeof(NSUInteger) * MAX(matchedCount, 1));
+    NSInteger *previous = malloc(sizeof(NSInteger) * MAX(newCount, 1));
+    BOOL *stable = calloc(MAX(newCount, 1), sizeof(BOOL));//新结果中相对顺序不变的行
+    NSUInteger length = 0;
+    for (NSUInteger i = 0; i < newCount; i++) {
+        NSInteger j = oldForNew[i];
+        if (j < 0) {
+            continue;
+        }
+        NSUInteger low = 0, high = length;
+        while (low < high) {
+            NSUInteger mid = (low + high) / 2;
+            if (oldForNew[tails[mid]] < j) {
+                low = mid + 1;
+            }else{
+                high = mid;
+            }
+        }
+        previous[i] = low > 0 ? (NSInteger)tails[low - 1] : -1;
+        tails[low] = i;
+        if (low == length) {
+            length++;
+        }
+    }
+    for (NSInteger i = length > 0 ? (NSInteger)tails[length - 1] : -1; i >= 0; i = previous[i]) {
+        stable[i] = YES;
+    }
+
+    NSMutableIndexSet *removed = [NSMutableIndexSet indexSet];
+    for (NSUInteger j = 0; j < oldCount; j++) {
+        if (!oldMatched[j]) {
+            [removed addIndex:j];
+        }
+    }
+
+    NSMutableIndexSet *inserted = [NSMutableIndexSet indexSet];
+    NSMutableIndexSet *updated = [NSMutableIndexSet indexSet];
+    NSMutableArray<DatabaseLiveQueryMove *> *moves = [NSMutableArray array];
+    for (NSUInteger i = 0; i < newCount; i++) {
+        NSInteger j = oldForNew[i];
+        if (j < 0) {
+            [inserted addIndex:i];
+            continue;
+        }
+        id oldContent = oldRows[j]->_content, newContent = newRows[i]->_content;
+        BOOL changed = oldContent != newContent && ![oldContent isEqual:newContent];
+        if (stable[i]) {
+            if (changed) {
+                [updated addIndex:j];
+            }
+        }else if (changed) {
+            //批量更新中移动的行不能同时刷新
+            [removed addIndex:j];
+            [inserted addIndex:i];
+        }else{
+            DatabaseLiveQueryMove *move = [[DatabaseLiveQueryMove alloc] init];
+            move.fromIndex = j;
+            move.toIndex = i;
+            [moves addObject:move];
+        }
+    }
+    free(oldForNew);
+    free(oldMatched);
+    free(tails);
+    free(previous);
+    free(stable);
+
+    DatabaseLiveQueryDiff *diff = [[DatabaseLiveQueryDiff alloc] init];
+    diff.removedIndexes = removed;
+    diff.insertedIndexes = inserted;
+    diff.moves = moves;
+    diff.updatedIndexes = updated;
+    return diff;
+}
+
+@end
+
+
+@interface DatabaseLiveQuery ()
+{
+    dispatch_queue_t _stateQueue;//串行队列：以下状态与修改的回调都在其中处理
+    NSArray *_arguments;
+    NSString *_identityColumn;
+    DatabaseModelMapping *_mapping;//模型查询的映射；任意查询为 nil
+
+    dispatch_queue_t _handlerQueue;
+    void (^_handler)(NSArray *results, DatabaseLiveQueryDiff *diff);
+    NSUInteger _generation;//每次开始递增，丢弃停止之前提交的查询结果
+    NSArray<DatabaseLiveQueryRow *> *_rows;
+    NSArray<DatabaseChangeObservation *> *_observations;
+    DatabaseCancellationToken *_token;//正在执行的查询
+    BOOL _needsRefresh;//查询期间依赖的表又被修改
+    BOOL _hasDelivered;//开始之后是否已回调过
+}
+@property (atomic, copy, readwrite, nullable) NSDictionary<NSString *, NSSet<NSString *> *> *dependencies;
+@property (atomic, copy, readwrite) NSArray *results;
+@property (atomic, assign, readwrite, getter=isRunning) BOOL running;
+@end
+
+@implementation DatabaseLiveQuery
+
+- (instancetype)initWithModelClass:(Class)modelClass where:(NSString *)clause arguments:(NSArray *)arguments{
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:modelClass];
+    NSString *sql = clause.length ? [NSString stringWithFormat:@"%@ WHERE %@",mapping.selectSQL,clause] : mapping.selectSQL;
+    self = [self initWithStore:[DatabaseDAO storeForClass:modelClass] sql:sql arguments:arguments identityColumn:nil];
+    if (self) {
+        _mapping = mapping;
+    }
+    return self;
+}
+
+- (instancetype)initWithStore:(DatabaseStore *)store sql:(NSString *)sql arguments:(NSArray *)arguments identityColumn:(NSString *)identityColumn{
+    self = [super init];
+    if (self) {
+        _store = store;
+        _sql = [sql copy];
+        _arguments = [arguments copy] ?: @[];
+        _identityColumn = [identityColumn copy];
+        _stateQueue = dispatch_queue_create("com.persistence.liveQuery", DISPATCH_QUEUE_SERIAL);
+        _rows = @[];
+        _results = @[];
+    }
+    return self;
+}
+
+- (void)dealloc{
+    for (DatabaseChangeObservation *observation in _observations) {
+        [observation invalidate];
+    }
+    [_token cancel];
+}
+
+- (NSString *)description{
+    return [NSString stringWithFormat:@"<%@: %p> %@ %@ dependencies:%@",NSStringFromClass(self.class),self,self.store.name,self.sql,self.dependencies];
+}
+
+#pragma mark - 开始、停止
+
+- (void)startWithQueue:(dispatch_queue_t)queue handler:(void (^)(NSArray *results, DatabaseLiveQueryDiff *diff))handler{
+    dispatch_async(_stateQueue, ^{
+        if (self.running) {
+            return;
+        }
+        self.running = YES;
+        self->_generation++;
+        self->_handlerQueue = queue ?: dispatch_get_main_queue();
+        self->_handler = [handler copy];
+        self->_rows = @[];
+        self->_hasDelivered = NO;
+        self.results = @[];
+
+        if (self.dependencies) {
+            [self observeDependencies];
+            [self refresh];
+            return;
+        }
+        //先记录依赖并开始观察，再执行第一次查询：两者之间提交的修改也包含在第一次的结果中
+        NSUInteger generation = self->_generation;
+        __weak typeof(self) weakSelf = self;
+        self->_token = [self.store databaseInLane:DatabaseLaneInteractive read:^(FMDatabase *database) {
+            DatabaseLiveQuery *strongSelf = weakSelf;
+            NSDictionary *dependencies = [strongSelf dependenciesInDatabase:database];
+            if (dependencies == nil) {
+                return;
+            }
+            dispatch_async(strongSelf->_stateQueue, ^{
+                if (!strongSelf.running || strongSelf->_generation != generation) {
+                    return;
+                }
+                strongSelf->_token = nil;
+                strongSelf.dependencies = dependencies;
+                [strongSelf observeDependencies];
+                [strongSelf refresh];
+            });
+        }];
+    });
+}
+
+- (void)stop{
+    dispatch_async(_stateQueue, ^{
+        if (!self.running) {
+            return;
+        }
+        self.running = NO;
+        self->_generation++;
+        for (DatabaseChangeObservation *observation in self->_observations) {
+            [observation invalidate];
+        }
+        self->_observations = nil;
+        [self->_token cancel];
+        self->_token = nil;
+        self->_needsRefresh = NO;
+        self->_handler = nil;
+    });
+}
+
+#pragma mark - 依赖的表
+
+/** 编译查询语句（不执行），通过授权回调记录读取的表
+ * 未限定数据库名称的表按 SQLite 的查找顺序（temp、main、ATTACH 的数据库）确定所在的数据库
+ * @return 编译失败时返回 nil
+ */
+- (NSDictionary<NSString *, NSSet<NSString *> *> *)dependenciesInDatabase:(FMDatabase *)database{
+    NSMutableDictionary<NSString *, NSMutableSet<NSString *> *> *schemaTables = [NSMutableDictionary dictionary];
+    NSMutableSet<NSString *> *unqualifiedTables = [NSMutableSet set];
+    [database setAuthorizer:^int(int actionCode, NSString *arg1, NSString *arg2, NSString *databaseName, NSString *triggerOrView) {
+        if (actionCode == SQLITE_READ && arg1.length && ![arg1 hasPrefix:@"sqlite_"]) {
+            if (databaseName) {
+                NSMutableSet<NSString *> *tables = schemaTables[databaseName];
+                if (tables == nil) {
+                    tables = [NSMutableSet set];
+                    schemaTables[databaseName] = tables;
+                }
+                [tables addObject:arg1];
+            }else{
+                [unqualifiedTables addObject:arg1];
+            }
+        }
+        return SQLITE_OK;
+    }];
+    sqlite3_stmt *statement = NULL;
+    int rc = sqlite3_prepare_v2(database.sqliteHandle, self.sql.UTF8String, -1, &statement, NULL);
+    sqlite3_finalize(statement);
+    [database setAuthorizer:nil];
+    if (rc != SQLITE_OK) {
+        NSLog(@"%@ prepare error ===== %@",self,database.lastErrorMessage);
+        return nil;
+    }
+
+    if (unqualifiedTables.count) {
+        NSMutableArray<NSString *> *schemas = [NSMutableArray arrayWithObjects:@"temp",@"main",nil];
+        FMResultSet *resultSet = [database executeQuery:@"PRAGMA database_list"];
+        while ([resultSet next]) {
+            NSString *name = [resultSet stringForColumn:@"name"];
+            if (![schemas containsObject:name]) {
+                [schemas addObject:name];
+            }
+        }
+        [resultSet close];
+        for (NSString *table in unqualifiedTables) {
+            for (NSString *schema in schemas) {
+                NSString *sql = [NSString stringWithFormat:@"SELECT 1 FROM \"%@\".sqlite_master WHERE type IN ('table','view') AND name = ?",schema];
+                if ([database intForQuery:sql,table]) {
+                    NSMutableSet<NSString *> *tables = schemaTables[schema] ?: [NSMutableSet set];
+                    [tables addObject:table];
+                    schemaTables[schema] = tables;
+                    break;
+                }
+            }
+        }
+    }
+
+    //main 为本数据库；temp 中的表只属于这个连接，不会被写连接修改
+    NSMutableDictionary<NSString *, NSSet<NSString *> *> *dependencies = [NSMutableDictionary dictionary];
+    [schemaTables enumerateKeysAndObjectsUsingBlock:^(NSString *schema, NSMutableSet<NSString *> *tables, BOOL *stop) {
+        if ([schema isEqualToString:@"temp"]) {
+            return;
+        }
+        NSString *storeName = [schema isEqualToString:@"main"] ? self.store.name : schema;
+        NSMutableSet<NSString *> *merged = [dependencies[storeName] mutableCopy] ?: [NSMutableSet set];
+        [merged unionSet:tables];
+        dependencies[storeName] = merged;
+    }];
+    return dependencies;
+}
+
+/** 在依赖的每个数据库文件上注册观察者，修改在 _stateQueue 中回调
+ * @note 只在 _stateQueue 中调用
+ */
+- (void)observeDependencies{
+    NSMutableArray<DatabaseChangeObservation *> *observations = [NSMutableArray array];
+    __weak typeof(self) weakSelf = self;
+    [self.dependencies enumerateKeysAndObjectsUsingBlock:^(NSString *storeName, NSSet<NSString *> *tables, BOOL *stop) {
+        DatabaseStore *store = [storeName isEqualToString:self.store.name] ? self.store : [DatabaseManagement storeNamed:storeName];
+        if (store == nil) {
+            return;
+        }
+        //不限定表名：全文索引的影子表同样需要触发
+        [observations addObject:[store addChangeObserverForTables:nil queue:self->_stateQueue block:^(DatabaseChangeSet *changes) {
+            DatabaseLiveQuery *strongSelf = weakSelf;
+            if (strongSelf.running && [strongSelf dependsOnChanges:changes tables:tables]) {
+                [strongSelf refresh];
+            }
+        }]];
+    }];
+    _observations = observations;
+}
+
+- (BOOL)dependsOnChanges:(DatabaseChangeSet *)changes tables:(NSSet<NSString *> *)tables{
+    if (changes.resetsAllTables) {
+        return YES;
+    }
+    for (NSString *changedTable in changes.tableNames) {
+        if ([tables containsObject:changedTable]) {
+            return YES;
+        }
+        NSRange range = [changedTable rangeOfString:@"_" options:NSBackwardsSearch];
+        if (range.location != NSNotFound && [tables containsObject:[changedTable substringToIndex:range.location]]) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+#pragma mark - 查询
+
+/** 重新查询；已有查询在执行时合并为之后的一次
+ * @note 只在 _stateQueue 中调用
+ */
+- (void)refresh{
+    if (_token && !_token.isCancelled) {
+        _needsRefresh = YES;
+        return;
+    }
+    _needsRefresh = NO;
+    NSUInteger generation = _generation;
+    __weak typeof(self) weakSelf = self;
+    _token = [self.store databaseInLane:DatabaseLaneInteractive read:^(FMDatabase *database) {
+        DatabaseLiveQuery *strongSelf = weakSelf;
+        if (strongSelf == nil) {
+            return;
+        }
+        NSArray<DatabaseLiveQueryRow *> *rows = [strongSelf rowsInDatabase:database];
+        dispatch_async(strongSelf->_stateQueue, ^{
+            [strongSelf didFetchRows:rows generation:generation];
+        });
+    }];
+}
+
+- (NSArray<DatabaseLiveQueryRow *> *)rowsInDatabase:(FMDatabase *)database{
+    FMResultSet *resultSet = [database executeQuery:self.sql withArgumentsInArray:_arguments];
+    if (resultSet == nil) {
+        NSLog(@"%@ error ===== %@",self,database.lastError);
+        return @[];
+    }
+    NSMutableArray<DatabaseLiveQueryRow *> *rows = [NSMutableArray array];
+    while ([resultSet next]) {
+        DatabaseLiveQueryRow *row = [[DatabaseLiveQueryRow alloc] init];
+        if (_mapping) {
+            id model = [_mapping modelFromResultSet:resultSet];
+            row->_object = model;
+            row->_content = [_mapping argumentsForModel:model];
+            row->_identity = [_mapping uniqueValueForModel:model] ?: row->_content;
+        }else{
+            NSDictionary *dictionary = [resultSet resultDictionary];
+            row->_object = dictionary;
+            row->_content = dictionary;
+            row->_identity = (_identityColumn ? dictionary[_identityColumn] : nil) ?: dictionary;
+        }
+        [rows addObject:row];
+    }
+    [resultSet close];
+    return rows;
+}
+
+/** @note 只在 _stateQueue 中调用
+ */
+- (void)didFetchRows:(NSArray<DatabaseLiveQueryRow *> *)rows generation:(NSUInteger)generation{
+    if (!self.running || generation != _generation) {
+        return;
+    }
+    _token = nil;
+    DatabaseLiveQueryDiff *diff = [DatabaseLiveQueryDiff diffWithOldRows:_rows newRows:rows];
+    _rows = rows;
+    NSMutableArray *results = [NSMutableArray arrayWithCapacity:rows.count];
+    for (DatabaseLiveQueryRow *row in rows) {
+        [results addObject:row->_object];
+    }
+    self.results = results;
+
+    if (diff.hasChanges || !_hasDelivered) {
+        _hasDelivered = YES;
+        void (^handler)(NSArray *, DatabaseLiveQueryDiff *) = _handler;
+        NSArray *snapshot = [results copy];
+        dispatch_async(_handlerQueue, ^{
+            handler(snapshot, diff);
+        });
+    }
+    if (_needsRefresh) {
+        [self refresh];
+    }
+}
+
+@end
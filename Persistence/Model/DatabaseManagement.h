@@ -12,6 +12,8 @@
 #import "FMDatabase.h"
 #import "FMResultSet.h"
 #import "FMDatabaseAdditions.h"
+#import "FMDatabaseQueue.h"
+#import "DatabaseStore.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -29,25 +31,139 @@ NS_ASSUME_NONNULL_BEGIN
  */
 + (void)dropTableWithName:(NSString *)tableName;
 
-/** 清空一张表
+/** 清空一张已注册表结构的表：按注册的表结构重建（见 DatabaseStore 的 -emptyTablesWithSchemas:completion:），耗时与行数无关；清空整个数据库文件使用 +clearSqlite
+ * @param completion 在主线程回调是否已提交；没有注册表结构时回调 NO
  */
 + (void)emptyTableWithName:(NSString *)tableName;
++ (void)emptyTableWithName:(NSString *)tableName completion:(void (^ _Nullable)(BOOL success))completion;
+
+/** 数据库文件
+ * main：用户数据（UserModel、Persons、Cars 等），文件为 fmdb_Data.sqlite；
+ * reference：参考数据（PhoneCodeModel、ProvincesModel），文件为 fmdb_Reference.sqlite；旧版本保存在 main 中的这两张表在启动时删除；
+ * bundle：编译时由 Resource.bundle 生成的只读参考数据（Reference.sqlite），随 App 打包，以 immutable=1 打开并映射到内存；
+ *         reference 中没有数据时，PhoneCodeModel、ProvincesModel 读取其中的同名表，首次启动无需导入；写操作都在 reference 中执行；
+ * main、reference 各自持有写锁，参考数据的大批量导入不阻塞用户数据的写操作；
+ * reference、bundle 被 ATTACH 到 main 的只读连接上，main 的查询可以直接访问参考数据的表
+ */
++ (DatabaseStore *)mainStore;
++ (DatabaseStore *)referenceStore;
++ (nullable DatabaseStore *)bundleStore;
+
+/** 注册一个数据库文件，之后可以通过名称获取；注册时在该文件的维护通道中创建、升级分配到该文件的表
+ * 表结构就绪之前提交的读写任务排在其后执行
+ */
++ (void)registerStore:(DatabaseStore *)store;
+
+/** 根据名称获取数据库文件
+ */
++ (nullable DatabaseStore *)storeNamed:(NSString *)name;
+
+/** 将表分配到指定名称的数据库文件
+ */
++ (void)assignTable:(NSString *)tableName toStore:(NSString *)storeName;
+
+/** 获取表所在的数据库文件；没有分配的表位于 main
+ */
++ (DatabaseStore *)storeForTable:(NSString *)tableName;
+
+/** 观察表的修改：按表所在的数据库文件分别注册，每个文件的写连接每提交一个事务回调一次合并的修改（见 DatabaseChangeSet）
+ * 界面可以根据修改的 rowid 增量更新，不必每次写入之后重新读取整张表
+ * @param queue 回调所在的队列，nil 为主队列
+ * @return 调用 -invalidate 移除观察者
+ */
++ (DatabaseChangeObservation *)addChangeObserverForTables:(NSArray<NSString *> *)tableNames queue:(nullable dispatch_queue_t)queue block:(void (^)(DatabaseChangeSet *changes))block;
+
+/** 注册一张表的结构声明
+ * 内置的表在第一次访问数据库文件之前注册完毕；数据库文件已打开时注册的表在维护通道中创建、升级
+ */
++ (void)registerTableSchema:(DatabaseTableSchema *)schema;
+
+/** 已注册的所有表结构
+ */
++ (NSArray<DatabaseTableSchema *> *)tableSchemas;
+
+/** 已注册的一张表的结构；没有注册时返回 nil
+ */
++ (nullable DatabaseTableSchema *)tableSchemaForTable:(NSString *)tableName;
+
+/** 删除所有数据库文件中过期的行（有效期由表结构声明，例如 MAX_STORE_TIME）
+ * 启动后定期在维护通道中分批执行，也可以手动调用
+ */
++ (void)sweepExpiredRows;
+
+/** main 数据库的任务调度器：按通道的优先级与权重分派读写任务
+ */
++ (DatabaseScheduler *)scheduler;
+
+/** main 数据库的 WAL 检查点调度器：写连接提交事务时不再执行自动检查点
+ */
++ (DatabaseCheckpointScheduler *)checkpointScheduler;
+
+/** 以下提交数据库任务的方法作用于 main 数据库，其它数据库使用 DatabaseStore 的同名方法
+ * 都返回该任务的取消令牌：取消后，排队中的任务不再执行，正在执行的语句通过进度回调立即中断并回滚事务
+ */
 
 /** 使用事务执行一些操作
- * 在分线程中执行
+ * 在分线程中执行，属于用户写入通道
  */
-+ (void)databaseChildThreadInTransaction:(void (^)(FMDatabase *database, BOOL *rollback))block;
++ (DatabaseCancellationToken *)databaseChildThreadInTransaction:(void (^)(FMDatabase *database, BOOL *rollback))block;
 
 /** 使用事务执行一些操作
  * 在当前线程中执行（一般用于创建表时使用）
  */
 + (void)databaseCurrentThreadInTransaction:(void (^)(FMDatabase *database, BOOL *rollback))block;
 
-/** 清空数据
+/** 只读查询：在分线程中执行，属于交互通道
+ * 在只读连接上执行，不开启事务，不获取写锁；数据库处于 WAL 模式，读写互不阻塞
+ */
++ (DatabaseCancellationToken *)databaseChildThreadInRead:(void (^)(FMDatabase *database))block;
+
+/** 在指定通道中使用事务执行写操作：在分线程中执行
+ * 后台、维护通道的事务可能被更高优先级的写操作抢占：事务回滚后 block 稍后重新执行
+ */
++ (DatabaseCancellationToken *)databaseInLane:(DatabaseLane)lane transaction:(void (^)(FMDatabase *database, BOOL *rollback))block;
+
+/** 在指定通道中执行只读查询：在分线程中执行
+ */
++ (DatabaseCancellationToken *)databaseInLane:(DatabaseLane)lane read:(void (^)(FMDatabase *database))block;
+
+/** 在指定通道中分批执行大量写操作：在分线程中执行
+ * 每一批使用单独的事务，批次之间让出写连接，更高优先级的任务可以插入执行；
+ * @param block 执行第 batchIndex 批写操作，返回是否还有下一批；设置 rollback 为 YES 时回滚本批并停止后续批次
+ * @param completion 在主线程回调，finished 表示所有批次是否都已提交
+ */
++ (DatabaseCancellationToken *)databaseInLane:(DatabaseLane)lane batches:(BOOL (^)(FMDatabase *database, NSUInteger batchIndex, BOOL *rollback))block completion:(void (^ _Nullable)(BOOL finished))completion;
+
+/** 一致性只读查询：在分线程中执行
+ * 在只读连接上开启延迟事务，block 内的多次查询读取同一个数据库版本，且不阻塞写操作
+ */
++ (DatabaseCancellationToken *)databaseChildThreadInConsistentRead:(void (^)(FMDatabase *database))block;
+
+/** 合并写入：在分线程中执行
+ * 时间窗口内（或累计到最大数量）提交的写操作，合并到同一个事务中按提交顺序执行，整批只提交一次；
+ * 每个写操作在各自的保存点中执行，失败时只回滚自身，不影响同批次的其它写操作；
+ * @param block 写操作，返回该操作是否成功
+ * @param completion 在主线程回调该写操作自身的执行结果
+ * @note 取消令牌只能阻止还未执行的写操作；已开始执行的写操作与同批次的其它操作共用一个事务，不会被中断
+ */
++ (DatabaseCancellationToken *)databaseBatchWrite:(BOOL (^)(FMDatabase *database))block completion:(void (^ _Nullable)(BOOL success))completion;
+
+/** 设置合并写入的时间窗口（默认 0.01 秒）与单个批次的最大写操作数（默认 64）
+ */
++ (void)setBatchWriteInterval:(NSTimeInterval)interval maxCount:(NSUInteger)maxCount;
+
+/** 在主线程回调查询结果：在数据库任务中调用
+ * 所在任务的取消令牌已被取消时，不再回调
+ */
++ (void)databaseMainThreadCompletion:(void (^)(void))block;
+
+/** 清空所有数据库文件的数据
+ * 先取消所有未完成的任务（正在执行的语句立即中断），再用空的模板文件替换各个数据库文件，耗时与数据量无关
  */
 + (void)clearSqlite;
 
-/** 移除数据库中的每张表
+/** 移除所有数据库文件中的每张表
+ * 先取消所有未完成的任务（正在执行的语句立即中断），再移除每张表
 */
 + (void)dropSqlite;
 
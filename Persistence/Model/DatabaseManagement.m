@@ -9,58 +9,252 @@
 #import "DatabaseManagement.h"
 #import "PhoneCodeModel+DAO.h"
 #import "ProvincesModel+DAO.h"
-#import "FMDatabaseQueue.h"
+#import "UserModel+DAO.h"
+#import "Persons.h"
 
 NSString *groupSqliteFile(void){
     return [NSHomeDirectory() stringByAppendingPathComponent:@"Documents/fmdb_Data.sqlite"];
 }
 
+NSString *referenceSqliteFile(void){
+    return [NSHomeDirectory() stringByAppendingPathComponent:@"Documents/fmdb_Reference.sqlite"];
+}
+
+/** 编译时由 Scripts/build_reference_database.sh 生成，随 App 打包；没有打包时为 nil
+ */
+NSString *bundledReferenceSqliteFile(void){
+    return [[NSBundle mainBundle] pathForResource:@"Reference" ofType:@"sqlite"];
+}
+
 @implementation DatabaseManagement
 
 + (void)prepareWhenApplicationLaunch{
     NSLog(@"sqlite === %@",groupSqliteFile());
-    //创建表
-    NSInvocationOperation *tableOperation = [[NSInvocationOperation alloc] initWithTarget:self selector:@selector(creatGroupTable) object:nil];
-    tableOperation.queuePriority = NSOperationQueuePriorityVeryHigh;
+    //打开数据库文件；表结构在各自的维护通道中创建、升级，表结构已是最新时只读取一次 user_version
+    [self mainStore];
     
     //移除无效文件
     NSInvocationOperation *removeOperation = [[NSInvocationOperation alloc] initWithTarget:self selector:@selector(removeUselessFile) object:nil];
     removeOperation.queuePriority = NSOperationQueuePriorityLow;
+    [[self.scheduler operationQueueForLane:DatabaseLaneMaintenance] addOperation:removeOperation];
+    
+    //旧版本保存在 main 中的参考数据表
+    [self dropRelocatedTables];
     
-    [[self shareThreadQueue] addOperation:tableOperation];
-    [[self shareThreadQueue] addOperation:removeOperation];
+    //定期删除过期的缓存数据
+    [self startExpirySweeper];
+    
+    //预先生成重置用的模板文件
+    NSInvocationOperation *templateOperation = [[NSInvocationOperation alloc] initWithTarget:self selector:@selector(prepareResetTemplates) object:nil];
+    templateOperation.queuePriority = NSOperationQueuePriorityVeryLow;
+    [[self.scheduler operationQueueForLane:DatabaseLaneMaintenance] addOperation:templateOperation];
 }
 
-+ (FMDatabaseQueue *)databaseQueue{
-    static FMDatabaseQueue *databaseQueue = nil;
+#pragma mark - 数据库文件
+
+/** 已注册的数据库文件：名称 -> DatabaseStore
+ */
++ (NSMutableDictionary<NSString *, DatabaseStore *> *)stores{
+    static NSMutableDictionary *stores = nil;
     static dispatch_once_t onceToken;
     dispatch_once(&onceToken, ^{
-        if (databaseQueue == nil){
-            databaseQueue = [[FMDatabaseQueue alloc] initWithPath:groupSqliteFile()];
-        }
+        stores = [NSMutableDictionary dictionary];
     });
-    return databaseQueue;
+    return stores;
 }
 
-/** 实例化一个全局任务队列，限定Operation并发量
+/** 表所在的数据库文件：表名 -> 数据库名称
  */
-+ (NSOperationQueue *)shareThreadQueue{
-    static NSOperationQueue *threadQueue = nil;
++ (NSMutableDictionary<NSString *, NSString *> *)tableStores{
+    static NSMutableDictionary *tableStores = nil;
     static dispatch_once_t onceToken;
     dispatch_once(&onceToken, ^{
-        if (threadQueue == nil){
-            threadQueue = [[NSOperationQueue alloc] init];
-            threadQueue.maxConcurrentOperationCount = 6;
-            threadQueue.name = @"本地数据队列";
+        //参考数据的写入都在 reference 中；打包的 Reference.sqlite 只读，reference 中没有数据时作为读取的后备
+        tableStores = [NSMutableDictionary dictionaryWithDictionary:@{@"PhoneCodeModel" : @"reference",
+                                                                      @"ProvincesModel" : @"reference"}];
+    });
+    return tableStores;
+}
+
++ (DatabaseStore *)mainStore{
+    static DatabaseStore *mainStore = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        if (mainStore == nil){
+            mainStore = [[DatabaseStore alloc] initWithName:@"main" path:groupSqliteFile() profile:DatabaseStoreProfileReadWrite];
+            [mainStore attachStore:self.referenceStore];//跨文件查询参考数据
+            if (self.bundleStore) {
+                [mainStore attachStore:self.bundleStore];
+            }
+            [self registerStore:mainStore];
         }
     });
-    return threadQueue;
+    return mainStore;
+}
+
++ (DatabaseStore *)referenceStore{
+    static DatabaseStore *referenceStore = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        if (referenceStore == nil){
+            //参考数据需要在运行时导入，因此以可读写的方式打开
+            referenceStore = [[DatabaseStore alloc] initWithName:@"reference" path:referenceSqliteFile() profile:DatabaseStoreProfileReadWrite];
+            if (self.bundleStore) {
+                [referenceStore attachStore:self.bundleStore];//缓存中没有数据时读取打包的数据
+            }
+            [self registerStore:referenceStore];
+        }
+    });
+    return referenceStore;
+}
+
++ (DatabaseStore *)bundleStore{
+    static DatabaseStore *bundleStore = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSString *path = bundledReferenceSqliteFile();
+        if (bundleStore == nil && path){
+            //App 包中的文件不会被修改：不加锁、不检查 WAL，并映射到内存
+            bundleStore = [[DatabaseStore alloc] initWithName:@"bundle" path:path profile:DatabaseStoreProfileImmutable];
+            [self registerStore:bundleStore];
+        }
+    });
+    return bundleStore;
+}
+
++ (void)registerStore:(DatabaseStore *)store{
+    //不在调用方的线程（一般为启动时的主线程）中执行迁移
+    [store prepareSchemasInBackground:[self tableSchemasInStoreNamed:store.name]];
+    @synchronized (self.stores) {
+        self.stores[store.name] = store;
+    }
+}
+
++ (DatabaseStore *)storeNamed:(NSString *)name{
+    if ([name isEqualToString:@"main"]){
+        return self.mainStore;
+    }else if ([name isEqualToString:@"reference"]){
+        return self.referenceStore;
+    }else if ([name isEqualToString:@"bundle"]){
+        return self.bundleStore;
+    }
+    @synchronized (self.stores) {
+        return self.stores[name];
+    }
+}
+
++ (void)assignTable:(NSString *)tableName toStore:(NSString *)storeName{
+    @synchronized (self.tableStores) {
+        self.tableStores[tableName] = storeName;
+    }
+}
+
++ (DatabaseStore *)storeForTable:(NSString *)tableName{
+    return [self storeNamed:[self storeNameForTable:tableName]] ?: self.mainStore;
+}
+
++ (NSString *)storeNameForTable:(NSString *)tableName{
+    @synchronized (self.tableStores) {
+        return self.tableStores[tableName] ?: @"main";
+    }
+}
+
+#pragma mark - 表结构
+
+/** 已注册的表结构，默认包含所有内置的表
+ */
++ (NSMutableArray<DatabaseTableSchema *> *)registeredTableSchemas{
+    static NSMutableArray *schemas = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        schemas = [NSMutableArray arrayWithObjects:
+                   UserModel.tableSchema,
+                   UserInfoModel.tableSchema,
+                   Persons.tableSchema,
+                   Car.tableSchema,
+                   PhoneCodeModel.tableSchema,
+                   ProvincesModel.tableSchema,nil];
+    });
+    return schemas;
+}
+
++ (NSArray<DatabaseTableSchema *> *)tableSchemas{
+    @synchronized (self.registeredTableSchemas) {
+        return [self.registeredTableSchemas copy];
+    }
+}
+
++ (DatabaseTableSchema *)tableSchemaForTable:(NSString *)tableName{
+    @synchronized (self.registeredTableSchemas) {
+        for (DatabaseTableSchema *schema in self.registeredTableSchemas) {
+            if ([schema.tableName isEqualToString:tableName]) {
+                return schema;
+            }
+        }
+    }
+    return nil;
+}
+
++ (void)registerTableSchema:(DatabaseTableSchema *)schema{
+    @synchronized (self.registeredTableSchemas) {
+        NSUInteger index = [self.registeredTableSchemas indexOfObjectPassingTest:^BOOL(DatabaseTableSchema * _Nonnull obj, NSUInteger idx, BOOL * _Nonnull stop) {
+            return [obj.tableName isEqualToString:schema.tableName];
+        }];
+        if (index == NSNotFound) {
+            [self.registeredTableSchemas addObject:schema];
+        }else{
+            self.registeredTableSchemas[index] = schema;
+        }
+    }
+    
+    NSString *storeName = [self storeNameForTable:schema.tableName];
+    DatabaseStore *store;
+    @synchronized (self.stores) {
+        store = self.stores[storeName];
+    }
+    [store prepareSchemasInBackground:[self tableSchemasInStoreNamed:storeName]];
+}
+
+/** 分配到指定数据库文件的表结构
+ * @note 只根据表名与文件名称的对应关系过滤，不会打开数据库文件；创建数据库文件的过程中也可以调用
+ */
++ (NSArray<DatabaseTableSchema *> *)tableSchemasInStoreNamed:(NSString *)storeName{
+    NSMutableArray<DatabaseTableSchema *> *schemas = [NSMutableArray array];
+    for (DatabaseTableSchema *schema in self.tableSchemas) {
+        if ([[self storeNameForTable:schema.tableName] isEqualToString:storeName]) {
+            [schemas addObject:schema];
+        }
+    }
+    return schemas;
+}
+
+/** 所有已创建的数据库文件
+ */
++ (NSArray<DatabaseStore *> *)allStores{
+    [self mainStore];
+    @synchronized (self.stores) {
+        return self.stores.allValues;
+    }
+}
+
++ (FMDatabaseQueue *)databaseQueue{
+    return self.mainStore.writeQueue;
+}
+
++ (DatabaseScheduler *)scheduler{
+    return self.mainStore.scheduler;
 }
 
++ (DatabaseCheckpointScheduler *)checkpointScheduler{
+    return self.mainStore.checkpointScheduler;
+}
+
+#pragma mark - 表
+
 /** 创建一张表
 */
 + (void)creatTableWithName:(NSString *)tableName sql:(NSString *)sql{
-    [DatabaseManagement databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+    [[self storeForTable:tableName] databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
         if (![database tableExists:tableName]){
             [database executeUpdate:sql];
         }
@@ -71,107 +265,248 @@ NSString *groupSqliteFile(void){
  */
 + (void)dropTableWithName:(NSString *)tableName{
     NSString *sql = [NSString stringWithFormat:@"DROP TABLE IF EXISTS %@",tableName];
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+    NSString *versionSql = [NSString stringWithFormat:@"DELETE FROM %@ WHERE tableName = ?",DatabaseSchemaVersionTable];
+    DatabaseStore *store = [self storeForTable:tableName];
+    [store databaseBatchWrite:^BOOL(FMDatabase *database) {
         [database executeUpdate:sql];
+        //表结构与指纹不再一致，下次启动时重新创建
+        [database executeUpdate:versionSql,tableName];
+        database.userVersion = 0;
+        return !database.hadError;
+    } completion:^(BOOL success) {
+        //DROP TABLE 不经过 update_hook
+        if (success) {
+            [store tableDidChangeWithoutHook:tableName];
+        }
     }];
 }
 
 + (void)emptyTableWithName:(NSString *)tableName{
-    NSString *dropSql = [NSString stringWithFormat:@"DROP TABLE IF EXISTS %@",tableName];
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        
-        NSString *creatSql;
-        
-        FMResultSet *resultSet = database.getSchema;
-        while ([resultSet next]){
-            NSString *name = [resultSet stringForColumn:@"name"];
-            if ([name isEqualToString:tableName]) {
-                creatSql = [resultSet stringForColumn:@"sql"];
-                break;
-            }
+    [self emptyTableWithName:tableName completion:nil];
+}
+
++ (void)emptyTableWithName:(NSString *)tableName completion:(void (^)(BOOL success))completion{
+    DatabaseTableSchema *schema = [self tableSchemaForTable:tableName];
+    if (schema == nil) {
+        NSLog(@"%@ 没有注册表结构，无法重建",tableName);
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(NO);
+            });
         }
-        [resultSet close];
-        
-        [database executeUpdate:dropSql];
-        if (creatSql) {
-            [database executeUpdate:creatSql];
+        return;
+    }
+    [[self storeForTable:tableName] emptyTablesWithSchemas:@[schema] completion:completion];
+}
+
+#pragma mark - 修改通知
+
++ (DatabaseChangeObservation *)addChangeObserverForTables:(NSArray<NSString *> *)tableNames queue:(dispatch_queue_t)queue block:(void (^)(DatabaseChangeSet *changes))block{
+    //按所在的数据库文件分组，每个文件注册一个观察者
+    NSMapTable<DatabaseStore *, NSMutableArray<NSString *> *> *storeTables = [NSMapTable strongToStrongObjectsMapTable];
+    for (NSString *tableName in tableNames) {
+        DatabaseStore *store = [self storeForTable:tableName];
+        NSMutableArray<NSString *> *names = [storeTables objectForKey:store];
+        if (names == nil) {
+            names = [NSMutableArray array];
+            [storeTables setObject:names forKey:store];
         }
-    }];
+        [names addObject:tableName];
+    }
+    NSMutableArray<DatabaseChangeObservation *> *observations = [NSMutableArray array];
+    for (DatabaseStore *store in storeTables) {
+        [observations addObject:[store addChangeObserverForTables:[storeTables objectForKey:store] queue:queue block:block]];
+    }
+    return [[DatabaseChangeObservation alloc] initWithChildren:observations];
 }
 
-+ (void)databaseChildThreadInTransaction:(void (^)(FMDatabase *database, BOOL *rollback))block{
-    [[self shareThreadQueue] addOperationWithBlock:^{
-        [DatabaseManagement.databaseQueue inTransaction:^(FMDatabase *db, BOOL *rollback) {
-            [db setShouldCacheStatements:YES];
-            block(db,rollback);
-        }];
-    }];
+#pragma mark - main 数据库
+
++ (DatabaseCancellationToken *)databaseChildThreadInTransaction:(void (^)(FMDatabase *database, BOOL *rollback))block{
+    return [self.mainStore databaseChildThreadInTransaction:block];
 }
 
 + (void)databaseCurrentThreadInTransaction:(void (^)(FMDatabase *database, BOOL *rollback))block{
-    [DatabaseManagement.databaseQueue inTransaction:^(FMDatabase *db, BOOL *rollback) {
-        block(db,rollback);
-    }];
+    [self.mainStore databaseCurrentThreadInTransaction:block];
+}
+
++ (DatabaseCancellationToken *)databaseChildThreadInRead:(void (^)(FMDatabase *database))block{
+    return [self.mainStore databaseChildThreadInRead:block];
+}
+
++ (DatabaseCancellationToken *)databaseInLane:(DatabaseLane)lane read:(void (^)(FMDatabase *database))block{
+    return [self.mainStore databaseInLane:lane read:block];
+}
+
++ (DatabaseCancellationToken *)databaseChildThreadInConsistentRead:(void (^)(FMDatabase *database))block{
+    return [self.mainStore databaseChildThreadInConsistentRead:block];
+}
+
++ (DatabaseCancellationToken *)databaseInLane:(DatabaseLane)lane transaction:(void (^)(FMDatabase *database, BOOL *rollback))block{
+    return [self.mainStore databaseInLane:lane transaction:block];
 }
 
-+ (void)creatGroupTable{
-    [ProvincesModel creatTable];
-    [PhoneCodeModel creatTable];
++ (DatabaseCancellationToken *)databaseInLane:(DatabaseLane)lane batches:(BOOL (^)(FMDatabase *database, NSUInteger batchIndex, BOOL *rollback))block completion:(void (^)(BOOL finished))completion{
+    return [self.mainStore databaseInLane:lane batches:block completion:completion];
 }
 
++ (DatabaseCancellationToken *)databaseBatchWrite:(BOOL (^)(FMDatabase *database))block completion:(void (^)(BOOL success))completion{
+    return [self.mainStore databaseBatchWrite:block completion:completion];
+}
 
++ (void)setBatchWriteInterval:(NSTimeInterval)interval maxCount:(NSUInteger)maxCount{
+    [self.mainStore setBatchWriteInterval:interval maxCount:maxCount];
+}
 
++ (void)databaseMainThreadCompletion:(void (^)(void))block{
+    DatabaseCancellationToken *token = DatabaseCancellationToken.currentToken;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (!token.isCancelled){
+            block();
+        }
+    });
+}
 
 /** 移除缓数据
  */
 + (void)clearSqlite{
-    //如果还有针对数据库的操作，则全部取消
-    if ([self shareThreadQueue].operationCount > 0){
-        [[self shareThreadQueue] cancelAllOperations];
+    //先取消所有数据库文件上未完成的操作，再用空的模板文件替换
+    NSArray<DatabaseStore *> *stores = [self allStores];
+    [stores makeObjectsPerformSelector:@selector(cancelAllOperations)];
+    for (DatabaseStore *store in stores) {
+        //只读、不可变的数据库（bundle）不能替换
+        if (store.profile == DatabaseStoreProfileReadWrite) {
+            [store resetWithCompletion:nil];
+        }
     }
+}
+
++ (void)dropSqlite{
+    NSArray<DatabaseStore *> *stores = [self allStores];
+    [stores makeObjectsPerformSelector:@selector(cancelAllOperations)];
     
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [database interrupt];//中断数据库操作
-        
-        [database executeUpdate:@"UPDATE sqlite_sequence SET seq = 0"];
-        
-        FMResultSet *resultSet = database.getSchema;
-        while ([resultSet next]){
-            NSString *tbl_name = [resultSet stringForColumn:@"tbl_name"];
-            if (tbl_name) {
-                NSString *deleteSql = [NSString stringWithFormat:@"DELETE FROM %@",tbl_name];
-                [database executeUpdate:deleteSql];
+    for (DatabaseStore *store in stores) {
+        [store.scheduler writeInLane:DatabaseLaneUserWrite token:nil transaction:^(FMDatabase *database, BOOL *rollback) {
+            FMResultSet *resultSet = database.getSchema;
+            while ([resultSet next]){
+                
+                NSString *tbl_name = [resultSet stringForColumn:@"tbl_name"];
+                if (tbl_name) {
+                    NSString *dropSql = [NSString stringWithFormat:@"DROP TABLE IF EXISTS %@",tbl_name];
+                    [database executeUpdate:dropSql];
+                }
             }
-        }
-        [resultSet close];
+            [resultSet close];
+            database.userVersion = 0;//下次启动时重新创建所有表
+        } completion:^(BOOL committed) {
+            if (committed) {
+                [store reclaimSpaceWithCompletion:nil];//表被删除后的空闲页
+            }
+        }];
+    }
+}
 
-    }];
+/** 启动后 10 秒第一次删除过期数据，之后每 30 分钟一次
+ */
++ (void)startExpirySweeper{
+    static dispatch_source_t timer = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0));
+        dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, 10 * NSEC_PER_SEC), 30 * 60 * NSEC_PER_SEC, 60 * NSEC_PER_SEC);
+        dispatch_source_set_event_handler(timer, ^{
+            [self sweepExpiredRows];
+        });
+        dispatch_resume(timer);
+    });
 }
 
-+ (void)dropSqlite{
-    if ([self shareThreadQueue].operationCount > 0){
-        [[self shareThreadQueue] cancelAllOperations];
++ (void)sweepExpiredRows{
+    for (DatabaseStore *store in [self allStores]) {
+        NSArray<DatabaseTableSchema *> *schemas = [self tableSchemasInStoreNamed:store.name];
+        if ([schemas indexOfObjectPassingTest:^BOOL(DatabaseTableSchema * _Nonnull obj, NSUInteger idx, BOOL * _Nonnull stop) {
+            return obj.expiryColumn != nil;
+        }] != NSNotFound) {
+            [store sweepExpiredRowsInSchemas:schemas batchSize:200 completion:nil];
+        }
     }
-    
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [database interrupt];//中断数据库操作
-        
-        FMResultSet *resultSet = database.getSchema;
-        while ([resultSet next]){
-            
-            NSString *tbl_name = [resultSet stringForColumn:@"tbl_name"];
-            if (tbl_name) {
-                NSString *dropSql = [NSString stringWithFormat:@"DROP TABLE IF EXISTS %@",tbl_name];
-                [database executeUpdate:dropSql];
+}
+
+/** 分配到其它数据库文件的表在旧版本中位于 main（fmdb_Data.sqlite）：删除 main 中的旧表、全文索引与版本记录，再回收空闲页
+ * 这些表保存的是可以重新获取的参考数据，不复制到新文件；旧表不存在时只查询一次 sqlite_master
+ */
++ (void)dropRelocatedTables{
+    NSMutableArray<NSString *> *tableNames = [NSMutableArray array];
+    NSMutableArray<NSString *> *virtualTableNames = [NSMutableArray array];
+    NSRegularExpression *expression = [NSRegularExpression regularExpressionWithPattern:@"^CREATE VIRTUAL TABLE (?:IF NOT EXISTS )?(\\w+)" options:NSRegularExpressionCaseInsensitive error:nil];
+    for (DatabaseTableSchema *schema in self.tableSchemas) {
+        if ([[self storeNameForTable:schema.tableName] isEqualToString:@"main"]) {
+            continue;
+        }
+        [tableNames addObject:schema.tableName];
+        for (NSArray<NSString *> *sqls in schema.migrations.allValues) {
+            for (NSString *sql in sqls) {
+                NSTextCheckingResult *result = [expression firstMatchInString:sql options:0 range:NSMakeRange(0, sql.length)];
+                if (result) {
+                    [virtualTableNames addObject:[sql substringWithRange:[result rangeAtIndex:1]]];
+                }
             }
         }
+    }
+
+    DatabaseStore *store = self.mainStore;
+    NSMutableArray<NSString *> *droppedTables = [NSMutableArray array];
+    [store.scheduler writeInLane:DatabaseLaneMaintenance token:nil transaction:^(FMDatabase *database, BOOL *rollback) {
+        [droppedTables removeAllObjects];//被抢占后重新执行
+        NSMutableSet<NSString *> *existingTables = [NSMutableSet set];
+        FMResultSet *resultSet = [database executeQuery:@"SELECT name FROM sqlite_master WHERE type = 'table'"];
+        while ([resultSet next]){
+            [existingTables addObject:[resultSet stringForColumnIndex:0]];
+        }
         [resultSet close];
+
+        //先删除虚拟表（连同影子表），再删除基础表（连同索引、触发器）
+        for (NSString *tableName in [virtualTableNames arrayByAddingObjectsFromArray:tableNames]) {
+            if (![existingTables containsObject:tableName]) {
+                continue;
+            }
+            if (![database executeUpdate:[NSString stringWithFormat:@"DROP TABLE IF EXISTS \"%@\"",tableName]]) {
+                NSLog(@"drop relocated table %@ error ===== %@",tableName,database.lastError);
+                *rollback = YES;
+                return;
+            }
+            [droppedTables addObject:tableName];
+        }
+        if (droppedTables.count == 0) {
+            return;
+        }
+        for (NSString *tableName in tableNames) {
+            [database executeUpdate:[NSString stringWithFormat:@"DELETE FROM %@ WHERE tableName = ?",DatabaseSchemaVersionTable],tableName];
+            if ([existingTables containsObject:@"sqlite_sequence"]) {
+                [database executeUpdate:@"DELETE FROM sqlite_sequence WHERE name = ?",tableName];
+            }
+        }
+    } completion:^(BOOL committed) {
+        if (committed && droppedTables.count) {
+            NSLog(@"%@ dropped relocated tables %@",store,droppedTables);
+            for (NSString *tableName in droppedTables) {
+                [store tableDidChangeWithoutHook:tableName];
+            }
+            [store reclaimSpaceWithCompletion:nil];
+        }
     }];
+}
 
++ (void)prepareResetTemplates{
+    [[self allStores] makeObjectsPerformSelector:@selector(prepareResetTemplate)];
 }
 
+/** 回收各个数据库文件的空闲页
+ */
 + (void)removeUselessFile{
-    
+    for (DatabaseStore *store in [self allStores]) {
+        [store reclaimSpaceWithCompletion:nil];
+    }
 }
 
 + (void)info{
@@ -191,6 +526,7 @@ NSString *groupSqliteFile(void){
         NSLog(@"changes -- %d",db.changes);
 
         NSLog(@"goodConnection -- %d",db.goodConnection);
+        NSLog(@"busyCount -- %lu , busyWaitTime -- %f , busyTimeoutCount -- %lu",(unsigned long)db.busyCount,db.busyWaitTime,(unsigned long)db.busyTimeoutCount);
 
 //        NSLog(@"cachedStatements ---- %@",db.cachedStatements);
         
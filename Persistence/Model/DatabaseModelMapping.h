@@ -0,0 +1,204 @@
+//
+//  DatabaseModelMapping.h
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/27.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class FMDatabase;
+@class FMResultSet;
+@class DatabaseTableSchema;
+
+/** 按唯一键插入或更新一行的结果
+ */
+typedef NS_ENUM(NSInteger, DatabaseUpsertResult) {
+    DatabaseUpsertResultFailed = 0,
+    DatabaseUpsertResultInserted,//新的行
+    DatabaseUpsertResultUpdated,//已有的行，内容有变化
+    DatabaseUpsertResultUnchanged,//已有的行，内容相同，没有写入
+};
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** 模型类可选实现的映射规则，覆盖默认值
+ */
+@protocol DatabaseModel <NSObject>
+@optional
+
+/** 表名，默认为类名
+ */
++ (NSString *)databaseTableName;
+
+/** 唯一键对应的属性：更新、删除时作为 WHERE 条件；没有实现时不支持更新、删除
+ */
++ (NSString *)databaseUniqueKey;
+
+/** 属性名 -> 列名，默认列名与属性名相同
+ */
++ (NSDictionary<NSString *, NSString *> *)databaseColumnMapping;
+
+/** 不保存到数据库的属性
+ */
++ (NSArray<NSString *> *)databaseIgnoredProperties;
+
+/** 记录从数据库读取、写入之后修改过的属性，更新时只写入修改过的列；默认为 NO
+ * 开启时第一次获取映射会替换映射的属性的 setter（最多 64 个属性），修改记录为每个模型一个 64 位的掩码；
+ * 子类与父类不能同时开启
+ */
++ (BOOL)databaseTracksChanges;
+
+@end
+
+
+/** 模型类与表之间的映射：每个类只通过 runtime 解析一次属性，生成并缓存所有操作的 SQL 与绑定、读取计划
+ *
+ * 映射的属性：可读写，类型为 NSString、NSNumber、NSDate、NSData 或整型、浮点型、BOOL；
+ * 其余属性（数组、其它模型等）以及 databaseIgnoredProperties 中的属性被忽略；
+ * 绑定时按列的顺序直接调用 getter，nil 写入 NULL；读取时查询的列与映射的列顺序一致，按下标直接调用 setter，不再按列名查找
+ *
+ * 以下同步方法在调用方所在的数据库任务中执行，SQL 不变，写连接与只读连接缓存的预编译语句可以重复使用
+ *
+ * 开启修改记录（databaseTracksChanges）时，读取的模型、写入并提交的模型以当前的值为基准，之后调用 setter 的属性记为已修改；
+ * 更新只写入已修改的列，UPDATE 语句按修改的列缓存；没有修改时不执行语句；没有基准的模型（例如新建的模型）仍然写入所有的列；
+ * 写操作不清除修改记录，由调用方在事务提交之后调用 -commitChanges:ofModel:，事务回滚时修改保留
+ */
+@interface DatabaseModelMapping : NSObject
+
+/** 获取一个模型类的映射，第一次获取时生成，之后线程安全地复用
+ */
++ (instancetype)mappingForClass:(Class)modelClass;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (nonatomic, unsafe_unretained, readonly) Class modelClass;
+@property (nonatomic, copy, readonly) NSString *tableName;
+
+/** 映射的属性与对应的列，顺序一致
+ */
+@property (nonatomic, copy, readonly) NSArray<NSString *> *properties;
+@property (nonatomic, copy, readonly) NSArray<NSString *> *columns;
+
+/** 是否开启了修改记录
+ */
+@property (nonatomic, assign, readonly) BOOL tracksChanges;
+
+/** 唯一键对应的列；没有声明唯一键时为 nil
+ */
+@property (nonatomic, copy, readonly, nullable) NSString *uniqueColumn;
+
+/** 预先生成的 SQL；没有声明唯一键时 updateSQL、deleteSQL 为 nil
+ */
+@property (nonatomic, copy, readonly) NSString *insertSQL;
+@property (nonatomic, copy, readonly) NSString *replaceSQL;
+@property (nonatomic, copy, readonly, nullable) NSString *updateSQL;
+@property (nonatomic, copy, readonly, nullable) NSString *deleteSQL;
+
+/** INSERT ... ON CONFLICT(唯一键) DO UPDATE SET 其余的列 WHERE 至少一列不同
+ * 冲突时原地更新：rowid 不变，不消耗 AUTOINCREMENT 的序号，不触发 DELETE 触发器；内容相同的行不写入
+ * 唯一键必须有 UNIQUE 约束；没有声明唯一键时为 nil，没有其余的列时为 DO NOTHING
+ */
+@property (nonatomic, copy, readonly, nullable) NSString *upsertSQL;
+
+/** SELECT 映射的列 FROM 表；查询条件拼接在后面
+ */
+@property (nonatomic, copy, readonly) NSString *selectSQL;
+
+/** 查询 ATTACH 的数据库中的同名表：SELECT 映射的列 FROM schema.表；schema 为 nil 时与 selectSQL 相同
+ */
+- (NSString *)selectSQLInSchema:(nullable NSString *)schema;
+
+/** 根据属性名或列名获取映射的列；不是映射的列时返回 nil（用于校验调用方传入的列名，避免拼接任意字符串）
+ */
+- (nullable NSString *)columnForKey:(NSString *)key;
+
+/** 按 columns 的顺序读取模型的值，nil 为 NSNull
+ */
+- (NSArray *)argumentsForModel:(id)model;
+
+/** 按 columns 的下标为模型的属性赋值，调用 setter
+ * 类型与属性不一致的值被忽略；nil、NSNull 不赋值给基本类型的属性
+ */
+- (void)setValue:(nullable id)value atIndex:(NSUInteger)index forModel:(id)model;
+
+/** 唯一键的值
+ */
+- (nullable id)uniqueValueForModel:(id)model;
+
+/** 基准之后修改过的属性；没有开启修改记录、模型没有基准时返回 nil
+ */
+- (nullable NSArray<NSString *> *)changedPropertiesForModel:(id)model;
+
+/** 按读取计划将结果集的每一行解析为模型，读取完毕后关闭结果集
+ * 结果集的前 columns.count 列必须与 columns 一致（由 selectSQL 查询得到）
+ */
+- (NSMutableArray *)modelsFromResultSet:(FMResultSet *)resultSet;
+
+/** 将结果集的当前行解析为模型，不移动、不关闭结果集
+ */
+- (id)modelFromResultSet:(FMResultSet *)resultSet;
+
+/** 同上，映射的列从第 offset 列开始（JOIN 查询中多个表的列依次排列）
+ */
+- (id)modelFromResultSet:(FMResultSet *)resultSet columnOffset:(int)offset;
+
+/** 整理一组通过 json_each 绑定的值：json_each 返回的值不按列的类型转换，列映射为字符串属性时数字转为字符串
+ * column 不是映射的列时原样返回
+ */
+- (NSArray *)JSONValues:(NSArray *)values forColumn:(NSString *)column;
+
+/** 查询：clause 为 nil 时查询所有行，否则为 WHERE 之后的条件
+ */
+- (NSMutableArray *)modelsInDatabase:(FMDatabase *)database where:(nullable NSString *)clause arguments:(nullable NSArray *)arguments;
+
+/** 根据某一列的值查询；key 不是映射的列时返回空数组；extraClause 不为 nil 时以 AND 追加在条件之后
+ */
+- (NSMutableArray *)modelsInDatabase:(FMDatabase *)database key:(NSString *)key value:(nullable id)value extraClause:(nullable NSString *)extraClause;
+
+/** 同上，查询 ATTACH 的数据库 schema 中的同名表
+ */
+- (NSMutableArray *)modelsInDatabase:(FMDatabase *)database schema:(nullable NSString *)schema where:(nullable NSString *)clause arguments:(nullable NSArray *)arguments;
+- (NSMutableArray *)modelsInDatabase:(FMDatabase *)database schema:(nullable NSString *)schema key:(NSString *)key value:(nullable id)value extraClause:(nullable NSString *)extraClause;
+
+/** 按唯一键查询一行，同时读取该行的 rowid（用于行缓存的失效）；没有声明唯一键、没有该行时返回 nil
+ * extraClause 不为 nil 时以 AND 追加在条件之后
+ */
+- (nullable id)modelInDatabase:(FMDatabase *)database uniqueValue:(nullable id)value extraClause:(nullable NSString *)extraClause rowid:(int64_t * _Nullable)rowid;
+
+/** 按一组唯一键查询：整组唯一键编码为 JSON 数组，通过 json_each 在一条语句中查询，SQL 与唯一键的个数无关
+ * @param values 字符串或数字；唯一键为字符串属性时数字按字符串比较，其余类型需要传入与列一致的类型
+ * @param rowids 不为 nil 时写入每一行的 rowid，键与返回值相同
+ * @return 唯一键的值（读取到的值）-> 模型；不存在的唯一键不包含在内
+ */
+- (NSMutableDictionary *)modelsInDatabase:(FMDatabase *)database uniqueValues:(NSArray *)values extraClause:(nullable NSString *)extraClause rowids:(nullable NSMutableDictionary<id, NSNumber *> *)rowids;
+
+/** 写操作，返回是否成功；失败时打印错误
+ */
+- (BOOL)insertModel:(id)model replace:(BOOL)replace inDatabase:(FMDatabase *)database;
+- (BOOL)updateModel:(id)model inDatabase:(FMDatabase *)database;//开启修改记录时只写入修改过的列，没有修改时直接返回 YES
+- (BOOL)deleteModel:(id)model inDatabase:(FMDatabase *)database;
+
+/** 复制映射的列得到一个新的模型，未映射的属性（例如 childArray）不复制；副本有独立的修改记录，初始与原模型相同
+ * 用于把共享的模型（行缓存中的模型）交给会修改它的调用方
+ */
+- (nullable id)copyOfModel:(nullable id)model;
+
+/** 修改记录的快照：写操作之前获取；没有开启修改记录时为 0，没有基准的模型为所有的列
+ */
+- (uint64_t)changesOfModel:(id)model;
+
+/** 写入该模型的事务提交之后调用：清除快照中的修改，快照之后的修改保留到下一次更新；没有基准的模型以当前的值为基准
+ * 事务回滚、提交失败时不调用，下一次更新重新写入这些列
+ */
+- (void)commitChanges:(uint64_t)changes ofModel:(id)model;
+
+/** 按唯一键插入或更新（upsertSQL），根据影响的行数与 last_insert_rowid 区分插入、更新与未变化
+ * @param schema 带有效期的表：更新时同时刷新 expiryColumn；内容相同、但满足 schema.refreshClause 的行同样更新，刷新有效期；nil 时不处理有效期
+ */
+- (DatabaseUpsertResult)upsertModel:(id)model schema:(nullable DatabaseTableSchema *)schema inDatabase:(FMDatabase *)database;
+
+@end
+
+NS_ASSUME_NONNULL_END
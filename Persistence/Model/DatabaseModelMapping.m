@@ -0,0 +1,833 @@
+//
+//  DatabaseModelMapping.m
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/27.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import "DatabaseModelMapping.h"
+#import "FMDatabase.h"
+#import "FMResultSet.h"
+#import "DatabaseSchema.h"
+#import <sqlite3.h>
+#import <objc/runtime.h>
+#import <objc/message.h>
+#import <stdatomic.h>
+
+/** 对象属性的类型
+ */
+typedef NS_ENUM(NSInteger, DatabaseObjectKind) {
+    DatabaseObjectKindNone = 0,//基本类型
+    DatabaseObjectKindString,
+    DatabaseObjectKindNumber,
+    DatabaseObjectKindDate,
+    DatabaseObjectKindData,
+};
+
+/** 一列的绑定、读取计划：属性类型的编码与 getter、setter
+ */
+typedef struct {
+    char type;//'@' 为对象，其余为基本类型的编码
+    DatabaseObjectKind kind;
+    SEL getter;
+    SEL setter;
+} DatabaseColumnPlan;
+
+static DatabaseObjectKind DatabaseObjectKindForClass(Class cls){
+    //只接受不可变的类型：可变类型的属性不能直接赋值查询得到的对象
+    if (cls == NSString.class) return DatabaseObjectKindString;
+    if (cls == NSNumber.class) return DatabaseObjectKindNumber;
+    if (cls == NSDate.class) return DatabaseObjectKindDate;
+    if (cls == NSData.class) return DatabaseObjectKindData;
+    return DatabaseObjectKindNone;
+}
+
+/** 对象属性的类型对应的类：赋值时按 isKindOfClass: 判断，类簇的私有子类同样接受
+ */
+static Class DatabaseClassForObjectKind(DatabaseObjectKind kind){
+    switch (kind) {
+        case DatabaseObjectKindString: return NSString.class;
+        case DatabaseObjectKindNumber: return NSNumber.class;
+        case DatabaseObjectKindDate: return NSDate.class;
+        case DatabaseObjectKindData: return NSData.class;
+        default: return Nil;
+    }
+}
+
+/** 解析一个属性；不能映射时返回 NO
+ */
+static BOOL DatabaseColumnPlanForProperty(objc_property_t property, DatabaseColumnPlan *plan){
+    char *readonly = property_copyAttributeValue(property, "R");
+    if (readonly) {
+        free(readonly);
+        return NO;
+    }
+    char *encoding = property_copyAttributeValue(property, "T");
+    if (!encoding) {
+        return NO;
+    }
+
+    BOOL supported = YES;
+    plan->type = encoding[0];
+    plan->kind = DatabaseObjectKindNone;
+    switch (plan->type) {
+        case '@':{
+            //T@"NSString"
+            size_t length = strlen(encoding);
+            if (length > 3) {
+                NSString *className = [[NSString alloc] initWithBytes:encoding + 2 length:length - 3 encoding:NSUTF8StringEncoding];
+                plan->kind = DatabaseObjectKindForClass(NSClassFromString(className));
+            }
+            supported = plan->kind != DatabaseObjectKindNone;
+        }break;
+        case 'c': case 'B': case 's': case 'i': case 'l': case 'q':
+        case 'C': case 'S': case 'I': case 'L': case 'Q':
+        case 'f': case 'd':
+            break;
+        default:
+            supported = NO;
+            break;
+    }
+    free(encoding);
+    if (!supported) {
+        return NO;
+    }
+
+    NSString *name = @(property_getName(property));
+    char *getter = property_copyAttributeValue(property, "G");
+    char *setter = property_copyAttributeValue(property, "S");
+    plan->getter = getter ? sel_registerName(getter) : NSSelectorFromString(name);
+    plan->setter = setter ? sel_registerName(setter) : NSSelectorFromString([NSString stringWithFormat:@"set%@%@:",[name substringToIndex:1].uppercaseString,[name substringFromIndex:1]]);
+    free(getter);
+    free(setter);
+    return YES;
+}
+
+/** 绑定计划：调用 getter 读取属性的值
+ */
+static id DatabaseColumnValue(id model, const DatabaseColumnPlan *plan){
+    SEL getter = plan->getter;
+    switch (plan->type) {
+        case '@': return ((id (*)(id, SEL))objc_msgSend)(model, getter) ?: NSNull.null;
+        case 'c': return @(((char (*)(id, SEL))objc_msgSend)(model, getter));
+        case 'B': return @(((bool (*)(id, SEL))objc_msgSend)(model, getter));
+        case 's': return @(((short (*)(id, SEL))objc_msgSend)(model, getter));
+        case 'i': return @(((int (*)(id, SEL))objc_msgSend)(model, getter));
+        case 'l': return @(((long (*)(id, SEL))objc_msgSend)(model, getter));
+        case 'q': return @(((long long (*)(id, SEL))objc_msgSend)(model, getter));
+        case 'C': return @(((unsigned char (*)(id, SEL))objc_msgSend)(model, getter));
+        case 'S': return @(((unsigned short (*)(id, SEL))objc_msgSend)(model, getter));
+        case 'I': return @(((unsigned int (*)(id, SEL))objc_msgSend)(model, getter));
+        case 'L': return @(((unsigned long (*)(id, SEL))objc_msgSend)(model, getter));
+        case 'Q': return @(((unsigned long long (*)(id, SEL))objc_msgSend)(model, getter));
+        case 'f': return @(((float (*)(id, SEL))objc_msgSend)(model, getter));
+        case 'd': return @(((double (*)(id, SEL))objc_msgSend)(model, getter));
+        default: return NSNull.null;
+    }
+}
+
+/** 读取计划：按列的下标读取，调用 setter 赋值；NULL 的基本类型保持默认值
+ */
+static void DatabaseSetColumnValue(id model, const DatabaseColumnPlan *plan, FMResultSet *resultSet, int index){
+    SEL setter = plan->setter;
+    if (plan->type == '@') {
+        id value = nil;
+        switch (plan->kind) {
+            case DatabaseObjectKindString: value = [resultSet stringForColumnIndex:index]; break;
+            case DatabaseObjectKindDate: value = [resultSet dateForColumnIndex:index]; break;
+            case DatabaseObjectKindData: value = [resultSet dataForColumnIndex:index]; break;
+            case DatabaseObjectKindNumber:{
+                id object = [resultSet objectForColumnIndex:index];
+                value = [object isKindOfClass:NSNumber.class] ? object : nil;
+            }break;
+            default: break;
+        }
+        ((void (*)(id, SEL, id))objc_msgSend)(model, setter, value);
+        return;
+    }
+    if ([resultSet columnIndexIsNull:index]) {
+        return;
+    }
+    switch (plan->type) {
+        case 'c': ((void (*)(id, SEL, char))objc_msgSend)(model, setter, (char)[resultSet longLongIntForColumnIndex:index]); break;
+        case 'B': ((void (*)(id, SEL, bool))objc_msgSend)(model, setter, [resultSet boolForColumnIndex:index]); break;
+        case 's': ((void (*)(id, SEL, short))objc_msgSend)(model, setter, (short)[resultSet longLongIntForColumnIndex:index]); break;
+        case 'i': ((void (*)(id, SEL, int))objc_msgSend)(model, setter, (int)[resultSet longLongIntForColumnIndex:index]); break;
+        case 'l': ((void (*)(id, SEL, long))objc_msgSend)(model, setter, (long)[resultSet longLongIntForColumnIndex:index]); break;
+        case 'q': ((void (*)(id, SEL, long long))objc_msgSend)(model, setter, [resultSet longLongIntForColumnIndex:index]); break;
+        case 'C': ((void (*)(id, SEL, unsigned char))objc_msgSend)(model, setter, (unsigned char)[resultSet longLongIntForColumnIndex:index]); break;
+        case 'S': ((void (*)(id, SEL, unsigned short))objc_msgSend)(model, setter, (unsigned short)[resultSet longLongIntForColumnIndex:index]); break;
+        case 'I': ((void (*)(id, SEL, unsigned int))objc_msgSend)(model, setter, (unsigned int)[resultSet longLongIntForColumnIndex:index]); break;
+        case 'L': ((void (*)(id, SEL, unsigned long))objc_msgSend)(model, setter, (unsigned long)[resultSet unsignedLongLongIntForColumnIndex:index]); break;
+        case 'Q': ((void (*)(id, SEL, unsigned long long))objc_msgSend)(model, setter, [resultSet unsignedLongLongIntForColumnIndex:index]); break;
+        case 'f': ((void (*)(id, SEL, float))objc_msgSend)(model, setter, (float)[resultSet doubleForColumnIndex:index]); break;
+        case 'd': ((void (*)(id, SEL, double))objc_msgSend)(model, setter, [resultSet doubleForColumnIndex:index]); break;
+        default: break;
+    }
+}
+
+/** 复制一列：从 source 的 getter 读取，调用 target 的 setter；对象类型都不可变，直接共享
+ */
+static void DatabaseCopyColumnValue(id source, id target, const DatabaseColumnPlan *plan){
+    SEL getter = plan->getter;
+    SEL setter = plan->setter;
+    switch (plan->type) {
+        case '@': ((void (*)(id, SEL, id))objc_msgSend)(target, setter, ((id (*)(id, SEL))objc_msgSend)(source, getter)); break;
+        case 'c': ((void (*)(id, SEL, char))objc_msgSend)(target, setter, ((char (*)(id, SEL))objc_msgSend)(source, getter)); break;
+        case 'B': ((void (*)(id, SEL, bool))objc_msgSend)(target, setter, ((bool (*)(id, SEL))objc_msgSend)(source, getter)); break;
+        case 's': ((void (*)(id, SEL, short))objc_msgSend)(target, setter, ((short (*)(id, SEL))objc_msgSend)(source, getter)); break;
+        case 'i': ((void (*)(id, SEL, int))objc_msgSend)(target, setter, ((int (*)(id, SEL))objc_msgSend)(source, getter)); break;
+        case 'l': ((void (*)(id, SEL, long))objc_msgSend)(target, setter, ((long (*)(id, SEL))objc_msgSend)(source, getter)); break;
+        case 'q': ((void (*)(id, SEL, long long))objc_msgSend)(target, setter, ((long long (*)(id, SEL))objc_msgSend)(source, getter)); break;
+        case 'C': ((void (*)(id, SEL, unsigned char))objc_msgSend)(target, setter, ((unsigned char (*)(id, SEL))objc_msgSend)(source, getter)); break;
+        case 'S': ((void (*)(id, SEL, unsigned short))objc_msgSend)(target, setter, ((unsigned short (*)(id, SEL))objc_msgSend)(source, getter)); break;
+        case 'I': ((void (*)(id, SEL, unsigned int))objc_msgSend)(target, setter, ((unsigned int (*)(id, SEL))objc_msgSend)(source, getter)); break;
+        case 'L': ((void (*)(id, SEL, unsigned long))objc_msgSend)(target, setter, ((unsigned long (*)(id, SEL))objc_msgSend)(source, getter)); break;
+        case 'Q': ((void (*)(id, SEL, unsigned long long))objc_msgSend)(target, setter, ((unsigned long long (*)(id, SEL))objc_msgSend)(source, getter)); break;
+        case 'f': ((void (*)(id, SEL, float))objc_msgSend)(target, setter, ((float (*)(id, SEL))objc_msgSend)(source, getter)); break;
+        case 'd': ((void (*)(id, SEL, double))objc_msgSend)(target, setter, ((double (*)(id, SEL))objc_msgSend)(source, getter)); break;
+        default: break;
+    }
+}
+
+/** 一个模型的修改记录：第 i 位为 columns[i] 对应的属性；以关联对象保存，读取、写入成功时建立
+ */
+@interface DatabaseChangeState : NSObject
+{
+    @public
+    _Atomic(uint64_t) _mask;
+}
+@end
+
+@implementation DatabaseChangeState
+@end
+
+static char DatabaseChangeStateKey;
+
+static DatabaseChangeState *DatabaseChangeStateForModel(id model){
+    return objc_getAssociatedObject(model, &DatabaseChangeStateKey);
+}
+
+/** 以模型当前的值为基准：清除修改记录，没有时建立
+ */
+static void DatabaseResetChangeState(id model){
+    DatabaseChangeState *state = DatabaseChangeStateForModel(model);
+    if (state) {
+        atomic_store(&state->_mask, 0);
+    }else{
+        state = [[DatabaseChangeState alloc] init];
+        atomic_init(&state->_mask, 0);
+        objc_setAssociatedObject(model, &DatabaseChangeStateKey, state, OBJC_ASSOCIATION_RETAIN);
+    }
+}
+
+/** setter 调用之后记录修改；没有基准的模型不记录
+ */
+static void DatabaseMarkChanged(id model, uint64_t bit){
+    DatabaseChangeState *state = DatabaseChangeStateForModel(model);
+    if (state) {
+        atomic_fetch_or(&state->_mask, bit);
+    }
+}
+
+/** 替换一个属性的 setter：调用原来的实现之后记录修改
+ * 继承的 setter 添加到 cls 上，不影响父类
+ */
+static void DatabaseInstallTrackingSetter(Class cls, const DatabaseColumnPlan *plan, uint64_t bit){
+    SEL setter = plan->setter;
+    Method method = class_getInstanceMethod(cls, setter);
+    IMP original = method_getImplementation(method);
+    id block = nil;
+    switch (plan->type) {
+#define DATABASE_TRACKING_SETTER(valueType) \
+        block = ^(id model, valueType value){ \
+            ((void (*)(id, SEL, valueType))original)(model, setter, value); \
+            DatabaseMarkChanged(model, bit); \
+        }; break;
+        case '@': DATABASE_TRACKING_SETTER(id)
+        case 'c': DATABASE_TRACKING_SETTER(char)
+        case 'B': DATABASE_TRACKING_SETTER(bool)
+        case 's': DATABASE_TRACKING_SETTER(short)
+        case 'i': DATABASE_TRACKING_SETTER(int)
+        case 'l': DATABASE_TRACKING_SETTER(long)
+        case 'q': DATABASE_TRACKING_SETTER(long long)
+        case 'C': DATABASE_TRACKING_SETTER(unsigned char)
+        case 'S': DATABASE_TRACKING_SETTER(unsigned short)
+        case 'I': DATABASE_TRACKING_SETTER(unsigned int)
+        case 'L': DATABASE_TRACKING_SETTER(unsigned long)
+        case 'Q': DATABASE_TRACKING_SETTER(unsigned long long)
+        case 'f': DATABASE_TRACKING_SETTER(float)
+        case 'd': DATABASE_TRACKING_SETTER(double)
+#undef DATABASE_TRACKING_SETTER
+        default: return;
+    }
+    IMP imp = imp_implementationWithBlock(block);
+    if (!class_addMethod(cls, setter, imp, method_getTypeEncoding(method))) {
+        method_setImplementation(method, imp);
+    }
+}
+
+/** 按修改的列缓存的 UPDATE 语句的上限：超过之后生成的语句不再缓存
+ */
+static NSUInteger const DatabaseUpdateSQLCacheLimit = 32;
+
+
+@interface DatabaseModelMapping ()
+{
+    DatabaseColumnPlan *_plans;
+    NSUInteger _planCount;
+    NSInteger _uniqueIndex;//唯一键在 columns 中的下标，没有唯一键时为 NSNotFound
+    NSDictionary<NSString *, NSString *> *_keyColumns;//属性名、列名 -> 列名
+    NSMutableDictionary<NSString *, NSString *> *_selectByColumnSQL;
+    NSString *_selectByUniqueSQL;//按唯一键查询一行，同时读取 rowid
+    NSString *_selectByUniqueValuesSQL;//按一组唯一键查询，唯一键以 JSON 数组绑定；同时读取 rowid
+    NSMutableDictionary<NSString *, NSString *> *_upsertSQLForExpiryColumn;//带有效期的表的 upsert，按 expiryColumn 缓存
+    uint64_t _allColumnsMask;
+    NSMutableDictionary<NSNumber *, NSString *> *_updateSQLForMask;//只更新修改过的列，按掩码缓存
+}
+@end
+
+@implementation DatabaseModelMapping
+
++ (instancetype)mappingForClass:(Class)modelClass{
+    static NSMutableDictionary<NSString *, DatabaseModelMapping *> *mappings;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        mappings = [NSMutableDictionary dictionary];
+    });
+
+    NSString *key = NSStringFromClass(modelClass);
+    @synchronized (mappings) {
+        DatabaseModelMapping *mapping = mappings[key];
+        if (mapping == nil) {
+            mapping = [[DatabaseModelMapping alloc] initWithClass:modelClass];
+            mappings[key] = mapping;
+        }
+        return mapping;
+    }
+}
+
+- (instancetype)initWithClass:(Class)modelClass{
+    self = [super init];
+    if (self) {
+        _modelClass = modelClass;
+        _tableName = [modelClass respondsToSelector:@selector(databaseTableName)] ? [[modelClass databaseTableName] copy] : NSStringFromClass(modelClass);
+        NSDictionary<NSString *, NSString *> *columnMapping = [modelClass respondsToSelector:@selector(databaseColumnMapping)] ? [modelClass databaseColumnMapping] : nil;
+        NSSet<NSString *> *ignoredProperties = [modelClass respondsToSelector:@selector(databaseIgnoredProperties)] ? [NSSet setWithArray:[modelClass databaseIgnoredProperties]] : nil;
+        NSString *uniqueKey = [modelClass respondsToSelector:@selector(databaseUniqueKey)] ? [modelClass databaseUniqueKey] : nil;
+
+        //父类的属性在前；只解析一次，之后的读写都使用这里生成的计划
+        NSMutableArray<Class> *classes = [NSMutableArray array];
+        for (Class cls = modelClass; cls && cls != NSObject.class; cls = class_getSuperclass(cls)) {
+            [classes insertObject:cls atIndex:0];
+        }
+
+        NSMutableArray<NSString *> *properties = [NSMutableArray array];
+        NSMutableArray<NSString *> *columns = [NSMutableArray array];
+        NSMutableData *plans = [NSMutableData data];
+        for (Class cls in classes) {
+            unsigned int count = 0;
+            objc_property_t *propertyList = class_copyPropertyList(cls, &count);
+            for (unsigned int i = 0; i < count; i++) {
+                NSString *name = @(property_getName(propertyList[i]));
+                DatabaseColumnPlan plan;
+                if ([properties containsObject:name] || [ignoredProperties containsObject:name] ||
+                    !DatabaseColumnPlanForProperty(propertyList[i], &plan)) {
+                    continue;
+                }
+                [properties addObject:name];
+                [columns addObject:columnMapping[name] ?: name];
+                [plans appendBytes:&plan length:sizeof(DatabaseColumnPlan)];
+            }
+            free(propertyList);
+        }
+
+        _properties = [properties copy];
+        _columns = [columns copy];
+        _planCount = columns.count;
+        _plans = calloc(MAX(_planCount, 1), sizeof(DatabaseColumnPlan));
+        memcpy(_plans, plans.bytes, plans.length);
+
+        NSMutableDictionary<NSString *, NSString *> *keyColumns = [NSMutableDictionary dictionary];
+        [columns enumerateObjectsUsingBlock:^(NSString * _Nonnull column, NSUInteger idx, BOOL * _Nonnull stop) {
+            keyColumns[column] = column;
+            keyColumns[properties[idx]] = column;
+        }];
+        _keyColumns = [keyColumns copy];
+        _selectByColumnSQL = [NSMutableDictionary dictionary];
+        _upsertSQLForExpiryColumn = [NSMutableDictionary dictionary];
+
+        _tracksChanges = [modelClass respondsToSelector:@selector(databaseTracksChanges)] && [modelClass databaseTracksChanges];
+        if (_tracksChanges && _planCount > 64) {
+            NSLog(@"%@ 映射的属性超过 64 个，不记录修改",NSStringFromClass(modelClass));
+            _tracksChanges = NO;
+        }
+        for (NSUInteger i = 0; i < _planCount && _tracksChanges; i++) {
+            if (![modelClass instancesRespondToSelector:_plans[i].setter]) {
+                NSLog(@"%@ 的属性 %@ 没有 setter，不记录修改",NSStringFromClass(modelClass),properties[i]);
+                _tracksChanges = NO;
+            }
+        }
+        if (_tracksChanges) {
+            for (NSUInteger i = 0; i < _planCount; i++) {
+                DatabaseInstallTrackingSetter(modelClass, &_plans[i], 1ULL << i);
+            }
+        }
+        _allColumnsMask = _planCount >= 64 ? UINT64_MAX : (1ULL << _planCount) - 1;
+        _updateSQLForMask = [NSMutableDictionary dictionary];
+
+        _uniqueIndex = uniqueKey ? [properties indexOfObject:uniqueKey] : NSNotFound;
+        if (uniqueKey && _uniqueIndex == NSNotFound) {
+            NSLog(@"%@ 的唯一键 %@ 不是映射的属性",NSStringFromClass(modelClass),uniqueKey);
+        }
+
+        //所有操作的 SQL 只生成一次
+        NSString *columnList = [columns componentsJoinedByString:@","];
+        NSMutableArray<NSString *> *placeholders = [NSMutableArray arrayWithCapacity:columns.count];
+        for (NSUInteger i = 0; i < columns.count; i++) {
+            [placeholders addObject:@"?"];
+        }
+        NSString *placeholderList = [placeholders componentsJoinedByString:@" , "];
+        _insertSQL = [NSString stringWithFormat:@"INSERT INTO %@ (%@) VALUES (%@)",_tableName,columnList,placeholderList];
+        _replaceSQL = [NSString stringWithFormat:@"REPLACE INTO %@ (%@) VALUES (%@)",_tableName,columnList,placeholderList];
+        _selectSQL = [NSString stringWithFormat:@"SELECT %@ FROM %@",columnList,_tableName];
+
+        if (_uniqueIndex != NSNotFound) {
+            _uniqueColumn = columns[_uniqueIndex];
+            NSMutableArray<NSString *> *assignments = [NSMutableArray arrayWithCapacity:columns.count];
+            for (NSString *column in columns) {
+                if (![column isEqualToString:_uniqueColumn]) {
+                    [assignments addObject:[NSString stringWithFormat:@"%@ = ?",column]];
+                }
+            }
+            if (assignments.count) {
+                _updateSQL = [NSString stringWithFormat:@"UPDATE %@ SET %@ WHERE %@ = ?",_tableName,[assignments componentsJoinedByString:@","],_uniqueColumn];
+            }
+            _deleteSQL = [NSString stringWithFormat:@"DELETE FROM %@ WHERE %@ = ?",_tableName,_uniqueColumn];
+            _upsertSQL = [self upsertSQLWithExpiryColumn:nil refreshClause:nil];
+            _selectByUniqueSQL = [NSString stringWithFormat:@"SELECT %@,rowid FROM %@ WHERE %@ = ?",columnList,_tableName,_uniqueColumn];
+            _selectByUniqueValuesSQL = [NSString stringWithFormat:@"SELECT %@,rowid FROM %@ WHERE %@ IN (SELECT value FROM json_each(?))",columnList,_tableName,_uniqueColumn];
+        }
+    }
+    return self;
+}
+
+- (void)dealloc{
+    free(_plans);
+}
+
+- (NSString *)description{
+    return [NSString stringWithFormat:@"<DatabaseModelMapping %@ -> %@ (%@)>",NSStringFromClass(self.modelClass),self.tableName,[self.columns componentsJoinedByString:@","]];
+}
+
+/** upsert：只更新内容不同的行；expiryColumn 不为 nil 时更新同时刷新写入时间，满足 refreshClause 的行即使内容相同也更新
+ * DO UPDATE 的 WHERE 中不带前缀的列为表中已有的行，excluded 为要写入的行
+ */
+- (NSString *)upsertSQLWithExpiryColumn:(NSString *)expiryColumn refreshClause:(NSString *)refreshClause{
+    NSMutableArray<NSString *> *assignments = [NSMutableArray arrayWithCapacity:self.columns.count + 1];
+    NSMutableArray<NSString *> *differences = [NSMutableArray arrayWithCapacity:self.columns.count + 1];
+    for (NSString *column in self.columns) {
+        if (![column isEqualToString:_uniqueColumn] && ![column isEqualToString:expiryColumn]) {
+            [assignments addObject:[NSString stringWithFormat:@"%@ = excluded.%@",column,column]];
+            [differences addObject:[NSString stringWithFormat:@"%@ IS NOT excluded.%@",column,column]];
+        }
+    }
+    if (expiryColumn) {
+        [assignments addObject:[NSString stringWithFormat:@"%@ = CURRENT_TIMESTAMP",expiryColumn]];
+        if (refreshClause.length) {
+            [differences addObject:refreshClause];
+        }
+    }
+    NSString *action = @"DO NOTHING";
+    if (differences.count) {
+        action = [NSString stringWithFormat:@"DO UPDATE SET %@ WHERE %@",[assignments componentsJoinedByString:@","],[differences componentsJoinedByString:@" OR "]];
+    }
+    return [NSString stringWithFormat:@"%@ ON CONFLICT(%@) %@",self.insertSQL,_uniqueColumn,action];
+}
+
+#pragma mark - 绑定、读取
+
+- (NSString *)columnForKey:(NSString *)key{
+    return key ? _keyColumns[key] : nil;
+}
+
+- (NSArray *)argumentsForModel:(id)model{
+    NSMutableArray *arguments = [NSMutableArray arrayWithCapacity:_planCount];
+    for (NSUInteger i = 0; i < _planCount; i++) {
+        [arguments addObject:DatabaseColumnValue(model, &_plans[i])];
+    }
+    return arguments;
+}
+
+- (void)setValue:(id)value atIndex:(NSUInteger)index forModel:(id)model{
+    if (index >= _planCount) {
+        return;
+    }
+    const DatabaseColumnPlan *plan = &_plans[index];
+    SEL setter = plan->setter;
+    if (value == NSNull.null) {
+        value = nil;
+    }
+    if (plan->type == '@') {
+        if (value && ![value isKindOfClass:DatabaseClassForObjectKind(plan->kind)]) {
+            return;
+        }
+        ((void (*)(id, SEL, id))objc_msgSend)(model, setter, value);
+        return;
+    }
+    if (![value isKindOfClass:NSNumber.class]) {
+        return;
+    }
+    NSNumber *number = value;
+    switch (plan->type) {
+        case 'c': ((void (*)(id, SEL, char))objc_msgSend)(model, setter, number.charValue); break;
+        case 'B': ((void (*)(id, SEL, bool))objc_msgSend)(model, setter, number.boolValue); break;
+        case 's': ((void (*)(id, SEL, short))objc_msgSend)(model, setter, number.shortValue); break;
+        case 'i': ((void (*)(id, SEL, int))objc_msgSend)(model, setter, number.intValue); break;
+        case 'l': ((void (*)(id, SEL, long))objc_msgSend)(model, setter, number.longValue); break;
+        case 'q': ((void (*)(id, SEL, long long))objc_msgSend)(model, setter, number.longLongValue); break;
+        case 'C': ((void (*)(id, SEL, unsigned char))objc_msgSend)(model, setter, number.unsignedCharValue); break;
+        case 'S': ((void (*)(id, SEL, unsigned short))objc_msgSend)(model, setter, number.unsignedShortValue); break;
+        case 'I': ((void (*)(id, SEL, unsigned int))objc_msgSend)(model, setter, number.unsignedIntValue); break;
+        case 'L': ((void (*)(id, SEL, unsigned long))objc_msgSend)(model, setter, number.unsignedLongValue); break;
+        case 'Q': ((void (*)(id, SEL, unsigned long long))objc_msgSend)(model, setter, number.unsignedLongLongValue); break;
+        case 'f': ((void (*)(id, SEL, float))objc_msgSend)(model, setter, number.floatValue); break;
+        case 'd': ((void (*)(id, SEL, double))objc_msgSend)(model, setter, number.doubleValue); break;
+        default: break;
+    }
+}
+
+- (id)uniqueValueForModel:(id)model{
+    if (_uniqueIndex == NSNotFound) {
+        return nil;
+    }
+    id value = DatabaseColumnValue(model, &_plans[_uniqueIndex]);
+    return value == NSNull.null ? nil : value;
+}
+
+- (NSArray<NSString *> *)changedPropertiesForModel:(id)model{
+    DatabaseChangeState *state = _tracksChanges ? DatabaseChangeStateForModel(model) : nil;
+    if (state == nil) {
+        return nil;
+    }
+    uint64_t mask = atomic_load(&state->_mask);
+    NSMutableArray<NSString *> *properties = [NSMutableArray array];
+    for (NSUInteger i = 0; i < _planCount; i++) {
+        if (mask & (1ULL << i)) {
+            [properties addObject:self.properties[i]];
+        }
+    }
+    return properties;
+}
+
+- (NSMutableArray *)modelsFromResultSet:(FMResultSet *)resultSet{
+    NSMutableArray *array = [NSMutableArray array];
+    int count = MIN((int)_planCount, resultSet.columnCount);
+    while ([resultSet next]){
+        id model = [[self.modelClass alloc] init];
+        for (int i = 0; i < count; i++) {
+            DatabaseSetColumnValue(model, &_plans[i], resultSet, i);
+        }
+        if (_tracksChanges) {
+            DatabaseResetChangeState(model);
+        }
+        [array addObject:model];
+    }
+    [resultSet close];
+    return array;
+}
+
+- (id)modelFromResultSet:(FMResultSet *)resultSet{
+    return [self modelFromResultSet:resultSet columnOffset:0];
+}
+
+- (id)modelFromResultSet:(FMResultSet *)resultSet columnOffset:(int)offset{
+    id model = [[self.modelClass alloc] init];
+    int count = MIN((int)_planCount, resultSet.columnCount - offset);
+    for (int i = 0; i < count; i++) {
+        DatabaseSetColumnValue(model, &_plans[i], resultSet, offset + i);
+    }
+    if (_tracksChanges) {
+        DatabaseResetChangeState(model);
+    }
+    return model;
+}
+
+- (NSArray *)JSONValues:(NSArray *)values forColumn:(NSString *)column{
+    NSUInteger index = [self.columns indexOfObject:[self columnForKey:column] ?: @""];
+    if (index == NSNotFound || _plans[index].kind != DatabaseObjectKindString) {
+        return values;
+    }
+    NSMutableArray *strings = [NSMutableArray arrayWithCapacity:values.count];
+    for (id value in values) {
+        [strings addObject:[value isKindOfClass:NSNumber.class] ? [value stringValue] : value];
+    }
+    return strings;
+}
+
+#pragma mark - 查询
+
+- (NSString *)selectSQLInSchema:(NSString *)schema{
+    if (schema.length == 0) {
+        return self.selectSQL;
+    }
+    return [NSString stringWithFormat:@"SELECT %@ FROM \"%@\".%@",[self.columns componentsJoinedByString:@","],schema,self.tableName];
+}
+
+- (NSMutableArray *)modelsInDatabase:(FMDatabase *)database where:(NSString *)clause arguments:(NSArray *)arguments{
+    return [self modelsInDatabase:database schema:nil where:clause arguments:arguments];
+}
+
+- (NSMutableArray *)modelsInDatabase:(FMDatabase *)database key:(NSString *)key value:(id)value extraClause:(NSString *)extraClause{
+    return [self modelsInDatabase:database schema:nil key:key value:value extraClause:extraClause];
+}
+
+- (NSMutableArray *)modelsInDatabase:(FMDatabase *)database schema:(NSString *)schema where:(NSString *)clause arguments:(NSArray *)arguments{
+    NSString *selectSQL = [self selectSQLInSchema:schema];
+    NSString *sql = clause.length ? [NSString stringWithFormat:@"%@ WHERE %@",selectSQL,clause] : selectSQL;
+    FMResultSet *resultSet = [database executeQuery:sql withArgumentsInArray:arguments ?: @[]];
+    if (resultSet == nil) {
+        NSLog(@"error ===== %@",database.lastError);
+        return [NSMutableArray array];
+    }
+    return [self modelsFromResultSet:resultSet];
+}
+
+- (NSMutableArray *)modelsInDatabase:(FMDatabase *)database schema:(NSString *)schema key:(NSString *)key value:(id)value extraClause:(NSString *)extraClause{
+    NSString *column = [self columnForKey:key];
+    if (column == nil) {
+        NSLog(@"%@ 没有映射的列 %@",self.tableName,key);
+        return [NSMutableArray array];
+    }
+
+    NSString *cacheKey = schema.length ? [NSString stringWithFormat:@"%@.%@",schema,column] : column;
+    NSString *sql = nil;
+    @synchronized (_selectByColumnSQL) {
+        sql = _selectByColumnSQL[cacheKey];
+        if (sql == nil) {
+            sql = [NSString stringWithFormat:@"%@ WHERE %@ = ?",[self selectSQLInSchema:schema],column];
+            _selectByColumnSQL[cacheKey] = sql;
+        }
+    }
+    if (extraClause.length) {
+        sql = [NSString stringWithFormat:@"%@ AND %@",sql,extraClause];
+    }
+
+    FMResultSet *resultSet = [database executeQuery:sql withArgumentsInArray:@[value ?: NSNull.null]];
+    if (resultSet == nil) {
+        NSLog(@"error ===== %@",database.lastError);
+        return [NSMutableArray array];
+    }
+    return [self modelsFromResultSet:resultSet];
+}
+
+- (id)modelInDatabase:(FMDatabase *)database uniqueValue:(id)value extraClause:(NSString *)extraClause rowid:(int64_t *)rowid{
+    if (_selectByUniqueSQL == nil) {
+        NSLog(@"%@ 没有声明唯一键，不支持按唯一键查询",self.tableName);
+        return nil;
+    }
+    if (value == nil) {
+        return nil;
+    }
+    NSString *sql = extraClause.length ? [NSString stringWithFormat:@"%@ AND %@",_selectByUniqueSQL,extraClause] : _selectByUniqueSQL;
+    FMResultSet *resultSet = [database executeQuery:sql withArgumentsInArray:@[value]];
+    if (resultSet == nil) {
+        NSLog(@"error ===== %@",database.lastError);
+        return nil;
+    }
+    id model = nil;
+    if ([resultSet next]) {
+        model = [self modelFromResultSet:resultSet];
+        if (rowid) {
+            *rowid = [resultSet longLongIntForColumnIndex:(int)_planCount];
+        }
+    }
+    [resultSet close];
+    return model;
+}
+
+- (NSMutableDictionary *)modelsInDatabase:(FMDatabase *)database uniqueValues:(NSArray *)values extraClause:(NSString *)extraClause rowids:(NSMutableDictionary<id, NSNumber *> *)rowids{
+    NSMutableDictionary *models = [NSMutableDictionary dictionaryWithCapacity:values.count];
+    if (_selectByUniqueValuesSQL == nil) {
+        NSLog(@"%@ 没有声明唯一键，不支持按唯一键查询",self.tableName);
+        return models;
+    }
+    if (values.count == 0) {
+        return models;
+    }
+    //json_each 返回的值不按列的类型转换：字符串类型的唯一键，数字先转为字符串，否则与表中的文本不相等
+    values = [self JSONValues:values forColumn:self.uniqueColumn];
+    //整组唯一键编码为一个 JSON 数组绑定到同一个参数：SQL 与个数无关，预编译语句可以重复使用
+    NSError *error = nil;
+    NSData *data = [NSJSONSerialization isValidJSONObject:values] ? [NSJSONSerialization dataWithJSONObject:values options:0 error:&error] : nil;
+    if (data == nil) {
+        NSLog(@"%@ 唯一键只能是字符串或数字 ===== %@",self.tableName,error ?: values);
+        return models;
+    }
+    NSString *json = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+    NSString *sql = extraClause.length ? [NSString stringWithFormat:@"%@ AND %@",_selectByUniqueValuesSQL,extraClause] : _selectByUniqueValuesSQL;
+    FMResultSet *resultSet = [database executeQuery:sql withArgumentsInArray:@[json]];
+    if (resultSet == nil) {
+        NSLog(@"error ===== %@",database.lastError);
+        return models;
+    }
+    while ([resultSet next]) {
+        id model = [self modelFromResultSet:resultSet];
+        id value = [self uniqueValueForModel:model];
+        if (value) {
+            models[value] = model;
+            rowids[value] = @([resultSet longLongIntForColumnIndex:(int)_planCount]);
+        }
+    }
+    [resultSet close];
+    return models;
+}
+
+#pragma mark - 写操作
+
+- (BOOL)insertModel:(id)model replace:(BOOL)replace inDatabase:(FMDatabase *)database{
+    BOOL result = [database executeUpdate:replace ? self.replaceSQL : self.insertSQL withArgumentsInArray:[self argumentsForModel:model]];
+    if (!result) {
+        NSLog(@"error ===== %@",database.lastError);
+        NSLog(@"model ===== %@",model);
+    }
+    return result;
+}
+
+- (BOOL)updateModel:(id)model inDatabase:(FMDatabase *)database{
+    if (self.updateSQL == nil) {
+        NSLog(@"%@ 没有声明唯一键或可更新的列，不支持更新",self.tableName);
+        return NO;
+    }
+    //有基准的模型只写入修改过的列；唯一键不在 SET 中
+    uint64_t mask = (_tracksChanges ? [self changesOfModel:model] : _allColumnsMask) & ~(1ULL << _uniqueIndex);
+    if (mask == 0) {
+        return YES;
+    }
+    NSString *sql = mask == (_allColumnsMask & ~(1ULL << _uniqueIndex)) ? self.updateSQL : [self updateSQLForMask:mask];
+
+    //修改的列按顺序绑定，唯一键作为最后一个参数
+    NSMutableArray *arguments = [NSMutableArray arrayWithCapacity:_planCount];
+    for (NSUInteger i = 0; i < _planCount; i++) {
+        if (mask & (1ULL << i)) {
+            [arguments addObject:DatabaseColumnValue(model, &_plans[i])];
+        }
+    }
+    [arguments addObject:DatabaseColumnValue(model, &_plans[_uniqueIndex])];
+
+    BOOL result = [database executeUpdate:sql withArgumentsInArray:arguments];
+    if (!result) {
+        NSLog(@"error ===== %@",database.lastError);
+        NSLog(@"model ===== %@",model);
+    }
+    return result;
+}
+
+#pragma mark - 修改记录
+
+- (uint64_t)changesOfModel:(id)model{
+    if (!_tracksChanges) {
+        return 0;
+    }
+    DatabaseChangeState *state = DatabaseChangeStateForModel(model);
+    return state ? atomic_load(&state->_mask) : _allColumnsMask;
+}
+
+- (id)copyOfModel:(id)model{
+    if (model == nil) {
+        return nil;
+    }
+    //副本没有修改记录时 setter 不记录修改，复制之后再继承原模型的修改记录
+    id copy = [[self.modelClass alloc] init];
+    for (NSUInteger i = 0; i < _planCount; i++) {
+        DatabaseCopyColumnValue(model, copy, &_plans[i]);
+    }
+    DatabaseChangeState *state = _tracksChanges ? DatabaseChangeStateForModel(model) : nil;
+    if (state) {
+        DatabaseResetChangeState(copy);
+        atomic_store(&DatabaseChangeStateForModel(copy)->_mask, atomic_load(&state->_mask));
+    }
+    return copy;
+}
+
+- (void)commitChanges:(uint64_t)changes ofModel:(id)model{
+    if (!_tracksChanges) {
+        return;
+    }
+    DatabaseChangeState *state = DatabaseChangeStateForModel(model);
+    if (state) {
+        //只清除已写入的修改：快照之后的修改保留到下一次更新
+        atomic_fetch_and(&state->_mask, ~changes);
+    }else{
+        DatabaseResetChangeState(model);
+    }
+}
+
+/** 只更新掩码中的列：UPDATE 表 SET 列 = ? ... WHERE 唯一键 = ?
+ */
+- (NSString *)updateSQLForMask:(uint64_t)mask{
+    NSNumber *key = @(mask);
+    @synchronized (_updateSQLForMask) {
+        NSString *sql = _updateSQLForMask[key];
+        if (sql) {
+            return sql;
+        }
+    }
+    NSMutableArray<NSString *> *assignments = [NSMutableArray array];
+    for (NSUInteger i = 0; i < _planCount; i++) {
+        if (mask & (1ULL << i)) {
+            [assignments addObject:[NSString stringWithFormat:@"%@ = ?",self.columns[i]]];
+        }
+    }
+    NSString *sql = [NSString stringWithFormat:@"UPDATE %@ SET %@ WHERE %@ = ?",self.tableName,[assignments componentsJoinedByString:@","],self.uniqueColumn];
+    @synchronized (_updateSQLForMask) {
+        if (_updateSQLForMask.count < DatabaseUpdateSQLCacheLimit) {
+            _updateSQLForMask[key] = sql;
+        }
+    }
+    return sql;
+}
+
+- (DatabaseUpsertResult)upsertModel:(id)model schema:(DatabaseTableSchema *)schema inDatabase:(FMDatabase *)database{
+    if (self.upsertSQL == nil) {
+        NSLog(@"%@ 没有声明唯一键，不支持 upsert",self.tableName);
+        return DatabaseUpsertResultFailed;
+    }
+    NSString *sql = self.upsertSQL;
+    if (schema.expiryColumn) {
+        @synchronized (_upsertSQLForExpiryColumn) {
+            sql = _upsertSQLForExpiryColumn[schema.expiryColumn];
+            if (sql == nil) {
+                sql = [self upsertSQLWithExpiryColumn:schema.expiryColumn refreshClause:schema.refreshClause];
+                _upsertSQLForExpiryColumn[schema.expiryColumn] = sql;
+            }
+        }
+    }
+
+    //插入时 last_insert_rowid 被设置为新行的 rowid；更新、DO NOTHING 不改变它
+    sqlite3_set_last_insert_rowid(database.sqliteHandle, 0);
+    if (![database executeUpdate:sql withArgumentsInArray:[self argumentsForModel:model]]) {
+        NSLog(@"error ===== %@",database.lastError);
+        NSLog(@"model ===== %@",model);
+        return DatabaseUpsertResultFailed;
+    }
+    if (database.changes == 0) {
+        return DatabaseUpsertResultUnchanged;
+    }
+    return database.lastInsertRowId != 0 ? DatabaseUpsertResultInserted : DatabaseUpsertResultUpdated;
+}
+
+- (BOOL)deleteModel:(id)model inDatabase:(FMDatabase *)database{
+    if (self.deleteSQL == nil) {
+        NSLog(@"%@ 没有声明唯一键，不支持删除",self.tableName);
+        return NO;
+    }
+    BOOL result = [database executeUpdate:self.deleteSQL withArgumentsInArray:@[DatabaseColumnValue(model, &_plans[_uniqueIndex])]];
+    if (!result) {
+        NSLog(@"error ===== %@",database.lastError);
+    }
+    return result;
+}
+
+@end
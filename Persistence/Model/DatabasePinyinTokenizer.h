@@ -0,0 +1,28 @@
+//
+//  DatabasePinyinTokenizer.h
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/30.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class FMDatabase;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** 拼音分词器的名称：CREATE VIRTUAL TABLE ... USING fts5(..., tokenize = 'pinyin')
+ *
+ * 在 unicode61 的基础上分词（参数原样传给 unicode61，例如 tokenize = 'pinyin remove_diacritics 2'）；
+ * 写入时，一列中由多个字母、数字组成的词（例如拼音 "a er ba ni ya"）额外生成两个同位置的词：
+ * 首字母 "aebny" 与全拼 "aerbaniya"，查询 "aeb*"、"aerba*" 都能匹配；查询时不做额外处理
+ */
+FOUNDATION_EXPORT NSString * const DatabasePinyinTokenizerName;
+
+/** 在连接上注册拼音分词器：FTS5 的分词器属于连接，读写该虚拟表（包括触发器写入）的每个连接在打开后都需要注册
+ * @return 是否注册成功；系统的 SQLite 没有 FTS5 时返回 NO
+ */
+FOUNDATION_EXPORT BOOL DatabaseRegisterPinyinTokenizer(FMDatabase *database);
+
+NS_ASSUME_NONNULL_END
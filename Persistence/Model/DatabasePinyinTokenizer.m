@@ -0,0 +1,178 @@
+//
+//  DatabasePinyinTokenizer.m
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/30.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import "DatabasePinyinTokenizer.h"
+#import "FMDatabase.h"
+#import <sqlite3.h>
+
+/** 系统的 sqlite3.h 不包含 fts5.h：以下声明与 SQLite 的 fts5.h 一致，只保留分词器用到的部分
+ */
+#ifndef _FTS5_H
+
+typedef struct Fts5Tokenizer Fts5Tokenizer;
+typedef struct fts5_tokenizer fts5_tokenizer;
+struct fts5_tokenizer {
+    int (*xCreate)(void *, const char **azArg, int nArg, Fts5Tokenizer **ppOut);
+    void (*xDelete)(Fts5Tokenizer *);
+    int (*xTokenize)(Fts5Tokenizer *, void *pCtx, int flags, const char *pText, int nText,
+                     int (*xToken)(void *pCtx, int tflags, const char *pToken, int nToken, int iStart, int iEnd));
+};
+
+#define FTS5_TOKENIZE_QUERY     0x0001
+#define FTS5_TOKENIZE_PREFIX    0x0002
+#define FTS5_TOKENIZE_DOCUMENT  0x0004
+#define FTS5_TOKENIZE_AUX       0x0008
+
+#define FTS5_TOKEN_COLOCATED    0x0001
+
+typedef struct fts5_api fts5_api;
+struct fts5_api {
+    int iVersion;
+    int (*xCreateTokenizer)(fts5_api *pApi, const char *zName, void *pContext, fts5_tokenizer *pTokenizer, void (*xDestroy)(void *));
+    int (*xFindTokenizer)(fts5_api *pApi, const char *zName, void **ppContext, fts5_tokenizer *pTokenizer);
+    int (*xCreateFunction)(fts5_api *pApi, const char *zName, void *pContext, void *xFunction, void (*xDestroy)(void *));
+};
+
+#endif
+
+NSString * const DatabasePinyinTokenizerName = @"pinyin";
+
+/** 首字母、全拼的最大字节数，超出时不生成
+ */
+#define DatabasePinyinMaxLength 64
+
+/** 分词器实例：包装一个 unicode61 实例
+ */
+typedef struct {
+    fts5_tokenizer parent;
+    Fts5Tokenizer *parentTokenizer;
+} DatabasePinyinTokenizer;
+
+/** 一次分词的状态：转发 unicode61 的每个词，同时拼接首字母与全拼
+ */
+typedef struct {
+    void *context;
+    int (*xToken)(void *, int, const char *, int, int, int);
+    int wordCount;
+    int initialsLength;
+    int joinedLength;//超出长度时为 -1
+    int start;
+    int end;
+    char initials[DatabasePinyinMaxLength];
+    char joined[DatabasePinyinMaxLength];
+} DatabasePinyinContext;
+
+static int DatabasePinyinCreate(void *context, const char **arguments, int argumentCount, Fts5Tokenizer **outTokenizer){
+    fts5_api *api = context;
+    DatabasePinyinTokenizer *tokenizer = sqlite3_malloc(sizeof(DatabasePinyinTokenizer));
+    if (tokenizer == NULL) {
+        return SQLITE_NOMEM;
+    }
+    memset(tokenizer, 0, sizeof(DatabasePinyinTokenizer));
+    void *parentContext = NULL;
+    int result = api->xFindTokenizer(api, "unicode61", &parentContext, &tokenizer->parent);
+    if (result == SQLITE_OK) {
+        result = tokenizer->parent.xCreate(parentContext, arguments, argumentCount, &tokenizer->parentTokenizer);
+    }
+    if (result != SQLITE_OK) {
+        sqlite3_free(tokenizer);
+        tokenizer = NULL;
+    }
+    *outTokenizer = (Fts5Tokenizer *)tokenizer;
+    return result;
+}
+
+static void DatabasePinyinDelete(Fts5Tokenizer *instance){
+    DatabasePinyinTokenizer *tokenizer = (DatabasePinyinTokenizer *)instance;
+    if (tokenizer) {
+        if (tokenizer->parentTokenizer) {
+            tokenizer->parent.xDelete(tokenizer->parentTokenizer);
+        }
+        sqlite3_free(tokenizer);
+    }
+}
+
+static int DatabasePinyinToken(void *instance, int flags, const char *token, int length, int start, int end){
+    DatabasePinyinContext *context = instance;
+    BOOL isASCII = length > 0;
+    for (int i = 0; i < length && isASCII; i++) {
+        isASCII = isalnum((unsigned char)token[i]) != 0;
+    }
+    //只拼接字母、数字组成的词；unicode61 已经转为小写
+    if (isASCII && (flags & FTS5_TOKEN_COLOCATED) == 0) {
+        if (context->wordCount == 0) {
+            context->start = start;
+        }
+        context->end = end;
+        context->wordCount++;
+        if (context->initialsLength < DatabasePinyinMaxLength) {
+            context->initials[context->initialsLength++] = token[0];
+        }
+        if (context->joinedLength >= 0 && context->joinedLength + length <= DatabasePinyinMaxLength) {
+            memcpy(context->joined + context->joinedLength, token, length);
+            context->joinedLength += length;
+        }else{
+            context->joinedLength = -1;
+        }
+    }
+    return context->xToken(context->context, flags, token, length, start, end);
+}
+
+static int DatabasePinyinTokenize(Fts5Tokenizer *instance, void *pContext, int flags, const char *text, int textLength,
+                                  int (*xToken)(void *, int, const char *, int, int, int)){
+    DatabasePinyinTokenizer *tokenizer = (DatabasePinyinTokenizer *)instance;
+    if ((flags & FTS5_TOKENIZE_DOCUMENT) == 0) {
+        return tokenizer->parent.xTokenize(tokenizer->parentTokenizer, pContext, flags, text, textLength, xToken);
+    }
+
+    DatabasePinyinContext context;
+    memset(&context, 0, sizeof(DatabasePinyinContext));
+    context.context = pContext;
+    context.xToken = xToken;
+    int result = tokenizer->parent.xTokenize(tokenizer->parentTokenizer, &context, flags, text, textLength, DatabasePinyinToken);
+    if (result != SQLITE_OK || context.wordCount < 2) {
+        return result;
+    }
+    //与最后一个词位于同一位置：查询只按前缀匹配，不影响短语查询的位置
+    if (context.initialsLength < DatabasePinyinMaxLength) {
+        result = xToken(pContext, FTS5_TOKEN_COLOCATED, context.initials, context.initialsLength, context.start, context.end);
+    }
+    if (result == SQLITE_OK && context.joinedLength > 0) {
+        result = xToken(pContext, FTS5_TOKEN_COLOCATED, context.joined, context.joinedLength, context.start, context.end);
+    }
+    return result;
+}
+
+/** 通过 SELECT fts5(?) 取得连接上的 fts5_api
+ */
+static fts5_api *DatabaseFTS5API(sqlite3 *db){
+    fts5_api *api = NULL;
+    sqlite3_stmt *statement = NULL;
+    if (sqlite3_prepare_v2(db, "SELECT fts5(?1)", -1, &statement, NULL) == SQLITE_OK) {
+        sqlite3_bind_pointer(statement, 1, (void *)&api, "fts5_api_ptr", NULL);
+        sqlite3_step(statement);
+    }
+    sqlite3_finalize(statement);
+    return api;
+}
+
+BOOL DatabaseRegisterPinyinTokenizer(FMDatabase *database){
+    sqlite3 *db = database.sqliteHandle;
+    fts5_api *api = db ? DatabaseFTS5API(db) : NULL;
+    if (api == NULL || api->iVersion < 2) {
+        NSLog(@"%@ fts5 unavailable",database);
+        return NO;
+    }
+    fts5_tokenizer tokenizer = {DatabasePinyinCreate, DatabasePinyinDelete, DatabasePinyinTokenize};
+    int result = api->xCreateTokenizer(api, DatabasePinyinTokenizerName.UTF8String, api, &tokenizer, NULL);
+    if (result != SQLITE_OK) {
+        NSLog(@"%@ register tokenizer error ===== %d",database,result);
+        return NO;
+    }
+    return YES;
+}
@@ -0,0 +1,97 @@
+//
+//  DatabaseRowCache.h
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/6/2.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** 行缓存：以（表名，唯一键的值）为键，缓存按唯一键读取的模型，容量有限，淘汰最久未使用的模型
+ *
+ * 失效由写连接的回调驱动，不依赖调用方：
+ *  UPDATE、DELETE：sqlite3_update_hook 给出行的 rowid，立即移除该行对应的模型；
+ *  INSERT：REPLACE 因唯一键冲突删除旧行时 update_hook 不会被调用，无法知道被删除的是哪一行，移除该表所有的模型；
+ *  从第一次修改到事务提交（WAL 回调）或回滚（rollback_hook）期间，被修改的表不再写入缓存，
+ *  提交之前开始的查询读取到的旧数据也不会写入缓存（见 -readStamp）
+ *
+ * 以下情况 SQLite 不调用 update_hook，需要调用方主动移除：不带 WHERE 的 DELETE（截断优化）、DROP TABLE、替换数据库文件
+ *
+ * 缓存的模型在多个调用方之间共享，不能修改；需要修改时复制一份（DatabaseDAO 为开启修改记录的类返回副本）
+ * 线程安全
+ */
+@interface DatabaseRowCache : NSObject
+
+/** @param countLimit 最多缓存的模型数量
+ */
+- (instancetype)initWithCountLimit:(NSUInteger)countLimit NS_DESIGNATED_INITIALIZER;
+
+/** 默认最多缓存 1024 个模型
+ */
+- (instancetype)init;
+
+@property (nonatomic, assign, readonly) NSUInteger countLimit;
+
+/** 当前缓存的模型数量
+ */
+@property (nonatomic, assign, readonly) NSUInteger count;
+
+/** 查找；命中时该模型成为最近使用的模型
+ */
+- (nullable id)objectForTable:(NSString *)table key:(id)key;
+
+/** 查询数据库之前获取的时间戳：之后该表有任何修改（包括尚未提交的修改），用这个时间戳写入缓存都被忽略
+ */
+- (uint64_t)readStamp;
+
+/** 写入查询得到的模型
+ * @param rowid 该行的 rowid，用于 update_hook 的失效
+ * @param readStamp 查询之前通过 -readStamp 获取
+ */
+- (void)setObject:(id)object forTable:(NSString *)table key:(id<NSCopying>)key rowid:(int64_t)rowid readStamp:(uint64_t)readStamp;
+
+/** 主动移除
+ */
+- (void)removeObjectForTable:(NSString *)table key:(id)key;
+- (void)removeObjectsInTable:(NSString *)table;
+- (void)removeAllObjects;
+
+#pragma mark - 写连接的回调
+
+/** 写连接修改了一行：在 update_hook 中调用
+ * @param operation SQLITE_INSERT、SQLITE_UPDATE 或 SQLITE_DELETE
+ */
+- (void)rowDidChangeInTable:(NSString *)table rowid:(int64_t)rowid operation:(int)operation;
+
+/** 写连接的事务已提交、已回滚：之后被修改的表重新允许写入缓存
+ */
+- (void)transactionDidCommit;
+- (void)transactionDidRollback;
+
+#pragma mark - 统计
+
+@property (nonatomic, assign, readonly) NSUInteger hitCount;
+@property (nonatomic, assign, readonly) NSUInteger missCount;
+
+/** 命中率：hitCount / (hitCount + missCount)，没有查找时为 0
+ */
+@property (nonatomic, assign, readonly) double hitRatio;
+
+/** 因容量被淘汰的模型数量
+ */
+@property (nonatomic, assign, readonly) NSUInteger evictionCount;
+
+/** 因数据被修改而失效的模型数量
+ */
+@property (nonatomic, assign, readonly) NSUInteger invalidationCount;
+
+/** 清零统计
+ */
+- (void)resetStatistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,357 @@
+//
+//  DatabaseRowCache.m
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/6/2.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import "DatabaseRowCache.h"
+#import <os/lock.h>
+#import <sqlite3.h>
+
+/** 一个缓存的模型：同时是最近使用链表中的节点
+ */
+@interface DatabaseRowCacheEntry : NSObject
+{
+    @public
+    NSString *_table;
+    id _key;
+    id _object;
+    int64_t _rowid;
+    __unsafe_unretained DatabaseRowCacheEntry *_prev;//链表由 _next 持有
+    DatabaseRowCacheEntry *_next;
+}
+@end
+
+@implementation DatabaseRowCacheEntry
+@end
+
+/** 一张表的缓存状态
+ */
+@interface DatabaseRowCacheTable : NSObject
+{
+    @public
+    NSMutableDictionary<id, DatabaseRowCacheEntry *> *_entries;//唯一键的值 -> 模型
+    NSMutableDictionary<NSNumber *, DatabaseRowCacheEntry *> *_rowids;//rowid -> 模型
+    uint64_t _modifiedStamp;//最近一次修改时的时间戳
+    BOOL _pending;//写连接的当前事务修改了这张表，尚未提交或回滚
+}
+@end
+
+@implementation DatabaseRowCacheTable
+
+- (instancetype)init{
+    self = [super init];
+    if (self) {
+        _entries = [NSMutableDictionary dictionary];
+        _rowids = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+@end
+
+@interface DatabaseRowCache ()
+{
+    os_unfair_lock _lock;//查找在每次读取时调用，使用开销最小的锁；锁内不调用外部代码
+    NSMutableDictionary<NSString *, DatabaseRowCacheTable *> *_tables;
+    NSMutableArray<DatabaseRowCacheTable *> *_pendingTables;//当前事务修改的表
+    DatabaseRowCacheEntry *_head;//最近使用
+    __unsafe_unretained DatabaseRowCacheEntry *_tail;//最久未使用
+    NSUInteger _count;
+    uint64_t _stamp;//每次修改递增
+    uint64_t _clearedStamp;//最近一次 -removeAllObjects 时的时间戳
+    NSUInteger _hitCount;
+    NSUInteger _missCount;
+    NSUInteger _evictionCount;
+    NSUInteger _invalidationCount;
+}
+@end
+
+@implementation DatabaseRowCache
+
+- (instancetype)initWithCountLimit:(NSUInteger)countLimit{
+    self = [super init];
+    if (self) {
+        _lock = OS_UNFAIR_LOCK_INIT;
+        _countLimit = MAX(countLimit, 1);
+        _tables = [NSMutableDictionary dictionary];
+        _pendingTables = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (instancetype)init{
+    return [self initWithCountLimit:1024];
+}
+
+- (NSString *)description{
+    os_unfair_lock_lock(&_lock);
+    NSString *string = [NSString stringWithFormat:@"<%@: %p> count:%lu/%lu hit:%lu miss:%lu ratio:%.3f eviction:%lu invalidation:%lu",NSStringFromClass(self.class),self,(unsigned long)_count,(unsigned long)_countLimit,(unsigned long)_hitCount,(unsigned long)_missCount,(_hitCount + _missCount) ? (double)_hitCount / (_hitCount + _missCount) : 0,(unsigned long)_evictionCount,(unsigned long)_invalidationCount];
+    os_unfair_lock_unlock(&_lock);
+    return string;
+}
+
+#pragma mark - 链表，只在锁内调用
+
+- (void)unlinkEntry:(DatabaseRowCacheEntry *)entry{
+    DatabaseRowCacheEntry *next = entry->_next;
+    if (entry->_prev) {
+        entry->_prev->_next = next;
+    }else{
+        _head = next;
+    }
+    if (next) {
+        next->_prev = entry->_prev;
+    }else{
+        _tail = entry->_prev;
+    }
+    entry->_prev = nil;
+    entry->_next = nil;
+}
+
+- (void)linkEntryAtHead:(DatabaseRowCacheEntry *)entry{
+    entry->_next = _head;
+    if (_head) {
+        _head->_prev = entry;
+    }else{
+        _tail = entry;
+    }
+    _head = entry;
+}
+
+/** 从链表与表的索引中移除
+ */
+- (void)removeEntry:(DatabaseRowCacheEntry *)entry inTable:(DatabaseRowCacheTable *)table{
+    [table->_entries removeObjectForKey:entry->_key];
+    [table->_rowids removeObjectForKey:@(entry->_rowid)];
+    [self unlinkEntry:entry];
+    _count--;
+}
+
+- (NSUInteger)removeEntriesInTable:(DatabaseRowCacheTable *)table{
+    NSUInteger count = table->_entries.count;
+    for (DatabaseRowCacheEntry *entry in table->_entries.allValues) {
+        [self unlinkEntry:entry];
+    }
+    [table->_entries removeAllObjects];
+    [table->_rowids removeAllObjects];
+    _count -= count;
+    return count;
+}
+
+- (DatabaseRowCacheTable *)tableNamed:(NSString *)name{
+    DatabaseRowCacheTable *table = _tables[name];
+    if (table == nil) {
+        table = [[DatabaseRowCacheTable alloc] init];
+        _tables[name] = table;
+    }
+    return table;
+}
+
+#pragma mark - 读写
+
+- (NSUInteger)count{
+    os_unfair_lock_lock(&_lock);
+    NSUInteger count = _count;
+    os_unfair_lock_unlock(&_lock);
+    return count;
+}
+
+- (id)objectForTable:(NSString *)table key:(id)key{
+    if (key == nil) {
+        return nil;
+    }
+    id object = nil;
+    os_unfair_lock_lock(&_lock);
+    DatabaseRowCacheTable *cacheTable = _tables[table];
+    DatabaseRowCacheEntry *entry = cacheTable ? cacheTable->_entries[key] : nil;
+    if (entry) {
+        object = entry->_object;
+        if (entry != _head) {
+            [self unlinkEntry:entry];
+            [self linkEntryAtHead:entry];
+        }
+        _hitCount++;
+    }else{
+        _missCount++;
+    }
+    os_unfair_lock_unlock(&_lock);
+    return object;
+}
+
+- (uint64_t)readStamp{
+    os_unfair_lock_lock(&_lock);
+    uint64_t stamp = _stamp;
+    os_unfair_lock_unlock(&_lock);
+    return stamp;
+}
+
+- (void)setObject:(id)object forTable:(NSString *)tableName key:(id<NSCopying>)key rowid:(int64_t)rowid readStamp:(uint64_t)readStamp{
+    if (object == nil || key == nil) {
+        return;
+    }
+    DatabaseRowCacheEntry *evicted = nil;
+    os_unfair_lock_lock(&_lock);
+    DatabaseRowCacheTable *table = [self tableNamed:tableName];
+    //查询之后该表被修改过，或者正在被修改：查询得到的可能是旧数据
+    if (table->_pending || table->_modifiedStamp > readStamp || _clearedStamp > readStamp) {
+        os_unfair_lock_unlock(&_lock);
+        return;
+    }
+    DatabaseRowCacheEntry *entry = table->_entries[key];
+    if (entry) {
+        [self removeEntry:entry inTable:table];
+    }
+    entry = [[DatabaseRowCacheEntry alloc] init];
+    entry->_table = tableName;
+    entry->_key = [(id)key copy];
+    entry->_object = object;
+    entry->_rowid = rowid;
+    table->_entries[entry->_key] = entry;
+    table->_rowids[@(rowid)] = entry;
+    [self linkEntryAtHead:entry];
+    _count++;
+
+    if (_count > _countLimit) {
+        evicted = _tail;
+        [self removeEntry:evicted inTable:_tables[evicted->_table]];
+        _evictionCount++;
+    }
+    os_unfair_lock_unlock(&_lock);
+    //被淘汰的模型在锁外释放
+    evicted = nil;
+}
+
+- (void)removeObjectForTable:(NSString *)tableName key:(id)key{
+    if (key == nil) {
+        return;
+    }
+    os_unfair_lock_lock(&_lock);
+    DatabaseRowCacheTable *table = [self tableNamed:tableName];
+    table->_modifiedStamp = ++_stamp;
+    DatabaseRowCacheEntry *entry = table->_entries[key];
+    if (entry) {
+        [self removeEntry:entry inTable:table];
+        _invalidationCount++;
+    }
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)removeObjectsInTable:(NSString *)tableName{
+    os_unfair_lock_lock(&_lock);
+    DatabaseRowCacheTable *table = [self tableNamed:tableName];
+    table->_modifiedStamp = ++_stamp;
+    _invalidationCount += [self removeEntriesInTable:table];
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)removeAllObjects{
+    os_unfair_lock_lock(&_lock);
+    _clearedStamp = ++_stamp;
+    _invalidationCount += _count;
+    for (DatabaseRowCacheTable *table in _tables.allValues) {
+        [table->_entries removeAllObjects];
+        [table->_rowids removeAllObjects];
+    }
+    //逐个断开链表，避免释放长链表时递归过深
+    while (_head) {
+        DatabaseRowCacheEntry *entry = _head;
+        [self unlinkEntry:entry];
+    }
+    _count = 0;
+    os_unfair_lock_unlock(&_lock);
+}
+
+#pragma mark - 写连接的回调
+
+- (void)rowDidChangeInTable:(NSString *)tableName rowid:(int64_t)rowid operation:(int)operation{
+    os_unfair_lock_lock(&_lock);
+    DatabaseRowCacheTable *table = [self tableNamed:tableName];
+    table->_modifiedStamp = ++_stamp;
+    if (!table->_pending) {
+        table->_pending = YES;
+        [_pendingTables addObject:table];
+    }
+    if (table->_entries.count) {
+        if (operation == SQLITE_INSERT) {
+            _invalidationCount += [self removeEntriesInTable:table];
+        }else{
+            DatabaseRowCacheEntry *entry = table->_rowids[@(rowid)];
+            if (entry) {
+                [self removeEntry:entry inTable:table];
+                _invalidationCount++;
+            }
+        }
+    }
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)finishTransaction{
+    os_unfair_lock_lock(&_lock);
+    if (_pendingTables.count) {
+        uint64_t stamp = ++_stamp;
+        for (DatabaseRowCacheTable *table in _pendingTables) {
+            table->_pending = NO;
+            table->_modifiedStamp = stamp;
+        }
+        [_pendingTables removeAllObjects];
+    }
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)transactionDidCommit{
+    [self finishTransaction];
+}
+
+- (void)transactionDidRollback{
+    //回滚之前被移除的模型不会恢复，只是少了一次命中
+    [self finishTransaction];
+}
+
+#pragma mark - 统计
+
+- (NSUInteger)hitCount{
+    os_unfair_lock_lock(&_lock);
+    NSUInteger count = _hitCount;
+    os_unfair_lock_unlock(&_lock);
+    return count;
+}
+
+- (NSUInteger)missCount{
+    os_unfair_lock_lock(&_lock);
+    NSUInteger count = _missCount;
+    os_unfair_lock_unlock(&_lock);
+    return count;
+}
+
+- (double)hitRatio{
+    os_unfair_lock_lock(&_lock);
+    NSUInteger total = _hitCount + _missCount;
+    double ratio = total ? (double)_hitCount / total : 0;
+    os_unfair_lock_unlock(&_lock);
+    return ratio;
+}
+
+- (NSUInteger)evictionCount{
+    os_unfair_lock_lock(&_lock);
+    NSUInteger count = _evictionCount;
+    os_unfair_lock_unlock(&_lock);
+    return count;
+}
+
+- (NSUInteger)invalidationCount{
+    os_unfair_lock_lock(&_lock);
+    NSUInteger count = _invalidationCount;
+    os_unfair_lock_unlock(&_lock);
+    return count;
+}
+
+- (void)resetStatistics{
+    os_unfair_lock_lock(&_lock);
+    _hitCount = _missCount = _evictionCount = _invalidationCount = 0;
+    os_unfair_lock_unlock(&_lock);
+}
+
+@end
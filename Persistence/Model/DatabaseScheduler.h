@@ -0,0 +1,127 @@
+//
+//  DatabaseScheduler.h
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/20.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "FMDatabaseQueue.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** 数据库任务所在的通道，优先级从高到低
+ */
+typedef NS_ENUM(NSInteger, DatabaseLane) {
+    DatabaseLaneInteractive = 0,//交互：界面正在等待结果的查询
+    DatabaseLaneUserWrite,//用户写入：用户操作产生的写操作
+    DatabaseLaneBackground,//后台：同步、导入等大批量任务
+    DatabaseLaneMaintenance,//维护：清理、检查点等
+};
+
+/** 通道的数量
+ */
+FOUNDATION_EXPORT NSInteger const DatabaseLaneCount;
+
+/** 取消令牌：通过 DatabaseManagement 提交的每个数据库任务都对应一个取消令牌
+ * 调用 -cancel 后：
+ *  任务还在排队，则不再执行；
+ *  任务正在执行，则通过连接的进度回调（sqlite3_progress_handler）尽快中断正在执行的语句，并回滚事务；
+ *  任务已经执行完毕，则没有任何影响
+ */
+@interface DatabaseCancellationToken : NSObject
+
+/** 是否已取消
+ */
+@property (atomic, readonly, getter=isCancelled) BOOL cancelled;
+
+/** 取消任务，可以在任意线程调用，多次调用只生效一次
+ */
+- (void)cancel;
+
+/** 当前线程正在执行的数据库任务的取消令牌；不在数据库任务中时返回 nil
+ */
++ (nullable DatabaseCancellationToken *)currentToken;
+
+@end
+
+/** 数据库任务调度器
+ *
+ * 每个通道有各自的服务质量（QoS）与权重：
+ *  读操作：分派到通道各自的串行 NSOperationQueue；交互、用户写入通道使用前台只读连接，后台、维护通道使用后台只读连接，前台与后台彼此不排队；
+ *  写操作：写连接同一时刻只执行一个任务，调度器按通道权重挑选下一个任务（步幅调度），
+ *         权重越大的通道被选中得越频繁，权重小的通道也不会饿死；
+ *         选中的任务在单独的串行写队列中执行（QoS 与通道一致），不与通道队列中的其它任务排队；
+ *
+ * 抢占：后台、维护通道的写任务运行超过时间片，且交互、用户写入通道有写任务在等待时，
+ *      通过 sqlite3_progress_handler 中断正在执行的语句，回滚该任务的事务，并放回所在通道的队首稍后重新执行；
+ *      同一个任务最多被抢占 maxPreemptCount 次，之后不再被抢占，保证任务一定能执行完成
+ *
+ * 取消：写连接与只读连接都设置了进度回调，正在执行的任务的取消令牌被取消后，立即中断当前语句
+ */
+@interface DatabaseScheduler : NSObject
+
+/** @param writeQueue 写连接；为 nil 时（只读的数据库）所有写任务都回调失败
+ */
+- (instancetype)initWithWriteQueue:(FMDatabaseQueue * _Nullable)writeQueue
+                         readQueue:(FMDatabaseQueue *)readQueue
+               backgroundReadQueue:(FMDatabaseQueue *)backgroundReadQueue NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+/** 写连接
+ */
+@property (nonatomic, strong, readonly, nullable) FMDatabaseQueue *writeQueue;
+
+/** 后台、维护通道的写任务可以连续运行的时间片，超过后才会被抢占；默认 0.05 秒
+ */
+@property (atomic, assign) NSTimeInterval preemptTimeSlice;
+
+/** 同一个写任务最多被抢占的次数，默认 3 次
+ */
+@property (atomic, assign) NSUInteger maxPreemptCount;
+
+/** 设置通道的权重，默认依次为 8、4、2、1
+ */
+- (void)setWeight:(NSUInteger)weight forLane:(DatabaseLane)lane;
+
+/** 通道的任务队列，队列的 qualityOfService 与通道对应
+ */
+- (NSOperationQueue *)operationQueueForLane:(DatabaseLane)lane;
+
+/** 通道使用的只读连接
+ */
+- (FMDatabaseQueue *)readQueueForLane:(DatabaseLane)lane;
+
+/** 之后提交的读写任务都等待 operation 完成之后才执行，operation 由调用方加入队列
+ * 用于打开数据库文件之后在分线程中创建、升级表结构：表结构就绪之前的任务不会读写旧的表
+ */
+- (void)holdOperationsUntilFinished:(NSOperation *)operation;
+
+/** 在通道中执行一个不使用数据库连接的任务：在分线程中执行
+ * 取消令牌只能阻止还在排队的任务
+ */
+- (DatabaseCancellationToken *)addOperationInLane:(DatabaseLane)lane block:(void (^)(void))block;
+
+/** 在通道中执行只读操作：在分线程中执行
+ */
+- (DatabaseCancellationToken *)readInLane:(DatabaseLane)lane block:(void (^)(FMDatabase *db))block;
+
+/** 在通道中开启读事务执行只读操作，block 内的多次查询读取同一个数据库版本：在分线程中执行
+ */
+- (DatabaseCancellationToken *)readTransactionInLane:(DatabaseLane)lane block:(void (^)(FMDatabase *db))block;
+
+/** 在通道中执行写事务：在分线程中执行
+ * @param token 任务使用的取消令牌，为 nil 时创建一个新的令牌；先后执行的多个任务可以共用同一个令牌
+ * @param block 写操作；被抢占时事务回滚，稍后 block 会被重新执行，因此 block 不应有数据库之外的副作用
+ * @param completion 在分线程回调事务是否提交成功；任务被取消时回调 NO
+ */
+- (DatabaseCancellationToken *)writeInLane:(DatabaseLane)lane token:(DatabaseCancellationToken * _Nullable)token transaction:(void (^)(FMDatabase *db, BOOL *rollback))block completion:(void (^ _Nullable)(BOOL committed))completion;
+
+/** 取消所有未完成的任务：排队中的任务不再执行，正在执行的语句立即中断并回滚
+ */
+- (void)cancelAllOperations;
+
+@end
+
+NS_ASSUME_NONNULL_END
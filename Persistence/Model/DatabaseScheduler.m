@@ -0,0 +1,477 @@
+//
+//  DatabaseScheduler.m
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/20.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import "DatabaseScheduler.h"
+#import <sqlite3.h>
+
+NSInteger const DatabaseLaneCount = 4;
+
+/** 每执行多少条虚拟机指令检查一次是否需要中断
+ */
+static int const DatabaseProgressInstructions = 1000;
+
+/** 线程字典中保存当前取消令牌的键
+ */
+static NSString * const DatabaseCurrentTokenKey = @"com.persistence.cancellationToken";
+
+@interface DatabaseCancellationToken ()
+{
+    void (^_cancellationHandler)(void);//取消时的处理：移出等待队列、取消 NSOperation
+}
+@property (atomic, readwrite, getter=isCancelled) BOOL cancelled;
+@end
+
+@implementation DatabaseCancellationToken
+
+- (void)cancel{
+    void (^handler)(void) = nil;
+    @synchronized (self) {
+        if (_cancelled) {
+            return;
+        }
+        _cancelled = YES;
+        handler = _cancellationHandler;
+        _cancellationHandler = nil;
+    }
+    if (handler) {
+        handler();
+    }
+}
+
+/** 设置取消时的处理；令牌已被取消时立即执行
+ */
+- (void)setCancellationHandler:(void (^)(void))handler{
+    @synchronized (self) {
+        if (!_cancelled) {
+            _cancellationHandler = [handler copy];
+            return;
+        }
+    }
+    if (handler) {
+        handler();
+    }
+}
+
++ (DatabaseCancellationToken *)currentToken{
+    return NSThread.currentThread.threadDictionary[DatabaseCurrentTokenKey];
+}
+
+/** 在当前线程中以 token 作为当前令牌执行 block
+ */
++ (void)performWithToken:(DatabaseCancellationToken *)token block:(void (^)(void))block{
+    NSMutableDictionary *threadDictionary = NSThread.currentThread.threadDictionary;
+    DatabaseCancellationToken *previousToken = threadDictionary[DatabaseCurrentTokenKey];
+    threadDictionary[DatabaseCurrentTokenKey] = token;
+    block();
+    threadDictionary[DatabaseCurrentTokenKey] = previousToken;
+}
+
+@end
+
+/** 连接上正在执行的任务的取消令牌，供连接的进度回调读取
+ */
+@interface DatabaseConnectionContext : NSObject
+@property (atomic, strong) DatabaseCancellationToken *token;
+@end
+
+@implementation DatabaseConnectionContext
+@end
+
+/** 写连接上的一个任务
+ */
+@interface DatabaseWriteTask : NSObject
+@property (nonatomic, assign) DatabaseLane lane;
+@property (nonatomic, strong) DatabaseCancellationToken *token;
+@property (nonatomic, copy) void (^block)(FMDatabase *db, BOOL *rollback);
+@property (nonatomic, copy) void (^completion)(BOOL committed);
+@property (nonatomic, assign) NSUInteger preemptCount;//已被抢占的次数
+@property (atomic, assign) BOOL preemptible;//本次运行是否允许被抢占
+@property (atomic, assign) BOOL preempted;//本次运行是否已被抢占
+@property (atomic, assign) CFAbsoluteTime startTime;//本次运行的开始时间
+@end
+
+@implementation DatabaseWriteTask
+@end
+
+@interface DatabaseScheduler ()
+{
+    dispatch_queue_t _stateQueue;//串行队列，保护下面的调度状态
+    NSMutableArray<DatabaseWriteTask *> *_pendingWrites[4];//每个通道等待中的写任务
+    NSUInteger _laneWeight[4];//通道权重
+    double _lanePass[4];//步幅调度：通道的行程，每被选中一次增加 1/权重
+    double _globalPass;//最近一次被选中的通道的行程
+    BOOL _isWriting;//写连接上是否有任务在执行
+    NSArray<NSOperationQueue *> *_operationQueues;
+    NSOperationQueue *_writerQueue;//串行队列，只执行写任务，不与通道队列中的维护任务排队
+    NSHashTable<DatabaseCancellationToken *> *_liveTokens;//还未完成的任务的取消令牌
+}
+@property (nonatomic, strong) FMDatabaseQueue *readQueue;
+@property (nonatomic, strong) FMDatabaseQueue *backgroundReadQueue;
+@property (nonatomic, strong) DatabaseConnectionContext *readContext;
+@property (nonatomic, strong) DatabaseConnectionContext *backgroundReadContext;
+@property (atomic, strong) DatabaseWriteTask *runningTask;//写连接上正在执行的任务
+@property (atomic, assign) NSUInteger urgentWriteCount;//交互、用户写入通道等待中的写任务数量
+@property (atomic, strong) NSOperation *holdOperation;//之后的任务都等待它完成
+@end
+
+@implementation DatabaseScheduler
+
+- (instancetype)initWithWriteQueue:(FMDatabaseQueue *)writeQueue readQueue:(FMDatabaseQueue *)readQueue backgroundReadQueue:(FMDatabaseQueue *)backgroundReadQueue{
+    self = [super init];
+    if (self) {
+        _writeQueue = writeQueue;
+        _readQueue = readQueue;
+        _backgroundReadQueue = backgroundReadQueue;
+        _preemptTimeSlice = 0.05;
+        _maxPreemptCount = 3;
+        _stateQueue = dispatch_queue_create("com.persistence.scheduler", DISPATCH_QUEUE_SERIAL);
+        _liveTokens = [NSHashTable weakObjectsHashTable];
+
+        NSQualityOfService qualityOfServices[4] = {NSQualityOfServiceUserInteractive,NSQualityOfServiceUserInitiated,NSQualityOfServiceUtility,NSQualityOfServiceBackground};
+        NSArray<NSString *> *names = @[@"本地数据队列-交互",@"本地数据队列-用户写入",@"本地数据队列-后台",@"本地数据队列-维护"];
+        NSMutableArray<NSOperationQueue *> *operationQueues = [NSMutableArray arrayWithCapacity:DatabaseLaneCount];
+        for (NSInteger lane = 0; lane < DatabaseLaneCount; lane++) {
+            NSOperationQueue *queue = [[NSOperationQueue alloc] init];
+            queue.qualityOfService = qualityOfServices[lane];
+            //每个只读连接是一个串行队列：通道并发执行的读操作只会在连接上排队，并发数与连接数一致
+            queue.maxConcurrentOperationCount = 1;
+            queue.name = names[lane];
+            [operationQueues addObject:queue];
+
+            _pendingWrites[lane] = [NSMutableArray array];
+            _laneWeight[lane] = 8 >> lane;
+            _lanePass[lane] = 0;
+        }
+        _operationQueues = [operationQueues copy];
+        _writerQueue = [[NSOperationQueue alloc] init];
+        _writerQueue.maxConcurrentOperationCount = 1;
+        _writerQueue.name = @"本地数据队列-写连接";
+
+        //写连接：进度回调负责抢占与取消，提交回调保证被抢占、被取消的任务不会有任何写入被提交
+        __weak typeof(self) weakSelf = self;
+        [writeQueue inDatabase:^(FMDatabase *db) {
+            [db setProgressHandler:^BOOL{
+                return [weakSelf shouldInterruptRunningTask];
+            } instructions:DatabaseProgressInstructions];
+            [db setCommitHook:^BOOL{
+                DatabaseWriteTask *task = weakSelf.runningTask;
+                return task.preempted || task.token.isCancelled;
+            }];
+        }];
+
+        //只读连接：进度回调负责取消
+        _readContext = [self installContextOnReadQueue:readQueue];
+        _backgroundReadContext = [self installContextOnReadQueue:backgroundReadQueue];
+    }
+    return self;
+}
+
+- (DatabaseConnectionContext *)installContextOnReadQueue:(FMDatabaseQueue *)readQueue{
+    DatabaseConnectionContext *context = [[DatabaseConnectionContext alloc] init];
+    __weak DatabaseConnectionContext *weakContext = context;
+    [readQueue inDatabase:^(FMDatabase *db) {
+        [db setProgressHandler:^BOOL{
+            return weakContext.token.isCancelled;
+        } instructions:DatabaseProgressInstructions];
+    }];
+    return context;
+}
+
+- (void)setWeight:(NSUInteger)weight forLane:(DatabaseLane)lane{
+    dispatch_async(_stateQueue, ^{
+        self->_laneWeight[lane] = MAX(weight, 1);
+    });
+}
+
+- (NSOperationQueue *)operationQueueForLane:(DatabaseLane)lane{
+    return _operationQueues[lane];
+}
+
+- (FMDatabaseQueue *)readQueueForLane:(DatabaseLane)lane{
+    return lane <= DatabaseLaneUserWrite ? self.readQueue : self.backgroundReadQueue;
+}
+
+- (DatabaseConnectionContext *)readContextForLane:(DatabaseLane)lane{
+    return lane <= DatabaseLaneUserWrite ? self.readContext : self.backgroundReadContext;
+}
+
+- (void)holdOperationsUntilFinished:(NSOperation *)operation{
+    self.holdOperation = operation;
+}
+
+/** 任务等待 -holdOperationsUntilFinished: 设置的操作完成
+ */
+- (void)addHoldDependencyToOperation:(NSOperation *)operation{
+    NSOperation *holdOperation = self.holdOperation;
+    if (holdOperation && !holdOperation.isFinished) {
+        [operation addDependency:holdOperation];
+    }
+}
+
+#pragma mark - 取消
+
+/** 登记一个还未完成的取消令牌，供 -cancelAllOperations 使用
+ */
+- (void)registerToken:(DatabaseCancellationToken *)token{
+    @synchronized (_liveTokens) {
+        [_liveTokens addObject:token];
+    }
+}
+
+- (void)unregisterToken:(DatabaseCancellationToken *)token{
+    @synchronized (_liveTokens) {
+        [_liveTokens removeObject:token];
+    }
+}
+
+- (void)cancelAllOperations{
+    NSArray<DatabaseCancellationToken *> *tokens;
+    @synchronized (_liveTokens) {
+        tokens = _liveTokens.allObjects;
+        [_liveTokens removeAllObjects];
+    }
+    [tokens makeObjectsPerformSelector:@selector(cancel)];
+}
+
+#pragma mark - 读操作
+
+- (DatabaseCancellationToken *)addOperationInLane:(DatabaseLane)lane block:(void (^)(void))block{
+    DatabaseCancellationToken *token = [[DatabaseCancellationToken alloc] init];
+    [self registerToken:token];
+
+    NSBlockOperation *operation = [NSBlockOperation blockOperationWithBlock:^{
+        if (!token.isCancelled) {
+            [DatabaseCancellationToken performWithToken:token block:block];
+        }
+        [self unregisterToken:token];
+    }];
+    __weak NSBlockOperation *weakOperation = operation;
+    [token setCancellationHandler:^{
+        [weakOperation cancel];
+    }];
+    [self addHoldDependencyToOperation:operation];
+    [[self operationQueueForLane:lane] addOperation:operation];
+    return token;
+}
+
+- (DatabaseCancellationToken *)readInLane:(DatabaseLane)lane block:(void (^)(FMDatabase *db))block{
+    return [self readInLane:lane transaction:NO block:block];
+}
+
+- (DatabaseCancellationToken *)readTransactionInLane:(DatabaseLane)lane block:(void (^)(FMDatabase *db))block{
+    return [self readInLane:lane transaction:YES block:block];
+}
+
+- (DatabaseCancellationToken *)readInLane:(DatabaseLane)lane transaction:(BOOL)transaction block:(void (^)(FMDatabase *db))block{
+    FMDatabaseQueue *readQueue = [self readQueueForLane:lane];
+    DatabaseConnectionContext *context = [self readContextForLane:lane];
+    return [self addOperationInLane:lane block:^{
+        DatabaseCancellationToken *token = DatabaseCancellationToken.currentToken;
+        void (^readBlock)(FMDatabase *db) = ^(FMDatabase *db){
+            context.token = token;
+            [DatabaseCancellationToken performWithToken:token block:^{
+                block(db);
+            }];
+            context.token = nil;
+        };
+        if (transaction) {
+            [readQueue inReadTransaction:readBlock];
+        }else{
+            [readQueue inDatabase:readBlock];
+        }
+    }];
+}
+
+#pragma mark - 写操作
+
+- (DatabaseCancellationToken *)writeInLane:(DatabaseLane)lane token:(DatabaseCancellationToken *)token transaction:(void (^)(FMDatabase *db, BOOL *rollback))block completion:(void (^)(BOOL committed))completion{
+    DatabaseWriteTask *task = [[DatabaseWriteTask alloc] init];
+    task.lane = lane;
+    task.token = token ?: [[DatabaseCancellationToken alloc] init];
+    task.block = block;
+    task.completion = completion;
+    [self registerToken:task.token];
+
+    //排队中被取消：移出等待队列；正在执行时被取消：由进度回调中断
+    __weak typeof(self) weakSelf = self;
+    __weak DatabaseWriteTask *weakTask = task;
+    [task.token setCancellationHandler:^{
+        DatabaseScheduler *strongSelf = weakSelf;
+        if (strongSelf == nil) {
+            return;
+        }
+        dispatch_async(strongSelf->_stateQueue, ^{
+            DatabaseWriteTask *strongTask = weakTask;
+            if (strongTask && [strongSelf removePendingWriteTask:strongTask] && strongTask.completion) {
+                strongTask.completion(NO);
+            }
+        });
+    }];
+
+    dispatch_async(_stateQueue, ^{
+        [self enqueueWriteTask:task atFront:NO];
+        [self scheduleNextWrite];
+    });
+    return task.token;
+}
+
+/** 加入通道的等待队列
+ * @note 只在 _stateQueue 中调用
+ */
+- (void)enqueueWriteTask:(DatabaseWriteTask *)task atFront:(BOOL)atFront{
+    NSMutableArray *pendingArray = _pendingWrites[task.lane];
+    if (pendingArray.count == 0) {
+        //通道由空闲变为繁忙，行程追上当前进度，避免空闲期间积累的份额一次性用掉
+        _lanePass[task.lane] = MAX(_lanePass[task.lane], _globalPass);
+    }
+    if (atFront) {
+        [pendingArray insertObject:task atIndex:0];
+    }else{
+        [pendingArray addObject:task];
+    }
+    if (task.lane <= DatabaseLaneUserWrite) {
+        self.urgentWriteCount++;
+    }
+}
+
+/** 移出通道的等待队列
+ * @return 任务是否还在等待队列中
+ * @note 只在 _stateQueue 中调用
+ */
+- (BOOL)removePendingWriteTask:(DatabaseWriteTask *)task{
+    NSMutableArray *pendingArray = _pendingWrites[task.lane];
+    NSUInteger index = [pendingArray indexOfObjectIdenticalTo:task];
+    if (index == NSNotFound) {
+        return NO;
+    }
+    [pendingArray removeObjectAtIndex:index];
+    if (task.lane <= DatabaseLaneUserWrite) {
+        self.urgentWriteCount--;
+    }
+    return YES;
+}
+
+/** 写连接空闲时，选出行程最小的通道，执行其队首任务
+ * @note 只在 _stateQueue 中调用
+ */
+- (void)scheduleNextWrite{
+    if (_isWriting) {
+        return;
+    }
+    NSInteger selectedLane = -1;
+    for (NSInteger lane = 0; lane < DatabaseLaneCount; lane++) {
+        if (_pendingWrites[lane].count == 0) {
+            continue;
+        }
+        if (selectedLane < 0 || _lanePass[lane] < _lanePass[selectedLane]) {
+            selectedLane = lane;
+        }
+    }
+    if (selectedLane < 0) {
+        return;
+    }
+
+    DatabaseWriteTask *task = _pendingWrites[selectedLane].firstObject;
+    [self removePendingWriteTask:task];
+    _globalPass = _lanePass[selectedLane];
+    _lanePass[selectedLane] += 1.0 / _laneWeight[selectedLane];
+    _isWriting = YES;
+
+    //写任务在单独的串行队列中执行：通道队列中的重建、检查点等任务不会让已选中的写任务等待，占住写连接
+    //执行写任务的 NSOperation 不可取消，否则写连接将一直处于繁忙状态；取消由任务的令牌处理
+    NSBlockOperation *operation = [NSBlockOperation blockOperationWithBlock:^{
+        [self runWriteTask:task];
+    }];
+    operation.qualityOfService = [self operationQueueForLane:task.lane].qualityOfService;
+    [self addHoldDependencyToOperation:operation];
+    [_writerQueue addOperation:operation];
+}
+
+- (void)runWriteTask:(DatabaseWriteTask *)task{
+    __block BOOL committed = NO;
+    __block BOOL preempted = NO;
+    if (!task.token.isCancelled) {
+        [self.writeQueue inDatabase:^(FMDatabase *db) {
+            [db setShouldCacheStatements:YES];
+            task.preempted = NO;
+            task.preemptible = task.lane >= DatabaseLaneBackground && task.preemptCount < self.maxPreemptCount;
+            task.startTime = CFAbsoluteTimeGetCurrent();
+            self.runningTask = task;
+
+            __block BOOL shouldRollback = ![db beginTransaction];
+            if (!shouldRollback) {
+                [DatabaseCancellationToken performWithToken:task.token block:^{
+                    task.block(db, &shouldRollback);
+                }];
+            }
+            task.preemptible = NO;//提交过程不允许被抢占
+            preempted = task.preempted;
+
+            if (preempted || shouldRollback || task.token.isCancelled) {
+                //语句被中断时，SQLite 可能已经自动回滚了事务
+                if (!sqlite3_get_autocommit(db.sqliteHandle)) {
+                    [db rollback];
+                }
+            }else{
+                committed = [db commit];
+                if (!committed) {
+                    NSLog(@"scheduler commit error ===== %@",db.lastError);
+                    if (!sqlite3_get_autocommit(db.sqliteHandle)) {
+                        [db rollback];
+                    }
+                }
+            }
+            self.runningTask = nil;
+        }];
+    }
+
+    if (!preempted) {
+        [self unregisterToken:task.token];
+        if (task.completion) {
+            task.completion(committed);
+        }
+    }
+
+    dispatch_async(_stateQueue, ^{
+        self->_isWriting = NO;
+        if (preempted) {
+            //被抢占的任务放回通道队首，等待更高优先级的任务执行完后重新执行
+            task.preemptCount++;
+            [self enqueueWriteTask:task atFront:YES];
+        }
+        [self scheduleNextWrite];
+    });
+}
+
+#pragma mark - 抢占
+
+/** 写连接的进度回调：是否中断正在执行的语句
+ * @note 在写连接所在的线程中调用，调用频繁，只读取原子属性
+ */
+- (BOOL)shouldInterruptRunningTask{
+    DatabaseWriteTask *task = self.runningTask;
+    if (task == nil) {
+        return NO;
+    }
+    if (task.token.isCancelled) {
+        return YES;
+    }
+    if (!task.preemptible) {
+        return NO;
+    }
+    if (task.preempted) {
+        return YES;
+    }
+    if (self.urgentWriteCount == 0 || CFAbsoluteTimeGetCurrent() - task.startTime < self.preemptTimeSlice) {
+        return NO;
+    }
+    task.preempted = YES;
+    return YES;
+}
+
+@end
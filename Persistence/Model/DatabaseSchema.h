@@ -0,0 +1,74 @@
+//
+//  DatabaseSchema.h
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/26.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** 记录每张表当前版本的表，与业务表保存在同一个数据库文件中
+ */
+FOUNDATION_EXPORT NSString * const DatabaseSchemaVersionTable;
+
+/** 一张表的结构声明：建表语句、当前版本与升级语句
+ *
+ * createSQL 创建的是第 1 版的表，migrations[@(n)] 是从第 n-1 版升级到第 n 版执行的语句（增加列、索引、触发器等）；
+ * 新建的表同样依次执行所有升级语句，保证新旧用户的表结构一致
+ */
+@interface DatabaseTableSchema : NSObject
+
++ (instancetype)schemaWithTableName:(NSString *)tableName
+                            version:(NSInteger)version
+                          createSQL:(NSString *)createSQL
+                         migrations:(nullable NSDictionary<NSNumber *, NSArray<NSString *> *> *)migrations;
+
+/** 带有效期的表：expiryColumn 保存写入时间（UTC 文本，例如 CURRENT_TIMESTAMP），超过 lifetime 秒的行视为过期
+ * 表结构就绪时在 expiryColumn 上创建索引，过期的行由维护通道分批删除
+ */
++ (instancetype)schemaWithTableName:(NSString *)tableName
+                            version:(NSInteger)version
+                          createSQL:(NSString *)createSQL
+                         migrations:(nullable NSDictionary<NSNumber *, NSArray<NSString *> *> *)migrations
+                       expiryColumn:(nullable NSString *)expiryColumn
+                           lifetime:(NSTimeInterval)lifetime;
+
+@property (nonatomic, copy, readonly) NSString *tableName;
+@property (nonatomic, assign, readonly) NSInteger version;
+@property (nonatomic, copy, readonly) NSString *createSQL;
+@property (nonatomic, copy, readonly) NSDictionary<NSNumber *, NSArray<NSString *> *> *migrations;
+
+/** 有效期：没有声明有效期时 expiryColumn 为 nil
+ */
+@property (nonatomic, copy, readonly, nullable) NSString *expiryColumn;
+@property (nonatomic, assign, readonly) NSTimeInterval lifetime;
+
+/** expiryColumn 上的索引：CREATE INDEX IF NOT EXISTS ...
+ */
+@property (nonatomic, copy, readonly, nullable) NSString *expiryIndexSQL;
+
+/** 查询条件：未过期的行，例如 time >= datetime('now','-604800 seconds')；可以使用 expiryColumn 上的索引
+ * 没有声明有效期时为 1，不过滤任何行
+ */
+@property (nonatomic, copy, readonly) NSString *freshnessClause;
+
+/** 查询条件：已过期的行；没有声明有效期时为 0
+ */
+@property (nonatomic, copy, readonly) NSString *expiredClause;
+
+/** 查询条件：写入时间超过有效期一半、需要刷新的行；没有声明有效期时为 0
+ * 按唯一键写入（upsert）时，内容相同的行只在满足这个条件时更新写入时间，其余的不写入
+ */
+@property (nonatomic, copy, readonly) NSString *refreshClause;
+
+@end
+
+/** 一组表结构的指纹：保存在数据库的 user_version 中
+ * 启动时 user_version 与指纹一致，说明所有表都已是最新版本，无需再读取 sqlite_master
+ */
+FOUNDATION_EXPORT int32_t DatabaseSchemaFingerprint(NSArray<DatabaseTableSchema *> *schemas);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,69 @@
+//
+//  DatabaseSchema.m
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/26.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import "DatabaseSchema.h"
+
+NSString * const DatabaseSchemaVersionTable = @"DatabaseSchemaVersion";
+
+@implementation DatabaseTableSchema
+
++ (instancetype)schemaWithTableName:(NSString *)tableName version:(NSInteger)version createSQL:(NSString *)createSQL migrations:(NSDictionary<NSNumber *,NSArray<NSString *> *> *)migrations{
+    return [self schemaWithTableName:tableName version:version createSQL:createSQL migrations:migrations expiryColumn:nil lifetime:0];
+}
+
++ (instancetype)schemaWithTableName:(NSString *)tableName version:(NSInteger)version createSQL:(NSString *)createSQL migrations:(NSDictionary<NSNumber *,NSArray<NSString *> *> *)migrations expiryColumn:(NSString *)expiryColumn lifetime:(NSTimeInterval)lifetime{
+    DatabaseTableSchema *schema = [[DatabaseTableSchema alloc] init];
+    schema->_tableName = [tableName copy];
+    schema->_version = MAX(version, 1);
+    schema->_createSQL = [createSQL copy];
+    schema->_migrations = [migrations copy] ?: @{};
+    if (expiryColumn && lifetime > 0) {
+        schema->_expiryColumn = [expiryColumn copy];
+        schema->_lifetime = lifetime;
+        //右侧是与行无关的常量表达式，比较时可以使用 expiryColumn 上的索引
+        NSString *threshold = [NSString stringWithFormat:@"datetime('now','-%.0f seconds')",lifetime];
+        schema->_expiryIndexSQL = [NSString stringWithFormat:@"CREATE INDEX IF NOT EXISTS %@_%@_expiry ON %@ (%@)",tableName,expiryColumn,tableName,expiryColumn];
+        schema->_freshnessClause = [NSString stringWithFormat:@"%@ >= %@",expiryColumn,threshold];
+        schema->_expiredClause = [NSString stringWithFormat:@"%@ < %@",expiryColumn,threshold];
+        schema->_refreshClause = [NSString stringWithFormat:@"%@ < datetime('now','-%.0f seconds')",expiryColumn,lifetime / 2];
+    }else{
+        schema->_freshnessClause = @"1";
+        schema->_expiredClause = @"0";
+        schema->_refreshClause = @"0";
+    }
+    return schema;
+}
+
+- (NSString *)description{
+    if (self.expiryColumn) {
+        return [NSString stringWithFormat:@"<DatabaseTableSchema %@ v%ld expiry:%@ %.0fs>",self.tableName,(long)self.version,self.expiryColumn,self.lifetime];
+    }
+    return [NSString stringWithFormat:@"<DatabaseTableSchema %@ v%ld>",self.tableName,(long)self.version];
+}
+
+@end
+
+int32_t DatabaseSchemaFingerprint(NSArray<DatabaseTableSchema *> *schemas){
+    NSMutableArray<NSString *> *items = [NSMutableArray arrayWithCapacity:schemas.count];
+    for (DatabaseTableSchema *schema in schemas) {
+        //有效期的列决定是否需要创建索引，计入指纹
+        [items addObject:[NSString stringWithFormat:@"%@:%ld:%@",schema.tableName,(long)schema.version,schema.expiryColumn ?: @""]];
+    }
+    [items sortUsingSelector:@selector(compare:)];
+
+    //FNV-1a，取正数；0 是新数据库的 user_version，不作为指纹
+    NSData *data = [[items componentsJoinedByString:@","] dataUsingEncoding:NSUTF8StringEncoding];
+    const uint8_t *bytes = data.bytes;
+    uint32_t hash = 2166136261u;
+    for (NSUInteger i = 0; i < data.length; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    int32_t fingerprint = (int32_t)(hash & 0x7fffffff);
+    return fingerprint ?: 1;
+}
@@ -0,0 +1,198 @@
+//
+//  DatabaseStore.h
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/25.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "DatabaseScheduler.h"
+#import "DatabaseCheckpointScheduler.h"
+#import "DatabaseSchema.h"
+#import "DatabaseRowCache.h"
+#import "DatabaseChangeTracker.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** 数据库文件的打开方式
+ */
+typedef NS_ENUM(NSInteger, DatabaseStoreProfile) {
+    DatabaseStoreProfileReadWrite = 0,//可读写：WAL 模式，写连接 + 两个只读连接 + 检查点连接
+    DatabaseStoreProfileReadOnly,//只读：只打开只读连接（mode=ro），所有写操作都失败
+    DatabaseStoreProfileImmutable,//不可变：以 immutable=1 打开，SQLite 不加锁、不检查文件是否被修改；文件在使用期间不能被任何进程修改
+};
+
+/** 一个数据库文件：拥有各自的写连接、只读连接与任务调度器
+ * 不同的 DatabaseStore 各自持有写锁，一个文件的大批量写入不会阻塞另一个文件的写操作；
+ * 跨文件的查询通过 -attachStore: 将另一个文件 ATTACH 到本文件的只读连接上
+ *
+ * 提交任务的方法与 DatabaseManagement 的同名类方法一致，DatabaseManagement 的类方法作用于 main 数据库
+ */
+@interface DatabaseStore : NSObject
+
+- (instancetype)initWithName:(NSString *)name path:(NSString *)path profile:(DatabaseStoreProfile)profile NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+/** 名称，同时是被 ATTACH 时使用的数据库名称
+ */
+@property (nonatomic, copy, readonly) NSString *name;
+
+/** 文件路径
+ */
+@property (nonatomic, copy, readonly) NSString *path;
+
+/** 打开方式
+ */
+@property (nonatomic, assign, readonly) DatabaseStoreProfile profile;
+
+/** 只读连接内存映射的字节数：不可变的数据库为文件大小，查询直接读取映射的文件页，多个连接与进程共享系统的页缓存；其余为 0，不使用内存映射
+ * 被 ATTACH 到其它数据库的只读连接上时同样生效
+ */
+@property (nonatomic, assign, readonly) long long mmapSize;
+
+/** 写连接；只读、不可变的数据库为 nil
+ */
+@property (nonatomic, strong, readonly, nullable) FMDatabaseQueue *writeQueue;
+
+/** 前台只读连接：交互、用户写入通道的查询使用
+ */
+@property (nonatomic, strong, readonly) FMDatabaseQueue *readQueue;
+
+/** 后台只读连接：后台、维护通道的查询使用
+ */
+@property (nonatomic, strong, readonly) FMDatabaseQueue *backgroundReadQueue;
+
+/** 任务调度器
+ */
+@property (nonatomic, strong, readonly) DatabaseScheduler *scheduler;
+
+/** WAL 检查点调度器；只读、不可变的数据库为 nil
+ */
+@property (nonatomic, strong, readonly, nullable) DatabaseCheckpointScheduler *checkpointScheduler;
+
+/** 按唯一键读取的行缓存（见 DatabaseDAO 的 +modelOfClass:uniqueValue:inDatabase:）
+ * 可读写的数据库由写连接的 update_hook、rollback_hook 与 WAL 回调使其失效；替换数据库文件后清空
+ */
+@property (nonatomic, strong, readonly) DatabaseRowCache *rowCache;
+
+/** 观察写连接提交的修改：每个事务提交之后回调一次合并的修改，回滚的事务不回调；清空数据库、清空表之后回调整表变化
+ * @param tableNames 只在这些表有修改时回调；nil 为所有的表
+ * @param queue 回调所在的队列，nil 为主队列
+ * @return 调用 -invalidate 移除观察者
+ */
+- (DatabaseChangeObservation *)addChangeObserverForTables:(nullable NSArray<NSString *> *)tableNames queue:(nullable dispatch_queue_t)queue block:(void (^)(DatabaseChangeSet *changes))block;
+
+/** 不经过 update_hook 的修改（不带条件的 DELETE、DROP TABLE）提交之后调用：移除行缓存中该表的模型，并向观察者发布整表变化
+ */
+- (void)tableDidChangeWithoutHook:(NSString *)tableName;
+
+/** 表结构是否已是最新版本；-prepareSchemas: 成功之后为 YES，之后的读写操作不再检查表结构
+ * -prepareSchemasInBackground: 完成之前为 NO
+ */
+@property (atomic, assign, readonly, getter=isSchemaReady) BOOL schemaReady;
+
+/** 在维护通道中创建、升级表结构（见 -prepareSchemas:），不阻塞调用方所在的线程
+ * 完成之前提交的读写任务都在其后执行；-databaseCurrentThreadInTransaction: 等待其完成
+ */
+- (void)prepareSchemasInBackground:(NSArray<DatabaseTableSchema *> *)schemas;
+
+/** 在写连接上同步创建、升级表结构
+ * 先读取一次 user_version：与这组表结构的指纹一致时直接返回；
+ * 否则读取一次 sqlite_master 与各表的版本，在同一个事务中执行所有建表、升级语句，最后写入新的指纹；任何一步失败都回滚
+ * @note 只读、不可变的数据库不做任何修改，直接认为表结构已就绪
+ */
+- (BOOL)prepareSchemas:(NSArray<DatabaseTableSchema *> *)schemas;
+
+/** 将另一个数据库文件以只读方式 ATTACH 到本数据库的只读连接上，数据库名称为 store.name
+ * 之后本数据库的查询可以直接访问另一个文件中的表（表名不冲突时无需加数据库名称前缀）
+ */
+- (void)attachStore:(DatabaseStore *)store;
+
+/** 使用事务执行一些操作：在分线程中执行，属于用户写入通道
+ */
+- (DatabaseCancellationToken *)databaseChildThreadInTransaction:(void (^)(FMDatabase *database, BOOL *rollback))block;
+
+/** 使用事务执行一些操作：在当前线程中执行（一般用于创建表时使用）
+ */
+- (void)databaseCurrentThreadInTransaction:(void (^)(FMDatabase *database, BOOL *rollback))block;
+
+/** 只读查询：在分线程中执行，属于交互通道
+ */
+- (DatabaseCancellationToken *)databaseChildThreadInRead:(void (^)(FMDatabase *database))block;
+
+/** 在指定通道中使用事务执行写操作：在分线程中执行
+ */
+- (DatabaseCancellationToken *)databaseInLane:(DatabaseLane)lane transaction:(void (^)(FMDatabase *database, BOOL *rollback))block;
+
+/** 在指定通道中执行只读查询：在分线程中执行
+ */
+- (DatabaseCancellationToken *)databaseInLane:(DatabaseLane)lane read:(void (^)(FMDatabase *database))block;
+
+/** 在指定通道中分批执行大量写操作：在分线程中执行
+ */
+- (DatabaseCancellationToken *)databaseInLane:(DatabaseLane)lane batches:(BOOL (^)(FMDatabase *database, NSUInteger batchIndex, BOOL *rollback))block completion:(void (^ _Nullable)(BOOL finished))completion;
+
+/** 同上，每一批提交之后在分线程（写连接的串行队列）回调 batchCommitted
+ * 被抢占、回滚的批次会以同一个 batchIndex 重新执行，只有提交的批次回调一次；用于只统计已提交的结果
+ */
+- (DatabaseCancellationToken *)databaseInLane:(DatabaseLane)lane batches:(BOOL (^)(FMDatabase *database, NSUInteger batchIndex, BOOL *rollback))block batchCommitted:(void (^ _Nullable)(NSUInteger batchIndex))batchCommitted completion:(void (^ _Nullable)(BOOL finished))completion;
+
+/** 使用已有的取消令牌分批执行写操作：先后提交的多组批次共用同一个令牌，取消一次即停止所有批次
+ * 用于写入的数据分段到达的任务（例如边解析边导入）：等待下一段数据时不占用写连接，数据到达后再提交下一组批次
+ */
+- (DatabaseCancellationToken *)databaseInLane:(DatabaseLane)lane token:(DatabaseCancellationToken *)token batches:(BOOL (^)(FMDatabase *database, NSUInteger batchIndex, BOOL *rollback))block completion:(void (^ _Nullable)(BOOL finished))completion;
+
+/** 一致性只读查询：在分线程中执行
+ */
+- (DatabaseCancellationToken *)databaseChildThreadInConsistentRead:(void (^)(FMDatabase *database))block;
+
+/** 合并写入：在分线程中执行
+ */
+- (DatabaseCancellationToken *)databaseBatchWrite:(BOOL (^)(FMDatabase *database))block completion:(void (^ _Nullable)(BOOL success))completion;
+
+/** 设置合并写入的时间窗口（默认 0.01 秒）与单个批次的最大写操作数（默认 64）
+ */
+- (void)setBatchWriteInterval:(NSTimeInterval)interval maxCount:(NSUInteger)maxCount;
+
+/** 分批删除过期的行：在维护通道中执行
+ * 每一批在一张表中最多删除 batchSize 行并单独提交，批次之间写连接可以被其它任务使用；没有声明有效期的表被忽略
+ */
+- (DatabaseCancellationToken *)sweepExpiredRowsInSchemas:(NSArray<DatabaseTableSchema *> *)schemas batchSize:(NSUInteger)batchSize completion:(void (^ _Nullable)(BOOL finished))completion;
+
+/** 回收空闲页：在维护通道中执行，完成后在主线程回调
+ * 读取 auto_vacuum、page_count、freelist_count：
+ *  空闲页超过总页数的 1/4，使用 VACUUM INTO 重建文件，文件变小、数据页连续；
+ *  否则 auto_vacuum 为 INCREMENTAL 时分批执行 PRAGMA incremental_vacuum，每批单独提交，可被其它通道抢占；
+ *  旧版本创建的数据库（auto_vacuum 不是 INCREMENTAL）不重建，空闲页留给之后的写入复用
+ */
+- (void)reclaimSpaceWithCompletion:(void (^ _Nullable)(BOOL success))completion;
+
+/** 使用 VACUUM INTO 重建数据库文件并启用增量回收：在维护通道中执行，完成后在主线程回调
+ * 耗时与数据库大小成正比，由调用方在合适的时机（例如用户触发的存储清理）显式调用
+ */
+- (void)rebuildWithCompletion:(void (^ _Nullable)(BOOL success))completion;
+
+/** 生成重置用的模板文件（<path>.template）：与当前数据库表结构一致的空数据库
+ * 表结构没有变化时直接返回；一般在启动后于维护通道中预先生成，重置时只需复制模板
+ */
+- (BOOL)prepareResetTemplate;
+
+/** 清空数据库：关闭所有连接，用模板的副本原子地替换数据库文件，再重新打开
+ * 耗时与数据量无关；在维护通道中执行，完成后在主线程回调
+ */
+- (void)resetWithCompletion:(void (^ _Nullable)(BOOL success))completion;
+
+/** 清空指定的表：在用户写入通道的一个事务中 DROP TABLE，再按表结构声明重建到当前版本（索引、触发器随之重建），提交之后移除行缓存中的模型并发布整表变化
+ * 耗时与行数无关，不关闭任何连接；版本记录与指纹不变，下次启动无需升级
+ * @param completion 在主线程回调是否已提交
+ */
+- (DatabaseCancellationToken *)emptyTablesWithSchemas:(NSArray<DatabaseTableSchema *> *)schemas completion:(void (^ _Nullable)(BOOL success))completion;
+
+/** 取消所有未完成的操作：排队中的不再执行，正在执行的语句立即中断并回滚
+ */
+- (void)cancelAllOperations;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,863 @@
+//
+//  DatabaseStore.m
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/25.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import "DatabaseStore.h"
+#import "FMDatabase.h"
+#import "FMDatabaseAdditions.h"
+#import "DatabasePinyinTokenizer.h"
+#import <sqlite3.h>
+
+/** 合并写入中的一个写操作
+ */
+@interface DatabaseBatchWriteItem : NSObject
+@property (nonatomic, copy) BOOL (^block)(FMDatabase *database);
+@property (nonatomic, copy) void (^completion)(BOOL success);
+@property (nonatomic, strong) DatabaseCancellationToken *token;
+@end
+
+@implementation DatabaseBatchWriteItem
+@end
+
+@interface DatabaseStore ()
+{
+    dispatch_queue_t _batchWriteQueue;//串行队列，保护合并写入的状态
+    NSMutableArray<DatabaseBatchWriteItem *> *_pendingBatchWrites;//待写入的操作；只在 _batchWriteQueue 中访问
+    NSTimeInterval _batchWriteInterval;
+    NSUInteger _batchWriteMaxCount;
+    BOOL _isBatchWriteScheduled;//是否已经安排了一次写入；只在 _batchWriteQueue 中访问
+    NSUInteger _batchWriteGeneration;//每次写入加一，定时器只写入安排它的那一批；只在 _batchWriteQueue 中访问
+    NSMutableArray<DatabaseStore *> *_attachedStores;//ATTACH 到本数据库只读连接上的其它数据库
+    NSHashTable<DatabaseStore *> *_attachingStores;//将本数据库 ATTACH 到只读连接上的其它数据库
+    int _templateSchemaVersion;//生成模板文件时数据库的 schema_version；只在 @synchronized (self) 中访问
+    NSOperation *_schemaOperation;//最近一次创建、升级表结构的任务；只在 @synchronized (self) 中访问
+}
+@property (nonatomic, strong) FMDatabaseQueue *checkpointQueue;
+@property (nonatomic, strong) DatabaseChangeTracker *changeTracker;
+@property (atomic, assign, readwrite, getter=isSchemaReady) BOOL schemaReady;
+@end
+
+@implementation DatabaseStore
+
+/** 删除数据库的日志文件（-wal、-shm、-journal）；includingDatabase 为 YES 时同时删除数据库文件
+ */
+static void DatabaseStoreRemoveFiles(NSString *path, BOOL includingDatabase){
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    for (NSString *suffix in @[@"-wal",@"-shm",@"-journal"]) {
+        [fileManager removeItemAtPath:[path stringByAppendingString:suffix] error:nil];
+    }
+    if (includingDatabase) {
+        [fileManager removeItemAtPath:path error:nil];
+    }
+}
+
+/** 原子地将 fromPath 重命名为 toPath，toPath 已存在时被替换
+ */
+static BOOL DatabaseStoreRename(NSString *fromPath, NSString *toPath){
+    if (rename(fromPath.fileSystemRepresentation, toPath.fileSystemRepresentation) != 0) {
+        NSLog(@"rename %@ error ===== %s",fromPath,strerror(errno));
+        return NO;
+    }
+    return YES;
+}
+
+/** 每个连接打开后的公共设置：注册全文索引使用的分词器，虚拟表的读写、触发器都依赖它
+ */
+static void DatabaseStoreConfigureConnection(FMDatabase *db){
+    DatabaseRegisterPinyinTokenizer(db);
+}
+
+/** 以 URI 的形式表示数据库文件，附带查询参数，例如 mode=ro、immutable=1
+ */
+static NSString *DatabaseStoreURI(NSString *path, NSString *query){
+    return [NSString stringWithFormat:@"%@?%@",[NSURL fileURLWithPath:path].absoluteString,query];
+}
+
+- (instancetype)initWithName:(NSString *)name path:(NSString *)path profile:(DatabaseStoreProfile)profile{
+    self = [super init];
+    if (self) {
+        _name = [name copy];
+        _path = [path copy];
+        _profile = profile;
+        _batchWriteQueue = dispatch_queue_create([NSString stringWithFormat:@"com.persistence.batchWrite.%@",name].UTF8String, DISPATCH_QUEUE_SERIAL);
+        _pendingBatchWrites = [NSMutableArray array];
+        _batchWriteInterval = 0.01;
+        _batchWriteMaxCount = 64;
+        _attachedStores = [NSMutableArray array];
+        _attachingStores = [NSHashTable weakObjectsHashTable];
+        _rowCache = [[DatabaseRowCache alloc] init];
+        _changeTracker = [[DatabaseChangeTracker alloc] initWithStoreName:name];
+
+        NSString *readPath = path;
+        switch (profile) {
+            case DatabaseStoreProfileReadWrite:{
+                _writeQueue = [[FMDatabaseQueue alloc] initWithPath:path];
+                [self configureWriteQueue];
+            }break;
+            case DatabaseStoreProfileReadOnly:{
+                readPath = DatabaseStoreURI(path, @"mode=ro");
+            }break;
+            case DatabaseStoreProfileImmutable:{
+                readPath = DatabaseStoreURI(path, @"immutable=1");
+                //文件在使用期间不会被修改，整个映射到内存
+                _mmapSize = [[[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil] fileSize];
+            }break;
+        }
+
+        //只读连接：只用于查询，不会获取写锁；打开 URI 支持，以便 ATTACH 其它数据库
+        _readQueue = [self readQueueWithPath:readPath];
+        _backgroundReadQueue = [self readQueueWithPath:readPath];
+        _scheduler = [[DatabaseScheduler alloc] initWithWriteQueue:_writeQueue readQueue:_readQueue backgroundReadQueue:_backgroundReadQueue];
+
+        if (_writeQueue) {
+            //检查点连接：只用于执行 WAL 检查点，不占用写连接
+            _checkpointQueue = [[FMDatabaseQueue alloc] initWithPath:path flags:SQLITE_OPEN_READWRITE];
+            _checkpointScheduler = [[DatabaseCheckpointScheduler alloc] initWithWriteQueue:_writeQueue checkpointQueue:_checkpointQueue scheduler:_scheduler];
+            _checkpointScheduler.reportHandler = ^(DatabaseCheckpointReport *report) {
+                NSLog(@"%@ %@",name,report);
+            };
+            //提交之后新数据才对只读连接可见：此时被修改的表才重新允许写入行缓存，观察者收到修改时也能读取到新数据
+            DatabaseRowCache *rowCache = _rowCache;
+            DatabaseChangeTracker *changeTracker = _changeTracker;
+            _checkpointScheduler.commitHandler = ^{
+                [rowCache transactionDidCommit];
+                [changeTracker transactionDidCommit];
+            };
+        }
+    }
+    return self;
+}
+
+/** 写连接的设置：重新打开写连接之后需要再次设置
+ */
+- (void)configureWriteQueue{
+    //WAL 模式：读操作读取提交时的版本，与写操作互不阻塞
+    //检查点之后 WAL 文件超过 4MB 时截断，限制磁盘占用
+    //新建的数据库在创建表之前启用增量回收；已有数据的数据库在空闲页过多或显式调用 -rebuildWithCompletion: 时重建
+    [self.writeQueue inDatabase:^(FMDatabase *db) {
+        [db executeStatements:@"PRAGMA auto_vacuum = INCREMENTAL"];
+        [db executeStatements:@"PRAGMA journal_mode = WAL"];
+        [db executeStatements:@"PRAGMA journal_size_limit = 4194304"];
+        //REPLACE 删除冲突的行时触发 DELETE 触发器，外部内容的全文索引才能删除旧行
+        [db executeStatements:@"PRAGMA recursive_triggers = ON"];
+        DatabaseStoreConfigureConnection(db);
+        //行缓存的失效、修改的记录：回调随连接重新打开自动恢复，这里重复设置没有副作用
+        DatabaseRowCache *rowCache = self.rowCache;
+        DatabaseChangeTracker *changeTracker = self.changeTracker;
+        [db setUpdateHook:^(int operation, NSString *databaseName, NSString *tableName, int64_t rowid) {
+            [rowCache rowDidChangeInTable:tableName rowid:rowid operation:operation];
+            [changeTracker rowDidChangeInTable:tableName rowid:rowid operation:operation];
+        }];
+        [db setRollbackHook:^{
+            [rowCache transactionDidRollback];
+            [changeTracker transactionDidRollback];
+        }];
+    }];
+}
+
+- (FMDatabaseQueue *)readQueueWithPath:(NSString *)path{
+    FMDatabaseQueue *readQueue = [[FMDatabaseQueue alloc] initWithPath:path flags:SQLITE_OPEN_READONLY | SQLITE_OPEN_URI];
+    [self configureReadQueue:readQueue];
+    return readQueue;
+}
+
+/** 只读连接的设置：重新打开只读连接之后需要再次设置
+ */
+- (void)configureReadQueue:(FMDatabaseQueue *)readQueue{
+    long long mmapSize = self.mmapSize;
+    [readQueue inDatabase:^(FMDatabase *db) {
+        [db setShouldCacheStatements:YES];
+        if (mmapSize > 0) {
+            [db executeStatements:[NSString stringWithFormat:@"PRAGMA mmap_size = %lld",mmapSize]];
+        }
+        DatabaseStoreConfigureConnection(db);
+    }];
+}
+
+#pragma mark - 表结构
+
+- (BOOL)prepareSchemas:(NSArray<DatabaseTableSchema *> *)schemas{
+    if (self.writeQueue == nil) {
+        self.schemaReady = YES;//预先生成的数据库文件，表结构由生成脚本负责
+        return YES;
+    }
+    int32_t fingerprint = DatabaseSchemaFingerprint(schemas);
+    __block BOOL result = YES;
+    [self.writeQueue inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        if ((int32_t)db.userVersion == fingerprint) {
+            return;//所有表都已是最新版本
+        }
+
+        NSString *versionSql = [NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS %@ (tableName TEXT PRIMARY KEY NOT NULL, version INTEGER NOT NULL)",DatabaseSchemaVersionTable];
+        if (![db executeUpdate:versionSql]) {
+            result = NO;
+        }
+
+        NSMutableSet<NSString *> *tables = [NSMutableSet set];
+        FMResultSet *resultSet = [db executeQuery:@"SELECT name FROM sqlite_master WHERE type = 'table'"];
+        while ([resultSet next]){
+            [tables addObject:[resultSet stringForColumnIndex:0]];
+        }
+        [resultSet close];
+
+        NSMutableDictionary<NSString *, NSNumber *> *versions = [NSMutableDictionary dictionary];
+        resultSet = [db executeQuery:[NSString stringWithFormat:@"SELECT tableName, version FROM %@",DatabaseSchemaVersionTable]];
+        while ([resultSet next]){
+            versions[[resultSet stringForColumnIndex:0]] = @([resultSet longForColumnIndex:1]);
+        }
+        [resultSet close];
+
+        for (DatabaseTableSchema *schema in schemas) {
+            if (!result) {
+                break;
+            }
+            //表已存在却没有版本记录：使用表结构注册之前创建的表，视为第 1 版
+            NSInteger version = [tables containsObject:schema.tableName] ? (versions[schema.tableName].integerValue ?: 1) : 0;
+            if (version >= schema.version) {
+                continue;
+            }
+            if (version == 0) {
+                result = [db executeUpdate:schema.createSQL];
+                version = 1;
+            }
+            while (result && version < schema.version) {
+                version++;
+                for (NSString *sql in schema.migrations[@(version)]) {
+                    if (!(result = [db executeUpdate:sql])) {
+                        break;
+                    }
+                }
+            }
+            if (result) {
+                NSString *sql = [NSString stringWithFormat:@"REPLACE INTO %@ (tableName, version) VALUES (?, ?)",DatabaseSchemaVersionTable];
+                result = [db executeUpdate:sql,schema.tableName,@(version)];
+            }
+            if (!result) {
+                NSLog(@"%@ migrate %@ error ===== %@",self,schema,db.lastError);
+            }
+        }
+
+        for (DatabaseTableSchema *schema in schemas) {
+            if (result && schema.expiryIndexSQL && !(result = [db executeUpdate:schema.expiryIndexSQL])) {
+                NSLog(@"%@ create expiry index %@ error ===== %@",self,schema,db.lastError);
+            }
+        }
+
+        if (result) {
+            db.userVersion = (uint32_t)fingerprint;
+        }else{
+            *rollback = YES;
+        }
+    }];
+    self.schemaReady = result;
+    return result;
+}
+
+- (void)prepareSchemasInBackground:(NSArray<DatabaseTableSchema *> *)schemas{
+    if (self.writeQueue == nil) {
+        self.schemaReady = YES;
+        return;
+    }
+    NSBlockOperation *operation = [NSBlockOperation blockOperationWithBlock:^{
+        [self prepareSchemas:schemas];
+    }];
+    operation.queuePriority = NSOperationQueuePriorityVeryHigh;
+    @synchronized (self) {
+        //先后注册的表结构按顺序创建、升级
+        if (_schemaOperation) {
+            [operation addDependency:_schemaOperation];
+        }
+        _schemaOperation = operation;
+    }
+    self.schemaReady = NO;
+    [self.scheduler holdOperationsUntilFinished:operation];
+    [[self.scheduler operationQueueForLane:DatabaseLaneMaintenance] addOperation:operation];
+}
+
+/** 等待表结构就绪：直接使用写连接的同步方法调用
+ */
+- (void)waitUntilSchemaPrepared{
+    NSOperation *operation;
+    @synchronized (self) {
+        operation = _schemaOperation;
+    }
+    [operation waitUntilFinished];
+}
+
+#pragma mark - ATTACH
+
+- (void)attachStore:(DatabaseStore *)store{
+    @synchronized (self) {
+        [_attachedStores addObject:store];
+    }
+    @synchronized (store) {
+        [store->_attachingStores addObject:self];
+    }
+    [self attachStoreOnReadQueues:store];
+}
+
+- (void)attachStoreOnReadQueues:(DatabaseStore *)store{
+    NSString *query = store.profile == DatabaseStoreProfileImmutable ? @"immutable=1" : @"mode=ro";
+    NSString *uri = DatabaseStoreURI(store.path, query);
+    NSString *sql = [NSString stringWithFormat:@"ATTACH DATABASE ? AS \"%@\"",store.name];
+    NSString *mmapSQL = store.mmapSize > 0 ? [NSString stringWithFormat:@"PRAGMA \"%@\".mmap_size = %lld",store.name,store.mmapSize] : nil;
+    for (FMDatabaseQueue *readQueue in @[self.readQueue,self.backgroundReadQueue]) {
+        [readQueue inDatabase:^(FMDatabase *db) {
+            if (![db executeUpdate:sql,uri]) {
+                NSLog(@"attach %@ error ===== %@",store.name,db.lastError);
+            }else if (mmapSQL) {
+                [db executeStatements:mmapSQL];
+            }
+        }];
+    }
+}
+
+/** 替换被 ATTACH 的数据库文件之前，需要先在只读连接上 DETACH，关闭其文件句柄
+ */
+- (void)detachStoreOnReadQueues:(DatabaseStore *)store{
+    NSString *sql = [NSString stringWithFormat:@"DETACH DATABASE \"%@\"",store.name];
+    for (FMDatabaseQueue *readQueue in @[self.readQueue,self.backgroundReadQueue]) {
+        [readQueue inDatabase:^(FMDatabase *db) {
+            [db executeUpdate:sql];
+        }];
+    }
+}
+
+- (NSString *)description{
+    return [NSString stringWithFormat:@"<DatabaseStore %@ : %@>",self.name,self.path];
+}
+
+#pragma mark - 事务
+
+- (DatabaseCancellationToken *)databaseChildThreadInTransaction:(void (^)(FMDatabase *database, BOOL *rollback))block{
+    return [self databaseInLane:DatabaseLaneUserWrite transaction:block];
+}
+
+- (void)databaseCurrentThreadInTransaction:(void (^)(FMDatabase *database, BOOL *rollback))block{
+    if (self.writeQueue == nil) {
+        NSLog(@"%@ is read only",self);
+        return;
+    }
+    [self waitUntilSchemaPrepared];
+    [self.writeQueue inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        block(db,rollback);
+    }];
+}
+
+- (DatabaseCancellationToken *)databaseInLane:(DatabaseLane)lane transaction:(void (^)(FMDatabase *database, BOOL *rollback))block{
+    return [self.scheduler writeInLane:lane token:nil transaction:block completion:nil];
+}
+
+- (DatabaseCancellationToken *)databaseInLane:(DatabaseLane)lane batches:(BOOL (^)(FMDatabase *database, NSUInteger batchIndex, BOOL *rollback))block completion:(void (^)(BOOL finished))completion{
+    return [self databaseInLane:lane token:[[DatabaseCancellationToken alloc] init] batches:block completion:completion];
+}
+
+- (DatabaseCancellationToken *)databaseInLane:(DatabaseLane)lane batches:(BOOL (^)(FMDatabase *database, NSUInteger batchIndex, BOOL *rollback))block batchCommitted:(void (^)(NSUInteger batchIndex))batchCommitted completion:(void (^)(BOOL finished))completion{
+    DatabaseCancellationToken *token = [[DatabaseCancellationToken alloc] init];
+    [self databaseInLane:lane token:token batchIndex:0 batches:block batchCommitted:batchCommitted completion:completion];
+    return token;
+}
+
+- (DatabaseCancellationToken *)databaseInLane:(DatabaseLane)lane token:(DatabaseCancellationToken *)token batches:(BOOL (^)(FMDatabase *database, NSUInteger batchIndex, BOOL *rollback))block completion:(void (^)(BOOL finished))completion{
+    [self databaseInLane:lane token:token batchIndex:0 batches:block batchCommitted:nil completion:completion];
+    return token;
+}
+
+/** 执行第 batchIndex 批写操作，提交后再提交下一批，批次之间写连接可以被其它任务使用
+ * 所有批次共用同一个取消令牌，取消后不再执行后续批次
+ */
+- (void)databaseInLane:(DatabaseLane)lane token:(DatabaseCancellationToken *)token batchIndex:(NSUInteger)batchIndex batches:(BOOL (^)(FMDatabase *database, NSUInteger batchIndex, BOOL *rollback))block batchCommitted:(void (^)(NSUInteger batchIndex))batchCommitted completion:(void (^)(BOOL finished))completion{
+    __block BOOL hasMore = NO;
+    [self.scheduler writeInLane:lane token:token transaction:^(FMDatabase *db, BOOL *rollback) {
+        hasMore = block(db,batchIndex,rollback);
+    } completion:^(BOOL committed) {
+        if (committed && batchCommitted) {
+            batchCommitted(batchIndex);
+        }
+        if (committed && hasMore && !token.isCancelled){
+            [self databaseInLane:lane token:token batchIndex:batchIndex + 1 batches:block batchCommitted:batchCommitted completion:completion];
+        }else if (completion){
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(committed && !hasMore);
+            });
+        }
+    }];
+}
+
+#pragma mark - 只读查询
+
+- (DatabaseCancellationToken *)databaseChildThreadInRead:(void (^)(FMDatabase *database))block{
+    return [self databaseInLane:DatabaseLaneInteractive read:block];
+}
+
+- (DatabaseCancellationToken *)databaseInLane:(DatabaseLane)lane read:(void (^)(FMDatabase *database))block{
+    return [self.scheduler readInLane:lane block:block];
+}
+
+- (DatabaseCancellationToken *)databaseChildThreadInConsistentRead:(void (^)(FMDatabase *database))block{
+    return [self.scheduler readTransactionInLane:DatabaseLaneInteractive block:block];
+}
+
+#pragma mark - 合并写入
+
+- (void)setBatchWriteInterval:(NSTimeInterval)interval maxCount:(NSUInteger)maxCount{
+    dispatch_async(_batchWriteQueue, ^{
+        self->_batchWriteInterval = MAX(interval, 0);
+        self->_batchWriteMaxCount = MAX(maxCount, 1);
+    });
+}
+
+- (DatabaseCancellationToken *)databaseBatchWrite:(BOOL (^)(FMDatabase *database))block completion:(void (^)(BOOL success))completion{
+    DatabaseBatchWriteItem *item = [[DatabaseBatchWriteItem alloc] init];
+    item.block = block;
+    item.completion = completion;
+    item.token = [[DatabaseCancellationToken alloc] init];
+
+    dispatch_async(_batchWriteQueue, ^{
+        [self->_pendingBatchWrites addObject:item];
+
+        if (self->_pendingBatchWrites.count >= self->_batchWriteMaxCount){
+            [self flushBatchWrites];//数量达到上限，立即写入
+        }else if (!self->_isBatchWriteScheduled){
+            self->_isBatchWriteScheduled = YES;
+            NSUInteger generation = self->_batchWriteGeneration;
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self->_batchWriteInterval * NSEC_PER_SEC)), self->_batchWriteQueue, ^{
+                //这一批已经因数量达到上限提前写入：不写入之后的一批，由它自己的定时器负责
+                if (self->_batchWriteGeneration == generation) {
+                    [self flushBatchWrites];
+                }
+            });
+        }
+    });
+    return item.token;
+}
+
+/** 取出当前所有待写入的操作，在一个事务中执行
+ * @note 只在 _batchWriteQueue 中调用
+ */
+- (void)flushBatchWrites{
+    _isBatchWriteScheduled = NO;
+    _batchWriteGeneration++;
+    if (_pendingBatchWrites.count == 0){
+        return;
+    }
+    NSArray<DatabaseBatchWriteItem *> *items = [_pendingBatchWrites copy];
+    [_pendingBatchWrites removeAllObjects];
+
+    //合并写入属于用户写入通道，整批在同一个事务中执行
+    NSMutableArray<NSNumber *> *results = [NSMutableArray arrayWithCapacity:items.count];
+    [self.scheduler writeInLane:DatabaseLaneUserWrite token:nil transaction:^(FMDatabase *db, BOOL *rollback) {
+        [items enumerateObjectsUsingBlock:^(DatabaseBatchWriteItem * _Nonnull item, NSUInteger idx, BOOL * _Nonnull stop) {
+            BOOL result = NO;
+            if (item.token.isCancelled){
+                [results addObject:@(result)];//已取消的写操作不再执行
+                return;
+            }
+            //每个写操作使用各自的保存点，失败时只回滚自身
+            NSString *name = [NSString stringWithFormat:@"batchWrite%lu",(unsigned long)idx];
+            NSUInteger changeMark = [self.changeTracker savepointMark];
+            if ([db startSavePointWithName:name error:nil]){
+                result = item.block(db);
+                if (!result){
+                    [db rollbackToSavePointWithName:name error:nil];
+                    [self.changeTracker rollbackToSavepointMark:changeMark];
+                }
+                [db releaseSavePointWithName:name error:nil];
+            }
+            [results addObject:@(result)];
+        }];
+    } completion:^(BOOL committed) {
+        if (!committed){
+            NSLog(@"batch write commit error");
+            [results removeAllObjects];//提交失败，整批写入都失败
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [items enumerateObjectsUsingBlock:^(DatabaseBatchWriteItem * _Nonnull item, NSUInteger idx, BOOL * _Nonnull stop) {
+                if (item.completion){
+                    item.completion(idx < results.count ? results[idx].boolValue : NO);
+                }
+            }];
+        });
+    }];
+}
+
+#pragma mark - 过期数据
+
+- (DatabaseCancellationToken *)sweepExpiredRowsInSchemas:(NSArray<DatabaseTableSchema *> *)schemas batchSize:(NSUInteger)batchSize completion:(void (^)(BOOL finished))completion{
+    NSUInteger limit = MAX(batchSize, 1);
+    NSMutableArray<NSString *> *sqls = [NSMutableArray array];
+    for (DatabaseTableSchema *schema in schemas) {
+        if (schema.expiryColumn) {
+            //子查询通过 expiryColumn 上的索引找到一批过期的行
+            [sqls addObject:[NSString stringWithFormat:@"DELETE FROM %@ WHERE rowid IN (SELECT rowid FROM %@ WHERE %@ LIMIT %lu)",schema.tableName,schema.tableName,schema.expiredClause,(unsigned long)limit]];
+        }
+    }
+
+    __block NSUInteger tableIndex = 0;
+    return [self databaseInLane:DatabaseLaneMaintenance batches:^BOOL(FMDatabase *database, NSUInteger batchIndex, BOOL *rollback) {
+        if (tableIndex >= sqls.count) {
+            return NO;
+        }
+        if (![database executeUpdate:sqls[tableIndex]]) {
+            NSLog(@"%@ sweep error ===== %@",self,database.lastError);
+            *rollback = YES;
+            return NO;
+        }
+        if ((NSUInteger)database.changes < limit) {
+            tableIndex++;//这张表已经没有过期的行
+        }
+        return tableIndex < sqls.count;
+    } completion:completion];
+}
+
+#pragma mark - 重置
+
+/** 模板文件：与当前数据库表结构一致的空数据库
+ */
+- (NSString *)templatePath{
+    return [self.path stringByAppendingString:@".template"];
+}
+
+- (int)currentSchemaVersion{
+    __block int schemaVersion = 0;
+    [self.readQueue inDatabase:^(FMDatabase *db) {
+        schemaVersion = [db intForQuery:@"PRAGMA schema_version"];
+    }];
+    return schemaVersion;
+}
+
+- (BOOL)prepareResetTemplate{
+    if (self.writeQueue == nil || !self.schemaReady) {
+        return NO;//表结构就绪之后再生成
+    }
+    @synchronized (self) {
+        //schema_version 在每次修改表结构时递增：与生成模板时一致，说明模板依然可用
+        int schemaVersion = [self currentSchemaVersion];
+        if (schemaVersion == _templateSchemaVersion && [[NSFileManager defaultManager] fileExistsAtPath:self.templatePath]) {
+            return YES;
+        }
+        NSString *buildPath = [self.templatePath stringByAppendingString:@".tmp"];
+        BOOL result = [self buildTemplateAtPath:buildPath] && DatabaseStoreRename(buildPath, self.templatePath);
+        _templateSchemaVersion = result ? schemaVersion : 0;
+        return result;
+    }
+}
+
+/** 在 path 生成一个空数据库：表、索引、触发器、视图与当前数据库一致，并复制表结构的版本记录与 user_version
+ */
+- (BOOL)buildTemplateAtPath:(NSString *)path{
+    DatabaseStoreRemoveFiles(path, YES);
+    FMDatabase *db = [FMDatabase databaseWithPath:path];
+    if (![db openWithFlags:SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI]) {
+        NSLog(@"%@ open template error",self);
+        return NO;
+    }
+    DatabaseStoreConfigureConnection(db);
+
+    [db executeStatements:@"PRAGMA auto_vacuum = INCREMENTAL"];
+    BOOL result = [db executeUpdate:@"ATTACH DATABASE ? AS live",DatabaseStoreURI(self.path, @"mode=ro")];
+    if (result) {
+        //先建表，再建索引，最后是触发器与视图
+        NSMutableArray<NSArray<NSString *> *> *entries = [NSMutableArray array];
+        FMResultSet *resultSet = [db executeQuery:@"SELECT type, name, sql FROM live.sqlite_master WHERE sql IS NOT NULL AND name NOT LIKE 'sqlite_%' ORDER BY CASE type WHEN 'table' THEN 0 WHEN 'index' THEN 1 ELSE 2 END, rowid"];
+        while ([resultSet next]){
+            [entries addObject:@[[resultSet stringForColumnIndex:0],[resultSet stringForColumnIndex:1],[resultSet stringForColumnIndex:2]]];
+        }
+        [resultSet close];
+        uint32_t userVersion = (uint32_t)[db longForQuery:@"PRAGMA live.user_version"];
+
+        [db beginTransaction];
+        for (NSArray<NSString *> *entry in entries) {
+            //虚拟表（例如 FTS5）创建时会自动创建影子表，跳过已存在的表
+            if ([entry[0] isEqualToString:@"table"] && [db tableExists:entry[1]]) {
+                continue;
+            }
+            if (!(result = [db executeUpdate:entry[2]])) {
+                break;
+            }
+        }
+        if (result && [db tableExists:DatabaseSchemaVersionTable]) {
+            NSString *sql = [NSString stringWithFormat:@"INSERT INTO main.%@ SELECT * FROM live.%@",DatabaseSchemaVersionTable,DatabaseSchemaVersionTable];
+            result = [db executeUpdate:sql];
+        }
+        if (result) {
+            db.userVersion = userVersion;
+            result = [db commit];
+        }else{
+            NSLog(@"%@ build template error ===== %@",self,db.lastError);
+            [db rollback];
+        }
+        [db executeUpdate:@"DETACH DATABASE live"];
+    }
+    if (result) {
+        [db executeStatements:@"PRAGMA journal_mode = WAL"];
+    }
+    [db close];
+    return result;
+}
+
+- (void)resetWithCompletion:(void (^)(BOOL success))completion{
+    //在维护通道中执行：与检查点、模板的生成串行
+    //直接使用维护通道的任务队列，不登记取消令牌，保证关闭的连接一定会被重新打开
+    [[self.scheduler operationQueueForLane:DatabaseLaneMaintenance] addOperationWithBlock:^{
+        CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+        BOOL result = [self resetDatabase];
+        NSLog(@"%@ reset success:%d duration:%.4fs",self,result,CFAbsoluteTimeGetCurrent() - startTime);
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(result);
+            });
+        }
+    }];
+}
+
+- (BOOL)resetDatabase{
+    if (self.writeQueue == nil) {
+        NSLog(@"%@ is read only",self);
+        return NO;
+    }
+    if (![self prepareResetTemplate]) {
+        return NO;
+    }
+    BOOL result = [self replaceDatabaseFileWithBuilder:^BOOL(NSString *path) {
+        DatabaseStoreRemoveFiles(path, YES);
+        NSError *error = nil;
+        if (![[NSFileManager defaultManager] copyItemAtPath:self.templatePath toPath:path error:&error]) {
+            NSLog(@"%@ copy template error ===== %@",self,error);
+            return NO;
+        }
+        return YES;
+    }];
+    if (result) {
+        //新文件由模板复制而来，模板依然与之一致
+        @synchronized (self) {
+            _templateSchemaVersion = [self currentSchemaVersion];
+        }
+        [self.changeTracker publishResetTables:nil];
+    }
+    return result;
+}
+
+- (DatabaseCancellationToken *)emptyTablesWithSchemas:(NSArray<DatabaseTableSchema *> *)schemas completion:(void (^)(BOOL success))completion{
+    //用户写入通道：与之后提交的写操作按顺序执行
+    return [self.scheduler writeInLane:DatabaseLaneUserWrite token:nil transaction:^(FMDatabase *db, BOOL *rollback) {
+        for (DatabaseTableSchema *schema in schemas) {
+            //DROP TABLE 整体释放表与索引的页，不逐行删除；之后按声明重建到当前版本，版本记录与指纹不变
+            BOOL result = [db executeUpdate:[NSString stringWithFormat:@"DROP TABLE IF EXISTS \"%@\"",schema.tableName]] && [db executeUpdate:schema.createSQL];
+            for (NSInteger version = 2; result && version <= schema.version; version++) {
+                for (NSString *sql in schema.migrations[@(version)]) {
+                    if (!(result = [db executeUpdate:sql])) {
+                        break;
+                    }
+                }
+            }
+            if (result && schema.expiryIndexSQL) {
+                result = [db executeUpdate:schema.expiryIndexSQL];
+            }
+            if (!result) {
+                NSLog(@"%@ empty %@ error ===== %@",self,schema.tableName,db.lastError);
+                *rollback = YES;
+                return;
+            }
+        }
+    } completion:^(BOOL committed) {
+        //DROP TABLE 不经过 update_hook
+        if (committed) {
+            for (DatabaseTableSchema *schema in schemas) {
+                [self tableDidChangeWithoutHook:schema.tableName];
+            }
+        }
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(committed);
+            });
+        }
+    }];
+}
+
+/** 用 builder 生成的新文件替换数据库文件
+ * 先关闭写连接，builder 执行期间写操作排队等待，只读连接照常查询；
+ * 之后关闭只读连接、检查点连接（以及 ATTACH 了本数据库的其它只读连接），替换文件后重新打开
+ * @note 在维护通道中调用
+ */
+- (BOOL)replaceDatabaseFileWithBuilder:(BOOL (^)(NSString *path))builder{
+    NSArray<DatabaseStore *> *attachedStores;
+    NSArray<DatabaseStore *> *attachingStores;
+    @synchronized (self) {
+        attachedStores = [_attachedStores copy];
+        attachingStores = _attachingStores.allObjects;
+    }
+
+    NSString *buildPath = [self.path stringByAppendingString:@".rebuild"];
+    __block BOOL result = NO;
+    BOOL reopened = [self.writeQueue closeAndReopenAfter:^{
+        DatabaseStoreRemoveFiles(buildPath, YES);
+        if (!(result = builder(buildPath))) {
+            DatabaseStoreRemoveFiles(buildPath, YES);
+            return;
+        }
+        for (DatabaseStore *store in attachingStores) {
+            [store detachStoreOnReadQueues:self];
+        }
+        //关闭期间提交到这些连接的操作排队等待
+        [self.readQueue closeAndReopenAfter:^{
+            [self.backgroundReadQueue closeAndReopenAfter:^{
+                [self.checkpointQueue closeAndReopenAfter:^{
+                    //新文件已包含所有提交的数据：删除旧的 WAL 文件，避免被应用到新的数据库文件上
+                    DatabaseStoreRemoveFiles(self.path, NO);
+                    result = DatabaseStoreRename(buildPath, self.path);
+                }];
+            }];
+        }];
+    }];
+
+    if (reopened) {
+        [self configureWriteQueue];
+    }
+    //新文件中的行与 rowid 都可能不同
+    [self.rowCache removeAllObjects];
+    [self configureReadQueue:self.readQueue];
+    [self configureReadQueue:self.backgroundReadQueue];
+    if (result) {
+        for (DatabaseStore *store in attachedStores) {
+            [self attachStoreOnReadQueues:store];
+        }
+        for (DatabaseStore *store in attachingStores) {
+            [store attachStoreOnReadQueues:self];
+        }
+    }
+    return result && reopened;
+}
+
+#pragma mark - 空间回收
+
+/** 空闲页超过总页数的这个比例时重建数据库文件
+ */
+static double const DatabaseStoreRebuildFreelistRatio = 0.25;
+
+/** 总页数少于这个值时不重建，只做增量回收
+ */
+static int const DatabaseStoreRebuildMinPageCount = 256;
+
+/** 每一批增量回收的页数
+ */
+static int const DatabaseStoreIncrementalVacuumPages = 64;
+
+- (void)reclaimSpaceWithCompletion:(void (^)(BOOL success))completion{
+    if (self.writeQueue == nil) {
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(NO);
+            });
+        }
+        return;
+    }
+    [[self.scheduler operationQueueForLane:DatabaseLaneMaintenance] addOperationWithBlock:^{
+        __block int autoVacuum = 0, pageCount = 0, freelistCount = 0;
+        [self.backgroundReadQueue inDatabase:^(FMDatabase *db) {
+            autoVacuum = [db intForQuery:@"PRAGMA auto_vacuum"];
+            pageCount = [db intForQuery:@"PRAGMA page_count"];
+            freelistCount = [db intForQuery:@"PRAGMA freelist_count"];
+        }];
+        NSLog(@"%@ auto_vacuum:%d page_count:%d freelist_count:%d",self,autoVacuum,pageCount,freelistCount);
+
+        //只有空闲页过多时才重建，同时整理碎片；auto_vacuum 不是 2（INCREMENTAL）的数据库不在启动时整体重建
+        if (pageCount >= DatabaseStoreRebuildMinPageCount && freelistCount >= pageCount * DatabaseStoreRebuildFreelistRatio) {
+            [self rebuildDatabaseFileWithCompletion:completion];
+        }else if (autoVacuum == 2 && freelistCount > 0) {
+            [self incrementalVacuumWithCompletion:completion];
+        }else if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(YES);
+            });
+        }
+    }];
+}
+
+- (void)rebuildWithCompletion:(void (^)(BOOL success))completion{
+    if (self.writeQueue == nil) {
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(NO);
+            });
+        }
+        return;
+    }
+    [[self.scheduler operationQueueForLane:DatabaseLaneMaintenance] addOperationWithBlock:^{
+        [self rebuildDatabaseFileWithCompletion:completion];
+    }];
+}
+
+/** @note 在维护通道中调用
+ */
+- (void)rebuildDatabaseFileWithCompletion:(void (^)(BOOL success))completion{
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    BOOL result = [self rebuildDatabaseFile];
+    NSLog(@"%@ rebuild success:%d duration:%.4fs",self,result,CFAbsoluteTimeGetCurrent() - startTime);
+    if (completion) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(result);
+        });
+    }
+}
+
+/** 使用 VACUUM INTO 重建数据库文件，并在新文件上启用增量回收
+ * @note 在维护通道中调用
+ */
+- (BOOL)rebuildDatabaseFile{
+    return [self replaceDatabaseFileWithBuilder:^BOOL(NSString *path) {
+        FMDatabase *db = [FMDatabase databaseWithPath:self.path];
+        if (![db openWithFlags:SQLITE_OPEN_READWRITE]) {
+            NSLog(@"%@ open rebuild database error",self);
+            return NO;
+        }
+        //auto_vacuum 对已有数据的数据库不会立即生效，VACUUM INTO 生成的文件使用新的设置
+        BOOL result = [db executeStatements:@"PRAGMA auto_vacuum = INCREMENTAL"] && [db executeUpdate:@"VACUUM INTO ?",path];
+        if (!result) {
+            NSLog(@"%@ vacuum into error ===== %@",self,db.lastError);
+        }
+        [db close];
+        return result;
+    }];
+}
+
+/** 在维护通道中分批执行 incremental_vacuum，直到没有空闲页
+ * 维护通道的权重最低、可被抢占，只在其它通道空闲时执行
+ */
+- (DatabaseCancellationToken *)incrementalVacuumWithCompletion:(void (^)(BOOL finished))completion{
+    NSString *sql = [NSString stringWithFormat:@"PRAGMA incremental_vacuum(%d)",DatabaseStoreIncrementalVacuumPages];
+    return [self databaseInLane:DatabaseLaneMaintenance batches:^BOOL(FMDatabase *database, NSUInteger batchIndex, BOOL *rollback) {
+        if (![database executeStatements:sql]) {
+            NSLog(@"%@ incremental vacuum error ===== %@",self,database.lastError);
+            *rollback = YES;
+            return NO;
+        }
+        return [database intForQuery:@"PRAGMA freelist_count"] > 0;
+    } completion:completion];
+}
+
+#pragma mark - 修改通知
+
+- (DatabaseChangeObservation *)addChangeObserverForTables:(NSArray<NSString *> *)tableNames queue:(dispatch_queue_t)queue block:(void (^)(DatabaseChangeSet *changes))block{
+    return [self.changeTracker addObserverForTables:tableNames ? [NSSet setWithArray:tableNames] : nil queue:queue block:block];
+}
+
+- (void)tableDidChangeWithoutHook:(NSString *)tableName{
+    [self.rowCache removeObjectsInTable:tableName];
+    [self.changeTracker publishResetTables:[NSSet setWithObject:tableName]];
+}
+
+#pragma mark - 取消
+
+- (void)cancelAllOperations{
+    [self.scheduler cancelAllOperations];
+    dispatch_sync(_batchWriteQueue, ^{
+        [[self->_pendingBatchWrites valueForKey:@"token"] makeObjectsPerformSelector:@selector(cancel)];
+    });
+}
+
+@end
@@ -9,6 +9,9 @@
 #import <Foundation/Foundation.h>
 #import "Car.h"
 
+@class DatabaseCancellationToken;
+@class DatabaseTableSchema;
+
 NS_ASSUME_NONNULL_BEGIN
 
 @interface Persons : NSObject
@@ -24,24 +27,28 @@ NS_ASSUME_NONNULL_BEGIN
 
 @interface Persons (DAO)
 
+/** 表结构
+ */
++ (DatabaseTableSchema *)tableSchema;
+
 /** 根据唯一键查询唯一值
  */
-+ (void)getDateWithName:(NSString *)name completionBlock:(void(^)(NSDate *date))block;
++ (DatabaseCancellationToken *)getDateWithName:(NSString *)name completionBlock:(void(^)(NSDate *date))block;
 
 /** 根据某个表头获取表中数据
  */
-+ (void)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(NSArray<Persons *> *models))block;
++ (DatabaseCancellationToken *)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(NSArray<Persons *> *models))block;
 
 /** 根据所有数据
  */
-+ (void)getAllDatas:(void(^)(NSArray<Persons *> *models))block;
++ (DatabaseCancellationToken *)getAllDatas:(void(^)(NSArray<Persons *> *models))block;
 
 /** 插入
  */
 + (void)insertModel:(Persons *)model;
 + (void)insertModels:(NSArray<Persons *> *)modelArray;
 
-/** 替代
+/** 替代：按 name 插入或更新，内容相同的行不写入
 */
 + (void)replaceModel:(Persons *)model;
 + (void)replaceModels:(NSArray<Persons *> *)modelArray;
@@ -8,6 +8,7 @@
 
 #import "Persons.h"
 #import "DatabaseManagement.h"
+#import "DatabaseDAO.h"
 
 
 @implementation Persons
@@ -17,137 +18,64 @@
 
 @implementation Persons (DAO)
 
-+ (void)creatTableWithDatabase:(FMDatabase *)database{
-    if (![database tableExists:@"Persons"]){
-        [database executeUpdate:@"CREATE TABLE Persons (id INTEGER PRIMARY KEY AUTOINCREMENT,name TEXT UNIQUE NOT NULL,age INTEGER CHECK (age>0),sex boolean DEFAULT YES,time DATETIME DEFAULT (datetime('now','localtime')),hobby TEXT DEFAULT '无')"];
-    }
+/** 映射：按姓名更新、删除；car 不是表中的列
+ */
++ (NSString *)databaseUniqueKey{
+    return @"name";
+}
+
++ (DatabaseTableSchema *)tableSchema{
+    return [DatabaseTableSchema schemaWithTableName:@"Persons" version:1 createSQL:@"CREATE TABLE Persons (id INTEGER PRIMARY KEY AUTOINCREMENT,name TEXT UNIQUE NOT NULL,age INTEGER CHECK (age>0),sex boolean DEFAULT YES,time DATETIME DEFAULT (datetime('now','localtime')),hobby TEXT DEFAULT '无')" migrations:nil];
 }
 
-+ (void)getDateWithName:(NSString *)name completionBlock:(void(^)(NSDate *date))block{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase * _Nonnull database, BOOL * _Nonnull rollback) {
++ (DatabaseCancellationToken *)getDateWithName:(NSString *)name completionBlock:(void(^)(NSDate *date))block{
+    return [DatabaseManagement databaseChildThreadInRead:^(FMDatabase *database) {
         NSDate *date = [database dateForQuery:@"SELECT time FROM Persons WHERE name = ?",name];
-        dispatch_async(dispatch_get_main_queue(), ^{
+        [DatabaseManagement databaseMainThreadCompletion:^{
              block(date);
-         });
+         }];
         
         NSString *string = [database stringForQuery:@"SELECT time FROM Persons WHERE name = ?",name];
         NSLog(@"string ===== %@",string);
     }];
 }
 
-+ (void)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(NSArray<Persons *> *models))block{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        
-        NSMutableArray *array = [NSMutableArray array];
-        
-        FMResultSet *resultSet = [database executeQuery:@"SELECT * FROM Persons WHERE ? = ?",key,value];
-        while ([resultSet next]){
-            Persons *model = [[Persons alloc] init];
-            model.name = [resultSet stringForColumn:@"name"];
-            model.age = [resultSet intForColumn:@"age"];
-            model.sex = [resultSet boolForColumn:@"sex"];
-            [array addObject:model];
-        }
-        [resultSet close];
-        
-       dispatch_async(dispatch_get_main_queue(), ^{
-            block(array);
-        });
-    }];
++ (DatabaseCancellationToken *)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(NSArray<Persons *> *models))block{
+    return [DatabaseDAO getModelsOfClass:self key:key value:value extraClause:nil completionBlock:block];
 }
 
 /** 根据所有数据
  */
-+ (void)getAllDatas:(void(^)(NSArray<Persons *> *models))block{
-    
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        NSMutableArray *array = [NSMutableArray array];
-        
-        FMResultSet *resultSet = [database executeQuery:@"SELECT * FROM Persons"];
-        while ([resultSet next]){
-            Persons *model = [[Persons alloc] init];
-            model.name = [resultSet stringForColumn:@"name"];
-            model.age = [resultSet intForColumn:@"age"];
-            model.sex = [resultSet boolForColumn:@"sex"];
-            [array addObject:model];
-        }
-        [resultSet close];
-        
-       dispatch_async(dispatch_get_main_queue(), ^{
-            block(array);
-        });
-    }];
++ (DatabaseCancellationToken *)getAllDatas:(void(^)(NSArray<Persons *> *models))block{
+    return [DatabaseDAO getModelsOfClass:self where:nil arguments:nil completionBlock:block];
 }
 
 + (void)insertModel:(Persons *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [self creatTableWithDatabase:database];        
-        BOOL result = [database executeUpdate:@"INSERT INTO Persons (name,age,sex) VALUES (? , ? , ?)" ,model.name,@(model.age),@(model.sex)];
-        if (!result) {
-            NSLog(@"error ===== %@",database.lastError);
-            NSLog(@"model ===== %@",model);
-        }
-    }];
+    [DatabaseDAO insertModel:model];
 }
 
 + (void)insertModels:(NSArray<Persons *> *)modelArray{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [self creatTableWithDatabase:database];
-        
-        [modelArray enumerateObjectsUsingBlock:^(Persons * _Nonnull model, NSUInteger idx, BOOL * _Nonnull stop) {
-            BOOL result = [database executeUpdate:@"INSERT INTO Persons (name,age,sex) VALUES (? , ? , ?)" ,model.name,@(model.age),@(model.sex)];
-            if (!result) {
-                NSLog(@"error ===== %@",database.lastError);
-                NSLog(@"model ===== %@",model);
-            }
-        }];
-    }];
+    [DatabaseDAO insertModels:modelArray];
 }
 
+/** 按 name upsert：id 不变，不消耗 AUTOINCREMENT 的序号
+ */
 + (void)replaceModel:(Persons *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [self creatTableWithDatabase:database];
-        
-        [database executeUpdate:@"REPLACE INTO Persons (name,age,sex) VALUES (? , ? , ?)" ,model.name,@(model.age),@(model.sex)];
-    }];
+    [DatabaseDAO upsertModel:model];
 }
 
 + (void)replaceModels:(NSArray<Persons *> *)modelArray{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [self creatTableWithDatabase:database];
-        
-        NSMutableString *string = [[NSMutableString alloc] init];
-        [modelArray enumerateObjectsUsingBlock:^(Persons * _Nonnull model, NSUInteger idx, BOOL * _Nonnull stop) {
-            if (idx) {
-                [string appendFormat:@",('%@' , '%@' , '%@')",model.name,@(model.age),@(model.sex)];
-            }else{
-                [string appendFormat:@"('%@' , '%@' , '%@')",model.name,@(model.age),@(model.sex)];
-            }
-        }];
-        NSString *sql = [NSString stringWithFormat:@"REPLACE INTO Persons (name,age,sex) VALUES %@",string];
-        BOOL result = [database executeUpdate:sql];
-        if (!result) {
-            NSLog(@"error ===== %@",database.lastError);
-        }
-    }];
+    [DatabaseDAO upsertModels:modelArray];
 }
 
 /** 更新
 */
 + (void)updateModel:(Persons *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        BOOL result = [database executeUpdate:@"UPDATE Persons SET age = ?,sex = ? WHERE name = ?" ,@(model.age),@(model.sex),model.name];
-        if (!result) {
-            NSLog(@"error ===== %@",database.lastError);
-            NSLog(@"model ===== %@",model);
-        }
-    }];
+    [DatabaseDAO updateModel:model];
 }
 
 + (void)deleteModel:(Persons *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [database executeUpdate:@"DELETE FROM Persons WHERE name = ?",model.name];
-    }];
+    [DatabaseDAO deleteModel:model];
 }
 
 @end
@@ -8,15 +8,19 @@
 
 #import "PhoneCodeModel.h"
 
+@class DatabaseCancellationToken;
+@class DatabaseTableSchema;
+@class DatabaseLiveQuery;
+
 NS_ASSUME_NONNULL_BEGIN
 
 @interface PhoneCodeModel (DAO)
 
 /** 异步操作 */
 
-/** 创建一张表
+/** 表结构
  */
-+ (void)creatTable;
++ (DatabaseTableSchema *)tableSchema;
 
 /** 销毁一张表
  */
@@ -24,27 +28,38 @@ NS_ASSUME_NONNULL_BEGIN
 
 /** 根据唯一键查询唯一值
  */
-+ (void)getNameWithPhoneCode:(NSString *)value completionBlock:(void(^)(NSString *name))block;
++ (DatabaseCancellationToken *)getNameWithPhoneCode:(NSString *)value completionBlock:(void(^)(NSString *name))block;
 
 /** 根据某个表头获取表中数据
  */
-+ (void)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(NSArray<PhoneCodeModel *> *models))block;
++ (DatabaseCancellationToken *)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(NSArray<PhoneCodeModel *> *models))block;
+
+/** 搜索国家、地区：匹配中文名、拼音（含首字母、全拼，例如 "aeb"、"aerba"）、英文名、区号与国家代码的前缀，按相关度排序
+ * 使用全文索引 PhoneCodeSearch，不扫描整张表；多个词以空格分隔，需要同时匹配
+ * @param limit 最多返回的行数
+ */
++ (nullable DatabaseCancellationToken *)searchModelsWithText:(NSString *)text limit:(NSUInteger)limit completionBlock:(void(^)(NSArray<PhoneCodeModel *> *models))block;
 
 /** 根据所有数据
  */
-+ (void)getAllDatas:(void(^)(NSArray<PhoneCodeModel *> *models))block;
++ (DatabaseCancellationToken *)getAllDatas:(void(^)(NSArray<PhoneCodeModel *> *models))block;
+
+/** 所有未过期数据的实时查询：PhoneCodeModel 表有修改提交之后重新查询，回调与上次结果的差异
+ * 不读取随 App 打包的号码表
+ */
++ (DatabaseLiveQuery *)liveQueryForAllDatas;
 
 /** 插入
  */
 + (void)insertModel:(PhoneCodeModel *)model;
 + (void)insertModels:(NSArray<PhoneCodeModel *> *)modelArray;
 
-/** 替代
+/** 替代：按区号插入或更新，内容相同的行不写入
 */
 + (void)replaceModel:(PhoneCodeModel *)model;
 + (void)replaceModels:(NSArray<PhoneCodeModel *> *)modelArray;
 
-/** 更新
+/** 更新：只写入读取之后修改过的列，没有修改时不执行语句
 */
 + (void)updateModel:(PhoneCodeModel *)model;
 
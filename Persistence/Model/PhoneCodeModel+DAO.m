@@ -8,159 +8,200 @@
 
 #import "PhoneCodeModel+DAO.h"
 #import "DatabaseManagement.h"
+#import "DatabaseDAO.h"
+#import "DatabasePinyinTokenizer.h"
+#import "DatabaseLiveQuery.h"
 
 @implementation PhoneCodeModel (DAO)
 
-+ (void)creatTable{
-    [DatabaseManagement databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        if (![database tableExists:@"PhoneCodeModel"]){
-            [database executeUpdate:@"CREATE TABLE PhoneCodeModel (id INTEGER PRIMARY KEY AUTOINCREMENT,phoneCode TEXT UNIQUE NOT NULL,countryCode TEXT, countryPinYin TEXT, countryEnglish TEXT, countryChinese TEXT,time DATE DEFAULT CURRENT_TIMESTAMP)"];
-        }
-    }];
+/** 该表保存在参考数据库中
+ */
++ (DatabaseStore *)store{
+    return [DatabaseManagement storeForTable:@"PhoneCodeModel"];
+}
+
+/** 映射：按电话区号更新、删除
+ */
++ (NSString *)databaseUniqueKey{
+    return @"phoneCode";
+}
+
+/** 编辑界面逐个修改字段：更新时只写入修改过的列
+ */
++ (BOOL)databaseTracksChanges{
+    return YES;
+}
+
+/** 缓存数据：time 超过 MAX_STORE_TIME 的行过期
+ * 第 2 版：外部内容的全文索引 PhoneCodeSearch，不重复保存文本，由触发器与表同步（过期删除同样经过触发器）
+ */
++ (DatabaseTableSchema *)tableSchema{
+    NSString *columns = @"countryChinese, countryPinYin, countryEnglish, phoneCode, countryCode";
+    NSString *newValues = @"new.countryChinese, new.countryPinYin, new.countryEnglish, new.phoneCode, new.countryCode";
+    NSString *oldValues = @"old.countryChinese, old.countryPinYin, old.countryEnglish, old.phoneCode, old.countryCode";
+    NSString *insertSQL = [NSString stringWithFormat:@"INSERT INTO PhoneCodeSearch (rowid, %@) VALUES (new.id, %@);",columns,newValues];
+    NSString *deleteSQL = [NSString stringWithFormat:@"INSERT INTO PhoneCodeSearch (PhoneCodeSearch, rowid, %@) VALUES ('delete', old.id, %@);",columns,oldValues];
+    NSArray<NSString *> *search = @[
+        //前缀索引：输入 1～3 个字符时的前缀查询直接命中
+        [NSString stringWithFormat:@"CREATE VIRTUAL TABLE IF NOT EXISTS PhoneCodeSearch USING fts5(%@, content = 'PhoneCodeModel', content_rowid = 'id', tokenize = '%@ remove_diacritics 2', prefix = '1 2 3')",columns,DatabasePinyinTokenizerName],
+        [NSString stringWithFormat:@"CREATE TRIGGER IF NOT EXISTS PhoneCodeSearch_insert AFTER INSERT ON PhoneCodeModel BEGIN %@ END",insertSQL],
+        [NSString stringWithFormat:@"CREATE TRIGGER IF NOT EXISTS PhoneCodeSearch_delete AFTER DELETE ON PhoneCodeModel BEGIN %@ END",deleteSQL],
+        [NSString stringWithFormat:@"CREATE TRIGGER IF NOT EXISTS PhoneCodeSearch_update AFTER UPDATE OF %@ ON PhoneCodeModel BEGIN %@ %@ END",columns,deleteSQL,insertSQL],
+        @"INSERT INTO PhoneCodeSearch (PhoneCodeSearch) VALUES ('rebuild')"];
+    return [DatabaseTableSchema schemaWithTableName:@"PhoneCodeModel" version:2 createSQL:@"CREATE TABLE PhoneCodeModel (id INTEGER PRIMARY KEY AUTOINCREMENT,phoneCode TEXT UNIQUE NOT NULL,countryCode TEXT, countryPinYin TEXT, countryEnglish TEXT, countryChinese TEXT,time DATE DEFAULT CURRENT_TIMESTAMP)" migrations:@{@2 : search} expiryColumn:@"time" lifetime:MAX_STORE_TIME];
 }
 
 + (void)dropTable{
     [DatabaseManagement emptyTableWithName:@"PhoneCodeModel"];
 }
 
-+ (void)getNameWithPhoneCode:(NSString *)value completionBlock:(void(^)(NSString *name))block{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase * _Nonnull database, BOOL * _Nonnull rollback) {
-        NSString *string = [database stringForQuery:@"SELECT countryChinese FROM PhoneCodeModel WHERE phoneCode = ?",value];
-        dispatch_async(dispatch_get_main_queue(), ^{
+/** 随 App 打包的号码表（bundle.PhoneCodeModel）：缓存中没有有效数据时读取，首次启动无需导入即可使用
+ */
++ (BOOL)hasBundledTable{
+    return DatabaseManagement.bundleStore != nil;
+}
+
+/** 按区号读取经过行缓存；缓存中的模型在过期的行被清理时失效，随 App 打包的号码表不写入缓存
+ */
++ (DatabaseCancellationToken *)getNameWithPhoneCode:(NSString *)value completionBlock:(void(^)(NSString *name))block{
+    NSString *clause = self.tableSchema.freshnessClause;
+    BOOL bundled = self.hasBundledTable;
+    return [self.store databaseChildThreadInRead:^(FMDatabase *database) {
+        NSString *string = [[DatabaseDAO modelOfClass:self uniqueValue:value extraClause:clause inDatabase:database] countryChinese];
+        if (string == nil && bundled) {
+            string = [database stringForQuery:@"SELECT countryChinese FROM bundle.PhoneCodeModel WHERE phoneCode = ?",value];
+        }
+        [DatabaseManagement databaseMainThreadCompletion:^{
              block(string);
-         });
+         }];
     }];
 }
 
-+ (void)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(NSArray<PhoneCodeModel *> *models))block{
-    
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        
-        NSMutableArray *array = [NSMutableArray array];
-        NSString *sql = [NSString stringWithFormat:@"SELECT * FROM PhoneCodeModel WHERE %@ = '%@'",key,value];
-        NSLog(@"sql ------ %@",sql);
-        FMResultSet *resultSet = [database executeQuery:@"SELECT * FROM PhoneCodeModel WHERE ? = '?'",key,value];
-        if (resultSet) {
-            
-            while ([resultSet next]){
-                PhoneCodeModel *model = [[PhoneCodeModel alloc] init];
-                 model.countryCode = [resultSet stringForColumn:@"countryCode"];
-                 model.countryPinYin = [resultSet stringForColumn:@"countryPinYin"];
-                 model.countryEnglish = [resultSet stringForColumn:@"countryEnglish"];
-                 model.phoneCode = [resultSet stringForColumn:@"phoneCode"];
-                 model.countryChinese = [resultSet stringForColumn:@"countryChinese"];
-                 
-                 NSLog(@"model ------ %@",model);
-
-                 [array addObject:model];
-            }
-            [resultSet close];
+/** 只返回未过期的行；按区号查询时经过行缓存
+ */
++ (DatabaseCancellationToken *)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(NSArray<PhoneCodeModel *> *models))block{
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:self];
+    NSString *clause = self.tableSchema.freshnessClause;
+    BOOL bundled = self.hasBundledTable;
+    BOOL unique = [[mapping columnForKey:key] isEqualToString:mapping.uniqueColumn];
+    return [self.store databaseChildThreadInRead:^(FMDatabase *database) {
+        NSArray *array = nil;
+        if (unique) {
+            PhoneCodeModel *model = [DatabaseDAO modelOfClass:self uniqueValue:value extraClause:clause inDatabase:database];
+            array = model ? @[model] : @[];
         }else{
-            NSLog(@"lastError ------ %@",database.lastError);
+            array = [mapping modelsInDatabase:database key:key value:value extraClause:clause];
+        }
+        if (array.count == 0 && bundled) {
+            array = [mapping modelsInDatabase:database schema:@"bundle" key:key value:value extraClause:nil];
         }
-       dispatch_async(dispatch_get_main_queue(), ^{
+        [DatabaseManagement databaseMainThreadCompletion:^{
             block(array);
-        });
+        }];
     }];
 }
 
++ (DatabaseCancellationToken *)getAllDatas:(void(^)(NSArray<PhoneCodeModel *> *models))block{
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:self];
+    NSString *clause = self.tableSchema.freshnessClause;
+    BOOL bundled = self.hasBundledTable;
+    return [self.store databaseChildThreadInRead:^(FMDatabase *database) {
+        NSArray *array = [mapping modelsInDatabase:database where:clause arguments:nil];
+        if (array.count == 0 && bundled) {
+            array = [mapping modelsInDatabase:database schema:@"bundle" where:nil arguments:nil];
+        }
+        [DatabaseManagement databaseMainThreadCompletion:^{
+            block(array);
+        }];
+    }];
+}
 
++ (DatabaseLiveQuery *)liveQueryForAllDatas{
+    return [[DatabaseLiveQuery alloc] initWithModelClass:self where:self.tableSchema.freshnessClause arguments:nil];
+}
 
-+ (void)getAllDatas:(void(^)(NSArray<PhoneCodeModel *> *models))block{
-    
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        NSMutableArray *array = [NSMutableArray array];
+#pragma mark - 搜索
 
-        FMResultSet *resultSet = [database executeQuery:@"SELECT * FROM PhoneCodeModel"];
-        while ([resultSet next]){
-            PhoneCodeModel *model = [[PhoneCodeModel alloc] init];
-            model.countryCode = [resultSet stringForColumn:@"countryCode"];
-            model.countryPinYin = [resultSet stringForColumn:@"countryPinYin"];
-            model.countryEnglish = [resultSet stringForColumn:@"countryEnglish"];
-            model.phoneCode = [resultSet stringForColumn:@"phoneCode"];
-            model.countryChinese = [resultSet stringForColumn:@"countryChinese"];
-            [array addObject:model];
-//            NSLog(@"countryPinYin ==== %@",resultSet.resultDictionary);
-            
-            NSLog(@"statement ： %@",resultSet.statement);
-            NSLog(@"columnCount ： %d",resultSet.columnCount);
+/** 将输入转为 FTS5 的查询：按空白拆分，每一段作为带引号的前缀查询，段之间为 AND
+ * 引号内的文本不解析为查询语法，输入中的 "、*、- 等字符不会导致语法错误
+ */
++ (NSString *)matchExpressionWithText:(NSString *)text{
+    NSMutableArray<NSString *> *terms = [NSMutableArray array];
+    for (NSString *term in [text componentsSeparatedByCharactersInSet:NSCharacterSet.whitespaceAndNewlineCharacterSet]) {
+        if (term.length) {
+            [terms addObject:[NSString stringWithFormat:@"\"%@\"*",[term stringByReplacingOccurrencesOfString:@"\"" withString:@"\"\""]]];
         }
-        [resultSet close];
-        
+    }
+    return [terms componentsJoinedByString:@" "];
+}
+
++ (DatabaseCancellationToken *)searchModelsWithText:(NSString *)text limit:(NSUInteger)limit completionBlock:(void(^)(NSArray<PhoneCodeModel *> *models))block{
+    NSString *match = [self matchExpressionWithText:text];
+    if (match.length == 0) {
         dispatch_async(dispatch_get_main_queue(), ^{
-               block(array);
+            block(@[]);
         });
-        
-        NSLog(@" --------- 查询结束 --------- ");
+        return nil;
+    }
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:self];
+    NSMutableArray<NSString *> *columns = [NSMutableArray array];
+    for (NSString *column in mapping.columns) {
+        [columns addObject:[@"m." stringByAppendingString:column]];
+    }
+    //列的权重：中文名、拼音优先于英文名，区号、国家代码最低
+    NSString *sql = [NSString stringWithFormat:@"SELECT %@ FROM PhoneCodeSearch JOIN PhoneCodeModel AS m ON m.id = PhoneCodeSearch.rowid WHERE PhoneCodeSearch MATCH ? AND %@ ORDER BY bm25(PhoneCodeSearch, 10.0, 8.0, 4.0, 2.0, 1.0) LIMIT ?",[columns componentsJoinedByString:@","],self.tableSchema.freshnessClause];
+    NSString *freshSQL = [NSString stringWithFormat:@"SELECT EXISTS (SELECT 1 FROM PhoneCodeModel WHERE %@)",self.tableSchema.freshnessClause];
+    BOOL bundled = self.hasBundledTable;
+    NSString *prefix = [[text stringByTrimmingCharactersInSet:NSCharacterSet.whitespaceAndNewlineCharacterSet] stringByAppendingString:@"%"];
+    return [self.store databaseChildThreadInRead:^(FMDatabase *database) {
+        NSArray *array = @[];
+        FMResultSet *resultSet = [database executeQuery:sql,match,@(limit)];
+        if (resultSet) {
+            array = [mapping modelsFromResultSet:resultSet];
+        }else{
+            NSLog(@"error ===== %@",database.lastError);
+        }
+        //打包的号码表没有全文索引：缓存为空时按前缀查找，整张表只有两百多行
+        if (array.count == 0 && bundled && ![database boolForQuery:freshSQL]) {
+            NSString *clause = @"countryChinese LIKE ? OR countryPinYin LIKE ? OR countryEnglish LIKE ? OR phoneCode LIKE ? ORDER BY countryPinYin LIMIT ?";
+            array = [mapping modelsInDatabase:database schema:@"bundle" where:clause arguments:@[prefix,prefix,prefix,prefix,@(limit)]];
+        }
+        [DatabaseManagement databaseMainThreadCompletion:^{
+            block(array);
+        }];
     }];
 }
 
 + (void)insertModel:(PhoneCodeModel *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        BOOL result = [database executeUpdate:@"INSERT INTO PhoneCodeModel (phoneCode,countryCode,countryPinYin,countryEnglish,countryChinese) VALUES (? , ? , ? , ? , ?)" ,model.phoneCode,model.countryCode,model.countryPinYin,model.countryEnglish,model.countryChinese];
-        if (!result) {
-            NSLog(@"error ===== %@",database.lastError);
-            NSLog(@"model ===== %@",model);
-        }
-    }];
+    [DatabaseDAO insertModel:model];
 }
 
 + (void)insertModels:(NSArray<PhoneCodeModel *> *)modelArray{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [modelArray enumerateObjectsUsingBlock:^(PhoneCodeModel * _Nonnull model, NSUInteger idx, BOOL * _Nonnull stop) {
-            BOOL result = [database executeUpdate:@"INSERT INTO PhoneCodeModel (phoneCode,countryCode,countryPinYin,countryEnglish,countryChinese) VALUES (? , ? , ? , ? , ?)" ,model.phoneCode,model.countryCode,model.countryPinYin,model.countryEnglish,model.countryChinese];
-            if (!result) {
-                NSLog(@"error ===== %@",database.lastError);
-                NSLog(@"model ===== %@",model);
-            }
-        }];
-    }];
+    [DatabaseDAO insertModels:modelArray];
 }
 
+/** 替代：按区号 upsert，内容相同的行不写入；写入时间超过有效期一半的行刷新写入时间，过期的缓存重新变为有效
+ */
 + (void)replaceModel:(PhoneCodeModel *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [database executeUpdate:@"REPLACE INTO PhoneCodeModel (phoneCode,countryCode,countryPinYin,countryEnglish,countryChinese) VALUES (? , ? , ? , ? , ?)",
-         model.phoneCode,model.countryCode,model.countryPinYin,model.countryEnglish,model.countryChinese];
-    }];
+    [DatabaseDAO upsertModel:model];
 }
 
+/** 刷新整张号码表：大部分行没有变化，几乎不产生写入
+ */
 + (void)replaceModels:(NSArray<PhoneCodeModel *> *)modelArray{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-
-        NSMutableString *string = [[NSMutableString alloc] init];
-
-        [modelArray enumerateObjectsUsingBlock:^(PhoneCodeModel * _Nonnull model, NSUInteger idx, BOOL * _Nonnull stop) {
-            if (idx) {
-                [string appendFormat:@",('%@' , '%@' , '%@' , '%@' , '%@')" ,model.phoneCode,model.countryCode,NSNull.null,model.countryEnglish,model.countryChinese];
-            }else{
-                [string appendFormat:@"('%@' , '%@' , '%@' , '%@' , '%@')" ,model.phoneCode,model.countryCode,model.countryPinYin,model.countryEnglish,model.countryChinese];
-            }
-        }];
-        NSString *sql = [NSString stringWithFormat:@"REPLACE INTO PhoneCodeModel (phoneCode,countryCode,countryPinYin,countryEnglish,countryChinese) VALUES %@",string];
-        BOOL result = [database executeUpdate:sql];
-        if (!result) {
-            NSLog(@"error ===== %@",database.lastError);
-        }
+    [DatabaseDAO upsertModels:modelArray completion:^(BOOL success, DatabaseUpsertCounts *counts) {
+        NSLog(@"PhoneCodeModel 写入 %@ ===== %@",success ? @"成功" : @"失败",counts);
     }];
 }
 
-/** 更新
+/** 更新：只写入读取之后修改过的列，没有修改时不执行语句
 */
 + (void)updateModel:(PhoneCodeModel *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        
-        BOOL result = [database executeUpdate:@"UPDATE PhoneCodeModel SET countryCode = ?,countryPinYin = ?,countryEnglish = ?,countryChinese = ? WHERE phoneCode = ?" ,model.countryCode,model.countryPinYin,model.countryEnglish,model.countryChinese,model.phoneCode];
-        if (!result) {
-            NSLog(@"error ===== %@",database.lastError);
-            NSLog(@"model ===== %@",model);
-        }
-    }];
+    [DatabaseDAO updateModel:model];
 }
 
 + (void)deleteModel:(PhoneCodeModel *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [database executeUpdate:@"DELETE FROM PhoneCodeModel WHERE phoneCode = ?",model.phoneCode];
-    }];
+    [DatabaseDAO deleteModel:model];
 }
 
 @end
@@ -7,15 +7,28 @@
 //
 
 #import "ProvincesModel.h"
+#import "DatabaseBinaryCodec.h"
+
+@class DatabaseCancellationToken;
+@class DatabaseTableSchema;
+@class ProvincesTree;
 
 NS_ASSUME_NONNULL_BEGIN
 
-@interface ProvincesModel (DAO)
+/** 树形查询递归的最大层级
+ */
+FOUNDATION_EXPORT NSInteger const ProvincesMaxDepth;
+
+/** ProvincesModel 位于 reference，写入、导入都在其中执行；
+ * 打包了预先生成的 Reference.sqlite 时，reference 中没有数据的读取使用其中只读的同名表，首次启动无需导入；
+ * 写入或导入之后只读取 reference 中的数据；+dropTable 清空之后重新读取打包的数据
+ */
+@interface ProvincesModel (DAO) <DatabaseBinaryCoding>
 /** 异步操作 */
 
-/** 创建一张表
+/** 表结构
  */
-+ (void)creatTable;
++ (DatabaseTableSchema *)tableSchema;
 
 /** 销毁一张表
  */
@@ -23,19 +36,55 @@ NS_ASSUME_NONNULL_BEGIN
 
 /** 根据某个表头获取表中数据
  */
-+ (void)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(NSArray<ProvincesModel *> *models))block;
++ (DatabaseCancellationToken *)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(NSArray<ProvincesModel *> *models))block;
+
+/** 根据一组地区 ID 获取数据：一条语句查询所有未缓存的地区，回调 regionId -> ProvincesModel，不存在的 ID 不包含在内
+ */
++ (DatabaseCancellationToken *)getModelsWithRegionIds:(NSArray<NSString *> *)regionIds completionBlock:(void(^)(NSDictionary<NSString *, ProvincesModel *> *models))block;
+
+/** 树形查询：parentId 上有索引，祖先、路径、子树使用递归 CTE 在一条 SQL 中查询；返回的模型不包含 childArray
+ * 层级超过 ProvincesMaxDepth 的部分被忽略，parentId 形成环时不会无限递归
+ */
+
+/** 子节点，按写入的顺序排列；regionId 为 nil 时查询根节点（parentId 不在表中的地区）
+ */
++ (DatabaseCancellationToken *)getChildrenWithRegionId:(nullable NSString *)regionId completionBlock:(void(^)(NSArray<ProvincesModel *> *models))block;
+
+/** 祖先：从根节点到父节点，不包含自身
+ */
++ (DatabaseCancellationToken *)getAncestorsWithRegionId:(NSString *)regionId completionBlock:(void(^)(NSArray<ProvincesModel *> *models))block;
+
+/** 从根节点到自身的路径
+ */
++ (DatabaseCancellationToken *)getPathWithRegionId:(NSString *)regionId completionBlock:(void(^)(NSArray<ProvincesModel *> *models))block;
+
+/** 自身与所有后代，按先序（深度优先）排列
+ */
++ (DatabaseCancellationToken *)getSubtreeWithRegionId:(NSString *)regionId completionBlock:(void(^)(NSArray<ProvincesModel *> *models))block;
+
+/** 整张表的内存索引：第一次获取时读取整张表生成，之后直接返回缓存；通过以下方法写入、导入数据后失效
+ * 适合省市区选择器等频繁逐级查询的场景，生成后的查询不再访问数据库
+ * @return 已缓存时立即回调并返回 nil
+ */
++ (nullable DatabaseCancellationToken *)getRegionTree:(void(^)(ProvincesTree *tree))block;
 
 /** 插入
  */
 + (void)insertModel:(ProvincesModel *)model;
 + (void)insertModels:(NSArray<ProvincesModel *> *)modelArray;
 
-/** 替代
+/** 替代：按 regionId 插入或更新，内容相同的行不写入
 */
 + (void)replaceModel:(ProvincesModel *)model;
 + (void)replaceModels:(NSArray<ProvincesModel *> *)modelArray;
 
-/** 更新
+/** 从 JSON 文件导入省市区数据到 reference：流式解析、展开树形结构，与写入并行，在后台通道中分批提交
+ * 不创建模型对象，内存占用与文件大小无关；按 regionId upsert，中断后可以重新导入；导入大量数据时优先使用
+ * @param completion 在主线程回调，success 表示是否所有批次都已提交，count 为已提交的行数
+ */
++ (DatabaseCancellationToken *)importModelsWithContentsOfFile:(NSString *)path completion:(void (^ _Nullable)(BOOL success, NSUInteger count))completion;
+
+/** 更新：只写入读取之后修改过的列，没有修改时不执行语句
 */
 + (void)updateModel:(ProvincesModel *)model;
 
@@ -43,6 +92,12 @@ NS_ASSUME_NONNULL_BEGIN
  */
 + (void)deleteModel:(ProvincesModel *)model;
 
+/** 树形结构的快照：包含 childArray，以 DatabaseBinaryCodec 编码，可写入文件或 BLOB 列
+ * 解码得到的 childArray 在访问时才解码，只展开用到的分支
+ */
++ (nullable NSData *)snapshotDataWithModels:(NSArray<ProvincesModel *> *)modelArray;
++ (nullable NSArray<ProvincesModel *> *)modelsWithSnapshotData:(NSData *)data;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -8,118 +8,351 @@
 
 #import "ProvincesModel+DAO.h"
 #import "DatabaseManagement.h"
+#import "DatabaseDAO.h"
+#import "DatabaseJSONImporter.h"
+#import "ProvincesTree.h"
+
+NSInteger const ProvincesMaxDepth = 32;
+
+/** 内存索引的缓存；每次失效时版本号加 1，生成期间失效的索引不再缓存
+ */
+static ProvincesTree *_regionTree = nil;
+static NSUInteger _regionTreeVersion = 0;
 
 @implementation ProvincesModel (DAO)
 
-+ (void)creatTable{
-    [DatabaseManagement databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        if (![database tableExists:@"ProvincesModel"]){
-            [database executeUpdate:@"CREATE TABLE ProvincesModel (id INTEGER PRIMARY KEY,regionId TEXT UNIQUE NOT NULL,regionName TEXT, regionType TEXT, parentId TEXT, agencyId TEXT)"];
-        }
-    }];
+/** 该表保存在参考数据库中
+ */
++ (DatabaseStore *)store{
+    return [DatabaseManagement storeForTable:@"ProvincesModel"];
+}
+
+/** 映射：按地区 ID 更新、删除；childArray 不是表中的列
+ */
++ (NSString *)databaseUniqueKey{
+    return @"regionId";
+}
+
+/** 更新时只写入修改过的列，例如只修改地区名称时不改写 parentId 上的索引
+ */
++ (BOOL)databaseTracksChanges{
+    return YES;
+}
+
+/** 二进制编码：childArray 的元素为 ProvincesModel
+ */
++ (NSDictionary<NSString *, Class> *)binaryCodingNestedClasses{
+    return @{@"childArray" : ProvincesModel.class};
+}
+
++ (DatabaseTableSchema *)tableSchema{
+    //第 2 版：树形查询按 parentId 查找子节点，按 regionType 筛选层级
+    NSArray<NSString *> *indexes = @[@"CREATE INDEX IF NOT EXISTS ProvincesModel_parentId ON ProvincesModel (parentId)",
+                                     @"CREATE INDEX IF NOT EXISTS ProvincesModel_regionType ON ProvincesModel (regionType)"];
+    return [DatabaseTableSchema schemaWithTableName:@"ProvincesModel" version:2 createSQL:@"CREATE TABLE ProvincesModel (id INTEGER PRIMARY KEY,regionId TEXT UNIQUE NOT NULL,regionName TEXT, regionType TEXT, parentId TEXT, agencyId TEXT)" migrations:@{@2 : indexes}];
 }
 
 + (void)dropTable{
-    [DatabaseManagement databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [database executeUpdate:@"DROP TABLE IF EXISTS ProvincesModel"];
-        [database executeUpdate:@"CREATE TABLE ProvincesModel (id INTEGER PRIMARY KEY,regionId TEXT UNIQUE NOT NULL,regionName TEXT, regionType TEXT, parentId TEXT, agencyId TEXT)"];
+    [self invalidateRegionTree];
+    [DatabaseManagement emptyTableWithName:@"ProvincesModel" completion:^(BOOL success) {
+        [self invalidateRegionTree];
     }];
 }
 
-+ (void)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(NSArray<ProvincesModel *> *models))block{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        
-        NSString *sql = [NSString stringWithFormat:@"SELECT * FROM ProvincesModel WHERE %@ = %@",key,value];
-        NSMutableArray *array = [NSMutableArray array];
-        NSLog(@"sql ------ %@",sql);
-
-        FMResultSet *resultSet = [database executeQuery:sql];
-        if (resultSet) {
-            while ([resultSet next]){
-                ProvincesModel *model = [[ProvincesModel alloc] init];
-                model.regionId = [resultSet stringForColumn:@"regionId"];
-                model.regionName = [resultSet stringForColumn:@"regionName"];
-                model.regionType = [resultSet stringForColumn:@"regionType"];
-                model.parentId = [resultSet stringForColumn:@"parentId"];
-                model.agencyId = [resultSet stringForColumn:@"agencyId"];
-                [array addObject:model];
-            }
-            [resultSet close];
+/** 随 App 打包的地区表（bundle.ProvincesModel）：reference 中没有数据时读取，首次启动无需导入即可使用
+ */
++ (BOOL)hasBundledTable{
+    return DatabaseManagement.bundleStore != nil;
+}
+
+/** 本次读取使用的表：reference 中有数据（导入、写入过）时为 main，否则为打包的 bundle
+ * 同一次读取只使用其中一张表，两者的数据不会混在一棵树中
+ */
++ (NSString *)schemaInDatabase:(FMDatabase *)database{
+    if (self.hasBundledTable && ![database boolForQuery:@"SELECT EXISTS (SELECT 1 FROM main.ProvincesModel)"]) {
+        return @"bundle";
+    }
+    return @"main";
+}
+
+/** 在只读连接上选择读取的表之后查询，在主线程回调
+ */
++ (DatabaseCancellationToken *)readModels:(NSArray<ProvincesModel *> *(^)(FMDatabase *database, NSString *schema))query completionBlock:(void(^)(NSArray<ProvincesModel *> *models))block{
+    return [self.store databaseChildThreadInRead:^(FMDatabase *database) {
+        NSArray<ProvincesModel *> *array = query(database,[self schemaInDatabase:database]) ?: @[];
+        [DatabaseManagement databaseMainThreadCompletion:^{
+            block(array);
+        }];
+    }];
+}
+
+/** 按 regionId 查询时经过行缓存；打包的地区表不写入缓存
+ */
++ (DatabaseCancellationToken *)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(NSArray<ProvincesModel *> *models))block{
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:self];
+    BOOL unique = [[mapping columnForKey:key] isEqualToString:mapping.uniqueColumn];
+    return [self readModels:^NSArray<ProvincesModel *> *(FMDatabase *database, NSString *schema) {
+        if (unique && [schema isEqualToString:@"main"]) {
+            ProvincesModel *model = [DatabaseDAO modelOfClass:self uniqueValue:value inDatabase:database];
+            return model ? @[model] : @[];
+        }
+        return [mapping modelsInDatabase:database schema:schema key:key value:value extraClause:nil];
+    } completionBlock:block];
+}
+
++ (DatabaseCancellationToken *)getModelsWithRegionIds:(NSArray<NSString *> *)regionIds completionBlock:(void(^)(NSDictionary<NSString *, ProvincesModel *> *models))block{
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:self];
+    return [self.store databaseChildThreadInRead:^(FMDatabase *database) {
+        NSDictionary<NSString *, ProvincesModel *> *models = nil;
+        if ([[self schemaInDatabase:database] isEqualToString:@"main"]) {
+            models = [DatabaseDAO modelsOfClass:self uniqueValues:regionIds inDatabase:database];
         }else{
-            NSLog(@"Error ====== %@",database.lastError);
+            //打包的地区表：一条语句查询所有的 ID
+            NSData *data = [NSJSONSerialization dataWithJSONObject:regionIds options:0 error:nil];
+            NSString *json = data ? [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] : @"[]";
+            NSMutableDictionary<NSString *, ProvincesModel *> *dictionary = [NSMutableDictionary dictionaryWithCapacity:regionIds.count];
+            for (ProvincesModel *model in [mapping modelsInDatabase:database schema:@"bundle" where:@"regionId IN (SELECT value FROM json_each(?))" arguments:@[json]]) {
+                dictionary[model.regionId] = model;
+            }
+            models = dictionary;
         }
-        
-       dispatch_async(dispatch_get_main_queue(), ^{
-            block(array);
-        });
+        [DatabaseManagement databaseMainThreadCompletion:^{
+            block(models);
+        }];
     }];
 }
 
-+ (void)insertModel:(ProvincesModel *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        BOOL result = [database executeUpdate:@"INSERT INTO ProvincesModel (regionId,regionName,regionType,parentId,agencyId) VALUES (? , ? , ? , ? , ?)",
-        model.regionId,model.regionName,model.regionType,model.parentId,model.agencyId];
-        if (!result) {
-            NSLog(@"error ===== %@",database.lastError);
-            NSLog(@"model ===== %@",model);
+#pragma mark - 树形查询
+
+/** 映射的列，以 prefix 限定
+ */
++ (NSString *)columnsWithPrefix:(NSString *)prefix{
+    NSMutableArray<NSString *> *columns = [NSMutableArray array];
+    for (NSString *column in [DatabaseModelMapping mappingForClass:self].columns) {
+        [columns addObject:prefix ? [NSString stringWithFormat:@"%@.%@",prefix,column] : column];
+    }
+    return [columns componentsJoinedByString:@","];
+}
+
+/** 生成的树形查询语句，按 名称.schema 缓存
+ */
++ (NSString *)SQLNamed:(NSString *)name schema:(NSString *)schema builder:(NSString *(^)(NSString *table))builder{
+    static NSMutableDictionary<NSString *, NSString *> *sqls = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sqls = [NSMutableDictionary dictionary];
+    });
+    NSString *cacheKey = [NSString stringWithFormat:@"%@.%@",name,schema];
+    @synchronized (sqls) {
+        NSString *sql = sqls[cacheKey];
+        if (sql == nil) {
+            sql = builder([NSString stringWithFormat:@"%@.ProvincesModel",schema]);
+            sqls[cacheKey] = sql;
         }
+        return sql;
+    }
+}
+
+/** 从自身沿 parentId 上溯，depth 为与自身的距离；只读取 depth >= 第三个参数的行，按从根节点到自身的顺序排列
+ */
++ (NSString *)pathSQLInSchema:(NSString *)schema{
+    return [self SQLNamed:@"path" schema:schema builder:^NSString *(NSString *table) {
+        return [NSString stringWithFormat:@"WITH RECURSIVE path (regionId, parentId, depth) AS ("
+                "SELECT regionId, parentId, 0 FROM %1$@ WHERE regionId = ? "
+                "UNION ALL "
+                "SELECT m.regionId, m.parentId, path.depth + 1 FROM %1$@ AS m JOIN path ON m.regionId = path.parentId WHERE path.depth < ?) "
+                "SELECT %2$@ FROM path JOIN %1$@ AS m USING (regionId) WHERE path.depth >= ? ORDER BY path.depth DESC",table,[self columnsWithPrefix:@"m"]];
     }];
 }
 
-+ (void)insertModels:(NSArray<ProvincesModel *> *)modelArray{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [modelArray enumerateObjectsUsingBlock:^(ProvincesModel * _Nonnull model, NSUInteger idx, BOOL * _Nonnull stop) {
-            BOOL result = [database executeUpdate:@"INSERT INTO ProvincesModel (regionId,regionName,regionType,parentId,agencyId) VALUES (? , ? , ? , ? , ?)",
-            model.regionId,model.regionName,model.regionType,model.parentId,model.agencyId];
-            if (!result) {
-                NSLog(@"error ===== %@",database.lastError);
-                NSLog(@"model ===== %@",model);
+/** 从自身沿 parentId 的索引向下展开；队列按层级降序、id 升序取出，刚加入的子节点最先展开，结果即为先序
+ */
++ (NSString *)subtreeSQLInSchema:(NSString *)schema{
+    return [self SQLNamed:@"subtree" schema:schema builder:^NSString *(NSString *table) {
+        NSString *columns = [self columnsWithPrefix:nil];
+        return [NSString stringWithFormat:@"WITH RECURSIVE subtree (id, depth, %2$@) AS ("
+                "SELECT id, 0, %2$@ FROM %1$@ WHERE regionId = ? "
+                "UNION ALL "
+                "SELECT m.id, subtree.depth + 1, %3$@ FROM %1$@ AS m JOIN subtree ON m.parentId = subtree.regionId WHERE subtree.depth < ? "
+                "ORDER BY 2 DESC, 1) "
+                "SELECT %2$@ FROM subtree",table,columns,[self columnsWithPrefix:@"m"]];
+    }];
+}
+
+/** 根节点：parentId 不在同一张表中的地区，按写入的顺序排列
+ */
++ (NSString *)rootsSQLInSchema:(NSString *)schema{
+    return [self SQLNamed:@"roots" schema:schema builder:^NSString *(NSString *table) {
+        return [NSString stringWithFormat:@"%@ AS m WHERE NOT EXISTS (SELECT 1 FROM %@ WHERE regionId = m.parentId) ORDER BY id",[[DatabaseModelMapping mappingForClass:self] selectSQLInSchema:schema],table];
+    }];
+}
+
++ (DatabaseCancellationToken *)getModelsWithSQL:(NSString *(^)(NSString *schema))sqlForSchema arguments:(NSArray *)arguments completionBlock:(void(^)(NSArray<ProvincesModel *> *models))block{
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:self];
+    return [self readModels:^NSArray<ProvincesModel *> *(FMDatabase *database, NSString *schema) {
+        FMResultSet *resultSet = [database executeQuery:sqlForSchema(schema) withArgumentsInArray:arguments];
+        if (resultSet == nil) {
+            NSLog(@"error ===== %@",database.lastError);
+            return @[];
+        }
+        return [mapping modelsFromResultSet:resultSet];
+    } completionBlock:block];
+}
+
++ (DatabaseCancellationToken *)getChildrenWithRegionId:(NSString *)regionId completionBlock:(void(^)(NSArray<ProvincesModel *> *models))block{
+    if (regionId == nil) {
+        return [self getModelsWithSQL:^NSString *(NSString *schema) {
+            return [self rootsSQLInSchema:schema];
+        } arguments:@[] completionBlock:block];
+    }
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:self];
+    return [self readModels:^NSArray<ProvincesModel *> *(FMDatabase *database, NSString *schema) {
+        return [mapping modelsInDatabase:database schema:schema where:@"parentId = ? ORDER BY id" arguments:@[regionId]];
+    } completionBlock:block];
+}
+
++ (DatabaseCancellationToken *)getAncestorsWithRegionId:(NSString *)regionId completionBlock:(void(^)(NSArray<ProvincesModel *> *models))block{
+    return [self getModelsWithSQL:^NSString *(NSString *schema) {
+        return [self pathSQLInSchema:schema];
+    } arguments:@[regionId,@(ProvincesMaxDepth),@1] completionBlock:block];
+}
+
++ (DatabaseCancellationToken *)getPathWithRegionId:(NSString *)regionId completionBlock:(void(^)(NSArray<ProvincesModel *> *models))block{
+    return [self getModelsWithSQL:^NSString *(NSString *schema) {
+        return [self pathSQLInSchema:schema];
+    } arguments:@[regionId,@(ProvincesMaxDepth),@0] completionBlock:block];
+}
+
++ (DatabaseCancellationToken *)getSubtreeWithRegionId:(NSString *)regionId completionBlock:(void(^)(NSArray<ProvincesModel *> *models))block{
+    return [self getModelsWithSQL:^NSString *(NSString *schema) {
+        return [self subtreeSQLInSchema:schema];
+    } arguments:@[regionId,@(ProvincesMaxDepth)] completionBlock:block];
+}
+
+#pragma mark - 内存索引
+
++ (DatabaseCancellationToken *)getRegionTree:(void(^)(ProvincesTree *tree))block{
+    ProvincesTree *tree = nil;
+    NSUInteger version = 0;
+    @synchronized (self) {
+        tree = _regionTree;
+        version = _regionTreeVersion;
+    }
+    if (tree) {
+        block(tree);
+        return nil;
+    }
+    return [self.store databaseChildThreadInRead:^(FMDatabase *database) {
+        ProvincesTree *tree = [ProvincesTree treeWithDatabase:database schema:[self schemaInDatabase:database]];
+        @synchronized (self) {
+            if (version == _regionTreeVersion) {
+                _regionTree = tree;
             }
+        }
+        [DatabaseManagement databaseMainThreadCompletion:^{
+            block(tree);
         }];
     }];
 }
 
+/** 写入时立即失效一次，提交之后再失效一次：避免在两者之间生成的索引读到提交之前的数据
+ */
++ (void)invalidateRegionTree{
+    @synchronized (self) {
+        _regionTree = nil;
+        _regionTreeVersion++;
+    }
+}
+
+#pragma mark - 写操作
+
++ (void)insertModel:(ProvincesModel *)model{
+    [self invalidateRegionTree];
+    [DatabaseDAO insertModel:model completion:^(BOOL success) {
+        [self invalidateRegionTree];
+    }];
+}
+
++ (void)insertModels:(NSArray<ProvincesModel *> *)modelArray{
+    [self invalidateRegionTree];
+    [DatabaseDAO insertModels:modelArray completion:^(BOOL success, NSUInteger failedCount) {
+        if (failedCount) {
+            NSLog(@"ProvincesModel %lu 行写入失败",(unsigned long)failedCount);
+        }
+        [self invalidateRegionTree];
+    }];
+}
+
 + (void)replaceModel:(ProvincesModel *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [database executeUpdate:@"REPLACE INTO ProvincesModel (regionId,regionName,regionType,parentId,agencyId) VALUES (? , ? , ? , ? , ?)",
-         model.regionId,model.regionName,model.regionType,model.parentId,model.agencyId];
+    [self invalidateRegionTree];
+    [DatabaseDAO upsertModel:model completion:^(BOOL success, DatabaseUpsertResult result) {
+        [self invalidateRegionTree];
     }];
 }
 
+/** 导入大量数据：展开树形结构后在后台通道中分批写入，每批一个事务，批次之间让出写连接，不影响界面的读写
+ * 按 regionId upsert：重复导入同一份数据时内容相同的行不写入
+ */
 + (void)replaceModels:(NSArray<ProvincesModel *> *)modelArray{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [ProvincesModel replaceModels:modelArray database:database];
+    NSMutableArray<ProvincesModel *> *flatArray = [NSMutableArray array];
+    [ProvincesModel flattenModels:modelArray intoArray:flatArray];
+    [self invalidateRegionTree];
+    [DatabaseDAO upsertModels:flatArray completion:^(BOOL success, DatabaseUpsertCounts *counts) {
+        [self invalidateRegionTree];
     }];
 }
 
-+ (void)replaceModels:(NSArray<ProvincesModel *> *)modelArray database:(FMDatabase *)database{
++ (DatabaseCancellationToken *)importModelsWithContentsOfFile:(NSString *)path completion:(void (^)(BOOL, NSUInteger))completion{
+    //JSON 成员名称与列名的对应关系，与 -initWithDictionary: 一致
+    NSDictionary<NSString *, NSString *> *columnsForKeys = @{@"region_id" : @"regionId",
+                                                           @"region_name" : @"regionName",
+                                                           @"region_type" : @"regionType",
+                                                           @"parent_id" : @"parentId",
+                                                           @"agency_id" : @"agencyId"};
+    DatabaseJSONImporter *importer = [[DatabaseJSONImporter alloc] initWithPath:path tableName:@"ProvincesModel" uniqueColumn:@"regionId" columnsForKeys:columnsForKeys];
+    [self invalidateRegionTree];
+    return [importer importIntoStore:self.store completion:^(BOOL success, NSUInteger count) {
+        [self invalidateRegionTree];
+        if (completion) {
+            completion(success,count);
+        }
+    }];
+}
+
+/** 将省市区的树形结构展开为数组，父节点在子节点之前
+ */
++ (void)flattenModels:(NSArray<ProvincesModel *> *)modelArray intoArray:(NSMutableArray<ProvincesModel *> *)flatArray{
     [modelArray enumerateObjectsUsingBlock:^(ProvincesModel * _Nonnull model, NSUInteger idx, BOOL * _Nonnull stop) {
-        [database executeUpdate:@"REPLACE INTO ProvincesModel (regionId,regionName,regionType,parentId,agencyId) VALUES (? , ? , ? , ? , ?)",
-         model.regionId,model.regionName,model.regionType,model.parentId,model.agencyId];
-        
+        [flatArray addObject:model];
         if (model.childArray.count) {
-            [ProvincesModel replaceModels:model.childArray database:database];
+            [ProvincesModel flattenModels:model.childArray intoArray:flatArray];
         }
-        
     }];
 }
 
 /** 更新
 */
 + (void)updateModel:(ProvincesModel *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        BOOL result = [database executeUpdate:@"UPDATE ProvincesModel SET regionName = ?,regionType = ?,parentId = ?,agencyId = ? WHERE regionId = ?" ,model.regionName,model.regionType,model.parentId,model.agencyId,model.regionId];
-        if (!result) {
-            NSLog(@"error ===== %@",database.lastError);
-            NSLog(@"model ===== %@",model);
-        }
+    [self invalidateRegionTree];
+    [DatabaseDAO updateModel:model completion:^(BOOL success) {
+        [self invalidateRegionTree];
     }];
 }
 
 + (void)deleteModel:(ProvincesModel *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [database executeUpdate:@"DELETE FROM ProvincesModel WHERE regionId = ?",model.regionId];
+    [self invalidateRegionTree];
+    [DatabaseDAO deleteModel:model completion:^(BOOL success) {
+        [self invalidateRegionTree];
     }];
 }
 
++ (NSData *)snapshotDataWithModels:(NSArray<ProvincesModel *> *)modelArray{
+    return [DatabaseBinaryCodec dataWithRootObject:modelArray];
+}
+
++ (NSArray<ProvincesModel *> *)modelsWithSnapshotData:(NSData *)data{
+    id models = [DatabaseBinaryCodec rootObjectWithData:data];
+    return [models isKindOfClass:NSArray.class] ? models : nil;
+}
+
 @end
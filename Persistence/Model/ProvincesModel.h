@@ -31,6 +31,10 @@ NS_ASSUME_NONNULL_BEGIN
 
 @interface ProvincesModel (DemoData)
 
+/** 省市区数据文件 CityModelList.json 的路径
+ */
++ (NSString *)provincesFilePath;
+
 + (NSMutableArray<ProvincesModel *> *)provincesModelArray;
 
 @end
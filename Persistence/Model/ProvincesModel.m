@@ -134,9 +134,13 @@ NSString *const kProvincesModelRegionName = @"region_name";
 
 @implementation ProvincesModel (DemoData)
 
++ (NSString *)provincesFilePath{
+    return [[NSBundle bundleWithPath:[[NSBundle mainBundle] pathForResource:@"Resource" ofType:@"bundle"]] pathForResource:@"CityModelList" ofType:@"json"];
+}
+
 + (NSMutableArray<ProvincesModel *> *)provincesModelArray{
     NSMutableArray *provincesModelArray = [NSMutableArray array];
-    NSString *filePath = [[NSBundle bundleWithPath:[[NSBundle mainBundle] pathForResource:@"Resource" ofType:@"bundle"]] pathForResource:@"CityModelList" ofType:@"json"];
+    NSString *filePath = [self provincesFilePath];
 
     NSData *data = [NSData dataWithContentsOfFile:filePath];
     id json = [NSJSONSerialization JSONObjectWithData:data options:kNilOptions error:nil];
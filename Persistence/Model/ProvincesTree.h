@@ -0,0 +1,69 @@
+//
+//  ProvincesTree.h
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/29.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "ProvincesModel.h"
+
+@class FMDatabase;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** 省市区的内存索引：由 ProvincesModel 表一次性生成，之后的树形查询不再访问数据库
+ *
+ * 所有地区按先序遍历（欧拉序）保存在一个数组中，每个地区只记录父节点的下标与子树的结束下标：
+ * 子树是数组中连续的一段 [i, end[i])，取子树是 O(子树大小) 的切片；
+ * 第一个子节点是 i + 1，下一个兄弟节点是 end[子节点]，取子节点是 O(子节点数)；祖先沿父节点下标上溯，是 O(深度)
+ *
+ * 生成后不可变，可以在任意线程中使用；返回的模型不包含 childArray
+ * 每次查询返回模型的副本（ProvincesModel 开启了修改记录）：修改副本后调用 +updateModel: 只写入修改的列，不影响索引与其它调用方
+ */
+@interface ProvincesTree : NSObject
+
+/** 在数据库任务中读取整张表并生成索引；parentId 不在表中的地区为根节点
+ */
++ (instancetype)treeWithDatabase:(FMDatabase *)database;
+
+/** 读取 ATTACH 的数据库中的同名表（例如 bundle）；schema 为 nil 时与 +treeWithDatabase: 相同
+ */
++ (instancetype)treeWithDatabase:(FMDatabase *)database schema:(nullable NSString *)schema;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/** 地区数量
+ */
+@property (nonatomic, assign, readonly) NSUInteger count;
+
+/** 根节点（省、直辖市）
+ */
+@property (nonatomic, copy, readonly) NSArray<ProvincesModel *> *roots;
+
+- (nullable ProvincesModel *)modelWithRegionId:(NSString *)regionId;
+
+/** 子节点；regionId 为 nil 时返回根节点
+ */
+- (NSArray<ProvincesModel *> *)childrenWithRegionId:(nullable NSString *)regionId;
+
+/** 祖先：从根节点到父节点，不包含自身
+ */
+- (NSArray<ProvincesModel *> *)ancestorsWithRegionId:(NSString *)regionId;
+
+/** 从根节点到自身的路径
+ */
+- (NSArray<ProvincesModel *> *)pathWithRegionId:(NSString *)regionId;
+
+/** 自身与所有后代，按先序排列
+ */
+- (NSArray<ProvincesModel *> *)subtreeWithRegionId:(NSString *)regionId;
+
+/** 层级：根节点为 0；不存在时返回 NSNotFound
+ */
+- (NSUInteger)depthWithRegionId:(NSString *)regionId;
+
+@end
+
+NS_ASSUME_NONNULL_END
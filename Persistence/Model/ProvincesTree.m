@@ -0,0 +1,227 @@
+//
+//  ProvincesTree.m
+//  Persistence
+//
+//  Created by 苏沫离 on 2020/5/29.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import "ProvincesTree.h"
+#import "DatabaseModelMapping.h"
+#import "FMDatabase.h"
+
+@interface ProvincesTree ()
+{
+    NSArray<ProvincesModel *> *_models;//按先序排列
+    NSDictionary<NSString *, NSNumber *> *_indexes;//regionId -> 先序下标
+    int32_t *_parents;//父节点的先序下标，根节点为 -1
+    int32_t *_ends;//子树的结束下标（不包含）
+    uint16_t *_depths;
+    NSArray<NSNumber *> *_rootIndexes;//根节点的先序下标
+}
+@end
+
+@implementation ProvincesTree
+
++ (instancetype)treeWithDatabase:(FMDatabase *)database{
+    return [self treeWithDatabase:database schema:nil];
+}
+
++ (instancetype)treeWithDatabase:(FMDatabase *)database schema:(NSString *)schema{
+    //按写入的顺序读取，兄弟节点保持数据源中的顺序
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:ProvincesModel.class];
+    NSArray<ProvincesModel *> *rows = @[];
+    FMResultSet *resultSet = [database executeQuery:[[mapping selectSQLInSchema:schema] stringByAppendingString:@" ORDER BY id"]];
+    if (resultSet) {
+        rows = [mapping modelsFromResultSet:resultSet];
+    }else{
+        NSLog(@"error ===== %@",database.lastError);
+    }
+    return [[ProvincesTree alloc] initWithRows:rows];
+}
+
+- (instancetype)initWithRows:(NSArray<ProvincesModel *> *)rows{
+    self = [super init];
+    if (self) {
+        int32_t n = (int32_t)rows.count;
+        NSMutableDictionary<NSString *, NSNumber *> *rowIndexes = [NSMutableDictionary dictionaryWithCapacity:n];
+        [rows enumerateObjectsUsingBlock:^(ProvincesModel * _Nonnull model, NSUInteger idx, BOOL * _Nonnull stop) {
+            if (model.regionId) {
+                rowIndexes[model.regionId] = @(idx);
+            }
+        }];
+
+        //按行号建立子节点列表（CSR）：childOffsets[r] ..< childOffsets[r + 1] 是第 r 行的子节点
+        int32_t *rowParents = malloc(sizeof(int32_t) * MAX(n, 1));
+        int32_t *childOffsets = calloc((size_t)n + 1, sizeof(int32_t));
+        for (int32_t r = 0; r < n; r++) {
+            NSString *parentId = rows[r].parentId;
+            NSNumber *parent = parentId ? rowIndexes[parentId] : nil;
+            rowParents[r] = (parent && parent.intValue != r) ? parent.intValue : -1;
+            if (rowParents[r] >= 0) {
+                childOffsets[rowParents[r] + 1]++;
+            }
+        }
+        for (int32_t r = 0; r < n; r++) {
+            childOffsets[r + 1] += childOffsets[r];
+        }
+        int32_t *children = malloc(sizeof(int32_t) * MAX(n, 1));
+        int32_t *fill = malloc(sizeof(int32_t) * MAX(n, 1));
+        memcpy(fill, childOffsets, sizeof(int32_t) * (size_t)n);
+        for (int32_t r = 0; r < n; r++) {
+            if (rowParents[r] >= 0) {
+                children[fill[rowParents[r]]++] = r;
+            }
+        }
+        free(fill);
+
+        //非递归的深度优先遍历：栈中的 r 表示进入第 r 行，-(r + 1) 表示离开第 r 行
+        _parents = malloc(sizeof(int32_t) * MAX(n, 1));
+        _ends = malloc(sizeof(int32_t) * MAX(n, 1));
+        _depths = malloc(sizeof(uint16_t) * MAX(n, 1));
+        int32_t *positions = malloc(sizeof(int32_t) * MAX(n, 1));
+        int32_t *stack = malloc(sizeof(int32_t) * MAX(2 * n, 1));
+        NSMutableArray<ProvincesModel *> *models = [NSMutableArray arrayWithCapacity:n];
+        NSMutableDictionary<NSString *, NSNumber *> *indexes = [NSMutableDictionary dictionaryWithCapacity:n];
+        int32_t count = 0;
+        for (int32_t root = 0; root < n; root++) {
+            if (rowParents[root] >= 0) {
+                continue;
+            }
+            int32_t top = 0;
+            stack[top++] = root;
+            while (top > 0) {
+                int32_t item = stack[--top];
+                if (item < 0) {
+                    _ends[positions[-item - 1]] = count;
+                    continue;
+                }
+                int32_t position = count++;
+                positions[item] = position;
+                int32_t parent = rowParents[item] >= 0 ? positions[rowParents[item]] : -1;
+                _parents[position] = parent;
+                _depths[position] = parent >= 0 ? _depths[parent] + 1 : 0;
+                [models addObject:rows[item]];
+                if (rows[item].regionId) {
+                    indexes[rows[item].regionId] = @(position);
+                }
+
+                stack[top++] = -item - 1;
+                //逆序入栈，先访问第一个子节点
+                for (int32_t c = childOffsets[item + 1] - 1; c >= childOffsets[item]; c--) {
+                    stack[top++] = children[c];
+                }
+            }
+        }
+        if (count < n) {
+            //parentId 形成环的地区无法从根节点到达
+            NSLog(@"ProvincesTree 忽略 %d 个无法从根节点到达的地区",n - count);
+        }
+        free(stack);
+        free(positions);
+        free(children);
+        free(childOffsets);
+        free(rowParents);
+
+        _models = [models copy];
+        _indexes = [indexes copy];
+        _count = (NSUInteger)count;
+
+        NSMutableArray<NSNumber *> *rootIndexes = [NSMutableArray array];
+        for (int32_t i = 0; i < count; i = _ends[i]) {
+            [rootIndexes addObject:@(i)];
+        }
+        _rootIndexes = [rootIndexes copy];
+    }
+    return self;
+}
+
+- (void)dealloc{
+    free(_parents);
+    free(_ends);
+    free(_depths);
+}
+
+- (NSArray<ProvincesModel *> *)roots{
+    NSMutableArray<ProvincesModel *> *roots = [NSMutableArray arrayWithCapacity:_rootIndexes.count];
+    for (NSNumber *index in _rootIndexes) {
+        [roots addObject:[self modelAtIndex:index.integerValue]];
+    }
+    return roots;
+}
+
+- (NSString *)description{
+    return [NSString stringWithFormat:@"<ProvincesTree %lu regions, %lu roots>",(unsigned long)self.count,(unsigned long)self.roots.count];
+}
+
+#pragma mark - 查询
+
+/** 索引中的模型被所有调用方共享，开启了修改记录：返回副本，修改副本不影响索引与其它调用方
+ */
+- (ProvincesModel *)modelAtIndex:(NSInteger)index{
+    return [[DatabaseModelMapping mappingForClass:ProvincesModel.class] copyOfModel:_models[index]];
+}
+
+- (NSInteger)indexWithRegionId:(NSString *)regionId{
+    NSNumber *index = regionId ? _indexes[regionId] : nil;
+    return index ? index.integerValue : NSNotFound;
+}
+
+- (ProvincesModel *)modelWithRegionId:(NSString *)regionId{
+    NSInteger index = [self indexWithRegionId:regionId];
+    return index == NSNotFound ? nil : [self modelAtIndex:index];
+}
+
+- (NSArray<ProvincesModel *> *)childrenWithRegionId:(NSString *)regionId{
+    if (regionId == nil) {
+        return self.roots;
+    }
+    NSInteger index = [self indexWithRegionId:regionId];
+    if (index == NSNotFound) {
+        return @[];
+    }
+    NSMutableArray<ProvincesModel *> *children = [NSMutableArray array];
+    for (int32_t child = (int32_t)index + 1; child < _ends[index]; child = _ends[child]) {
+        [children addObject:[self modelAtIndex:child]];
+    }
+    return children;
+}
+
+- (NSArray<ProvincesModel *> *)ancestorsWithRegionId:(NSString *)regionId{
+    NSInteger index = [self indexWithRegionId:regionId];
+    if (index == NSNotFound) {
+        return @[];
+    }
+    NSMutableArray<ProvincesModel *> *ancestors = [NSMutableArray arrayWithCapacity:_depths[index]];
+    for (int32_t parent = _parents[index]; parent >= 0; parent = _parents[parent]) {
+        [ancestors insertObject:[self modelAtIndex:parent] atIndex:0];
+    }
+    return ancestors;
+}
+
+- (NSArray<ProvincesModel *> *)pathWithRegionId:(NSString *)regionId{
+    NSInteger index = [self indexWithRegionId:regionId];
+    if (index == NSNotFound) {
+        return @[];
+    }
+    return [[self ancestorsWithRegionId:regionId] arrayByAddingObject:[self modelAtIndex:index]];
+}
+
+- (NSArray<ProvincesModel *> *)subtreeWithRegionId:(NSString *)regionId{
+    NSInteger index = [self indexWithRegionId:regionId];
+    if (index == NSNotFound) {
+        return @[];
+    }
+    NSMutableArray<ProvincesModel *> *subtree = [NSMutableArray arrayWithCapacity:(NSUInteger)(_ends[index] - index)];
+    for (int32_t i = (int32_t)index; i < _ends[index]; i++) {
+        [subtree addObject:[self modelAtIndex:i]];
+    }
+    return subtree;
+}
+
+- (NSUInteger)depthWithRegionId:(NSString *)regionId{
+    NSInteger index = [self indexWithRegionId:regionId];
+    return index == NSNotFound ? NSNotFound : _depths[index];
+}
+
+@end
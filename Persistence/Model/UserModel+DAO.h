@@ -8,14 +8,21 @@
 
 #import "UserModel.h"
 #import "FMDB.h"
+#import "DatabaseAggregateMapping.h"
+#import "DatabaseBinaryCodec.h"
+
+@class DatabaseCancellationToken;
+@class DatabaseTableSchema;
 
 NS_ASSUME_NONNULL_BEGIN
 
-@interface UserModel (DAO)
+/** UserModel 与 UserInfoModel 两张表作为一个聚合读写：查询为一条 JOIN 语句，写入、删除在一个事务中
+ */
+@interface UserModel (DAO) <DatabaseAggregate, DatabaseBinaryCoding>
 
-/** 创建一张表
+/** 表结构
  */
-+ (void)creatTable;
++ (DatabaseTableSchema *)tableSchema;
 
 /** 销毁一张表
  */
@@ -23,7 +30,12 @@ NS_ASSUME_NONNULL_BEGIN
 
 /** 根据群组id获取表中一组数据
  */
-+ (void)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(UserModel *model))block;
++ (DatabaseCancellationToken *)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(UserModel *model))block;
+
+/** 根据一组 numberId 获取数据：一条 JOIN 语句查询
+ * 回调 numberId -> UserModel，不存在的 numberId 不包含在内
+ */
++ (DatabaseCancellationToken *)getModelsWithNumberIds:(NSArray<NSString *> *)numberIds completionBlock:(void(^)(NSDictionary<NSString *, UserModel *> *models))block;
 
 /** 根据群组id 向表中插入一组数据
  */
@@ -42,9 +54,9 @@ NS_ASSUME_NONNULL_BEGIN
 
 @interface UserInfoModel (DAO)
 
-/** 创建一张表
+/** 表结构
  */
-+ (void)creatTable;
++ (DatabaseTableSchema *)tableSchema;
 
 /** 销毁一张表
  */
@@ -54,6 +66,10 @@ NS_ASSUME_NONNULL_BEGIN
  */
 + (UserInfoModel *)getUserInfoWithNumberId:(NSString *)numberId Database:(FMDatabase *)database;
 
+/** 根据一组 numberId 获取数据：numberId -> UserInfoModel
+ */
++ (NSDictionary<NSString *, UserInfoModel *> *)getUserInfosWithNumberIds:(NSArray<NSString *> *)numberIds Database:(FMDatabase *)database;
+
 /** 根据群组id 向表中插入一组数据
  */
 + (void)insertUserInfoWithNumberId:(NSString *)numberId Database:(FMDatabase *)database Model:(UserInfoModel *)model;
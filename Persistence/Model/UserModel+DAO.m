@@ -8,55 +8,86 @@
 
 #import "UserModel+DAO.h"
 #import "DatabaseManagement.h"
+#import "DatabaseModelMapping.h"
+#import "DatabaseAggregateMapping.h"
+#import "DatabaseDAO.h"
 
 
 @implementation UserModel (DAO)
 
-+ (void)creatTable{
-    [DatabaseManagement databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        if (![database tableExists:@"UserModel"]){
-            [database executeUpdate:@"CREATE TABLE UserModel (id INTEGER PRIMARY KEY,numberId TEXT UNIQUE NOT NULL)"];
-        }
-    }];
+/** 聚合：UserModel 表与 UserInfoModel 表以 numberId 关联，numberId 只保存在 userInfo 中
+ */
++ (NSString *)databaseAggregateKeyColumn{
+    return @"numberId";
+}
+
++ (NSString *)databaseAggregateKeyPath{
+    return @"userInfo.numberId";
+}
+
++ (NSArray<DatabaseAggregateRelationship *> *)databaseRelationships{
+    return @[[DatabaseAggregateRelationship relationshipWithProperty:@"userInfo" childClass:UserInfoModel.class childColumn:@"numberId"]];
+}
+
+/** 二进制编码：userInfo 与根模型编码在一起
+ */
++ (NSDictionary<NSString *, Class> *)binaryCodingNestedClasses{
+    return @{@"userInfo" : UserInfoModel.class};
+}
+
++ (DatabaseTableSchema *)tableSchema{
+    return [DatabaseTableSchema schemaWithTableName:@"UserModel" version:1 createSQL:@"CREATE TABLE UserModel (id INTEGER PRIMARY KEY,numberId TEXT UNIQUE NOT NULL)" migrations:nil];
 }
 
 + (void)dropTable{
-    [DatabaseManagement databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [database executeUpdate:@"DROP TABLE IF EXISTS UserModel"];
-        [database executeUpdate:@"CREATE TABLE UserModel (id INTEGER PRIMARY KEY,numberId TEXT UNIQUE NOT NULL)"];
-    }];
+    [DatabaseManagement emptyTableWithName:@"UserModel"];
 }
 
-+ (void)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(UserModel *model))block{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        UserModel *model = [[UserModel alloc] init];
-        model.userInfo = [UserInfoModel getUserInfoWithNumberId:value Database:database];
++ (DatabaseCancellationToken *)getModelWithKey:(NSString *)key value:(NSString *)value completionBlock:(void(^)(UserModel *model))block{
+    return [DatabaseManagement databaseChildThreadInRead:^(FMDatabase *database) {
+        //一条 JOIN 语句读取两张表
+        UserModel *model = [[DatabaseAggregateMapping mappingForClass:self] aggregateInDatabase:database key:value];
         if (model.userInfo && model.userInfo.numberId){
-            dispatch_async(dispatch_get_main_queue(), ^{
+            [DatabaseManagement databaseMainThreadCompletion:^{
                 block(model);
-            });
+            }];
         }
     }];
 }
 
-+ (void)insertModel:(UserModel *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [database executeUpdate:@"REPLACE INTO UserModel (numberId) VALUES (?)",model.userInfo.numberId];
-        [UserInfoModel insertUserInfoWithNumberId:model.userInfo.numberId Database:database Model:model.userInfo];
++ (DatabaseCancellationToken *)getModelsWithNumberIds:(NSArray<NSString *> *)numberIds completionBlock:(void(^)(NSDictionary<NSString *, UserModel *> *models))block{
+    NSArray<NSString *> *values = [numberIds copy];
+    return [DatabaseManagement databaseChildThreadInRead:^(FMDatabase *database) {
+        NSMutableDictionary<NSString *, UserModel *> *models = [[DatabaseAggregateMapping mappingForClass:self] aggregatesInDatabase:database keys:values];
+        //没有用户信息的记录不返回
+        for (NSString *numberId in models.allKeys) {
+            if (models[numberId].userInfo == nil) {
+                [models removeObjectForKey:numberId];
+            }
+        }
+        [DatabaseManagement databaseMainThreadCompletion:^{
+            block(models);
+        }];
     }];
 }
 
++ (void)insertModel:(UserModel *)model{
+    [DatabaseManagement databaseBatchWrite:^BOOL(FMDatabase *database) {
+        return [[DatabaseAggregateMapping mappingForClass:self] writeAggregate:model inDatabase:database];
+    } completion:nil];
+}
+
 + (void)updateModel:(UserModel *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [UserInfoModel insertUserInfoWithNumberId:model.userInfo.numberId Database:database Model:model.userInfo];
-    }];
+    [DatabaseManagement databaseBatchWrite:^BOOL(FMDatabase *database) {
+        return [[DatabaseAggregateMapping mappingForClass:self] writeAggregate:model inDatabase:database];
+    } completion:nil];
 }
 
 + (void)deleteModel:(UserModel *)model{
-    [DatabaseManagement databaseChildThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [database executeUpdate:@"DELETE FROM UserModel WHERE numberId = ?",model.userInfo.numberId];
-        [UserInfoModel deleteUserInfoWithNumberId:model.userInfo.numberId Database:database];
-    }];
+    NSString *numberId = model.userInfo.numberId;
+    [DatabaseManagement databaseBatchWrite:^BOOL(FMDatabase *database) {
+        return [[DatabaseAggregateMapping mappingForClass:self] deleteAggregateWithKey:numberId inDatabase:database];
+    } completion:nil];
 }
 
 @end
@@ -70,45 +101,42 @@
 
 @implementation UserInfoModel (DAO)
 
-+ (void)creatTable{
-    [DatabaseManagement databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        if (![database tableExists:@"UserInfoModel"]){
-            [database executeUpdate:@"CREATE TABLE UserInfoModel (id INTEGER PRIMARY KEY,numberId TEXT UNIQUE NOT NULL,headPath TEXT, age TEXT, sex TEXT, nickName TEXT, userMobile TEXT)"];
-        }
-    }];
+/** 映射：按 numberId 更新、删除
+ */
++ (NSString *)databaseUniqueKey{
+    return @"numberId";
+}
+
++ (DatabaseTableSchema *)tableSchema{
+    return [DatabaseTableSchema schemaWithTableName:@"UserInfoModel" version:1 createSQL:@"CREATE TABLE UserInfoModel (id INTEGER PRIMARY KEY,numberId TEXT UNIQUE NOT NULL,headPath TEXT, age TEXT, sex TEXT, nickName TEXT, userMobile TEXT)" migrations:nil];
 }
 
 + (void)dropTable{
-    [DatabaseManagement databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
-        [database executeUpdate:@"DROP TABLE IF EXISTS UserInfoModel"];
-        [database executeUpdate:@"CREATE TABLE UserInfoModel (id INTEGER PRIMARY KEY,numberId TEXT UNIQUE NOT NULL,headPath TEXT,age TEXT, sex TEXT, nickName TEXT, userMobile TEXT)"];
-    }];
+    [DatabaseManagement emptyTableWithName:@"UserInfoModel"];
 }
 
+/** 经过行缓存：返回的模型可能被其它调用方共享
+ */
 + (UserInfoModel *)getUserInfoWithNumberId:(NSString *)numberId Database:(FMDatabase *)database{
-    UserInfoModel *model = nil;
-    FMResultSet *resultSet = [database executeQuery:@"SELECT * FROM UserInfoModel WHERE numberId = ?",numberId];
-    while ([resultSet next]){
-        model = [[UserInfoModel alloc] init];
-        model.numberId = [resultSet stringForColumn:@"numberId"];
-        model.headPath = [resultSet stringForColumn:@"headPath"];
-        model.age = [resultSet stringForColumn:@"age"];
-        model.sex = [resultSet stringForColumn:@"sex"];
-        model.nickName = [resultSet stringForColumn:@"nickName"];
-        model.userMobile = [resultSet stringForColumn:@"userMobile"];
-    }
-    return model;
+    return [DatabaseDAO modelOfClass:self uniqueValue:numberId inDatabase:database];
+}
+
++ (NSDictionary<NSString *, UserInfoModel *> *)getUserInfosWithNumberIds:(NSArray<NSString *> *)numberIds Database:(FMDatabase *)database{
+    return [DatabaseDAO modelsOfClass:self uniqueValues:numberIds inDatabase:database];
 }
 
 + (void)insertUserInfoWithNumberId:(NSString *)numberId Database:(FMDatabase *)database Model:(UserInfoModel *)model{
     if (numberId && model){
-        [database executeUpdate:@"REPLACE INTO UserInfoModel (numberId,headPath,age,sex,nickName,userMobile) VALUES (? , ? , ? , ? , ? , ? , ? , ? , ?)",
-         numberId,model.headPath,model.age,model.sex,model.nickName,model.userMobile];
+        //写入的行以 numberId 为准，与 UserModel 表中的记录保持一致
+        if (![model.numberId isEqualToString:numberId]) {
+            model.numberId = numberId;
+        }
+        [[DatabaseModelMapping mappingForClass:self] upsertModel:model schema:nil inDatabase:database];
     }
 }
 
 + (void)deleteUserInfoWithNumberId:(NSString *)numberId Database:(FMDatabase *)database{
-    [database executeUpdate:@"DELETE FROM UserInfoModel WHERE numberId = ?",numberId];
+    [database executeUpdate:[DatabaseModelMapping mappingForClass:self].deleteSQL,numberId];
 }
 
 @end
@@ -10,6 +10,7 @@
 #import "PhoneCodeModel+DAO.h"
 #import "ProvincesModel+DAO.h"
 #import "DatabaseManagement.h"
+#import "DatabaseIndexAdvisor.h"
 #import "Persons.h"
 #import "FMDatabaseQueue.h"
 
@@ -29,7 +30,10 @@
     // Do any additional setup after loading the view from its nib.
     
 //    [DatabaseManagement info];
-    
+//    [DatabaseIndexAdvisor startRecording];
+//    [DatabaseManagement addChangeObserverForTables:@[@"PhoneCodeModel"] queue:nil block:^(DatabaseChangeSet * _Nonnull changes) {
+//        NSLog(@"changes ----- %@",changes);
+//    }];
 
 
 }
@@ -63,7 +67,7 @@
     
 //    [PhoneCodeModel insertModels:[PhoneCodeModel phoneCodeArray]];
 //
-//    [ProvincesModel replaceModels:[ProvincesModel provincesModelArray]];
+//    [ProvincesModel importModelsWithContentsOfFile:[ProvincesModel provincesFilePath] completion:nil];
 //
 //    [PhoneCodeModel insertModel:self.phoneCodeModel];
 //
@@ -108,6 +112,7 @@
 //
 //
 //    [DatabaseManagement info];
+//    [DatabaseIndexAdvisor analyzeAllStoresWithCompletion:nil];
 }
 
 - (IBAction)deleteButtonClick:(UIButton *)sender {
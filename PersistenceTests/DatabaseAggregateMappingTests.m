@@ -0,0 +1,107 @@
+//
+//  DatabaseAggregateMappingTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "FMDatabase.h"
+#import "FMDatabaseAdditions.h"
+#import "DatabaseSchema.h"
+#import "DatabaseAggregateMapping.h"
+#import "UserModel+DAO.h"
+
+@interface DatabaseAggregateMappingTests : XCTestCase
+{
+    FMDatabase *_database;
+    DatabaseAggregateMapping *_mapping;
+}
+@end
+
+@implementation DatabaseAggregateMappingTests
+
+- (void)setUp{
+    _database = [FMDatabase databaseWithPath:nil];
+    XCTAssertTrue([_database open]);
+    XCTAssertTrue([_database executeUpdate:UserModel.tableSchema.createSQL]);
+    XCTAssertTrue([_database executeUpdate:UserInfoModel.tableSchema.createSQL]);
+    _mapping = [DatabaseAggregateMapping mappingForClass:UserModel.class];
+}
+
+- (void)tearDown{
+    [_database close];
+    _database = nil;
+}
+
+- (UserModel *)userWithNumberId:(NSString *)numberId nickName:(NSString *)nickName{
+    UserInfoModel *userInfo = [[UserInfoModel alloc] init];
+    userInfo.numberId = numberId;
+    userInfo.nickName = nickName;
+    userInfo.age = @"18";
+    UserModel *user = [[UserModel alloc] init];
+    user.userInfo = userInfo;
+    return user;
+}
+
+- (void)testDeclaration{
+    XCTAssertEqualObjects(_mapping.keyColumn, @"numberId");
+    XCTAssertEqualObjects(_mapping.keyPath, @"userInfo.numberId");
+    XCTAssertEqual(_mapping.relationships.count, 1);
+    XCTAssertTrue([_mapping.selectSQL containsString:@"LEFT JOIN UserInfoModel"]);
+    XCTAssertEqualObjects([_mapping keyForAggregate:[self userWithNumberId:@"1" nickName:@"a"]], @"1");
+    XCTAssertNil([_mapping keyForAggregate:[[UserModel alloc] init]]);
+}
+
+- (void)testWriteAndRead{
+    XCTAssertTrue([_mapping writeAggregate:[self userWithNumberId:@"1001" nickName:@"张三"] inDatabase:_database]);
+    XCTAssertTrue([_mapping writeAggregate:[self userWithNumberId:@"1002" nickName:@"李四"] inDatabase:_database]);
+    XCTAssertEqual([_database intForQuery:@"SELECT count(*) FROM UserModel"], 2);
+    XCTAssertEqual([_database intForQuery:@"SELECT count(*) FROM UserInfoModel"], 2);
+
+    UserModel *user = [_mapping aggregateInDatabase:_database key:@"1001"];
+    XCTAssertEqualObjects(user.userInfo.numberId, @"1001");
+    XCTAssertEqualObjects(user.userInfo.nickName, @"张三");
+    XCTAssertEqualObjects(user.userInfo.age, @"18");
+    XCTAssertNil([_mapping aggregateInDatabase:_database key:@"9999"]);
+    XCTAssertNil([_mapping aggregateInDatabase:_database key:nil]);
+
+    //再次写入同一个标识：原地更新，不新增行
+    int64_t rowid = [_database longForQuery:@"SELECT id FROM UserInfoModel WHERE numberId = '1001'"];
+    XCTAssertTrue([_mapping writeAggregate:[self userWithNumberId:@"1001" nickName:@"张三丰"] inDatabase:_database]);
+    XCTAssertEqual([_database intForQuery:@"SELECT count(*) FROM UserInfoModel"], 2);
+    XCTAssertEqual([_database longForQuery:@"SELECT id FROM UserInfoModel WHERE numberId = '1001'"], rowid);
+    XCTAssertEqualObjects([[_mapping aggregateInDatabase:_database key:@"1001"] userInfo].nickName, @"张三丰");
+
+    //没有标识的聚合不写入
+    XCTAssertFalse([_mapping writeAggregate:[[UserModel alloc] init] inDatabase:_database]);
+}
+
+- (void)testBatchRead{
+    for (int i = 0; i < 50; i++) {
+        XCTAssertTrue([_mapping writeAggregate:[self userWithNumberId:@(2000 + i).stringValue nickName:@(i).stringValue] inDatabase:_database]);
+    }
+    //数字按字符串比较；不存在的标识不包含在内
+    NSMutableDictionary *users = [_mapping aggregatesInDatabase:_database keys:@[@"2000", @2049, @"3000"]];
+    XCTAssertEqualObjects([NSSet setWithArray:users.allKeys], ([NSSet setWithObjects:@"2000", @"2049", nil]));
+    XCTAssertEqualObjects([users[@"2049"] userInfo].nickName, @"49");
+    XCTAssertEqual([_mapping aggregatesInDatabase:_database keys:@[]].count, 0);
+    XCTAssertEqualObjects([_mapping.rootMapping JSONValues:@[@1, @"2"] forColumn:@"numberId"], (@[@"1", @"2"]));
+}
+
+- (void)testMissingChildAndDelete{
+    //只有根表中的行：子模型为 nil
+    XCTAssertTrue([_database executeUpdate:@"INSERT INTO UserModel (numberId) VALUES ('3001')"]);
+    UserModel *user = [_mapping aggregateInDatabase:_database key:@"3001"];
+    XCTAssertNotNil(user);
+    XCTAssertNil(user.userInfo);
+
+    XCTAssertTrue([_mapping writeAggregate:[self userWithNumberId:@"3002" nickName:@"王五"] inDatabase:_database]);
+    XCTAssertTrue([_mapping deleteAggregateWithKey:@"3002" inDatabase:_database]);
+    XCTAssertNil([_mapping aggregateInDatabase:_database key:@"3002"]);
+    XCTAssertEqual([_database intForQuery:@"SELECT count(*) FROM UserInfoModel WHERE numberId = '3002'"], 0);
+    XCTAssertEqual([_database intForQuery:@"SELECT count(*) FROM UserModel WHERE numberId = '3002'"], 0);
+}
+
+@end
@@ -0,0 +1,104 @@
+//
+//  DatabaseBatchWriteTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "DatabaseManagement.h"
+
+/** 合并写入：在 main 数据库中使用一张临时的表，结束后删除
+ */
+@interface DatabaseBatchWriteTests : XCTestCase
+@end
+
+@implementation DatabaseBatchWriteTests
+
+- (void)setUp{
+    [DatabaseManagement databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        [database executeUpdate:@"DROP TABLE IF EXISTS BatchWriteTestModel"];
+        [database executeUpdate:@"CREATE TABLE BatchWriteTestModel (id INTEGER PRIMARY KEY,name TEXT UNIQUE NOT NULL)"];
+    }];
+}
+
+- (void)tearDown{
+    [DatabaseManagement setBatchWriteInterval:0.01 maxCount:64];
+    [DatabaseManagement databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        [database executeUpdate:@"DROP TABLE IF EXISTS BatchWriteTestModel"];
+    }];
+}
+
+- (BOOL (^)(FMDatabase *database))insertName:(NSString *)name{
+    return ^BOOL(FMDatabase *database) {
+        return [database executeUpdate:@"INSERT INTO BatchWriteTestModel (name) VALUES (?)",name];
+    };
+}
+
+- (int)rowCount{
+    __block int count = 0;
+    [DatabaseManagement databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        count = [database intForQuery:@"SELECT count(*) FROM BatchWriteTestModel"];
+    }];
+    return count;
+}
+
+- (void)testEachWriteReportsItsOwnResult{
+    [DatabaseManagement setBatchWriteInterval:0.05 maxCount:64];
+    NSMutableArray<NSNumber *> *results = [NSMutableArray array];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"batch"];
+    expectation.expectedFulfillmentCount = 3;
+    //同一批次：重复的 name 违反唯一约束，只回滚自身的保存点
+    for (NSString *name in @[@"a", @"a", @"b"]) {
+        [DatabaseManagement databaseBatchWrite:[self insertName:name] completion:^(BOOL success) {
+            [results addObject:@(success)];
+            [expectation fulfill];
+        }];
+    }
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqualObjects(results, (@[@YES, @NO, @YES]));
+    XCTAssertEqual([self rowCount], 2);
+}
+
+- (void)testFullWindowFlushesImmediately{
+    //时间窗口远大于等待时间：只有数量达到上限才会写入
+    [DatabaseManagement setBatchWriteInterval:30 maxCount:2];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"batch"];
+    expectation.expectedFulfillmentCount = 2;
+    for (NSString *name in @[@"a", @"b"]) {
+        [DatabaseManagement databaseBatchWrite:[self insertName:name] completion:^(BOOL success) {
+            XCTAssertTrue(success);
+            [expectation fulfill];
+        }];
+    }
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual([self rowCount], 2);
+}
+
+- (void)testEarlyFlushDoesNotShortenNextWindow{
+    [DatabaseManagement setBatchWriteInterval:1 maxCount:2];
+    XCTestExpectation *first = [self expectationWithDescription:@"first"];
+    first.expectedFulfillmentCount = 2;
+    for (NSString *name in @[@"a", @"b"]) {
+        [DatabaseManagement databaseBatchWrite:[self insertName:name] completion:^(BOOL success) {
+            [first fulfill];
+        }];
+    }
+
+    //第一批数量达到上限立即写入，它的定时器在 1 秒时到期；0.5 秒时开始的下一批应等满自己的 1 秒
+    XCTestExpectation *second = [self expectationWithDescription:@"second"];
+    __block CFAbsoluteTime elapsed = 0;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.5 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+        [DatabaseManagement databaseBatchWrite:[self insertName:@"c"] completion:^(BOOL success) {
+            elapsed = CFAbsoluteTimeGetCurrent() - startTime;
+            [second fulfill];
+        }];
+    });
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertGreaterThan(elapsed, 0.8);
+    XCTAssertEqual([self rowCount], 3);
+}
+
+@end
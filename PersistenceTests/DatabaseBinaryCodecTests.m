@@ -0,0 +1,138 @@
+//
+//  DatabaseBinaryCodecTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "DatabaseBinaryCodec.h"
+#import "ProvincesModel+DAO.h"
+
+@interface DatabaseBinaryCodecTests : XCTestCase
+@end
+
+@implementation DatabaseBinaryCodecTests
+
++ (ProvincesModel *)modelWithRegionId:(NSString *)regionId name:(NSString *)name parentId:(NSString *)parentId{
+    ProvincesModel *model = [[ProvincesModel alloc] init];
+    model.regionId = regionId;
+    model.regionName = name;
+    model.parentId = parentId;
+    model.regionType = parentId ? @"2" : @"1";
+    return model;
+}
+
+/** 省 -> 两个市，其中一个市带一个区；包含非 ASCII 字符串与 nil 的字段
+ */
++ (ProvincesModel *)sampleTree{
+    ProvincesModel *district = [self modelWithRegionId:@"110101" name:@"东城区" parentId:@"110100"];
+    ProvincesModel *city = [self modelWithRegionId:@"110100" name:@"北京市" parentId:@"110000"];
+    city.childArray = @[district];
+    ProvincesModel *county = [self modelWithRegionId:@"110200" name:@"县" parentId:@"110000"];
+    ProvincesModel *province = [self modelWithRegionId:@"110000" name:@"北京" parentId:nil];
+    province.agencyId = @"1";
+    province.childArray = @[city, county];
+    return province;
+}
+
+- (void)testRoundTripObject{
+    NSData *data = [DatabaseBinaryCodec dataWithRootObject:[self.class sampleTree]];
+    XCTAssertNotNil(data);
+    XCTAssertEqual(memcmp(data.bytes, "PMB1", 4), 0);
+
+    ProvincesModel *province = [DatabaseBinaryCodec rootObjectWithData:data];
+    XCTAssertTrue([province isKindOfClass:ProvincesModel.class]);
+    XCTAssertEqualObjects(province.regionId, @"110000");
+    XCTAssertEqualObjects(province.regionName, @"北京");
+    XCTAssertEqualObjects(province.agencyId, @"1");
+    XCTAssertNil(province.parentId);
+    XCTAssertEqual(province.childArray.count, 2);
+
+    ProvincesModel *city = province.childArray[0];
+    XCTAssertEqualObjects(city.regionName, @"北京市");
+    XCTAssertEqualObjects(city.parentId, @"110000");
+    XCTAssertEqual(city.childArray.count, 1);
+    XCTAssertEqualObjects(city.childArray[0].regionName, @"东城区");
+    XCTAssertEqualObjects(province.childArray[1].regionId, @"110200");
+    XCTAssertEqual(province.childArray[1].childArray.count, 0);
+}
+
+- (void)testRoundTripArray{
+    NSArray<ProvincesModel *> *models = @[[self.class sampleTree], [self.class modelWithRegionId:@"120000" name:@"天津" parentId:nil]];
+    NSData *data = [DatabaseBinaryCodec dataWithRootObject:models];
+    XCTAssertNotNil(data);
+
+    NSArray<ProvincesModel *> *decoded = [DatabaseBinaryCodec rootObjectWithData:data];
+    XCTAssertTrue([decoded isKindOfClass:NSArray.class]);
+    XCTAssertEqual(decoded.count, 2);
+    //按需解码的数组：倒序访问与顺序访问的结果一致
+    XCTAssertEqualObjects(decoded[1].regionName, @"天津");
+    XCTAssertEqualObjects(decoded[0].regionName, @"北京");
+    XCTAssertEqualObjects([decoded valueForKey:@"regionId"], (@[@"110000", @"120000"]));
+    XCTAssertEqualObjects(decoded[0].childArray[0].childArray[0].regionId, @"110101");
+
+    //空数组
+    NSArray *empty = [DatabaseBinaryCodec rootObjectWithData:[DatabaseBinaryCodec dataWithRootObject:@[]]];
+    XCTAssertEqualObjects(empty, @[]);
+}
+
+- (void)testRoundTripFile{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:NSUUID.UUID.UUIDString];
+    XCTAssertTrue([DatabaseBinaryCodec writeRootObject:@[[self.class sampleTree]] toFile:path]);
+    NSArray<ProvincesModel *> *decoded = [DatabaseBinaryCodec rootObjectWithContentsOfFile:path];
+    XCTAssertEqualObjects(decoded.firstObject.childArray.firstObject.regionName, @"北京市");
+    [NSFileManager.defaultManager removeItemAtPath:path error:nil];
+
+    XCTAssertNil([DatabaseBinaryCodec rootObjectWithContentsOfFile:path]);
+}
+
+- (void)testRejectsNonModels{
+    XCTAssertNil([DatabaseBinaryCodec dataWithRootObject:@[@"string"]]);
+    XCTAssertNil([DatabaseBinaryCodec dataWithRootObject:@[@1, @2]]);
+
+    //嵌套属性的类型与声明不一致
+    ProvincesModel *province = [self.class sampleTree];
+    province.childArray = (NSArray *)@[@"not a model"];
+    XCTAssertNil([DatabaseBinaryCodec dataWithRootObject:province]);
+}
+
+- (void)testMalformedData{
+    XCTAssertNil([DatabaseBinaryCodec rootObjectWithData:[NSData data]]);
+    XCTAssertNil([DatabaseBinaryCodec rootObjectWithData:[@"PMB1" dataUsingEncoding:NSUTF8StringEncoding]]);
+    XCTAssertNil([DatabaseBinaryCodec rootObjectWithData:[@"not a snapshot" dataUsingEncoding:NSUTF8StringEncoding]]);
+
+    NSData *data = [DatabaseBinaryCodec dataWithRootObject:@[[self.class sampleTree]]];
+    //文件头不正确
+    NSMutableData *header = [data mutableCopy];
+    ((uint8_t *)header.mutableBytes)[3] = '2';
+    XCTAssertNil([DatabaseBinaryCodec rootObjectWithData:header]);
+
+    //末尾多出的字节
+    NSMutableData *trailing = [data mutableCopy];
+    [trailing appendBytes:"\0" length:1];
+    XCTAssertNil([DatabaseBinaryCodec rootObjectWithData:trailing]);
+
+    //空的字符串表、类表之后，根的类型不是对象或数组
+    XCTAssertNil([DatabaseBinaryCodec rootObjectWithData:[NSData dataWithBytes:"PMB1\0\0\x7F" length:7]]);
+}
+
+- (void)testTruncatedData{
+    NSData *data = [DatabaseBinaryCodec dataWithRootObject:@[[self.class sampleTree], [self.class sampleTree]]];
+    XCTAssertNotNil([DatabaseBinaryCodec rootObjectWithData:data]);
+    for (NSUInteger length = 0; length < data.length; length++) {
+        XCTAssertNil([DatabaseBinaryCodec rootObjectWithData:[data subdataWithRange:NSMakeRange(0, length)]], @"length %lu",(unsigned long)length);
+    }
+}
+
+- (void)testSnapshotHelpers{
+    NSArray<ProvincesModel *> *models = @[[self.class sampleTree]];
+    NSData *data = [ProvincesModel snapshotDataWithModels:models];
+    XCTAssertNotNil(data);
+    NSArray<ProvincesModel *> *decoded = [ProvincesModel modelsWithSnapshotData:data];
+    XCTAssertEqual(decoded.count, 1);
+    XCTAssertEqualObjects(decoded[0].childArray[0].childArray[0].regionName, @"东城区");
+}
+
+@end
@@ -0,0 +1,55 @@
+//
+//  DatabaseBundleStoreTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "DatabaseManagement.h"
+#import "FMDatabaseAdditions.h"
+
+@interface DatabaseBundleStoreTests : XCTestCase
+
+@end
+
+@implementation DatabaseBundleStoreTests
+
+- (void)testBundleStoreIsImmutable{
+    DatabaseStore *bundleStore = DatabaseManagement.bundleStore;
+    XCTAssertNotNil(bundleStore);
+    XCTAssertEqual(bundleStore.profile, DatabaseStoreProfileImmutable);
+    XCTAssertNil(bundleStore.writeQueue);
+    XCTAssertNil(bundleStore.checkpointScheduler);
+    XCTAssertEqual([DatabaseManagement storeNamed:@"bundle"], bundleStore);
+    //整个文件映射到内存
+    unsigned long long fileSize = [NSFileManager.defaultManager attributesOfItemAtPath:bundleStore.path error:nil].fileSize;
+    XCTAssertGreaterThan(bundleStore.mmapSize, 0);
+    XCTAssertEqual((unsigned long long)bundleStore.mmapSize, fileSize);
+}
+
+- (void)testBundledTablesHaveRows{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"read"];
+    [DatabaseManagement.bundleStore databaseChildThreadInRead:^(FMDatabase *database) {
+        XCTAssertGreaterThan([database intForQuery:@"SELECT count(*) FROM PhoneCodeModel"], 0);
+        XCTAssertGreaterThan([database intForQuery:@"SELECT count(*) FROM ProvincesModel"], 0);
+        XCTAssertEqualObjects([database stringForQuery:@"PRAGMA journal_mode"], @"delete");
+        XCTAssertEqual([database intForQuery:@"PRAGMA mmap_size"], (int)DatabaseManagement.bundleStore.mmapSize);
+        //不可写
+        XCTAssertFalse([database executeUpdate:@"DELETE FROM PhoneCodeModel"]);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+- (void)testBundleIsAttachedToReadingStores{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"read"];
+    [DatabaseManagement.mainStore databaseChildThreadInRead:^(FMDatabase *database) {
+        XCTAssertGreaterThan([database intForQuery:@"SELECT count(*) FROM bundle.PhoneCodeModel"], 0);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+@end
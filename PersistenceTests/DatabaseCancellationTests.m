@@ -0,0 +1,141 @@
+//
+//  DatabaseCancellationTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <sqlite3.h>
+#import "DatabaseScheduler.h"
+#import "FMDatabaseAdditions.h"
+
+static NSString * const DatabaseCancellationTestsSlowSQL = @"WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c WHERE x < 50000000) SELECT count(*) FROM c";
+
+@interface DatabaseCancellationTests : XCTestCase
+{
+    NSString *_path;
+    DatabaseScheduler *_scheduler;
+}
+@end
+
+@implementation DatabaseCancellationTests
+
+- (void)setUp{
+    _path = [NSTemporaryDirectory() stringByAppendingPathComponent:NSUUID.UUID.UUIDString];
+    FMDatabaseQueue *writeQueue = [FMDatabaseQueue databaseQueueWithPath:_path];
+    [writeQueue inDatabase:^(FMDatabase *db) {
+        XCTAssertTrue([db executeStatements:@"PRAGMA journal_mode = WAL"]);
+        XCTAssertTrue([db executeUpdate:@"CREATE TABLE Item (id INTEGER PRIMARY KEY,name TEXT)"]);
+    }];
+    FMDatabaseQueue *readQueue = [[FMDatabaseQueue alloc] initWithPath:_path flags:SQLITE_OPEN_READONLY];
+    FMDatabaseQueue *backgroundReadQueue = [[FMDatabaseQueue alloc] initWithPath:_path flags:SQLITE_OPEN_READONLY];
+    _scheduler = [[DatabaseScheduler alloc] initWithWriteQueue:writeQueue readQueue:readQueue backgroundReadQueue:backgroundReadQueue];
+}
+
+- (void)tearDown{
+    [_scheduler cancelAllOperations];
+    _scheduler = nil;
+    for (NSString *suffix in @[@"", @"-wal", @"-shm"]) {
+        [NSFileManager.defaultManager removeItemAtPath:[_path stringByAppendingString:suffix] error:nil];
+    }
+}
+
+- (int)rowCount{
+    __block int count = 0;
+    [_scheduler.writeQueue inDatabase:^(FMDatabase *db) {
+        count = [db intForQuery:@"SELECT count(*) FROM Item"];
+    }];
+    return count;
+}
+
+- (void)testCancelledQueuedWriteNeverRuns{
+    DatabaseCancellationToken *token = [[DatabaseCancellationToken alloc] init];
+    [token cancel];
+    [token cancel];//多次调用只生效一次
+    __block BOOL ran = NO;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"write"];
+    DatabaseCancellationToken *returned = [_scheduler writeInLane:DatabaseLaneUserWrite token:token transaction:^(FMDatabase *db, BOOL *rollback) {
+        ran = YES;
+    } completion:^(BOOL committed) {
+        XCTAssertFalse(committed);
+        [expectation fulfill];
+    }];
+    XCTAssertEqual(returned, token);
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertFalse(ran);
+}
+
+- (void)testCancelInterruptsRunningWriteAndRollsBack{
+    dispatch_semaphore_t started = dispatch_semaphore_create(0);
+    XCTestExpectation *expectation = [self expectationWithDescription:@"write"];
+    __block CFAbsoluteTime startTime = 0;
+    DatabaseCancellationToken *token = [_scheduler writeInLane:DatabaseLaneUserWrite token:nil transaction:^(FMDatabase *db, BOOL *rollback) {
+        [db executeUpdate:@"INSERT INTO Item (name) VALUES ('a')"];
+        dispatch_semaphore_signal(started);
+        [db intForQuery:DatabaseCancellationTestsSlowSQL];
+    } completion:^(BOOL committed) {
+        XCTAssertFalse(committed);
+        [expectation fulfill];
+    }];
+    dispatch_semaphore_wait(started, DISPATCH_TIME_FOREVER);
+    startTime = CFAbsoluteTimeGetCurrent();
+    [token cancel];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    //语句立即被中断，不等待执行完毕；取消之前的写入被回滚
+    XCTAssertLessThan(CFAbsoluteTimeGetCurrent() - startTime, 1);
+    XCTAssertEqual([self rowCount], 0);
+}
+
+- (void)testCancelInterruptsRunningRead{
+    dispatch_semaphore_t started = dispatch_semaphore_create(0);
+    XCTestExpectation *expectation = [self expectationWithDescription:@"read"];
+    __block DatabaseCancellationToken *currentToken = nil;
+    __block int errorCode = SQLITE_OK;
+    DatabaseCancellationToken *token = [_scheduler readInLane:DatabaseLaneInteractive block:^(FMDatabase *db) {
+        currentToken = DatabaseCancellationToken.currentToken;
+        dispatch_semaphore_signal(started);
+        FMResultSet *resultSet = [db executeQuery:DatabaseCancellationTestsSlowSQL];
+        [resultSet next];
+        errorCode = db.lastErrorCode;
+        [resultSet close];
+        [expectation fulfill];
+    }];
+    dispatch_semaphore_wait(started, DISPATCH_TIME_FOREVER);
+    [token cancel];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual(currentToken, token);
+    XCTAssertTrue(token.isCancelled);
+    XCTAssertEqual(errorCode, SQLITE_INTERRUPT);
+    XCTAssertNil(DatabaseCancellationToken.currentToken);
+}
+
+- (void)testCancelAllOperations{
+    //写连接被占用时，其余任务在排队；不允许抢占，排队的任务不会先执行
+    _scheduler.maxPreemptCount = 0;
+    dispatch_semaphore_t started = dispatch_semaphore_create(0);
+    XCTestExpectation *expectation = [self expectationWithDescription:@"writes"];
+    expectation.expectedFulfillmentCount = 3;
+    [_scheduler writeInLane:DatabaseLaneBackground token:nil transaction:^(FMDatabase *db, BOOL *rollback) {
+        dispatch_semaphore_signal(started);
+        [db intForQuery:DatabaseCancellationTestsSlowSQL];
+    } completion:^(BOOL committed) {
+        XCTAssertFalse(committed);
+        [expectation fulfill];
+    }];
+    dispatch_semaphore_wait(started, DISPATCH_TIME_FOREVER);
+    for (NSString *name in @[@"a", @"b"]) {
+        [_scheduler writeInLane:DatabaseLaneUserWrite token:nil transaction:^(FMDatabase *db, BOOL *rollback) {
+            [db executeUpdate:@"INSERT INTO Item (name) VALUES (?)",name];
+        } completion:^(BOOL committed) {
+            XCTAssertFalse(committed);
+            [expectation fulfill];
+        }];
+    }
+    [_scheduler cancelAllOperations];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual([self rowCount], 0);
+}
+
+@end
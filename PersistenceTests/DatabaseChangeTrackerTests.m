@@ -0,0 +1,165 @@
+//
+//  DatabaseChangeTrackerTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <sqlite3.h>
+#import "DatabaseChangeTracker.h"
+
+@interface DatabaseChangeTrackerTests : XCTestCase
+{
+    DatabaseChangeTracker *_tracker;
+    dispatch_queue_t _queue;
+    NSMutableArray<DatabaseChangeSet *> *_changeSets;
+    DatabaseChangeObservation *_observation;
+}
+@end
+
+@implementation DatabaseChangeTrackerTests
+
+- (void)setUp{
+    _tracker = [[DatabaseChangeTracker alloc] initWithStoreName:@"main"];
+    _queue = dispatch_queue_create("com.persistence.tests.changes", DISPATCH_QUEUE_SERIAL);
+    _changeSets = [NSMutableArray array];
+    _observation = [self observeTables:nil into:_changeSets];
+}
+
+- (void)tearDown{
+    [_observation invalidate];
+}
+
+- (DatabaseChangeObservation *)observeTables:(NSSet<NSString *> *)tableNames into:(NSMutableArray<DatabaseChangeSet *> *)changeSets{
+    return [_tracker addObserverForTables:tableNames queue:_queue block:^(DatabaseChangeSet *changes) {
+        [changeSets addObject:changes];
+    }];
+}
+
+/** 等待已发布的回调执行完毕
+ */
+- (NSArray<DatabaseChangeSet *> *)publishedChangeSets{
+    dispatch_sync(_queue, ^{});
+    return [_changeSets copy];
+}
+
+- (NSSet<NSNumber *> *)rowids:(NSArray<NSNumber *> *)rowids{
+    return [NSSet setWithArray:rowids];
+}
+
+- (void)testCoalescesChangesOfOneRow{
+    //插入后更新 -> 插入
+    [_tracker rowDidChangeInTable:@"Item" rowid:1 operation:SQLITE_INSERT];
+    [_tracker rowDidChangeInTable:@"Item" rowid:1 operation:SQLITE_UPDATE];
+    //插入后删除 -> 不出现
+    [_tracker rowDidChangeInTable:@"Item" rowid:2 operation:SQLITE_INSERT];
+    [_tracker rowDidChangeInTable:@"Item" rowid:2 operation:SQLITE_DELETE];
+    //更新后删除 -> 删除
+    [_tracker rowDidChangeInTable:@"Item" rowid:3 operation:SQLITE_UPDATE];
+    [_tracker rowDidChangeInTable:@"Item" rowid:3 operation:SQLITE_DELETE];
+    //删除后以同一 rowid 插入 -> 更新
+    [_tracker rowDidChangeInTable:@"Item" rowid:4 operation:SQLITE_DELETE];
+    [_tracker rowDidChangeInTable:@"Item" rowid:4 operation:SQLITE_INSERT];
+    [_tracker rowDidChangeInTable:@"Item" rowid:5 operation:SQLITE_UPDATE];
+    [_tracker rowDidChangeInTable:@"Item" rowid:5 operation:SQLITE_UPDATE];
+    [_tracker rowDidChangeInTable:@"Other" rowid:1 operation:SQLITE_DELETE];
+    [_tracker transactionDidCommit];
+
+    NSArray<DatabaseChangeSet *> *changeSets = [self publishedChangeSets];
+    XCTAssertEqual(changeSets.count, 1);
+    DatabaseChangeSet *changes = changeSets.firstObject;
+    XCTAssertEqualObjects(changes.storeName, @"main");
+    XCTAssertEqualObjects(changes.tableNames, ([NSSet setWithObjects:@"Item", @"Other", nil]));
+    XCTAssertFalse(changes.resetsAllTables);
+    XCTAssertFalse([changes isResetTable:@"Item"]);
+    XCTAssertEqualObjects([changes insertedRowidsInTable:@"Item"], [self rowids:@[@1]]);
+    XCTAssertEqualObjects([changes updatedRowidsInTable:@"Item"], [self rowids:(@[@4, @5])]);
+    XCTAssertEqualObjects([changes deletedRowidsInTable:@"Item"], [self rowids:@[@3]]);
+    XCTAssertEqualObjects([changes deletedRowidsInTable:@"Other"], [self rowids:@[@1]]);
+    XCTAssertEqualObjects([changes insertedRowidsInTable:@"Missing"], [NSSet set]);
+    XCTAssertFalse([changes containsTable:@"Missing"]);
+}
+
+- (void)testEachCommitPublishesOnce{
+    [_tracker rowDidChangeInTable:@"Item" rowid:1 operation:SQLITE_INSERT];
+    [_tracker transactionDidCommit];
+    [_tracker rowDidChangeInTable:@"Item" rowid:1 operation:SQLITE_UPDATE];
+    [_tracker transactionDidCommit];
+    //没有修改的事务、修改相互抵消的事务不发布
+    [_tracker transactionDidCommit];
+    [_tracker rowDidChangeInTable:@"Item" rowid:2 operation:SQLITE_INSERT];
+    [_tracker rowDidChangeInTable:@"Item" rowid:2 operation:SQLITE_DELETE];
+    [_tracker transactionDidCommit];
+
+    NSArray<DatabaseChangeSet *> *changeSets = [self publishedChangeSets];
+    XCTAssertEqual(changeSets.count, 2);
+    XCTAssertEqualObjects([changeSets[0] insertedRowidsInTable:@"Item"], [self rowids:@[@1]]);
+    XCTAssertEqualObjects([changeSets[1] updatedRowidsInTable:@"Item"], [self rowids:@[@1]]);
+}
+
+- (void)testRollbackDiscardsChanges{
+    [_tracker rowDidChangeInTable:@"Item" rowid:1 operation:SQLITE_INSERT];
+    [_tracker transactionDidRollback];
+    [_tracker transactionDidCommit];
+    XCTAssertEqual([self publishedChangeSets].count, 0);
+
+    //回滚到保存点：只丢弃保存点之后的记录
+    [_tracker rowDidChangeInTable:@"Item" rowid:1 operation:SQLITE_INSERT];
+    NSUInteger mark = [_tracker savepointMark];
+    [_tracker rowDidChangeInTable:@"Item" rowid:2 operation:SQLITE_INSERT];
+    [_tracker rowDidChangeInTable:@"Item" rowid:1 operation:SQLITE_DELETE];
+    [_tracker rollbackToSavepointMark:mark];
+    [_tracker transactionDidCommit];
+    NSArray<DatabaseChangeSet *> *changeSets = [self publishedChangeSets];
+    XCTAssertEqual(changeSets.count, 1);
+    XCTAssertEqualObjects([changeSets.firstObject insertedRowidsInTable:@"Item"], [self rowids:@[@1]]);
+    XCTAssertEqualObjects([changeSets.firstObject deletedRowidsInTable:@"Item"], [NSSet set]);
+}
+
+- (void)testTableFilter{
+    NSMutableArray<DatabaseChangeSet *> *itemChangeSets = [NSMutableArray array];
+    DatabaseChangeObservation *observation = [self observeTables:[NSSet setWithObject:@"Item"] into:itemChangeSets];
+
+    [_tracker rowDidChangeInTable:@"Other" rowid:1 operation:SQLITE_INSERT];
+    [_tracker transactionDidCommit];
+    [_tracker rowDidChangeInTable:@"Item" rowid:1 operation:SQLITE_INSERT];
+    [_tracker transactionDidCommit];
+    //清空数据库时总是回调
+    [_tracker publishResetTables:nil];
+    [self publishedChangeSets];
+    XCTAssertEqual(itemChangeSets.count, 2);
+    XCTAssertTrue([itemChangeSets[0] containsTable:@"Item"]);
+    XCTAssertTrue(itemChangeSets[1].resetsAllTables);
+    XCTAssertTrue([itemChangeSets[1] isResetTable:@"Item"]);
+
+    //移除之后不再回调
+    [observation invalidate];
+    [_tracker rowDidChangeInTable:@"Item" rowid:2 operation:SQLITE_INSERT];
+    [_tracker transactionDidCommit];
+    [self publishedChangeSets];
+    XCTAssertEqual(itemChangeSets.count, 2);
+    XCTAssertEqual(_changeSets.count, 4);
+}
+
+- (void)testPublishResetTables{
+    [_tracker publishResetTables:[NSSet setWithObject:@"Item"]];
+    NSArray<DatabaseChangeSet *> *changeSets = [self publishedChangeSets];
+    XCTAssertEqual(changeSets.count, 1);
+    XCTAssertFalse(changeSets.firstObject.resetsAllTables);
+    XCTAssertTrue([changeSets.firstObject isResetTable:@"Item"]);
+    XCTAssertFalse([changeSets.firstObject isResetTable:@"Other"]);
+    XCTAssertEqualObjects(changeSets.firstObject.tableNames, [NSSet setWithObject:@"Item"]);
+}
+
+- (void)testNoObserversRecordsNothing{
+    [_observation invalidate];
+    [_tracker rowDidChangeInTable:@"Item" rowid:1 operation:SQLITE_INSERT];
+    XCTAssertEqual([_tracker savepointMark], 0);
+    _observation = [self observeTables:nil into:_changeSets];
+    [_tracker transactionDidCommit];
+    XCTAssertEqual([self publishedChangeSets].count, 0);
+}
+
+@end
@@ -0,0 +1,126 @@
+//
+//  DatabaseCheckpointSchedulerTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <sqlite3.h>
+#import "DatabaseCheckpointScheduler.h"
+#import "FMDatabaseAdditions.h"
+
+@interface DatabaseCheckpointSchedulerTests : XCTestCase
+{
+    NSString *_path;
+    DatabaseScheduler *_scheduler;
+    DatabaseCheckpointScheduler *_checkpointScheduler;
+}
+@end
+
+@implementation DatabaseCheckpointSchedulerTests
+
+- (void)setUp{
+    _path = [NSTemporaryDirectory() stringByAppendingPathComponent:NSUUID.UUID.UUIDString];
+    FMDatabaseQueue *writeQueue = [FMDatabaseQueue databaseQueueWithPath:_path];
+    [writeQueue inDatabase:^(FMDatabase *db) {
+        XCTAssertTrue([db executeStatements:@"PRAGMA journal_mode = WAL"]);
+        XCTAssertTrue([db executeUpdate:@"CREATE TABLE Item (id INTEGER PRIMARY KEY,content BLOB)"]);
+    }];
+    FMDatabaseQueue *readQueue = [[FMDatabaseQueue alloc] initWithPath:_path flags:SQLITE_OPEN_READONLY];
+    FMDatabaseQueue *backgroundReadQueue = [[FMDatabaseQueue alloc] initWithPath:_path flags:SQLITE_OPEN_READONLY];
+    FMDatabaseQueue *checkpointQueue = [FMDatabaseQueue databaseQueueWithPath:_path];
+    _scheduler = [[DatabaseScheduler alloc] initWithWriteQueue:writeQueue readQueue:readQueue backgroundReadQueue:backgroundReadQueue];
+    _checkpointScheduler = [[DatabaseCheckpointScheduler alloc] initWithWriteQueue:writeQueue checkpointQueue:checkpointQueue scheduler:_scheduler];
+}
+
+- (void)tearDown{
+    _checkpointScheduler = nil;
+    _scheduler = nil;
+    for (NSString *suffix in @[@"", @"-wal", @"-shm"]) {
+        [NSFileManager.defaultManager removeItemAtPath:[_path stringByAppendingString:suffix] error:nil];
+    }
+}
+
+/** 每个事务写入一行 8KB 的数据：至少两个页
+ */
+- (void)commitTransactions:(NSUInteger)count{
+    NSData *content = [NSMutableData dataWithLength:8192];
+    for (NSUInteger i = 0; i < count; i++) {
+        [_scheduler.writeQueue inDatabase:^(FMDatabase *db) {
+            XCTAssertTrue([db executeUpdate:@"INSERT INTO Item (content) VALUES (?)",content]);
+        }];
+    }
+}
+
+- (unsigned long long)walFileSize{
+    return [NSFileManager.defaultManager attributesOfItemAtPath:[_path stringByAppendingString:@"-wal"] error:nil].fileSize;
+}
+
+- (void)testCommitsDoNotCheckpointAutomatically{
+    __block NSUInteger commitCount = 0;
+    _checkpointScheduler.commitHandler = ^{
+        commitCount++;
+    };
+    _checkpointScheduler.passivePageCount = 100000;
+    _checkpointScheduler.restartPageCount = 100000;
+    _checkpointScheduler.truncatePageCount = 100000;
+    //超过 SQLite 默认的自动检查点（1000 帧）
+    [self commitTransactions:600];
+    XCTAssertEqual(commitCount, 600);
+    XCTAssertNil(_checkpointScheduler.lastReport);
+    XCTAssertGreaterThan([self walFileSize], 1000 * 4096);
+}
+
+- (void)testPassiveCheckpointWaitsForIdle{
+    _checkpointScheduler.passivePageCount = 10;
+    _checkpointScheduler.idleInterval = 0.2;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"checkpoint"];
+    __block CFAbsoluteTime reportTime = 0;
+    _checkpointScheduler.reportHandler = ^(DatabaseCheckpointReport *report) {
+        reportTime = CFAbsoluteTimeGetCurrent();
+        [expectation fulfill];
+    };
+    [self commitTransactions:10];
+    CFAbsoluteTime commitTime = CFAbsoluteTimeGetCurrent();
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    DatabaseCheckpointReport *report = _checkpointScheduler.lastReport;
+    XCTAssertEqual(report.mode, FMDBCheckpointModePassive);
+    XCTAssertTrue(report.success);
+    XCTAssertGreaterThanOrEqual(report.walPageCount, 10);
+    XCTAssertEqual(report.checkpointCount, report.logFrameCount);
+    XCTAssertGreaterThanOrEqual(reportTime - commitTime, 0.15);
+}
+
+- (void)testRestartDoesNotWaitForIdle{
+    _checkpointScheduler.passivePageCount = 10;
+    _checkpointScheduler.restartPageCount = 10;
+    _checkpointScheduler.idleInterval = 60;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"checkpoint"];
+    _checkpointScheduler.reportHandler = ^(DatabaseCheckpointReport *report) {
+        [expectation fulfill];
+    };
+    [self commitTransactions:10];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual(_checkpointScheduler.lastReport.mode, FMDBCheckpointModeRestart);
+    XCTAssertTrue(_checkpointScheduler.lastReport.success);
+}
+
+- (void)testTruncateEmptiesWALFile{
+    _checkpointScheduler.passivePageCount = 100000;
+    [self commitTransactions:10];
+    XCTAssertGreaterThan([self walFileSize], 0);
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"checkpoint"];
+    _checkpointScheduler.reportHandler = ^(DatabaseCheckpointReport *report) {
+        [expectation fulfill];
+    };
+    [_checkpointScheduler checkpointWithMode:FMDBCheckpointModeTruncate];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertTrue(_checkpointScheduler.lastReport.success);
+    XCTAssertEqual([self walFileSize], 0);
+}
+
+@end
@@ -0,0 +1,107 @@
+//
+//  DatabaseExpiryTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "DatabaseStore.h"
+#import "FMDatabaseAdditions.h"
+
+@interface DatabaseExpiryTests : XCTestCase
+{
+    NSString *_directory;
+    DatabaseStore *_store;
+    DatabaseTableSchema *_cacheSchema;
+    DatabaseTableSchema *_plainSchema;
+}
+@end
+
+@implementation DatabaseExpiryTests
+
+- (void)setUp{
+    _directory = [NSTemporaryDirectory() stringByAppendingPathComponent:NSUUID.UUID.UUIDString];
+    [NSFileManager.defaultManager createDirectoryAtPath:_directory withIntermediateDirectories:YES attributes:nil error:nil];
+    _store = [[DatabaseStore alloc] initWithName:@"expiry_test" path:[_directory stringByAppendingPathComponent:@"expiry_test.sqlite"] profile:DatabaseStoreProfileReadWrite];
+    //有效期 1 天
+    _cacheSchema = [DatabaseTableSchema schemaWithTableName:@"Cache" version:1 createSQL:@"CREATE TABLE Cache (id INTEGER PRIMARY KEY,time TEXT DEFAULT CURRENT_TIMESTAMP)" migrations:nil expiryColumn:@"time" lifetime:86400];
+    _plainSchema = [DatabaseTableSchema schemaWithTableName:@"Plain" version:1 createSQL:@"CREATE TABLE Plain (id INTEGER PRIMARY KEY,time TEXT)" migrations:nil];
+    XCTAssertTrue([_store prepareSchemas:@[_cacheSchema, _plainSchema]]);
+}
+
+- (void)tearDown{
+    _store = nil;
+    [NSFileManager.defaultManager removeItemAtPath:_directory error:nil];
+}
+
+- (int)intForQuery:(NSString *)sql{
+    __block int value = 0;
+    [_store.writeQueue inDatabase:^(FMDatabase *db) {
+        value = [db intForQuery:sql];
+    }];
+    return value;
+}
+
+- (void)testClauses{
+    XCTAssertEqualObjects(_cacheSchema.expiryColumn, @"time");
+    XCTAssertEqualObjects(_cacheSchema.freshnessClause, @"time >= datetime('now','-86400 seconds')");
+    XCTAssertEqualObjects(_cacheSchema.expiredClause, @"time < datetime('now','-86400 seconds')");
+    XCTAssertEqualObjects(_cacheSchema.refreshClause, @"time < datetime('now','-43200 seconds')");
+
+    //没有声明有效期：不过滤任何行
+    XCTAssertNil(_plainSchema.expiryColumn);
+    XCTAssertNil(_plainSchema.expiryIndexSQL);
+    XCTAssertEqualObjects(_plainSchema.freshnessClause, @"1");
+    XCTAssertEqualObjects(_plainSchema.expiredClause, @"0");
+    XCTAssertEqualObjects(_plainSchema.refreshClause, @"0");
+
+    //有效期不大于 0 视为没有声明
+    DatabaseTableSchema *schema = [DatabaseTableSchema schemaWithTableName:@"Cache" version:1 createSQL:@"" migrations:nil expiryColumn:@"time" lifetime:0];
+    XCTAssertNil(schema.expiryColumn);
+    XCTAssertEqualObjects(schema.freshnessClause, @"1");
+}
+
+- (void)testExpiryIndexIsUsed{
+    XCTAssertEqual([self intForQuery:@"SELECT count(*) FROM sqlite_master WHERE type = 'index' AND name = 'Cache_time_expiry'"], 1);
+    __block NSString *detail = nil;
+    [_store.writeQueue inDatabase:^(FMDatabase *db) {
+        FMResultSet *resultSet = [db executeQuery:[NSString stringWithFormat:@"EXPLAIN QUERY PLAN SELECT id FROM Cache WHERE %@",self->_cacheSchema.freshnessClause]];
+        if ([resultSet next]) {
+            detail = [resultSet stringForColumn:@"detail"];
+        }
+        [resultSet close];
+    }];
+    XCTAssertTrue([detail containsString:@"Cache_time_expiry"], @"%@",detail);
+}
+
+- (void)testSweepDeletesExpiredRowsInBatches{
+    [_store databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        for (int i = 0; i < 25; i++) {
+            [database executeUpdate:@"INSERT INTO Cache (time) VALUES (datetime('now','-10 days'))"];
+            [database executeUpdate:@"INSERT INTO Plain (time) VALUES (datetime('now','-10 days'))"];
+        }
+        for (int i = 0; i < 5; i++) {
+            [database executeUpdate:@"INSERT INTO Cache DEFAULT VALUES"];
+        }
+    }];
+    XCTAssertEqual([self intForQuery:[NSString stringWithFormat:@"SELECT count(*) FROM Cache WHERE %@",_cacheSchema.expiredClause]], 25);
+
+    //每批最多 10 行，每批单独提交
+    DatabaseChangeObservation *observation = [_store addChangeObserverForTables:@[@"Cache"] queue:nil block:^(DatabaseChangeSet *changes) {
+        XCTAssertLessThanOrEqual([changes deletedRowidsInTable:@"Cache"].count, 10);
+    }];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"sweep"];
+    [_store sweepExpiredRowsInSchemas:@[_cacheSchema, _plainSchema] batchSize:10 completion:^(BOOL finished) {
+        XCTAssertTrue(finished);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    [observation invalidate];
+
+    XCTAssertEqual([self intForQuery:@"SELECT count(*) FROM Cache"], 5);
+    XCTAssertEqual([self intForQuery:@"SELECT count(*) FROM Plain"], 25);
+}
+
+@end
@@ -0,0 +1,115 @@
+//
+//  DatabaseIndexAdvisorTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "DatabaseIndexAdvisor.h"
+#import "DatabaseStore.h"
+#import "FMDatabaseAdditions.h"
+
+static NSString * const DatabaseIndexAdvisorTestsQuery = @"SELECT id, name FROM AdvisorItem WHERE category = ? ORDER BY name";
+
+@interface DatabaseIndexAdvisorTests : XCTestCase
+{
+    NSString *_directory;
+    DatabaseStore *_store;
+}
+@end
+
+@implementation DatabaseIndexAdvisorTests
+
+- (void)setUp{
+    _directory = [NSTemporaryDirectory() stringByAppendingPathComponent:NSUUID.UUID.UUIDString];
+    [NSFileManager.defaultManager createDirectoryAtPath:_directory withIntermediateDirectories:YES attributes:nil error:nil];
+    _store = [[DatabaseStore alloc] initWithName:@"advisor_test" path:[_directory stringByAppendingPathComponent:@"advisor_test.sqlite"] profile:DatabaseStoreProfileReadWrite];
+    [_store databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        [database executeUpdate:@"CREATE TABLE AdvisorItem (id INTEGER PRIMARY KEY,category TEXT,name TEXT)"];
+        for (int i = 0; i < 100; i++) {
+            [database executeUpdate:@"INSERT INTO AdvisorItem (category, name) VALUES (?, ?)",@(i % 10).stringValue,@(i).stringValue];
+        }
+    }];
+    [DatabaseIndexAdvisor removeAllRecordedStatements];
+}
+
+- (void)tearDown{
+    [DatabaseIndexAdvisor stopRecording];
+    [DatabaseIndexAdvisor removeAllRecordedStatements];
+    _store = nil;
+    [NSFileManager.defaultManager removeItemAtPath:_directory error:nil];
+}
+
+- (void)runQueries{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"read"];
+    [_store databaseChildThreadInRead:^(FMDatabase *database) {
+        for (NSString *category in @[@"1", @"2"]) {
+            FMResultSet *resultSet = [database executeQuery:DatabaseIndexAdvisorTestsQuery,category];
+            while ([resultSet next]) {}
+            [resultSet close];
+        }
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+- (void)testRecordsOnlyWhileRecording{
+    [self runQueries];
+    XCTAssertNil(DatabaseIndexAdvisor.recordedStatements[DatabaseIndexAdvisorTestsQuery]);
+
+    [DatabaseIndexAdvisor startRecording];
+    XCTAssertTrue(DatabaseIndexAdvisor.isRecording);
+    [self runQueries];
+    [_store databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        [database executeUpdate:@"INSERT INTO AdvisorItem (category, name) VALUES ('0', 'insert')"];
+    }];
+    [DatabaseIndexAdvisor stopRecording];
+    XCTAssertFalse(DatabaseIndexAdvisor.isRecording);
+    [self runQueries];
+
+    //同一条语句去重计数；插入不能从索引中受益，不记录
+    NSDictionary<NSString *, NSNumber *> *statements = DatabaseIndexAdvisor.recordedStatements;
+    XCTAssertEqualObjects(statements[DatabaseIndexAdvisorTestsQuery], @2);
+    for (NSString *sql in statements) {
+        XCTAssertFalse([sql hasPrefix:@"INSERT"], @"%@",sql);
+    }
+}
+
+- (void)testAnalyzeSuggestsIndex{
+    [DatabaseIndexAdvisor startRecording];
+    [self runQueries];
+    [DatabaseIndexAdvisor stopRecording];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"analyze"];
+    __block NSArray<DatabaseIndexAdvice *> *advices = nil;
+    [DatabaseIndexAdvisor analyzeStore:_store completion:^(NSArray<DatabaseIndexAdvice *> *result) {
+        XCTAssertTrue(NSThread.isMainThread);
+        advices = result;
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    //其它表的语句在这个数据库中无法编译，被跳过
+    NSUInteger index = [advices indexOfObjectPassingTest:^BOOL(DatabaseIndexAdvice *advice, NSUInteger idx, BOOL *stop) {
+        return [advice.sql isEqualToString:DatabaseIndexAdvisorTestsQuery];
+    }];
+    XCTAssertNotEqual(index, NSNotFound);
+    DatabaseIndexAdvice *advice = advices[index];
+    XCTAssertEqualObjects(advice.storeName, @"advisor_test");
+    XCTAssertEqual(advice.executionCount, 2);
+    XCTAssertEqual(advice.indexes.count, 1);
+    XCTAssertTrue([advice.indexes.firstObject hasPrefix:@"CREATE INDEX"]);
+    XCTAssertTrue([advice.indexes.firstObject containsString:@"category"]);
+    //全表扫描与排序的临时 B 树被索引取代
+    XCTAssertGreaterThan(advice.costBefore, advice.costAfter);
+    XCTAssertTrue([[DatabaseIndexAdvisor reportWithAdvices:advices] containsString:advice.indexes.firstObject]);
+
+    //分析不修改数据库
+    [_store.writeQueue inDatabase:^(FMDatabase *db) {
+        XCTAssertEqual([db intForQuery:@"SELECT count(*) FROM sqlite_master WHERE type = 'index'"], 0);
+    }];
+}
+
+@end
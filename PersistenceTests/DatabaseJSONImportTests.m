@@ -0,0 +1,170 @@
+//
+//  DatabaseJSONImportTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "DatabaseJSONRowReader.h"
+#import "DatabaseJSONImporter.h"
+#import "DatabaseStore.h"
+#import "FMDatabaseAdditions.h"
+
+@interface DatabaseJSONImportTests : XCTestCase
+{
+    NSString *_directory;
+}
+@end
+
+@implementation DatabaseJSONImportTests
+
+- (void)setUp{
+    _directory = [NSTemporaryDirectory() stringByAppendingPathComponent:NSUUID.UUID.UUIDString];
+    [NSFileManager.defaultManager createDirectoryAtPath:_directory withIntermediateDirectories:YES attributes:nil error:nil];
+}
+
+- (void)tearDown{
+    [NSFileManager.defaultManager removeItemAtPath:_directory error:nil];
+}
+
+- (NSString *)writeJSON:(NSString *)json{
+    NSString *path = [_directory stringByAppendingPathComponent:[NSUUID.UUID.UUIDString stringByAppendingPathExtension:@"json"]];
+    XCTAssertTrue([json writeToFile:path atomically:YES encoding:NSUTF8StringEncoding error:nil]);
+    return path;
+}
+
+- (NSString *)cityJSON{
+    return @"[{\"code\":\"110000\",\"name\":\"北京市\",\"list\":[{\"code\":\"110100\",\"name\":\"市辖区\",\"list\":[]}]},"
+    @" {\"code\":\"120000\",\"name\":\"天津市\",\"list\":[{\"code\":\"120100\",\"name\":\"市辖区\"}]}]";
+}
+
+- (NSArray<NSDictionary<NSString *, NSString *> *> *)readObjectsAtPath:(NSString *)path bufferSize:(NSUInteger)bufferSize reader:(DatabaseJSONRowReader **)outReader result:(BOOL *)result{
+    DatabaseJSONRowReader *reader = [[DatabaseJSONRowReader alloc] initWithPath:path];
+    if (bufferSize) {
+        reader.bufferSize = bufferSize;
+    }
+    NSMutableArray<NSDictionary<NSString *, NSString *> *> *objects = [NSMutableArray array];
+    *result = [reader readObjects:^(NSDictionary<NSString *,NSString *> *object, BOOL *stop) {
+        [objects addObject:object];
+    }];
+    if (outReader) {
+        *outReader = reader;
+    }
+    return objects;
+}
+
+- (void)testReaderFlattensObjects{
+    NSString *path = [self writeJSON:@"{\"name\":\"a\\\"b\\n\\u4e2d\",\"count\":-1.5e2,\"open\":true,\"closed\":false,\"none\":null,\"child\":{\"code\":\"1\"},\"empty\":{}}"];
+    BOOL result = NO;
+    NSArray<NSDictionary<NSString *, NSString *> *> *objects = [self readObjectsAtPath:path bufferSize:0 reader:NULL result:&result];
+    XCTAssertTrue(result);
+    //子对象先于父对象回调；数字保留原文，布尔值为 1、0，null 与空对象被忽略
+    XCTAssertEqualObjects(objects, (@[
+        @{@"code" : @"1"},
+        @{@"name" : @"a\"b\n中", @"count" : @"-1.5e2", @"open" : @"1", @"closed" : @"0"},
+    ]));
+}
+
+- (void)testSmallBufferReadsSameObjects{
+    NSMutableString *json = [NSMutableString stringWithString:@"["];
+    for (int i = 0; i < 200; i++) {
+        [json appendFormat:@"%@{\"code\":\"%d\",\"name\":\"城市%d\"}",i ? @"," : @"",i,i];
+    }
+    [json appendString:@"]"];
+    NSString *path = [self writeJSON:json];
+
+    //最小的缓冲区（64 字节）：字符串、数字、多字节字符跨越缓冲区边界
+    BOOL result = NO;
+    NSArray *objects = [self readObjectsAtPath:path bufferSize:1 reader:NULL result:&result];
+    XCTAssertTrue(result);
+    XCTAssertEqual(objects.count, 200);
+    XCTAssertEqualObjects(objects, [self readObjectsAtPath:path bufferSize:0 reader:NULL result:&result]);
+    XCTAssertEqualObjects(objects.lastObject, (@{@"code" : @"199", @"name" : @"城市199"}));
+}
+
+- (void)testStopAndMalformedInput{
+    DatabaseJSONRowReader *reader = [[DatabaseJSONRowReader alloc] initWithPath:[self writeJSON:[self cityJSON]]];
+    __block NSUInteger count = 0;
+    XCTAssertFalse([reader readObjects:^(NSDictionary<NSString *,NSString *> *object, BOOL *stop) {
+        count++;
+        *stop = YES;
+    }]);
+    XCTAssertEqual(count, 1);
+    XCTAssertNil(reader.error);
+
+    for (NSString *json in @[@"[{\"code\":\"1\"}", @"{\"code\" \"1\"}", @"{\"code\":\"\\x\"}", @"[1] 2", @"{\"code\":tru}"]) {
+        BOOL result = YES;
+        [self readObjectsAtPath:[self writeJSON:json] bufferSize:0 reader:&reader result:&result];
+        XCTAssertFalse(result, @"%@",json);
+        XCTAssertNotNil(reader.error, @"%@",json);
+    }
+
+    BOOL result = YES;
+    [self readObjectsAtPath:[_directory stringByAppendingPathComponent:@"missing.json"] bufferSize:0 reader:&reader result:&result];
+    XCTAssertFalse(result);
+    XCTAssertNotNil(reader.error);
+}
+
+- (void)testImportIsIdempotent{
+    DatabaseStore *store = [[DatabaseStore alloc] initWithName:@"import_test" path:[_directory stringByAppendingPathComponent:@"import_test.sqlite"] profile:DatabaseStoreProfileReadWrite];
+    [store databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        [database executeUpdate:@"CREATE TABLE City (id INTEGER PRIMARY KEY,code TEXT UNIQUE,name TEXT)"];
+    }];
+    NSString *path = [self writeJSON:[self cityJSON]];
+
+    //每组一行、每次提交一组：多个批次
+    DatabaseJSONImporter *importer = [[DatabaseJSONImporter alloc] initWithPath:path tableName:@"City" uniqueColumn:@"code" columnsForKeys:@{@"code" : @"code", @"name" : @"name"}];
+    importer.batchSize = 1;
+    importer.batchesPerCommit = 1;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"import"];
+    [importer importIntoStore:store completion:^(BOOL success, NSUInteger rowCount) {
+        XCTAssertTrue(success);
+        XCTAssertEqual(rowCount, 4);
+        XCTAssertTrue(NSThread.isMainThread);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    __block int totalChanges = 0;
+    [store.writeQueue inDatabase:^(FMDatabase *db) {
+        XCTAssertEqual([db intForQuery:@"SELECT count(*) FROM City"], 4);
+        XCTAssertEqualObjects([db stringForQuery:@"SELECT name FROM City WHERE code = '120000'"], @"天津市");
+        totalChanges = [db intForQuery:@"SELECT total_changes()"];
+    }];
+
+    //再次导入同一个文件：内容相同的行不写入
+    expectation = [self expectationWithDescription:@"import again"];
+    [importer importIntoStore:store completion:^(BOOL success, NSUInteger rowCount) {
+        XCTAssertTrue(success);
+        XCTAssertEqual(rowCount, 4);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+    [store.writeQueue inDatabase:^(FMDatabase *db) {
+        XCTAssertEqual([db intForQuery:@"SELECT count(*) FROM City"], 4);
+        XCTAssertEqual([db intForQuery:@"SELECT total_changes()"], totalChanges);
+    }];
+}
+
+- (void)testImportFailureKeepsCommittedBatches{
+    DatabaseStore *store = [[DatabaseStore alloc] initWithName:@"import_test" path:[_directory stringByAppendingPathComponent:@"import_test.sqlite"] profile:DatabaseStoreProfileReadWrite];
+    [store databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        [database executeUpdate:@"CREATE TABLE City (id INTEGER PRIMARY KEY,code TEXT UNIQUE,name TEXT)"];
+    }];
+    //格式错误出现在第二个对象之后
+    NSString *path = [self writeJSON:@"[{\"code\":\"1\",\"name\":\"a\"},{\"code\":\"2\",\"name\":\"b\"},{\"code\":"];
+    DatabaseJSONImporter *importer = [[DatabaseJSONImporter alloc] initWithPath:path tableName:@"City" uniqueColumn:@"code" columnsForKeys:@{@"code" : @"code", @"name" : @"name"}];
+    importer.batchSize = 1;
+    importer.batchesPerCommit = 1;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"import"];
+    [importer importIntoStore:store completion:^(BOOL success, NSUInteger rowCount) {
+        XCTAssertFalse(success);
+        XCTAssertLessThanOrEqual(rowCount, 2);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+}
+
+@end
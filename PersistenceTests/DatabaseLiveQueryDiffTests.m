@@ -0,0 +1,132 @@
+//
+//  DatabaseLiveQueryDiffTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "DatabaseLiveQuery.h"
+
+/** DatabaseLiveQuery.m 中比较两次结果的方法；每一行是 DatabaseLiveQueryRow 的实例，只有实例变量，通过 KVC 赋值
+ */
+@interface DatabaseLiveQueryDiff (Testing)
++ (instancetype)diffWithOldRows:(NSArray *)oldRows newRows:(NSArray *)newRows;
+@end
+
+@interface DatabaseLiveQueryDiffTests : XCTestCase
+@end
+
+@implementation DatabaseLiveQueryDiffTests
+
+/** 每一项为 "标识" 或 "标识:内容"，没有内容时内容与标识相同
+ */
++ (NSArray *)rows:(NSArray<NSString *> *)items{
+    Class rowClass = NSClassFromString(@"DatabaseLiveQueryRow");
+    NSMutableArray *rows = [NSMutableArray arrayWithCapacity:items.count];
+    for (NSString *item in items) {
+        NSArray<NSString *> *parts = [item componentsSeparatedByString:@":"];
+        NSObject *row = [[rowClass alloc] init];
+        [row setValue:parts.firstObject forKey:@"identity"];
+        [row setValue:parts.lastObject forKey:@"content"];
+        [row setValue:item forKey:@"object"];
+        [rows addObject:row];
+    }
+    return rows;
+}
+
++ (DatabaseLiveQueryDiff *)diffFrom:(NSArray<NSString *> *)oldItems to:(NSArray<NSString *> *)newItems{
+    return [DatabaseLiveQueryDiff diffWithOldRows:[self rows:oldItems] newRows:[self rows:newItems]];
+}
+
++ (NSArray<NSString *> *)moves:(DatabaseLiveQueryDiff *)diff{
+    NSMutableArray<NSString *> *moves = [NSMutableArray array];
+    for (DatabaseLiveQueryMove *move in diff.moves) {
+        [moves addObject:[NSString stringWithFormat:@"%lu->%lu",(unsigned long)move.fromIndex,(unsigned long)move.toIndex]];
+    }
+    return moves;
+}
+
++ (NSIndexSet *)indexes:(NSArray<NSNumber *> *)indexes{
+    NSMutableIndexSet *set = [NSMutableIndexSet indexSet];
+    for (NSNumber *index in indexes) {
+        [set addIndex:index.unsignedIntegerValue];
+    }
+    return set;
+}
+
+- (void)testNoChanges{
+    DatabaseLiveQueryDiff *diff = [self.class diffFrom:@[@"a", @"b", @"c"] to:@[@"a", @"b", @"c"]];
+    XCTAssertFalse(diff.hasChanges);
+    XCTAssertFalse([self.class diffFrom:@[] to:@[]].hasChanges);
+}
+
+- (void)testInsertAndRemoveDoNotProduceMoves{
+    //删除、插入造成的位置变化不算移动
+    DatabaseLiveQueryDiff *diff = [self.class diffFrom:@[@"a", @"b", @"c", @"d"] to:@[@"x", @"b", @"d", @"y"]];
+    XCTAssertEqualObjects(diff.removedIndexes, ([self.class indexes:@[@0, @2]]));
+    XCTAssertEqualObjects(diff.insertedIndexes, ([self.class indexes:@[@0, @3]]));
+    XCTAssertEqualObjects([self.class moves:diff], @[]);
+    XCTAssertEqual(diff.updatedIndexes.count, 0);
+
+    diff = [self.class diffFrom:@[] to:@[@"a", @"b"]];
+    XCTAssertEqualObjects(diff.insertedIndexes, ([self.class indexes:@[@0, @1]]));
+    diff = [self.class diffFrom:@[@"a", @"b"] to:@[]];
+    XCTAssertEqualObjects(diff.removedIndexes, ([self.class indexes:@[@0, @1]]));
+    XCTAssertEqualObjects([self.class moves:diff], @[]);
+}
+
+- (void)testUpdatesUseOldIndexes{
+    DatabaseLiveQueryDiff *diff = [self.class diffFrom:@[@"r", @"a:1", @"b:1"] to:@[@"a:2", @"b:1"]];
+    XCTAssertEqualObjects(diff.removedIndexes, [NSIndexSet indexSetWithIndex:0]);
+    XCTAssertEqualObjects(diff.updatedIndexes, [NSIndexSet indexSetWithIndex:1]);
+    XCTAssertEqualObjects([self.class moves:diff], @[]);
+    XCTAssertEqual(diff.insertedIndexes.count, 0);
+}
+
+- (void)testMoves{
+    //只移动不在最长递增子序列中的行
+    DatabaseLiveQueryDiff *diff = [self.class diffFrom:@[@"a", @"b", @"c"] to:@[@"c", @"a", @"b"]];
+    XCTAssertEqual(diff.removedIndexes.count, 0);
+    XCTAssertEqual(diff.insertedIndexes.count, 0);
+    XCTAssertEqualObjects([self.class moves:diff], @[@"2->0"]);
+
+    diff = [self.class diffFrom:@[@"a", @"b", @"c", @"d", @"e"] to:@[@"b", @"c", @"d", @"e", @"a"]];
+    XCTAssertEqualObjects([self.class moves:diff], @[@"0->4"]);
+
+    //交换两行：一次移动
+    diff = [self.class diffFrom:@[@"a", @"b"] to:@[@"b", @"a"]];
+    XCTAssertEqual([self.class moves:diff].count, 1);
+    XCTAssertEqual(diff.updatedIndexes.count, 0);
+}
+
+- (void)testMoveAndUpdateDoNotOverlap{
+    //b 的内容变化但相对顺序不变：只是更新；c 只移动
+    DatabaseLiveQueryDiff *diff = [self.class diffFrom:@[@"a", @"b:1", @"c", @"d"] to:@[@"a", @"c", @"e", @"b:2"]];
+    XCTAssertEqualObjects(diff.removedIndexes, [NSIndexSet indexSetWithIndex:3]);
+    XCTAssertEqualObjects(diff.insertedIndexes, [NSIndexSet indexSetWithIndex:2]);
+    XCTAssertEqualObjects([self.class moves:diff], @[@"2->1"]);
+    XCTAssertEqualObjects(diff.updatedIndexes, [NSIndexSet indexSetWithIndex:1]);
+
+    //移动且内容变化：表现为移除与新增
+    diff = [self.class diffFrom:@[@"a", @"b", @"c:1"] to:@[@"c:2", @"a", @"b"]];
+    XCTAssertEqualObjects(diff.removedIndexes, [NSIndexSet indexSetWithIndex:2]);
+    XCTAssertEqualObjects(diff.insertedIndexes, [NSIndexSet indexSetWithIndex:0]);
+    XCTAssertEqualObjects([self.class moves:diff], @[]);
+    XCTAssertEqual(diff.updatedIndexes.count, 0);
+}
+
+- (void)testDuplicateIdentitiesMatchInOrder{
+    DatabaseLiveQueryDiff *diff = [self.class diffFrom:@[@"a:1", @"a:2", @"b"] to:@[@"a:1", @"b"]];
+    XCTAssertEqualObjects(diff.removedIndexes, [NSIndexSet indexSetWithIndex:1]);
+    XCTAssertEqual(diff.insertedIndexes.count, 0);
+    XCTAssertEqualObjects([self.class moves:diff], @[]);
+    XCTAssertEqual(diff.updatedIndexes.count, 0);
+
+    diff = [self.class diffFrom:@[@"a:1"] to:@[@"a:1", @"a:2"]];
+    XCTAssertEqualObjects(diff.insertedIndexes, [NSIndexSet indexSetWithIndex:1]);
+    XCTAssertEqual(diff.removedIndexes.count, 0);
+}
+
+@end
@@ -0,0 +1,89 @@
+//
+//  DatabaseModelLookupTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "FMDatabase.h"
+#import "FMDatabaseAdditions.h"
+#import "DatabaseSchema.h"
+#import "DatabaseModelMapping.h"
+#import "ProvincesModel+DAO.h"
+
+@interface DatabaseModelLookupTests : XCTestCase
+{
+    FMDatabase *_database;
+    DatabaseModelMapping *_mapping;
+}
+@end
+
+@implementation DatabaseModelLookupTests
+
+- (void)setUp{
+    _database = [FMDatabase databaseWithPath:nil];
+    XCTAssertTrue([_database open]);
+    XCTAssertTrue([_database executeUpdate:ProvincesModel.tableSchema.createSQL]);
+    _mapping = [DatabaseModelMapping mappingForClass:ProvincesModel.class];
+    for (int i = 0; i < 2000; i++) {
+        ProvincesModel *model = [[ProvincesModel alloc] init];
+        model.regionId = @(100000 + i).stringValue;
+        model.regionName = [NSString stringWithFormat:@"地区%d",i];
+        model.regionType = @(i % 3).stringValue;
+        model.parentId = @"0";
+        XCTAssertTrue([_mapping insertModel:model replace:NO inDatabase:_database]);
+    }
+}
+
+- (void)tearDown{
+    [_database close];
+    _database = nil;
+}
+
+- (void)testMissingKeysAreOmitted{
+    NSMutableDictionary *models = [_mapping modelsInDatabase:_database uniqueValues:@[@"100001", @"999999", @"100002", @"100001"] extraClause:nil rowids:nil];
+    XCTAssertEqualObjects([NSSet setWithArray:models.allKeys], ([NSSet setWithObjects:@"100001", @"100002", nil]));
+    ProvincesModel *model = models[@"100002"];
+    XCTAssertEqualObjects(model.regionName, @"地区2");
+    XCTAssertEqual([_mapping modelsInDatabase:_database uniqueValues:@[] extraClause:nil rowids:nil].count, 0);
+}
+
+- (void)testNumbersMatchStringColumn{
+    //json_each 返回的值不按列的类型转换：字符串属性的唯一键，数字按字符串比较
+    NSMutableDictionary *models = [_mapping modelsInDatabase:_database uniqueValues:@[@100003, @"100004"] extraClause:nil rowids:nil];
+    XCTAssertEqual(models.count, 2);
+    XCTAssertEqualObjects([models[@"100003"] regionName], @"地区3");
+}
+
+- (void)testRowidsAndExtraClause{
+    NSMutableDictionary<id, NSNumber *> *rowids = [NSMutableDictionary dictionary];
+    NSMutableDictionary *models = [_mapping modelsInDatabase:_database uniqueValues:@[@"100000", @"100001", @"100002"] extraClause:@"regionType = '1'" rowids:rowids];
+    XCTAssertEqualObjects(models.allKeys, @[@"100001"]);
+    XCTAssertEqualObjects(rowids.allKeys, @[@"100001"]);
+    XCTAssertEqual(rowids[@"100001"].longLongValue, [_database longForQuery:@"SELECT id FROM ProvincesModel WHERE regionId = '100001'"]);
+}
+
+- (void)testManyKeysInOneStatement{
+    NSMutableArray<NSString *> *keys = [NSMutableArray array];
+    for (int i = 0; i < 1000; i++) {
+        [keys addObject:@(100000 + i * 2).stringValue];
+    }
+    //键的个数不受绑定参数个数的限制
+    NSMutableDictionary *models = [_mapping modelsInDatabase:_database uniqueValues:keys extraClause:nil rowids:nil];
+    XCTAssertEqual(models.count, 1000);
+    XCTAssertEqualObjects([models[@"101998"] regionName], @"地区1998");
+
+    //按唯一索引逐个查找，不扫描整张表
+    NSString *sql = [NSString stringWithFormat:@"EXPLAIN QUERY PLAN %@ WHERE regionId IN (SELECT value FROM json_each(?))",_mapping.selectSQL];
+    FMResultSet *resultSet = [_database executeQuery:sql,@"[]"];
+    NSMutableArray<NSString *> *plan = [NSMutableArray array];
+    while ([resultSet next]) {
+        [plan addObject:[resultSet stringForColumn:@"detail"]];
+    }
+    [resultSet close];
+    XCTAssertFalse([[plan componentsJoinedByString:@"\n"] containsString:@"SCAN ProvincesModel"], @"%@",plan);
+}
+
+@end
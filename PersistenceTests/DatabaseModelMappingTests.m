@@ -0,0 +1,194 @@
+//
+//  DatabaseModelMappingTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "FMDatabase.h"
+#import "FMDatabaseAdditions.h"
+#import "DatabaseSchema.h"
+#import "DatabaseModelMapping.h"
+#import "ProvincesModel+DAO.h"
+
+@interface DatabaseModelMappingTests : XCTestCase
+{
+    FMDatabase *_database;
+    DatabaseModelMapping *_mapping;
+}
+@end
+
+@implementation DatabaseModelMappingTests
+
+- (void)setUp{
+    _database = [FMDatabase databaseWithPath:nil];
+    XCTAssertTrue([_database open]);
+    XCTAssertTrue([_database executeUpdate:ProvincesModel.tableSchema.createSQL]);
+    _mapping = [DatabaseModelMapping mappingForClass:ProvincesModel.class];
+}
+
+- (void)tearDown{
+    [_database close];
+    _database = nil;
+}
+
+- (ProvincesModel *)modelWithRegionId:(NSString *)regionId{
+    ProvincesModel *model = [[ProvincesModel alloc] init];
+    model.regionId = regionId;
+    model.regionName = @"北京";
+    model.regionType = @"1";
+    model.parentId = @"0";
+    return model;
+}
+
+- (NSString *)column:(NSString *)column regionId:(NSString *)regionId{
+    NSString *sql = [NSString stringWithFormat:@"SELECT %@ FROM ProvincesModel WHERE regionId = ?",column];
+    return [_database stringForQuery:sql, regionId];
+}
+
+/** 从数据库读取的模型：以读取时的值为基准
+ */
+- (ProvincesModel *)readModelWithRegionId:(NSString *)regionId{
+    return [_mapping modelsInDatabase:_database where:@"regionId = ?" arguments:@[regionId]].firstObject;
+}
+
+#pragma mark - upsert
+
+- (void)testUpsertClassification{
+    ProvincesModel *model = [self modelWithRegionId:@"110000"];
+    XCTAssertEqual([_mapping upsertModel:model schema:nil inDatabase:_database], DatabaseUpsertResultInserted);
+    long rowid = [_database longForQuery:@"SELECT id FROM ProvincesModel WHERE regionId = ?", @"110000"];
+
+    //内容相同：不写入
+    XCTAssertEqual([_mapping upsertModel:model schema:nil inDatabase:_database], DatabaseUpsertResultUnchanged);
+    XCTAssertEqual([_mapping upsertModel:[self modelWithRegionId:@"110000"] schema:nil inDatabase:_database], DatabaseUpsertResultUnchanged);
+
+    //内容变化：原地更新，rowid 不变
+    model.regionName = @"北京市";
+    XCTAssertEqual([_mapping upsertModel:model schema:nil inDatabase:_database], DatabaseUpsertResultUpdated);
+    XCTAssertEqualObjects([self column:@"regionName" regionId:@"110000"], @"北京市");
+    XCTAssertEqual([_database longForQuery:@"SELECT id FROM ProvincesModel WHERE regionId = ?", @"110000"], rowid);
+
+    //改为 NULL 同样是变化
+    model.agencyId = nil;
+    model.parentId = nil;
+    XCTAssertEqual([_mapping upsertModel:model schema:nil inDatabase:_database], DatabaseUpsertResultUpdated);
+    XCTAssertNil([self column:@"parentId" regionId:@"110000"]);
+    XCTAssertEqual([_mapping upsertModel:model schema:nil inDatabase:_database], DatabaseUpsertResultUnchanged);
+
+    //之前的插入不影响之后的分类
+    XCTAssertEqual([_mapping upsertModel:[self modelWithRegionId:@"120000"] schema:nil inDatabase:_database], DatabaseUpsertResultInserted);
+    XCTAssertEqual([_mapping upsertModel:model schema:nil inDatabase:_database], DatabaseUpsertResultUnchanged);
+    XCTAssertEqual([_database intForQuery:@"SELECT count(*) FROM ProvincesModel"], 2);
+}
+
+- (void)testUpsertFailure{
+    ProvincesModel *model = [self modelWithRegionId:@"110000"];
+    XCTAssertTrue([_database executeUpdate:@"DROP TABLE ProvincesModel"]);
+    XCTAssertEqual([_mapping upsertModel:model schema:nil inDatabase:_database], DatabaseUpsertResultFailed);
+}
+
+#pragma mark - 修改记录与最小的 UPDATE
+
+- (void)testUpdateWritesOnlyChangedColumns{
+    XCTAssertTrue([_mapping insertModel:[self modelWithRegionId:@"110000"] replace:NO inDatabase:_database]);
+    ProvincesModel *model = [self readModelWithRegionId:@"110000"];
+    XCTAssertEqualObjects([_mapping changedPropertiesForModel:model], @[]);
+    XCTAssertEqual([_mapping changesOfModel:model], 0ULL);
+
+    //其它连接修改了 parentId；只修改地区名称的 UPDATE 不能覆盖它
+    XCTAssertTrue([_database executeUpdate:@"UPDATE ProvincesModel SET parentId = 'other' WHERE regionId = '110000'"]);
+    model.regionName = @"北京市";
+    XCTAssertEqualObjects([_mapping changedPropertiesForModel:model], @[@"regionName"]);
+    XCTAssertTrue([_mapping updateModel:model inDatabase:_database]);
+    XCTAssertEqualObjects([self column:@"regionName" regionId:@"110000"], @"北京市");
+    XCTAssertEqualObjects([self column:@"parentId" regionId:@"110000"], @"other");
+    XCTAssertEqualObjects([self column:@"regionType" regionId:@"110000"], @"1");
+
+    //多列：只写入这两列
+    XCTAssertTrue([_database executeUpdate:@"UPDATE ProvincesModel SET regionName = 'other' WHERE regionId = '110000'"]);
+    [_mapping commitChanges:[_mapping changesOfModel:model] ofModel:model];
+    model.regionType = @"2";
+    model.agencyId = @"86";
+    XCTAssertEqualObjects([NSSet setWithArray:[_mapping changedPropertiesForModel:model]], ([NSSet setWithArray:@[@"regionType", @"agencyId"]]));
+    XCTAssertTrue([_mapping updateModel:model inDatabase:_database]);
+    XCTAssertEqualObjects([self column:@"regionType" regionId:@"110000"], @"2");
+    XCTAssertEqualObjects([self column:@"agencyId" regionId:@"110000"], @"86");
+    XCTAssertEqualObjects([self column:@"regionName" regionId:@"110000"], @"other");
+}
+
+- (void)testUpdateWithoutChangesExecutesNothing{
+    XCTAssertTrue([_mapping insertModel:[self modelWithRegionId:@"110000"] replace:NO inDatabase:_database]);
+    ProvincesModel *model = [self readModelWithRegionId:@"110000"];
+    XCTAssertTrue([_database executeUpdate:@"UPDATE ProvincesModel SET regionName = 'other' WHERE regionId = '110000'"]);
+    int changes = [_database intForQuery:@"SELECT total_changes()"];
+    XCTAssertTrue([_mapping updateModel:model inDatabase:_database]);
+    XCTAssertEqual([_database intForQuery:@"SELECT total_changes()"], changes);
+    XCTAssertEqualObjects([self column:@"regionName" regionId:@"110000"], @"other");
+
+    //写入后提交修改记录：再次更新不执行语句
+    model.regionName = @"北京市";
+    uint64_t changesMask = [_mapping changesOfModel:model];
+    XCTAssertTrue([_mapping updateModel:model inDatabase:_database]);
+    [_mapping commitChanges:changesMask ofModel:model];
+    XCTAssertEqualObjects([_mapping changedPropertiesForModel:model], @[]);
+    changes = [_database intForQuery:@"SELECT total_changes()"];
+    XCTAssertTrue([_mapping updateModel:model inDatabase:_database]);
+    XCTAssertEqual([_database intForQuery:@"SELECT total_changes()"], changes);
+}
+
+- (void)testUncommittedChangesAreKept{
+    XCTAssertTrue([_mapping insertModel:[self modelWithRegionId:@"110000"] replace:NO inDatabase:_database]);
+    ProvincesModel *model = [self readModelWithRegionId:@"110000"];
+    model.regionName = @"北京市";
+    uint64_t snapshot = [_mapping changesOfModel:model];
+
+    //事务回滚：不调用 commitChanges，修改保留到下一次更新
+    XCTAssertTrue([_database beginTransaction]);
+    XCTAssertTrue([_mapping updateModel:model inDatabase:_database]);
+    XCTAssertTrue([_database rollback]);
+    XCTAssertEqualObjects([_mapping changedPropertiesForModel:model], @[@"regionName"]);
+
+    //快照之后的修改在提交之后保留
+    model.regionType = @"2";
+    XCTAssertTrue([_mapping updateModel:model inDatabase:_database]);
+    [_mapping commitChanges:snapshot ofModel:model];
+    XCTAssertEqualObjects([_mapping changedPropertiesForModel:model], @[@"regionType"]);
+    XCTAssertEqualObjects([self column:@"regionName" regionId:@"110000"], @"北京市");
+}
+
+- (void)testModelWithoutBaselineWritesAllColumns{
+    XCTAssertTrue([_mapping insertModel:[self modelWithRegionId:@"110000"] replace:NO inDatabase:_database]);
+    //新建的模型没有基准：写入所有的列，nil 的属性写入 NULL
+    ProvincesModel *model = [[ProvincesModel alloc] init];
+    model.regionId = @"110000";
+    model.regionName = @"北京市";
+    XCTAssertNil([_mapping changedPropertiesForModel:model]);
+    XCTAssertTrue([_mapping updateModel:model inDatabase:_database]);
+    XCTAssertEqualObjects([self column:@"regionName" regionId:@"110000"], @"北京市");
+    XCTAssertNil([self column:@"parentId" regionId:@"110000"]);
+    XCTAssertNil([self column:@"regionType" regionId:@"110000"]);
+
+    //提交之后以当前的值为基准
+    [_mapping commitChanges:[_mapping changesOfModel:model] ofModel:model];
+    XCTAssertEqualObjects([_mapping changedPropertiesForModel:model], @[]);
+}
+
+- (void)testCopyKeepsChanges{
+    XCTAssertTrue([_mapping insertModel:[self modelWithRegionId:@"110000"] replace:NO inDatabase:_database]);
+    ProvincesModel *model = [self readModelWithRegionId:@"110000"];
+    model.regionName = @"北京市";
+    ProvincesModel *copy = [_mapping copyOfModel:model];
+    XCTAssertNotEqual(copy, model);
+    XCTAssertEqualObjects(copy.regionName, @"北京市");
+    XCTAssertEqualObjects([_mapping changedPropertiesForModel:copy], @[@"regionName"]);
+
+    //副本的修改记录独立
+    copy.parentId = @"1";
+    XCTAssertEqualObjects([_mapping changedPropertiesForModel:model], @[@"regionName"]);
+    XCTAssertEqualObjects(model.parentId, @"0");
+}
+
+@end
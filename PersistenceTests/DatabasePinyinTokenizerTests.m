@@ -0,0 +1,88 @@
+//
+//  DatabasePinyinTokenizerTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "DatabasePinyinTokenizer.h"
+#import "DatabaseSchema.h"
+#import "PhoneCodeModel+DAO.h"
+#import "FMDatabaseAdditions.h"
+
+@interface DatabasePinyinTokenizerTests : XCTestCase
+{
+    FMDatabase *_database;
+}
+@end
+
+@implementation DatabasePinyinTokenizerTests
+
+- (void)setUp{
+    _database = [FMDatabase databaseWithPath:nil];
+    XCTAssertTrue([_database open]);
+    XCTAssertTrue(DatabaseRegisterPinyinTokenizer(_database));
+}
+
+- (void)tearDown{
+    [_database close];
+}
+
+- (NSArray<NSString *> *)searchText:(NSString *)text{
+    NSMutableArray<NSString *> *names = [NSMutableArray array];
+    FMResultSet *resultSet = [_database executeQuery:@"SELECT name FROM Search WHERE Search MATCH ? ORDER BY rowid",text];
+    while ([resultSet next]) {
+        [names addObject:[resultSet stringForColumnIndex:0]];
+    }
+    [resultSet close];
+    return names;
+}
+
+- (void)testInitialsAndFullPinyin{
+    NSString *sql = [NSString stringWithFormat:@"CREATE VIRTUAL TABLE Search USING fts5(name, pinyin, tokenize = '%@ remove_diacritics 2')",DatabasePinyinTokenizerName];
+    XCTAssertTrue([_database executeUpdate:sql]);
+    XCTAssertTrue([_database executeUpdate:@"INSERT INTO Search (name, pinyin) VALUES ('阿尔巴尼亚', 'a er ba ni ya'), ('亚美尼亚', 'ya mei ni ya'), ('Åland', 'a lan'), ('乍得', 'zhade')"]);
+
+    //首字母、全拼的前缀
+    XCTAssertEqualObjects([self searchText:@"aeb*"], @[@"阿尔巴尼亚"]);
+    XCTAssertEqualObjects([self searchText:@"aerba*"], @[@"阿尔巴尼亚"]);
+    XCTAssertEqualObjects([self searchText:@"ymny"], @[@"亚美尼亚"]);
+    //原有的词照常匹配
+    XCTAssertEqualObjects([self searchText:@"ya"], (@[@"阿尔巴尼亚", @"亚美尼亚"]));
+    XCTAssertEqualObjects([self searchText:@"pinyin:ni"], (@[@"阿尔巴尼亚", @"亚美尼亚"]));
+    //参数原样传给 unicode61：去除变音符号
+    XCTAssertEqualObjects([self searchText:@"aland"], @[@"Åland"]);
+    XCTAssertEqualObjects([self searchText:@"xyz"], @[]);
+    //前缀查询同时匹配原有的词、首字母与全拼
+    XCTAssertEqualObjects([self searchText:@"a*"], (@[@"阿尔巴尼亚", @"Åland"]));
+    //只有一个词时不生成首字母
+    XCTAssertEqualObjects([self searchText:@"z"], @[]);
+    XCTAssertEqualObjects([self searchText:@"zhade"], @[@"乍得"]);
+}
+
+- (void)testPhoneCodeSearchFollowsTable{
+    DatabaseTableSchema *schema = PhoneCodeModel.tableSchema;
+    XCTAssertTrue([_database executeUpdate:schema.createSQL]);
+    for (NSInteger version = 2; version <= schema.version; version++) {
+        for (NSString *sql in schema.migrations[@(version)]) {
+            XCTAssertTrue([_database executeUpdate:sql], @"%@",sql);
+        }
+    }
+    NSString *countSQL = @"SELECT count(*) FROM PhoneCodeSearch WHERE PhoneCodeSearch MATCH ?";
+    XCTAssertTrue([_database executeUpdate:@"INSERT INTO PhoneCodeModel (phoneCode, countryCode, countryPinYin, countryEnglish, countryChinese) VALUES ('355', 'AL', 'a er ba ni ya', 'Albania', '阿尔巴尼亚')"]);
+    XCTAssertEqual([_database intForQuery:countSQL,@"aeb*"], 1);
+    XCTAssertEqual([_database intForQuery:countSQL,@"alban*"], 1);
+    XCTAssertEqual([_database intForQuery:countSQL,@"355"], 1);
+
+    //更新、删除经过触发器同步到全文索引
+    XCTAssertTrue([_database executeUpdate:@"UPDATE PhoneCodeModel SET countryPinYin = 'ya mei ni ya', countryEnglish = 'Armenia' WHERE phoneCode = '355'"]);
+    XCTAssertEqual([_database intForQuery:countSQL,@"aeb*"], 0);
+    XCTAssertEqual([_database intForQuery:countSQL,@"ymny"], 1);
+    XCTAssertTrue([_database executeUpdate:@"DELETE FROM PhoneCodeModel"]);
+    XCTAssertEqual([_database intForQuery:countSQL,@"ymny"], 0);
+    XCTAssertEqual([_database intForQuery:@"SELECT count(*) FROM PhoneCodeSearch"], 0);
+}
+
+@end
@@ -0,0 +1,145 @@
+//
+//  DatabaseReclaimSpaceTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "DatabaseStore.h"
+#import "FMDatabaseAdditions.h"
+
+@interface DatabaseReclaimSpaceTests : XCTestCase
+{
+    NSString *_directory;
+    NSString *_path;
+    DatabaseStore *_store;
+}
+@end
+
+@implementation DatabaseReclaimSpaceTests
+
+- (void)setUp{
+    _directory = [NSTemporaryDirectory() stringByAppendingPathComponent:NSUUID.UUID.UUIDString];
+    [NSFileManager.defaultManager createDirectoryAtPath:_directory withIntermediateDirectories:YES attributes:nil error:nil];
+    _path = [_directory stringByAppendingPathComponent:@"reclaim_test.sqlite"];
+}
+
+- (void)tearDown{
+    _store = nil;
+    [NSFileManager.defaultManager removeItemAtPath:_directory error:nil];
+}
+
+- (void)openStore{
+    _store = [[DatabaseStore alloc] initWithName:@"reclaim_test" path:_path profile:DatabaseStoreProfileReadWrite];
+    [_store databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        [database executeUpdate:@"CREATE TABLE IF NOT EXISTS Item (id INTEGER PRIMARY KEY,content BLOB)"];
+    }];
+}
+
+/** 写入 count 行，每行约一个页
+ */
+- (void)insertRows:(int)count{
+    NSData *content = [NSMutableData dataWithLength:4000];
+    [_store databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        for (int i = 0; i < count; i++) {
+            [database executeUpdate:@"INSERT INTO Item (content) VALUES (?)",content];
+        }
+    }];
+}
+
+- (void)deleteRows:(int)count{
+    [_store databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        [database executeUpdate:@"DELETE FROM Item WHERE id IN (SELECT id FROM Item LIMIT ?)",@(count)];
+    }];
+}
+
+- (int)intForPragma:(NSString *)pragma{
+    __block int value = 0;
+    [_store.writeQueue inDatabase:^(FMDatabase *db) {
+        value = [db intForQuery:[NSString stringWithFormat:@"PRAGMA %@",pragma]];
+    }];
+    return value;
+}
+
+- (void)reclaimSpace{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"reclaim"];
+    [_store reclaimSpaceWithCompletion:^(BOOL success) {
+        XCTAssertTrue(success);
+        XCTAssertTrue(NSThread.isMainThread);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+}
+
+- (void)testIncrementalVacuumBelowThreshold{
+    [self openStore];
+    XCTAssertEqual([self intForPragma:@"auto_vacuum"], 2);
+    [self insertRows:600];
+    [self deleteRows:100];
+    int pageCount = [self intForPragma:@"page_count"];
+    int freelistCount = [self intForPragma:@"freelist_count"];
+    XCTAssertGreaterThan(freelistCount, 0);
+    XCTAssertLessThan(freelistCount, pageCount / 4);
+
+    //不重建文件，分批归还空闲页
+    [self reclaimSpace];
+    XCTAssertEqual([self intForPragma:@"freelist_count"], 0);
+    XCTAssertLessThanOrEqual([self intForPragma:@"page_count"], pageCount - freelistCount);
+}
+
+- (void)testRebuildAboveThreshold{
+    [self openStore];
+    [self insertRows:600];
+    [self deleteRows:400];
+    XCTAssertGreaterThan([self intForPragma:@"freelist_count"], [self intForPragma:@"page_count"] / 4);
+
+    [self reclaimSpace];
+    XCTAssertEqual([self intForPragma:@"freelist_count"], 0);
+    XCTAssertEqual([self intForPragma:@"auto_vacuum"], 2);
+    XCTAssertLessThan([self intForPragma:@"page_count"], 300);
+    //替换文件之后连接照常读写
+    [self insertRows:1];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"read"];
+    [_store databaseChildThreadInRead:^(FMDatabase *database) {
+        XCTAssertEqual([database intForQuery:@"SELECT count(*) FROM Item"], 201);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+- (void)testLegacyDatabaseIsNotRebuiltBelowThreshold{
+    //旧版本创建的数据库：没有启用增量回收
+    FMDatabase *database = [FMDatabase databaseWithPath:_path];
+    XCTAssertTrue([database open]);
+    XCTAssertTrue([database executeUpdate:@"CREATE TABLE Item (id INTEGER PRIMARY KEY,content BLOB)"]);
+    [database close];
+
+    [self openStore];
+    XCTAssertEqual([self intForPragma:@"auto_vacuum"], 0);
+    [self insertRows:600];
+    [self deleteRows:100];
+    int pageCount = [self intForPragma:@"page_count"];
+    int freelistCount = [self intForPragma:@"freelist_count"];
+    XCTAssertGreaterThan(freelistCount, 0);
+
+    //空闲页留给之后的写入复用
+    [self reclaimSpace];
+    XCTAssertEqual([self intForPragma:@"auto_vacuum"], 0);
+    XCTAssertEqual([self intForPragma:@"page_count"], pageCount);
+    XCTAssertEqual([self intForPragma:@"freelist_count"], freelistCount);
+
+    //显式重建：启用增量回收
+    XCTestExpectation *expectation = [self expectationWithDescription:@"rebuild"];
+    [_store rebuildWithCompletion:^(BOOL success) {
+        XCTAssertTrue(success);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+    XCTAssertEqual([self intForPragma:@"auto_vacuum"], 2);
+    XCTAssertEqual([self intForPragma:@"freelist_count"], 0);
+    XCTAssertLessThan([self intForPragma:@"page_count"], pageCount);
+}
+
+@end
@@ -0,0 +1,135 @@
+//
+//  DatabaseRowCacheTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <sqlite3.h>
+#import "DatabaseRowCache.h"
+
+@interface DatabaseRowCacheTests : XCTestCase
+{
+    DatabaseRowCache *_cache;
+}
+@end
+
+@implementation DatabaseRowCacheTests
+
+- (void)setUp{
+    _cache = [[DatabaseRowCache alloc] initWithCountLimit:16];
+}
+
+- (void)tearDown{
+    _cache = nil;
+}
+
+- (void)setObject:(id)object table:(NSString *)table key:(id<NSCopying>)key rowid:(int64_t)rowid{
+    [_cache setObject:object forTable:table key:key rowid:rowid readStamp:_cache.readStamp];
+}
+
+- (void)testHitAndMiss{
+    XCTAssertNil([_cache objectForTable:@"A" key:@"1"]);
+    [self setObject:@"a1" table:@"A" key:@"1" rowid:1];
+    XCTAssertEqualObjects([_cache objectForTable:@"A" key:@"1"], @"a1");
+    XCTAssertNil([_cache objectForTable:@"B" key:@"1"]);
+    XCTAssertEqual(_cache.count, 1);
+    XCTAssertEqual(_cache.hitCount, 1);
+    XCTAssertEqual(_cache.missCount, 2);
+}
+
+- (void)testStaleReadStampIsIgnored{
+    //查询开始之后该表被修改：查询得到的可能是旧数据，不写入缓存
+    uint64_t stamp = _cache.readStamp;
+    [_cache rowDidChangeInTable:@"A" rowid:2 operation:SQLITE_UPDATE];
+    [_cache transactionDidCommit];
+    [_cache setObject:@"a1" forTable:@"A" key:@"1" rowid:1 readStamp:stamp];
+    XCTAssertNil([_cache objectForTable:@"A" key:@"1"]);
+
+    //其它表的修改不影响
+    [_cache setObject:@"b1" forTable:@"B" key:@"1" rowid:1 readStamp:stamp];
+    XCTAssertEqualObjects([_cache objectForTable:@"B" key:@"1"], @"b1");
+
+    //提交之后重新获取的时间戳可以写入
+    [self setObject:@"a1" table:@"A" key:@"1" rowid:1];
+    XCTAssertEqualObjects([_cache objectForTable:@"A" key:@"1"], @"a1");
+}
+
+- (void)testPendingTransactionBlocksWrites{
+    //修改之后、提交之前，即使时间戳是新的也不写入：查询可能读取到提交之前的版本
+    [_cache rowDidChangeInTable:@"A" rowid:2 operation:SQLITE_UPDATE];
+    [self setObject:@"a1" table:@"A" key:@"1" rowid:1];
+    XCTAssertNil([_cache objectForTable:@"A" key:@"1"]);
+
+    [_cache transactionDidRollback];
+    [self setObject:@"a1" table:@"A" key:@"1" rowid:1];
+    XCTAssertEqualObjects([_cache objectForTable:@"A" key:@"1"], @"a1");
+}
+
+- (void)testUpdateAndDeleteInvalidateByRowid{
+    [self setObject:@"a1" table:@"A" key:@"1" rowid:1];
+    [self setObject:@"a2" table:@"A" key:@"2" rowid:2];
+    [self setObject:@"a3" table:@"A" key:@"3" rowid:3];
+
+    [_cache rowDidChangeInTable:@"A" rowid:2 operation:SQLITE_UPDATE];
+    XCTAssertNil([_cache objectForTable:@"A" key:@"2"]);
+    XCTAssertEqualObjects([_cache objectForTable:@"A" key:@"1"], @"a1");
+
+    [_cache rowDidChangeInTable:@"A" rowid:3 operation:SQLITE_DELETE];
+    XCTAssertNil([_cache objectForTable:@"A" key:@"3"]);
+    XCTAssertEqualObjects([_cache objectForTable:@"A" key:@"1"], @"a1");
+
+    //没有缓存的 rowid
+    [_cache rowDidChangeInTable:@"A" rowid:99 operation:SQLITE_UPDATE];
+    XCTAssertEqualObjects([_cache objectForTable:@"A" key:@"1"], @"a1");
+    [_cache transactionDidCommit];
+    XCTAssertEqual(_cache.count, 1);
+    XCTAssertEqual(_cache.invalidationCount, 2);
+}
+
+- (void)testInsertInvalidatesTable{
+    //REPLACE 删除的旧行不经过 update_hook：INSERT 移除整张表
+    [self setObject:@"a1" table:@"A" key:@"1" rowid:1];
+    [self setObject:@"a2" table:@"A" key:@"2" rowid:2];
+    [self setObject:@"b1" table:@"B" key:@"1" rowid:1];
+
+    [_cache rowDidChangeInTable:@"A" rowid:10 operation:SQLITE_INSERT];
+    [_cache transactionDidCommit];
+    XCTAssertNil([_cache objectForTable:@"A" key:@"1"]);
+    XCTAssertNil([_cache objectForTable:@"A" key:@"2"]);
+    XCTAssertEqualObjects([_cache objectForTable:@"B" key:@"1"], @"b1");
+    XCTAssertEqual(_cache.count, 1);
+}
+
+- (void)testManualRemoval{
+    [self setObject:@"a1" table:@"A" key:@"1" rowid:1];
+    uint64_t stamp = _cache.readStamp;
+    [_cache removeObjectsInTable:@"A"];
+    XCTAssertNil([_cache objectForTable:@"A" key:@"1"]);
+    [_cache setObject:@"a1" forTable:@"A" key:@"1" rowid:1 readStamp:stamp];
+    XCTAssertNil([_cache objectForTable:@"A" key:@"1"]);
+
+    [self setObject:@"b1" table:@"B" key:@"1" rowid:1];
+    stamp = _cache.readStamp;
+    [_cache removeAllObjects];
+    XCTAssertEqual(_cache.count, 0);
+    [_cache setObject:@"b1" forTable:@"B" key:@"1" rowid:1 readStamp:stamp];
+    XCTAssertNil([_cache objectForTable:@"B" key:@"1"]);
+}
+
+- (void)testEvictsLeastRecentlyUsed{
+    DatabaseRowCache *cache = [[DatabaseRowCache alloc] initWithCountLimit:2];
+    [cache setObject:@"a1" forTable:@"A" key:@"1" rowid:1 readStamp:cache.readStamp];
+    [cache setObject:@"a2" forTable:@"A" key:@"2" rowid:2 readStamp:cache.readStamp];
+    XCTAssertNotNil([cache objectForTable:@"A" key:@"1"]);
+    [cache setObject:@"a3" forTable:@"A" key:@"3" rowid:3 readStamp:cache.readStamp];
+    XCTAssertEqual(cache.count, 2);
+    XCTAssertEqual(cache.evictionCount, 1);
+    XCTAssertNil([cache objectForTable:@"A" key:@"2"]);
+    XCTAssertEqualObjects([cache objectForTable:@"A" key:@"1"], @"a1");
+    XCTAssertEqualObjects([cache objectForTable:@"A" key:@"3"], @"a3");
+}
+
+@end
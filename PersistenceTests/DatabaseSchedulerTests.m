@@ -0,0 +1,154 @@
+//
+//  DatabaseSchedulerTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <sqlite3.h>
+#import "DatabaseScheduler.h"
+#import "FMDatabaseAdditions.h"
+
+/** 耗时的语句：执行期间进度回调被反复调用，可以被抢占、取消
+ */
+static NSString * const DatabaseSchedulerTestsSlowSQL = @"WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c WHERE x < 5000000) SELECT count(*) FROM c";
+
+@interface DatabaseSchedulerTests : XCTestCase
+{
+    NSString *_path;
+    DatabaseScheduler *_scheduler;
+}
+@end
+
+@implementation DatabaseSchedulerTests
+
+- (void)setUp{
+    _path = [NSTemporaryDirectory() stringByAppendingPathComponent:NSUUID.UUID.UUIDString];
+    FMDatabaseQueue *writeQueue = [FMDatabaseQueue databaseQueueWithPath:_path];
+    [writeQueue inDatabase:^(FMDatabase *db) {
+        XCTAssertTrue([db executeStatements:@"PRAGMA journal_mode = WAL"]);
+        XCTAssertTrue([db executeUpdate:@"CREATE TABLE Item (id INTEGER PRIMARY KEY,name TEXT)"]);
+    }];
+    FMDatabaseQueue *readQueue = [[FMDatabaseQueue alloc] initWithPath:_path flags:SQLITE_OPEN_READONLY];
+    FMDatabaseQueue *backgroundReadQueue = [[FMDatabaseQueue alloc] initWithPath:_path flags:SQLITE_OPEN_READONLY];
+    _scheduler = [[DatabaseScheduler alloc] initWithWriteQueue:writeQueue readQueue:readQueue backgroundReadQueue:backgroundReadQueue];
+}
+
+- (void)tearDown{
+    [_scheduler cancelAllOperations];
+    _scheduler = nil;
+    for (NSString *suffix in @[@"", @"-wal", @"-shm"]) {
+        [NSFileManager.defaultManager removeItemAtPath:[_path stringByAppendingString:suffix] error:nil];
+    }
+}
+
+- (NSArray<NSString *> *)names{
+    __block NSArray<NSString *> *names = nil;
+    [_scheduler.writeQueue inDatabase:^(FMDatabase *db) {
+        NSMutableArray<NSString *> *array = [NSMutableArray array];
+        FMResultSet *resultSet = [db executeQuery:@"SELECT name FROM Item ORDER BY id"];
+        while ([resultSet next]) {
+            [array addObject:[resultSet stringForColumnIndex:0]];
+        }
+        [resultSet close];
+        names = array;
+    }];
+    return names;
+}
+
+- (void)testLanesMatchReadConnections{
+    //每个只读连接是一个串行队列：通道队列的并发数为 1
+    for (DatabaseLane lane = 0; lane < DatabaseLaneCount; lane++) {
+        XCTAssertEqual([_scheduler operationQueueForLane:lane].maxConcurrentOperationCount, 1);
+    }
+    XCTAssertEqual([_scheduler readQueueForLane:DatabaseLaneInteractive], [_scheduler readQueueForLane:DatabaseLaneUserWrite]);
+    XCTAssertEqual([_scheduler readQueueForLane:DatabaseLaneBackground], [_scheduler readQueueForLane:DatabaseLaneMaintenance]);
+    XCTAssertNotEqual([_scheduler readQueueForLane:DatabaseLaneInteractive], [_scheduler readQueueForLane:DatabaseLaneBackground]);
+    XCTAssertEqual([_scheduler operationQueueForLane:DatabaseLaneInteractive].qualityOfService, NSQualityOfServiceUserInteractive);
+}
+
+- (void)testUserWritePreemptsLongBackgroundWrite{
+    _scheduler.preemptTimeSlice = 0.01;
+    NSMutableArray<NSString *> *order = [NSMutableArray array];
+    __block NSUInteger backgroundRuns = 0;
+    dispatch_semaphore_t started = dispatch_semaphore_create(0);
+    XCTestExpectation *expectation = [self expectationWithDescription:@"writes"];
+    expectation.expectedFulfillmentCount = 2;
+
+    [_scheduler writeInLane:DatabaseLaneBackground token:nil transaction:^(FMDatabase *db, BOOL *rollback) {
+        backgroundRuns++;
+        [db executeUpdate:@"INSERT INTO Item (name) VALUES ('background')"];
+        if (backgroundRuns == 1) {
+            dispatch_semaphore_signal(started);
+        }
+        [db intForQuery:DatabaseSchedulerTestsSlowSQL];
+    } completion:^(BOOL committed) {
+        XCTAssertTrue(committed);
+        @synchronized (order) {
+            [order addObject:@"background"];
+        }
+        [expectation fulfill];
+    }];
+
+    dispatch_semaphore_wait(started, DISPATCH_TIME_FOREVER);
+    [_scheduler writeInLane:DatabaseLaneUserWrite token:nil transaction:^(FMDatabase *db, BOOL *rollback) {
+        [db executeUpdate:@"INSERT INTO Item (name) VALUES ('user')"];
+    } completion:^(BOOL committed) {
+        XCTAssertTrue(committed);
+        @synchronized (order) {
+            [order addObject:@"user"];
+        }
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+
+    //后台任务被中断、回滚，用户写入之后重新执行；回滚的那一次不留下任何写入
+    XCTAssertEqualObjects(order, (@[@"user", @"background"]));
+    XCTAssertGreaterThan(backgroundRuns, 1);
+    XCTAssertEqualObjects([self names], (@[@"user", @"background"]));
+}
+
+- (void)testPreemptionIsBounded{
+    //不允许抢占：后台任务执行完之后才执行用户写入
+    _scheduler.preemptTimeSlice = 0.01;
+    _scheduler.maxPreemptCount = 0;
+    __block NSUInteger backgroundRuns = 0;
+    dispatch_semaphore_t started = dispatch_semaphore_create(0);
+    XCTestExpectation *expectation = [self expectationWithDescription:@"writes"];
+    expectation.expectedFulfillmentCount = 2;
+
+    [_scheduler writeInLane:DatabaseLaneBackground token:nil transaction:^(FMDatabase *db, BOOL *rollback) {
+        backgroundRuns++;
+        [db executeUpdate:@"INSERT INTO Item (name) VALUES ('background')"];
+        dispatch_semaphore_signal(started);
+        [db intForQuery:DatabaseSchedulerTestsSlowSQL];
+    } completion:^(BOOL committed) {
+        [expectation fulfill];
+    }];
+    dispatch_semaphore_wait(started, DISPATCH_TIME_FOREVER);
+    [_scheduler writeInLane:DatabaseLaneUserWrite token:nil transaction:^(FMDatabase *db, BOOL *rollback) {
+        [db executeUpdate:@"INSERT INTO Item (name) VALUES ('user')"];
+    } completion:^(BOOL committed) {
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+    XCTAssertEqual(backgroundRuns, 1);
+    XCTAssertEqualObjects([self names], (@[@"background", @"user"]));
+}
+
+- (void)testRollbackKeepsNothing{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"write"];
+    [_scheduler writeInLane:DatabaseLaneUserWrite token:nil transaction:^(FMDatabase *db, BOOL *rollback) {
+        [db executeUpdate:@"INSERT INTO Item (name) VALUES ('a')"];
+        *rollback = YES;
+    } completion:^(BOOL committed) {
+        XCTAssertFalse(committed);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqualObjects([self names], @[]);
+}
+
+@end
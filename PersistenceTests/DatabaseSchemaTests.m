@@ -0,0 +1,165 @@
+//
+//  DatabaseSchemaTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "DatabaseStore.h"
+#import "FMDatabaseAdditions.h"
+
+@interface DatabaseSchemaTests : XCTestCase
+{
+    NSString *_directory;
+    DatabaseStore *_store;
+}
+@end
+
+@implementation DatabaseSchemaTests
+
+- (void)setUp{
+    _directory = [NSTemporaryDirectory() stringByAppendingPathComponent:NSUUID.UUID.UUIDString];
+    [NSFileManager.defaultManager createDirectoryAtPath:_directory withIntermediateDirectories:YES attributes:nil error:nil];
+    _store = [self reopenStore];
+}
+
+- (void)tearDown{
+    _store = nil;
+    [NSFileManager.defaultManager removeItemAtPath:_directory error:nil];
+}
+
+- (DatabaseStore *)reopenStore{
+    return [[DatabaseStore alloc] initWithName:@"schema_test" path:[_directory stringByAppendingPathComponent:@"schema_test.sqlite"] profile:DatabaseStoreProfileReadWrite];
+}
+
+- (DatabaseTableSchema *)itemSchemaWithVersion:(NSInteger)version{
+    return [DatabaseTableSchema schemaWithTableName:@"Item" version:version createSQL:@"CREATE TABLE Item (id INTEGER PRIMARY KEY,name TEXT)" migrations:@{
+        @2 : @[@"ALTER TABLE Item ADD COLUMN detail TEXT"],
+        @3 : @[@"CREATE INDEX Item_name ON Item (name)"],
+    }];
+}
+
+- (DatabaseTableSchema *)tagSchema{
+    return [DatabaseTableSchema schemaWithTableName:@"Tag" version:1 createSQL:@"CREATE TABLE Tag (name TEXT PRIMARY KEY)" migrations:nil];
+}
+
+- (NSArray<NSString *> *)columnsOfTable:(NSString *)tableName{
+    __block NSMutableArray<NSString *> *columns = [NSMutableArray array];
+    [_store.writeQueue inDatabase:^(FMDatabase *db) {
+        FMResultSet *resultSet = [db executeQuery:[NSString stringWithFormat:@"PRAGMA table_info(%@)",tableName]];
+        while ([resultSet next]) {
+            [columns addObject:[resultSet stringForColumn:@"name"]];
+        }
+        [resultSet close];
+    }];
+    return columns;
+}
+
+- (NSInteger)recordedVersionOfTable:(NSString *)tableName{
+    __block NSInteger version = 0;
+    [_store.writeQueue inDatabase:^(FMDatabase *db) {
+        version = [db intForQuery:[NSString stringWithFormat:@"SELECT version FROM %@ WHERE tableName = ?",DatabaseSchemaVersionTable],tableName];
+    }];
+    return version;
+}
+
+- (void)testFingerprint{
+    int32_t fingerprint = DatabaseSchemaFingerprint(@[[self itemSchemaWithVersion:1], [self tagSchema]]);
+    XCTAssertGreaterThan(fingerprint, 0);
+    //与注册顺序无关
+    XCTAssertEqual(fingerprint, DatabaseSchemaFingerprint(@[[self tagSchema], [self itemSchemaWithVersion:1]]));
+    //任意一张表的版本变化，指纹随之变化
+    XCTAssertNotEqual(fingerprint, DatabaseSchemaFingerprint(@[[self itemSchemaWithVersion:2], [self tagSchema]]));
+    //声明有效期同样改变指纹
+    DatabaseTableSchema *expiring = [DatabaseTableSchema schemaWithTableName:@"Tag" version:1 createSQL:@"CREATE TABLE Tag (name TEXT PRIMARY KEY,time TEXT)" migrations:nil expiryColumn:@"time" lifetime:60];
+    XCTAssertNotEqual(fingerprint, DatabaseSchemaFingerprint(@[[self itemSchemaWithVersion:1], expiring]));
+    XCTAssertGreaterThan(DatabaseSchemaFingerprint(@[]), 0);
+}
+
+- (void)testPrepareCreatesTablesAndWritesFingerprint{
+    NSArray<DatabaseTableSchema *> *schemas = @[[self itemSchemaWithVersion:3], [self tagSchema]];
+    XCTAssertFalse(_store.isSchemaReady);
+    XCTAssertTrue([_store prepareSchemas:schemas]);
+    XCTAssertTrue(_store.isSchemaReady);
+
+    //新建的表同样执行所有升级语句
+    XCTAssertEqualObjects([self columnsOfTable:@"Item"], (@[@"id", @"name", @"detail"]));
+    XCTAssertEqual([self recordedVersionOfTable:@"Item"], 3);
+    XCTAssertEqual([self recordedVersionOfTable:@"Tag"], 1);
+    [_store.writeQueue inDatabase:^(FMDatabase *db) {
+        XCTAssertEqual((int32_t)db.userVersion, DatabaseSchemaFingerprint(schemas));
+        XCTAssertEqual([db intForQuery:@"SELECT count(*) FROM sqlite_master WHERE type = 'index' AND name = 'Item_name'"], 1);
+    }];
+
+    //指纹一致：不再执行任何语句
+    [_store.writeQueue inDatabase:^(FMDatabase *db) {
+        [db executeUpdate:[NSString stringWithFormat:@"DELETE FROM %@",DatabaseSchemaVersionTable]];
+    }];
+    _store = [self reopenStore];
+    XCTAssertTrue([_store prepareSchemas:schemas]);
+    XCTAssertEqual([self recordedVersionOfTable:@"Item"], 0);
+}
+
+- (void)testMigrateExistingTable{
+    XCTAssertTrue([_store prepareSchemas:@[[self itemSchemaWithVersion:1]]]);
+    XCTAssertEqualObjects([self columnsOfTable:@"Item"], (@[@"id", @"name"]));
+    [_store databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        [database executeUpdate:@"INSERT INTO Item (name) VALUES ('a')"];
+    }];
+
+    _store = [self reopenStore];
+    XCTAssertTrue([_store prepareSchemas:@[[self itemSchemaWithVersion:2]]]);
+    XCTAssertEqualObjects([self columnsOfTable:@"Item"], (@[@"id", @"name", @"detail"]));
+    XCTAssertEqual([self recordedVersionOfTable:@"Item"], 2);
+    [_store.writeQueue inDatabase:^(FMDatabase *db) {
+        XCTAssertEqualObjects([db stringForQuery:@"SELECT name FROM Item"], @"a");
+    }];
+}
+
+- (void)testTableWithoutVersionRecordIsVersionOne{
+    //表结构注册之前创建的表
+    [_store.writeQueue inDatabase:^(FMDatabase *db) {
+        XCTAssertTrue([db executeUpdate:@"CREATE TABLE Item (id INTEGER PRIMARY KEY,name TEXT)"]);
+    }];
+    XCTAssertTrue([_store prepareSchemas:@[[self itemSchemaWithVersion:2]]]);
+    XCTAssertEqualObjects([self columnsOfTable:@"Item"], (@[@"id", @"name", @"detail"]));
+}
+
+- (void)testFailedMigrationRollsBack{
+    XCTAssertTrue([_store prepareSchemas:@[[self itemSchemaWithVersion:1]]]);
+    __block uint32_t userVersion = 0;
+    [_store.writeQueue inDatabase:^(FMDatabase *db) {
+        userVersion = db.userVersion;
+    }];
+
+    DatabaseTableSchema *broken = [DatabaseTableSchema schemaWithTableName:@"Item" version:3 createSQL:@"CREATE TABLE Item (id INTEGER PRIMARY KEY,name TEXT)" migrations:@{
+        @2 : @[@"ALTER TABLE Item ADD COLUMN detail TEXT"],
+        @3 : @[@"ALTER TABLE Missing ADD COLUMN detail TEXT"],
+    }];
+    _store = [self reopenStore];
+    XCTAssertFalse([_store prepareSchemas:@[broken, [self tagSchema]]]);
+    XCTAssertFalse(_store.isSchemaReady);
+
+    //同一个事务中的所有修改都被回滚
+    XCTAssertEqualObjects([self columnsOfTable:@"Item"], (@[@"id", @"name"]));
+    XCTAssertEqual([self columnsOfTable:@"Tag"].count, 0);
+    XCTAssertEqual([self recordedVersionOfTable:@"Item"], 1);
+    [_store.writeQueue inDatabase:^(FMDatabase *db) {
+        XCTAssertEqual(db.userVersion, userVersion);
+    }];
+}
+
+- (void)testPrepareInBackgroundHoldsQueuedReads{
+    [_store prepareSchemasInBackground:@[[self itemSchemaWithVersion:2]]];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"read"];
+    [_store databaseChildThreadInRead:^(FMDatabase *database) {
+        XCTAssertTrue([database columnExists:@"detail" inTableWithName:@"Item"]);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertTrue(_store.isSchemaReady);
+}
+
+@end
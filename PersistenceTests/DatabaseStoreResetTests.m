@@ -0,0 +1,147 @@
+//
+//  DatabaseStoreResetTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "DatabaseStore.h"
+#import "FMDatabaseAdditions.h"
+
+@interface DatabaseStoreResetTests : XCTestCase
+{
+    NSString *_directory;
+    DatabaseStore *_store;
+    NSArray<DatabaseTableSchema *> *_schemas;
+}
+@end
+
+@implementation DatabaseStoreResetTests
+
+- (void)setUp{
+    _directory = [NSTemporaryDirectory() stringByAppendingPathComponent:NSUUID.UUID.UUIDString];
+    [NSFileManager.defaultManager createDirectoryAtPath:_directory withIntermediateDirectories:YES attributes:nil error:nil];
+    _store = [[DatabaseStore alloc] initWithName:@"reset_test" path:[_directory stringByAppendingPathComponent:@"reset_test.sqlite"] profile:DatabaseStoreProfileReadWrite];
+    _schemas = @[
+        [DatabaseTableSchema schemaWithTableName:@"Counter" version:1 createSQL:@"CREATE TABLE Counter (value INTEGER)" migrations:nil],
+        [DatabaseTableSchema schemaWithTableName:@"Item" version:2 createSQL:@"CREATE TABLE Item (id INTEGER PRIMARY KEY,name TEXT)" migrations:@{
+            @2 : @[@"CREATE INDEX Item_name ON Item (name)",
+                   @"CREATE TRIGGER Item_count AFTER INSERT ON Item BEGIN UPDATE Counter SET value = value + 1; END"],
+        }],
+    ];
+    XCTAssertTrue([_store prepareSchemas:_schemas]);
+    [self fillRows];
+}
+
+- (void)tearDown{
+    _store = nil;
+    [NSFileManager.defaultManager removeItemAtPath:_directory error:nil];
+}
+
+- (void)fillRows{
+    [_store databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        [database executeUpdate:@"DELETE FROM Counter"];
+        [database executeUpdate:@"INSERT INTO Counter (value) VALUES (0)"];
+        for (int i = 0; i < 100; i++) {
+            [database executeUpdate:@"INSERT INTO Item (name) VALUES (?)",@(i).stringValue];
+        }
+    }];
+}
+
+- (int)intForQuery:(NSString *)sql{
+    __block int value = 0;
+    [_store.writeQueue inDatabase:^(FMDatabase *db) {
+        value = [db intForQuery:sql];
+    }];
+    return value;
+}
+
+- (void)testEmptyTableKeepsSchema{
+    __block uint32_t userVersion = 0;
+    [_store.writeQueue inDatabase:^(FMDatabase *db) {
+        userVersion = db.userVersion;
+    }];
+
+    XCTestExpectation *observed = [self expectationWithDescription:@"observer"];
+    DatabaseChangeObservation *observation = [_store addChangeObserverForTables:@[@"Item"] queue:nil block:^(DatabaseChangeSet *changes) {
+        if ([changes isResetTable:@"Item"]) {
+            XCTAssertFalse(changes.resetsAllTables);
+            [observed fulfill];
+        }
+    }];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"empty"];
+    [_store emptyTablesWithSchemas:@[_schemas.lastObject] completion:^(BOOL success) {
+        XCTAssertTrue(success);
+        XCTAssertTrue(NSThread.isMainThread);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    [observation invalidate];
+
+    //表被清空，其它表不受影响；索引、触发器按声明重建，版本记录与指纹不变
+    XCTAssertEqual([self intForQuery:@"SELECT count(*) FROM Item"], 0);
+    XCTAssertEqual([self intForQuery:@"SELECT value FROM Counter"], 100);
+    XCTAssertEqual([self intForQuery:@"SELECT count(*) FROM sqlite_master WHERE name IN ('Item_name', 'Item_count')"], 2);
+    XCTAssertEqual([self intForQuery:[NSString stringWithFormat:@"SELECT version FROM %@ WHERE tableName = 'Item'",DatabaseSchemaVersionTable]], 2);
+    [_store.writeQueue inDatabase:^(FMDatabase *db) {
+        XCTAssertEqual(db.userVersion, userVersion);
+    }];
+    [_store databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        [database executeUpdate:@"INSERT INTO Item (name) VALUES ('a')"];
+    }];
+    XCTAssertEqual([self intForQuery:@"SELECT value FROM Counter"], 101);
+}
+
+- (void)testFailedEmptyRollsBack{
+    DatabaseTableSchema *broken = [DatabaseTableSchema schemaWithTableName:@"Item" version:1 createSQL:@"CREATE TABLE Item (id INTEGER PRIMARY KEY,name TEXT" migrations:nil];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"empty"];
+    [_store emptyTablesWithSchemas:@[broken] completion:^(BOOL success) {
+        XCTAssertFalse(success);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual([self intForQuery:@"SELECT count(*) FROM Item"], 100);
+}
+
+- (void)testResetReplacesFileWithTemplate{
+    XCTAssertTrue([_store prepareResetTemplate]);
+    NSString *templatePath = [_store.path stringByAppendingString:@".template"];
+    XCTAssertTrue([NSFileManager.defaultManager fileExistsAtPath:templatePath]);
+    NSDate *templateDate = [NSFileManager.defaultManager attributesOfItemAtPath:templatePath error:nil].fileModificationDate;
+    //表结构没有变化：模板不重新生成
+    XCTAssertTrue([_store prepareResetTemplate]);
+    XCTAssertEqualObjects([NSFileManager.defaultManager attributesOfItemAtPath:templatePath error:nil].fileModificationDate, templateDate);
+
+    XCTestExpectation *observed = [self expectationWithDescription:@"observer"];
+    DatabaseChangeObservation *observation = [_store addChangeObserverForTables:@[@"Item"] queue:nil block:^(DatabaseChangeSet *changes) {
+        if (changes.resetsAllTables) {
+            [observed fulfill];
+        }
+    }];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"reset"];
+    [_store resetWithCompletion:^(BOOL success) {
+        XCTAssertTrue(success);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    [observation invalidate];
+
+    XCTAssertEqual([self intForQuery:@"SELECT count(*) FROM Item"], 0);
+    XCTAssertEqual([self intForQuery:@"SELECT count(*) FROM Counter"], 0);
+    XCTAssertEqual([self intForQuery:@"SELECT count(*) FROM sqlite_master WHERE name IN ('Item_name', 'Item_count')"], 2);
+    //只读连接重新打开之后读取的是新文件
+    expectation = [self expectationWithDescription:@"read"];
+    [_store databaseChildThreadInRead:^(FMDatabase *database) {
+        XCTAssertEqual([database intForQuery:@"SELECT count(*) FROM Item"], 0);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    //重置之后照常写入
+    [self fillRows];
+    XCTAssertEqual([self intForQuery:@"SELECT value FROM Counter"], 100);
+}
+
+@end
@@ -0,0 +1,149 @@
+//
+//  DatabaseStoreTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "DatabaseStore.h"
+#import "FMDatabaseAdditions.h"
+
+@interface DatabaseStoreTests : XCTestCase
+{
+    NSString *_directory;
+}
+@end
+
+@implementation DatabaseStoreTests
+
+- (void)setUp{
+    _directory = [NSTemporaryDirectory() stringByAppendingPathComponent:NSUUID.UUID.UUIDString];
+    [NSFileManager.defaultManager createDirectoryAtPath:_directory withIntermediateDirectories:YES attributes:nil error:nil];
+}
+
+- (void)tearDown{
+    [NSFileManager.defaultManager removeItemAtPath:_directory error:nil];
+}
+
+- (DatabaseStore *)storeNamed:(NSString *)name profile:(DatabaseStoreProfile)profile{
+    NSString *path = [_directory stringByAppendingPathComponent:[name stringByAppendingPathExtension:@"sqlite"]];
+    return [[DatabaseStore alloc] initWithName:name path:path profile:profile];
+}
+
+- (void)testAttachedStoreIsReadable{
+    DatabaseStore *mainStore = [self storeNamed:@"main_test" profile:DatabaseStoreProfileReadWrite];
+    DatabaseStore *referenceStore = [self storeNamed:@"reference_test" profile:DatabaseStoreProfileReadWrite];
+    [mainStore databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        [database executeUpdate:@"CREATE TABLE Item (id INTEGER PRIMARY KEY,code TEXT)"];
+        [database executeUpdate:@"INSERT INTO Item (code) VALUES ('86'), ('1')"];
+    }];
+    [referenceStore databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        [database executeUpdate:@"CREATE TABLE Country (code TEXT UNIQUE,name TEXT)"];
+        [database executeUpdate:@"INSERT INTO Country (code, name) VALUES ('86', '中国')"];
+    }];
+    [mainStore attachStore:referenceStore];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"read"];
+    [mainStore databaseChildThreadInRead:^(FMDatabase *database) {
+        //表名不冲突时不需要数据库名称前缀
+        XCTAssertEqual([database intForQuery:@"SELECT count(*) FROM Country"], 1);
+        XCTAssertEqualObjects([database stringForQuery:@"SELECT c.name FROM Item i JOIN reference_test.Country c ON c.code = i.code"], @"中国");
+        XCTAssertEqual([database intForQuery:@"SELECT count(*) FROM Item i LEFT JOIN Country c ON c.code = i.code WHERE c.name IS NULL"], 1);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    //被 ATTACH 的数据库之后的提交同样可见
+    [referenceStore databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        [database executeUpdate:@"INSERT INTO Country (code, name) VALUES ('1', 'United States')"];
+    }];
+    expectation = [self expectationWithDescription:@"read again"];
+    [mainStore databaseChildThreadInRead:^(FMDatabase *database) {
+        XCTAssertEqual([database intForQuery:@"SELECT count(*) FROM Item JOIN Country USING (code)"], 2);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+- (void)testWritersAreIndependent{
+    DatabaseStore *mainStore = [self storeNamed:@"main_test" profile:DatabaseStoreProfileReadWrite];
+    DatabaseStore *referenceStore = [self storeNamed:@"reference_test" profile:DatabaseStoreProfileReadWrite];
+    [mainStore databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        [database executeUpdate:@"CREATE TABLE Item (id INTEGER PRIMARY KEY)"];
+    }];
+
+    //reference 的写事务持续执行期间，main 照常写入
+    dispatch_semaphore_t started = dispatch_semaphore_create(0);
+    dispatch_semaphore_t finish = dispatch_semaphore_create(0);
+    XCTestExpectation *expectation = [self expectationWithDescription:@"reference"];
+    [referenceStore.scheduler writeInLane:DatabaseLaneBackground token:nil transaction:^(FMDatabase *db, BOOL *rollback) {
+        [db executeUpdate:@"CREATE TABLE Country (code TEXT)"];
+        dispatch_semaphore_signal(started);
+        dispatch_semaphore_wait(finish, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(5 * NSEC_PER_SEC)));
+    } completion:^(BOOL committed) {
+        XCTAssertTrue(committed);
+        [expectation fulfill];
+    }];
+    dispatch_semaphore_wait(started, DISPATCH_TIME_FOREVER);
+
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    [mainStore databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        XCTAssertTrue([database executeUpdate:@"INSERT INTO Item DEFAULT VALUES"]);
+    }];
+    XCTAssertLessThan(CFAbsoluteTimeGetCurrent() - startTime, 1);
+    dispatch_semaphore_signal(finish);
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+- (void)testReadOnlyProfile{
+    DatabaseStore *store = [self storeNamed:@"store_test" profile:DatabaseStoreProfileReadWrite];
+    [store databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        [database executeUpdate:@"CREATE TABLE Item (id INTEGER PRIMARY KEY)"];
+        [database executeUpdate:@"INSERT INTO Item DEFAULT VALUES"];
+    }];
+    XCTAssertNotNil(store.writeQueue);
+    XCTAssertNotNil(store.checkpointScheduler);
+    XCTAssertEqual(store.mmapSize, 0);
+
+    DatabaseStore *readOnlyStore = [[DatabaseStore alloc] initWithName:@"read_only" path:store.path profile:DatabaseStoreProfileReadOnly];
+    XCTAssertNil(readOnlyStore.writeQueue);
+    XCTAssertNil(readOnlyStore.checkpointScheduler);
+    __block BOOL ran = NO;
+    [readOnlyStore databaseCurrentThreadInTransaction:^(FMDatabase *database, BOOL *rollback) {
+        ran = YES;
+    }];
+    XCTAssertFalse(ran);
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"read"];
+    [readOnlyStore databaseChildThreadInRead:^(FMDatabase *database) {
+        XCTAssertEqual([database intForQuery:@"SELECT count(*) FROM Item"], 1);
+        XCTAssertFalse([database executeUpdate:@"INSERT INTO Item DEFAULT VALUES"]);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+- (void)testImmutableProfileMapsFile{
+    NSString *path = [_directory stringByAppendingPathComponent:@"immutable.sqlite"];
+    FMDatabase *database = [FMDatabase databaseWithPath:path];
+    XCTAssertTrue([database open]);
+    XCTAssertTrue([database executeUpdate:@"CREATE TABLE Item (id INTEGER PRIMARY KEY)"]);
+    XCTAssertTrue([database executeUpdate:@"INSERT INTO Item DEFAULT VALUES"]);
+    [database close];
+
+    DatabaseStore *store = [[DatabaseStore alloc] initWithName:@"immutable" path:path profile:DatabaseStoreProfileImmutable];
+    XCTAssertNil(store.writeQueue);
+    XCTAssertEqual(store.mmapSize, (long long)[NSFileManager.defaultManager attributesOfItemAtPath:path error:nil].fileSize);
+    XCTAssertGreaterThan(store.mmapSize, 0);
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"read"];
+    [store databaseChildThreadInRead:^(FMDatabase *database) {
+        XCTAssertEqual([database intForQuery:@"SELECT count(*) FROM Item"], 1);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+@end
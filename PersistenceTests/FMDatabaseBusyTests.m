@@ -0,0 +1,108 @@
+//
+//  FMDatabaseBusyTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <sqlite3.h>
+#import "FMDatabase.h"
+#import "FMDatabaseAdditions.h"
+
+/** 两个连接打开同一个文件：holder 持有写锁，waiter 等待
+ */
+@interface FMDatabaseBusyTests : XCTestCase
+{
+    NSString *_path;
+    FMDatabase *_holder;
+    FMDatabase *_waiter;
+}
+@end
+
+@implementation FMDatabaseBusyTests
+
+- (void)setUp{
+    _path = [NSTemporaryDirectory() stringByAppendingPathComponent:NSUUID.UUID.UUIDString];
+    _holder = [FMDatabase databaseWithPath:_path];
+    XCTAssertTrue([_holder open]);
+    XCTAssertTrue([_holder executeUpdate:@"CREATE TABLE Item (id INTEGER PRIMARY KEY,name TEXT)"]);
+    _waiter = [FMDatabase databaseWithPath:_path];
+    XCTAssertTrue([_waiter open]);
+}
+
+- (void)tearDown{
+    [_waiter close];
+    [_holder close];
+    [NSFileManager.defaultManager removeItemAtPath:_path error:nil];
+}
+
+- (void)testDefaults{
+    XCTAssertEqual(_waiter.busyStrategy, FMDBBusyStrategyExponentialBackoff);
+    XCTAssertTrue(_waiter.busyWakesOnCommit);
+    XCTAssertLessThan(_waiter.busyRetryInitialInterval, _waiter.busyRetryMaxInterval);
+    XCTAssertEqual(_waiter.busyCount, 0);
+}
+
+- (void)testTimeoutIsCounted{
+    _waiter.maxBusyRetryTimeInterval = 0.2;
+    XCTAssertTrue([_holder beginExclusiveTransaction]);
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    XCTAssertFalse([_waiter executeUpdate:@"INSERT INTO Item (name) VALUES ('waiter')"]);
+    CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - startTime;
+    XCTAssertEqual(_waiter.lastErrorCode, SQLITE_BUSY);
+    XCTAssertTrue([_holder commit]);
+
+    //等待到上限后放弃
+    XCTAssertGreaterThanOrEqual(elapsed, 0.19);
+    XCTAssertLessThan(elapsed, 1);
+    XCTAssertEqual(_waiter.busyCount, 1);
+    XCTAssertEqual(_waiter.busyTimeoutCount, 1);
+    XCTAssertGreaterThan(_waiter.busyWaitTime, 0.1);
+
+    [_waiter resetBusyStatistics];
+    XCTAssertEqual(_waiter.busyCount, 0);
+    XCTAssertEqual(_waiter.busyTimeoutCount, 0);
+    XCTAssertEqual(_waiter.busyWaitTime, 0);
+    XCTAssertTrue([_waiter executeUpdate:@"INSERT INTO Item (name) VALUES ('waiter')"]);
+    XCTAssertEqual(_waiter.busyCount, 0);
+}
+
+- (void)testCommitWakesWaiter{
+    //单次等待 1 秒：只有被提交唤醒才能在 1 秒之内完成
+    _waiter.maxBusyRetryTimeInterval = 5;
+    _waiter.busyRetryInitialInterval = 1;
+    _waiter.busyRetryMaxInterval = 1;
+    XCTAssertTrue([_holder beginExclusiveTransaction]);
+    XCTAssertTrue([_holder executeUpdate:@"INSERT INTO Item (name) VALUES ('holder')"]);
+
+    FMDatabase *holder = _holder;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.2 * NSEC_PER_SEC)), dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        [holder commit];
+    });
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    XCTAssertTrue([_waiter executeUpdate:@"INSERT INTO Item (name) VALUES ('waiter')"]);
+    XCTAssertLessThan(CFAbsoluteTimeGetCurrent() - startTime, 0.9);
+    XCTAssertEqual(_waiter.busyCount, 1);
+    XCTAssertEqual(_waiter.busyTimeoutCount, 0);
+    XCTAssertEqual([_waiter intForQuery:@"SELECT count(*) FROM Item"], 2);
+}
+
+- (void)testBackoffWithoutWakeWaitsItsInterval{
+    _waiter.maxBusyRetryTimeInterval = 5;
+    _waiter.busyRetryInitialInterval = 1;
+    _waiter.busyRetryMaxInterval = 1;
+    _waiter.busyWakesOnCommit = NO;
+    XCTAssertTrue([_holder beginExclusiveTransaction]);
+
+    FMDatabase *holder = _holder;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.2 * NSEC_PER_SEC)), dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        [holder commit];
+    });
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    XCTAssertTrue([_waiter executeUpdate:@"INSERT INTO Item (name) VALUES ('waiter')"]);
+    XCTAssertGreaterThanOrEqual(CFAbsoluteTimeGetCurrent() - startTime, 0.9);
+}
+
+@end
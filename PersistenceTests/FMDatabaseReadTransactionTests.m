@@ -0,0 +1,83 @@
+//
+//  FMDatabaseReadTransactionTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <sqlite3.h>
+#import "FMDatabaseQueue.h"
+#import "FMDatabase.h"
+#import "FMDatabaseAdditions.h"
+
+@interface FMDatabaseReadTransactionTests : XCTestCase
+{
+    NSString *_path;
+    FMDatabaseQueue *_writeQueue;
+    FMDatabaseQueue *_readQueue;
+}
+@end
+
+@implementation FMDatabaseReadTransactionTests
+
+- (void)setUp{
+    _path = [NSTemporaryDirectory() stringByAppendingPathComponent:NSUUID.UUID.UUIDString];
+    _writeQueue = [FMDatabaseQueue databaseQueueWithPath:_path];
+    [_writeQueue inDatabase:^(FMDatabase *db) {
+        XCTAssertTrue([db executeStatements:@"PRAGMA journal_mode = WAL"]);
+        XCTAssertTrue([db executeUpdate:@"CREATE TABLE Item (id INTEGER PRIMARY KEY,name TEXT)"]);
+        XCTAssertTrue([db executeUpdate:@"INSERT INTO Item (name) VALUES ('a')"]);
+    }];
+    _readQueue = [[FMDatabaseQueue alloc] initWithPath:_path flags:SQLITE_OPEN_READONLY];
+}
+
+- (void)tearDown{
+    [_readQueue close];
+    [_writeQueue close];
+    for (NSString *suffix in @[@"", @"-wal", @"-shm"]) {
+        [NSFileManager.defaultManager removeItemAtPath:[_path stringByAppendingString:suffix] error:nil];
+    }
+}
+
+- (void)testQueriesReadOneVersion{
+    __block int before = 0, after = 0;
+    __block BOOL written = NO;
+    [_readQueue inReadTransaction:^(FMDatabase *db) {
+        before = [db intForQuery:@"SELECT count(*) FROM Item"];
+        //读事务持有读锁期间，写连接照常提交，不被阻塞
+        [self->_writeQueue inDatabase:^(FMDatabase *writer) {
+            written = [writer executeUpdate:@"INSERT INTO Item (name) VALUES ('b')"];
+        }];
+        after = [db intForQuery:@"SELECT count(*) FROM Item"];
+    }];
+    XCTAssertTrue(written);
+    XCTAssertEqual(before, 1);
+    XCTAssertEqual(after, 1);
+
+    //事务结束之后读取到新的版本
+    [_readQueue inReadTransaction:^(FMDatabase *db) {
+        XCTAssertEqual([db intForQuery:@"SELECT count(*) FROM Item"], 2);
+    }];
+}
+
+- (void)testTransactionEndsWithBlock{
+    [_readQueue inReadTransaction:^(FMDatabase *db) {
+        XCTAssertTrue(db.isInTransaction);
+    }];
+    [_readQueue inDatabase:^(FMDatabase *db) {
+        XCTAssertFalse(db.isInTransaction);
+    }];
+}
+
+- (void)testReadOnlyConnectionRejectsWrites{
+    [_readQueue inReadTransaction:^(FMDatabase *db) {
+        XCTAssertFalse([db executeUpdate:@"INSERT INTO Item (name) VALUES ('c')"]);
+    }];
+    [_writeQueue inDatabase:^(FMDatabase *db) {
+        XCTAssertEqual([db intForQuery:@"SELECT count(*) FROM Item"], 1);
+    }];
+}
+
+@end
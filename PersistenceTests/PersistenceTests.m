@@ -1,37 +0,0 @@
-//
-//  PersistenceTests.m
-//  PersistenceTests
-//
-//  Created by 苏沫离 on 2020/5/7.
-//  Copyright © 2020 苏沫离. All rights reserved.
-//
-
-#import <XCTest/XCTest.h>
-
-@interface PersistenceTests : XCTestCase
-
-@end
-
-@implementation PersistenceTests
-
-- (void)setUp {
-    // Put setup code here. This method is called before the invocation of each test method in the class.
-}
-
-- (void)tearDown {
-    // Put teardown code here. This method is called after the invocation of each test method in the class.
-}
-
-- (void)testExample {
-    // This is an example of a functional test case.
-    // Use XCTAssert and related functions to verify your tests produce the correct results.
-}
-
-- (void)testPerformanceExample {
-    // This is an example of a performance test case.
-    [self measureBlock:^{
-        // Put the code you want to measure the time of here.
-    }];
-}
-
-@end
@@ -0,0 +1,129 @@
+//
+//  ProvincesTreeTests.m
+//  PersistenceTests
+//
+//  Created by 苏沫离 on 2020/6/14.
+//  Copyright © 2020 苏沫离. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "FMDatabase.h"
+#import "DatabaseSchema.h"
+#import "DatabaseModelMapping.h"
+#import "ProvincesModel+DAO.h"
+#import "ProvincesTree.h"
+
+@interface ProvincesTreeTests : XCTestCase
+{
+    FMDatabase *_database;
+}
+@end
+
+@implementation ProvincesTreeTests
+
+- (void)setUp{
+    _database = [FMDatabase databaseWithPath:nil];
+    XCTAssertTrue([_database open]);
+    XCTAssertTrue([_database executeUpdate:ProvincesModel.tableSchema.createSQL]);
+}
+
+- (void)tearDown{
+    [_database close];
+    _database = nil;
+}
+
+/** 按数组的顺序写入，id 与写入的顺序一致；每一项为 regionId 与 parentId（NSNull 为没有父节点）
+ */
+- (void)insertRows:(NSArray<NSArray *> *)rows{
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:ProvincesModel.class];
+    for (NSArray *row in rows) {
+        ProvincesModel *model = [[ProvincesModel alloc] init];
+        model.regionId = row[0];
+        model.regionName = [@"name-" stringByAppendingString:row[0]];
+        model.parentId = row[1] == NSNull.null ? nil : row[1];
+        XCTAssertTrue([mapping insertModel:model replace:NO inDatabase:_database]);
+    }
+}
+
++ (NSArray<NSString *> *)regionIds:(NSArray<ProvincesModel *> *)models{
+    return [models valueForKey:@"regionId"];
+}
+
+- (void)testPreorderAndSiblingOrder{
+    //子节点先于父节点写入，兄弟节点按写入顺序排列；parentId 不在表中的地区为根节点
+    [self insertRows:@[@[@"C2", @"P1"],
+                       @[@"P1", @"0"],
+                       @[@"P2", NSNull.null],
+                       @[@"C1", @"P1"],
+                       @[@"D1", @"C2"],
+                       @[@"C3", @"P2"],
+                       @[@"D2", @"C2"]]];
+    ProvincesTree *tree = [ProvincesTree treeWithDatabase:_database];
+    XCTAssertEqual(tree.count, 7);
+
+    XCTAssertEqualObjects([self.class regionIds:tree.roots], (@[@"P1", @"P2"]));
+    XCTAssertEqualObjects([self.class regionIds:[tree childrenWithRegionId:nil]], (@[@"P1", @"P2"]));
+    XCTAssertEqualObjects([self.class regionIds:[tree childrenWithRegionId:@"P1"]], (@[@"C2", @"C1"]));
+    XCTAssertEqualObjects([self.class regionIds:[tree childrenWithRegionId:@"C2"]], (@[@"D1", @"D2"]));
+    XCTAssertEqualObjects([self.class regionIds:[tree childrenWithRegionId:@"D1"]], @[]);
+
+    XCTAssertEqualObjects([self.class regionIds:[tree subtreeWithRegionId:@"P1"]], (@[@"P1", @"C2", @"D1", @"D2", @"C1"]));
+    XCTAssertEqualObjects([self.class regionIds:[tree subtreeWithRegionId:@"P2"]], (@[@"P2", @"C3"]));
+    XCTAssertEqualObjects([self.class regionIds:[tree subtreeWithRegionId:@"D2"]], @[@"D2"]);
+
+    XCTAssertEqualObjects([self.class regionIds:[tree ancestorsWithRegionId:@"D2"]], (@[@"P1", @"C2"]));
+    XCTAssertEqualObjects([self.class regionIds:[tree pathWithRegionId:@"D2"]], (@[@"P1", @"C2", @"D2"]));
+    XCTAssertEqualObjects([tree ancestorsWithRegionId:@"P1"], @[]);
+
+    XCTAssertEqual([tree depthWithRegionId:@"P2"], 0);
+    XCTAssertEqual([tree depthWithRegionId:@"C3"], 1);
+    XCTAssertEqual([tree depthWithRegionId:@"D1"], 2);
+    XCTAssertEqual([tree depthWithRegionId:@"missing"], NSNotFound);
+    XCTAssertNil([tree modelWithRegionId:@"missing"]);
+    XCTAssertEqualObjects([tree subtreeWithRegionId:@"missing"], @[]);
+}
+
+- (void)testCyclesAreIgnored{
+    //X、Y 互为父节点，Z 挂在环上：都无法从根节点到达；S 的父节点是自身，作为根节点
+    [self insertRows:@[@[@"P1", NSNull.null],
+                       @[@"X", @"Y"],
+                       @[@"Y", @"X"],
+                       @[@"Z", @"X"],
+                       @[@"S", @"S"],
+                       @[@"C1", @"P1"]]];
+    ProvincesTree *tree = [ProvincesTree treeWithDatabase:_database];
+    XCTAssertEqual(tree.count, 3);
+    XCTAssertEqualObjects([self.class regionIds:tree.roots], (@[@"P1", @"S"]));
+    XCTAssertEqualObjects([self.class regionIds:[tree subtreeWithRegionId:@"P1"]], (@[@"P1", @"C1"]));
+    for (NSString *regionId in @[@"X", @"Y", @"Z"]) {
+        XCTAssertNil([tree modelWithRegionId:regionId]);
+        XCTAssertEqual([tree depthWithRegionId:regionId], NSNotFound);
+        XCTAssertEqualObjects([tree ancestorsWithRegionId:regionId], @[]);
+    }
+    XCTAssertEqual([tree depthWithRegionId:@"S"], 0);
+}
+
+- (void)testEmptyTable{
+    ProvincesTree *tree = [ProvincesTree treeWithDatabase:_database];
+    XCTAssertEqual(tree.count, 0);
+    XCTAssertEqualObjects(tree.roots, @[]);
+    XCTAssertEqualObjects([tree childrenWithRegionId:nil], @[]);
+}
+
+- (void)testQueriesReturnCopies{
+    [self insertRows:@[@[@"P1", NSNull.null], @[@"C1", @"P1"]]];
+    ProvincesTree *tree = [ProvincesTree treeWithDatabase:_database];
+
+    ProvincesModel *model = [tree modelWithRegionId:@"C1"];
+    XCTAssertNotEqual(model, [tree modelWithRegionId:@"C1"]);
+    model.regionName = @"changed";
+    XCTAssertEqualObjects([tree modelWithRegionId:@"C1"].regionName, @"name-C1");
+    XCTAssertEqualObjects([tree childrenWithRegionId:@"P1"].firstObject.regionName, @"name-C1");
+
+    //副本以读取时的值为基准，只记录之后的修改
+    DatabaseModelMapping *mapping = [DatabaseModelMapping mappingForClass:ProvincesModel.class];
+    XCTAssertEqualObjects([mapping changedPropertiesForModel:model], @[@"regionName"]);
+    XCTAssertEqualObjects([mapping changedPropertiesForModel:[tree modelWithRegionId:@"C1"]], @[]);
+}
+
+@end
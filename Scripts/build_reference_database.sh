@@ -0,0 +1,62 @@
+#!/bin/sh
+#
+#  build_reference_database.sh
+#  Persistence
+#
+#  由 Resource.bundle 中的参考数据生成只读的 Reference.sqlite，作为资源拷贝到 App 中：
+#  启动时以 immutable=1 打开并内存映射，首次启动无需解析 JSON、导入数据
+#
+#  在 Xcode 的 Run Script 阶段执行；也可以手动执行：
+#  build_reference_database.sh <Resource.bundle 目录> <输出文件>
+#
+#  表结构与 PhoneCodeModel+DAO、ProvincesModel+DAO 声明的表结构一致；CityList.plist 与 CityModelList.json 的内容相同，只导入后者
+#
+
+set -e
+
+SOURCE_DIR="${1:-${SRCROOT}/Persistence/Resource.bundle}"
+OUTPUT_FILE="${2:-${TARGET_BUILD_DIR}/${UNLOCALIZED_RESOURCES_FOLDER_PATH}/Reference.sqlite}"
+TEMP_FILE="${OUTPUT_FILE}.tmp"
+SQLITE="${SQLITE:-sqlite3}"
+
+rm -f "${TEMP_FILE}"
+mkdir -p "$(dirname "${OUTPUT_FILE}")"
+
+# 页大小：行很短、以按键查找为主，4 KB 的页让每次查找触及的数据最少，一个 16 KB 的内存页容纳 4 个数据库页
+# journal_mode = DELETE：文件以 immutable=1 打开，不能依赖 WAL 文件
+"${SQLITE}" "${TEMP_FILE}" > /dev/null <<SQL
+PRAGMA page_size = 4096;
+PRAGMA journal_mode = DELETE;
+
+BEGIN;
+
+CREATE TABLE PhoneCodeModel (id INTEGER PRIMARY KEY AUTOINCREMENT,phoneCode TEXT UNIQUE NOT NULL,countryCode TEXT, countryPinYin TEXT, countryEnglish TEXT, countryChinese TEXT,time DATE DEFAULT CURRENT_TIMESTAMP);
+INSERT OR REPLACE INTO PhoneCodeModel (phoneCode,countryCode,countryPinYin,countryEnglish,countryChinese)
+SELECT json_extract(value,'\$.phoneCode'),json_extract(value,'\$.code'),json_extract(value,'\$.pinYin'),json_extract(value,'\$.english'),json_extract(value,'\$.chinese')
+FROM json_each(readfile('${SOURCE_DIR}/PhoneCode.json'))
+WHERE json_extract(value,'\$.phoneCode') IS NOT NULL;
+
+CREATE TABLE ProvincesModel (id INTEGER PRIMARY KEY,regionId TEXT UNIQUE NOT NULL,regionName TEXT, regionType TEXT, parentId TEXT, agencyId TEXT);
+INSERT OR REPLACE INTO ProvincesModel (regionId,regionName,regionType,parentId,agencyId)
+SELECT json_extract(value,'\$.region_id'),json_extract(value,'\$.region_name'),json_extract(value,'\$.region_type'),json_extract(value,'\$.parent_id'),json_extract(value,'\$.agency_id')
+FROM json_tree(readfile('${SOURCE_DIR}/CityModelList.json'))
+WHERE type = 'object' AND json_extract(value,'\$.region_id') IS NOT NULL;
+
+-- 数据写入之后再创建索引：一次排序生成，索引页紧凑
+CREATE INDEX ProvincesModel_parentId ON ProvincesModel (parentId);
+CREATE INDEX ProvincesModel_regionType ON ProvincesModel (regionType);
+
+COMMIT;
+
+ANALYZE;
+VACUUM;
+SQL
+
+# 空文件说明数据源有误，不覆盖上一次的结果
+if [ "$("${SQLITE}" "${TEMP_FILE}" "SELECT (SELECT count(*) FROM PhoneCodeModel) * (SELECT count(*) FROM ProvincesModel)")" = "0" ]; then
+    echo "error: Reference.sqlite 没有数据，请检查 ${SOURCE_DIR}" >&2
+    rm -f "${TEMP_FILE}"
+    exit 1
+fi
+
+mv -f "${TEMP_FILE}" "${OUTPUT_FILE}"